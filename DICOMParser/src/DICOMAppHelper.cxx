@@ -28,12 +28,18 @@
 #include "DICOMConfig.h"
 #include "DICOMAppHelper.h"
 #include "DICOMCallback.h"
+#include "DICOMFragmentIndex.h"
+#include "DICOMPixelKernels.h"
+#include "DICOMRLEDecoder.h"
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <string>
 #include <math.h>
 #include <algorithm>
+#include <atomic>
+#include <thread>
 
 //#define DEBUG_DICOM_APP_HELPER
 
@@ -51,10 +57,46 @@ public:
 
 }; 
 
+//
+// What the threads decoding encapsulated frames share.  Frames
+// are taken in turn from NextFrame; frame FirstFrame + i of Index
+// goes to Output + i * OutputFrameLength.
+//
+struct DICOMEncapsulatedDecodeJob
+{
+  DICOMFragmentIndex Index;
+  int FirstFrame;
+  size_t NumberOfFrames;
+  size_t PixelsPerFrame;
+  int SamplesPerPixel;
+  int BytesPerSample;
+  unsigned char* Output;
+  size_t OutputFrameLength;
+  // one per frame, when statistics are wanted
+  dicom_stl::vector<DICOMPixelStatistics> Statistics;
+  std::atomic<size_t> NextFrame;
+  std::atomic<bool> Failed;
+};
+
+//
+// The parser hands callbacks NULL for a value of zero length.
+// An empty text value reads as "", which atoi and atof take as 0,
+// and an empty or short binary value as 0.
+//
+static const char* DICOMValueText(unsigned char* val)
+{
+  return val ? reinterpret_cast<const char*> (val) : "";
+}
+
+static unsigned short DICOMValueUnsignedShort(unsigned char* val, valuelength len)
+{
+  return (val && len >= 2) ? DICOMFile::ReturnAsUnsignedShort(val, false) : 0;
+}
+
 struct lt_pair_int_string
 {
-  bool operator()(const dicom_stl::pair<int, dicom_stl::string> s1, 
-                  const dicom_stl::pair<int, dicom_stl::string> s2) const
+  bool operator()(const dicom_stl::pair<int, dicom_stl::string>& s1, 
+                  const dicom_stl::pair<int, dicom_stl::string>& s2) const
   {
     return s1.first < s2.first;
   }
@@ -63,8 +105,8 @@ struct lt_pair_int_string
 
 struct lt_pair_float_string
 {
-  bool operator()(const dicom_stl::pair<float, dicom_stl::string> s1, 
-                  const dicom_stl::pair<float, dicom_stl::string> s2) const
+  bool operator()(const dicom_stl::pair<float, dicom_stl::string>& s1, 
+                  const dicom_stl::pair<float, dicom_stl::string>& s2) const
   {
     return s1.first < s2.first;
   }
@@ -77,12 +119,29 @@ DICOMAppHelper::DICOMAppHelper()
   this->ByteSwapData = false;
   this->PixelSpacing[0] = this->PixelSpacing[1] = 1.0;
   this->Dimensions[0] = this->Dimensions[1] = 0;
-  this->PhotometricInterpretation = NULL;
-  this->TransferSyntaxUID = NULL;
   this->RescaleOffset = 0.0;
   this->RescaleSlope = 1.0;
+  this->NumberOfFrames = 1;
   this->ImageData = NULL;
+  this->DecodedData = NULL;
+  this->Destination = NULL;
+  this->DestinationType = DICOMParser::VR_UNKNOWN;
+  this->DestinationLengthInBytes = 0;
+  this->ImageDataType = DICOMParser::VR_UNKNOWN;
   this->ImageDataLengthInBytes = 0;
+  this->ImageDataCapacity = 0;
+  this->RecordSeriesDatabase = true;
+  this->ComputeImageStatistics = false;
+  this->PixelDecoderSelected = false;
+  this->PixelDecoder = NULL;
+  this->PixelDecoderType = DICOMParser::VR_UNKNOWN;
+  this->PixelDecoderValueSize = 0;
+  this->PixelDecoderBitsAllocated = 0;
+  this->PixelDecoderSlope = 1.0;
+  this->PixelDecoderOffset = 0.0;
+  this->NumberOfThreads = 0;
+  this->DecodeFirstFrame = 0;
+  this->DecodeFrameCount = 0;
 
   this->SeriesUIDCB = new DICOMMemberCallback<DICOMAppHelper>;
   this->SliceNumberCB = new DICOMMemberCallback<DICOMAppHelper>;
@@ -99,6 +158,7 @@ DICOMAppHelper::DICOMAppHelper()
   this->PhotometricInterpretationCB = new DICOMMemberCallback<DICOMAppHelper>;
   this->RescaleOffsetCB = new DICOMMemberCallback<DICOMAppHelper>;
   this->RescaleSlopeCB = new DICOMMemberCallback<DICOMAppHelper>;
+  this->NumberOfFramesCB = new DICOMMemberCallback<DICOMAppHelper>;
   this->PixelDataCB = new DICOMMemberCallback<DICOMAppHelper>;
 
   this->Implementation = new DICOMAppHelperImplementation;
@@ -117,14 +177,6 @@ DICOMAppHelper::~DICOMAppHelper()
     {
     delete [] (static_cast<char*> (this->ImageData));
     }
-  if (this->TransferSyntaxUID)
-    {
-    delete this->TransferSyntaxUID;
-    }
-  if (this->PhotometricInterpretation)
-    {
-    delete this->PhotometricInterpretation;
-    }
 
   delete this->SeriesUIDCB;
   delete this->SliceNumberCB;
@@ -141,6 +193,7 @@ DICOMAppHelper::~DICOMAppHelper()
   delete this->PhotometricInterpretationCB;
   delete this->RescaleOffsetCB;
   delete this->RescaleSlopeCB;
+  delete this->NumberOfFramesCB;
   delete this->PixelDataCB;
 
   delete this->Implementation;
@@ -150,7 +203,10 @@ void DICOMAppHelper::RegisterCallbacks(DICOMParser* parser)
 {
   if (!parser)
     {
+#ifdef DEBUG_DICOM_APP_HELPER
     dicom_stream::cerr << "Null parser!" << dicom_stream::endl;
+#endif
+    return;
     }
 
   SeriesUIDCB->SetCallbackFunction(this, &DICOMAppHelper::SeriesUIDCallback);
@@ -198,6 +254,9 @@ void DICOMAppHelper::RegisterCallbacks(DICOMParser* parser)
   RescaleSlopeCB->SetCallbackFunction(this, &DICOMAppHelper::RescaleSlopeCallback);
   parser->AddDICOMTagCallback(0x0028, 0x1053, DICOMParser::VR_FL, RescaleSlopeCB);
 
+  NumberOfFramesCB->SetCallbackFunction(this, &DICOMAppHelper::NumberOfFramesCallback);
+  parser->AddDICOMTagCallback(0x0028, 0x0008, DICOMParser::VR_IS, NumberOfFramesCB);
+
   DICOMTagInfo dicom_tags[] = {
     {0x0002, 0x0002, DICOMParser::VR_UI, "Media storage SOP class uid"},
     {0x0002, 0x0003, DICOMParser::VR_UI, "Media storage SOP inst uid"},
@@ -221,6 +280,7 @@ void DICOMAppHelper::RegisterCallbacks(DICOMParser* parser)
     {0x0020, 0x0032, DICOMParser::VR_SH, "Patient position"},
     {0x0020, 0x0037, DICOMParser::VR_SH, "Patient position cosines"},
     {0x0020, 0x1041, DICOMParser::VR_CS, "Slice location"},
+    {0x0028, 0x0008, DICOMParser::VR_IS, "Number of frames"},
     {0x0028, 0x0010, DICOMParser::VR_FL, "Num rows"},
     {0x0028, 0x0011, DICOMParser::VR_FL, "Num cols"},
     {0x0028, 0x0030, DICOMParser::VR_FL, "pixel spacing"},
@@ -269,17 +329,21 @@ void DICOMAppHelper::SeriesUIDCallback(DICOMParser *parser,
                                        doublebyte,
                                        DICOMParser::VRTypes,
                                        unsigned char* val,
-                                       quadbyte) 
+                                       valuelength) 
 {
-  char* newString = (char*) val;
-  dicom_stl::string newStdString(newString);
-  dicom_stl::map<dicom_stl::string, dicom_stl::vector<dicom_stl::string>, ltstdstr>::iterator iter = this->Implementation->SeriesUIDMap.find(newStdString);
+  this->SeriesUID.assign(DICOMValueText(val));
+  if (!this->RecordSeriesDatabase)
+    {
+    return;
+    }
+
+  dicom_stl::map<dicom_stl::string, dicom_stl::vector<dicom_stl::string>, ltstdstr>::iterator iter = this->Implementation->SeriesUIDMap.find(this->SeriesUID);
   if ( iter == this->Implementation->SeriesUIDMap.end())
     {
     dicom_stl::vector<dicom_stl::string> newVector;
 
     newVector.push_back(parser->GetFileName());
-    this->Implementation->SeriesUIDMap.insert(dicom_stl::pair<const dicom_stl::string, dicom_stl::vector<dicom_stl::string> > (newStdString, newVector));
+    this->Implementation->SeriesUIDMap.insert(dicom_stl::pair<const dicom_stl::string, dicom_stl::vector<dicom_stl::string> > (this->SeriesUID, newVector));
     }
   else
     {
@@ -316,12 +380,12 @@ void DICOMAppHelper::OutputSeries()
 }
 
 
-void DICOMAppHelper::ArrayCallback(DICOMParser *parser,
+void DICOMAppHelper::ArrayCallback(DICOMParser *,
                                    doublebyte group,
                                    doublebyte element,
                                    DICOMParser::VRTypes datatype,
                                    unsigned char* val,
-                                   quadbyte len) 
+                                   valuelength len) 
 {
   const char* desc = "No description";
   
@@ -390,11 +454,11 @@ void DICOMAppHelper::ArrayCallback(DICOMParser *parser,
         HeaderFile << val;
         break;
       case DICOMParser::VR_FL: // float
-        fval = static_cast<float> (atof((char*) val));
+        fval = static_cast<float> (atof(DICOMValueText(val)));
         HeaderFile << fval;
         break;
       case DICOMParser::VR_FD: // float double
-        fval = static_cast<float> (atof((char*) val));
+        fval = static_cast<float> (atof(DICOMValueText(val)));
         HeaderFile << dval;
         break;
       case DICOMParser::VR_UL: // unsigned long
@@ -407,11 +471,11 @@ void DICOMAppHelper::ArrayCallback(DICOMParser *parser,
       //  HeaderFile << ival;
       //  break;
       case DICOMParser::VR_SS:
-        ival = DICOMFile::ReturnAsSignedShort(val, parser->GetDICOMFile()->GetPlatformIsBigEndian()); 
+        ival = static_cast<short> (DICOMValueUnsignedShort(val, len));
         HeaderFile << ival;
         break;
       case DICOMParser::VR_US: // unsigned short
-        uival = DICOMFile::ReturnAsUnsignedShort(val, parser->GetDICOMFile()->GetPlatformIsBigEndian()); 
+        uival = DICOMValueUnsignedShort(val, len);
         HeaderFile << uival;
         break;
       default:
@@ -426,37 +490,39 @@ void DICOMAppHelper::ArrayCallback(DICOMParser *parser,
   
   HeaderFile << dicom_stream::dec << dicom_stream::endl;
   HeaderFile.fill(prev);
-
-  delete [] val;
 }
     
+DICOMOrderingElements& DICOMAppHelper::GetOrdering(DICOMParser* parser)
+{
+  if (this->OrderingFileName != parser->GetFileName())
+    {
+    this->OrderingFileName = parser->GetFileName();
+    this->Ordering = DICOMOrderingElements();
+    }
+  return this->Ordering;
+}
+
+void DICOMAppHelper::RecordOrdering(DICOMParser* parser)
+{
+  if (this->RecordSeriesDatabase)
+    {
+    this->Implementation->SliceOrderingMap[parser->GetFileName()] = this->Ordering;
+    }
+}
+
 void DICOMAppHelper::SliceNumberCallback(DICOMParser *parser,
                                          doublebyte,
                                          doublebyte,
                                          DICOMParser::VRTypes,
                                          unsigned char* val,
-                                         quadbyte) 
+                                         valuelength) 
 {
-  // Look for the current file in the map of slice ordering data
-  dicom_stl::map<dicom_stl::string, DICOMOrderingElements, ltstdstr>::iterator it;
-  it = this->Implementation->SliceOrderingMap.find(parser->GetFileName());
-  if (it == Implementation->SliceOrderingMap.end())
-    {
-    // file not found, create a new entry
-    DICOMOrderingElements ord;
-    ord.SliceNumber = atoi( (char *) val);
-
-    // insert into the map
-    this->Implementation->SliceOrderingMap.insert(dicom_stl::pair<const dicom_stl::string, DICOMOrderingElements>(parser->GetFileName(), ord));
-    }
-  else
-    {
-    // file found, add new values
-    (*it).second.SliceNumber = atoi( (char *)val );
-    }
+  DICOMOrderingElements& ord = this->GetOrdering(parser);
+  ord.SliceNumber = atoi( DICOMValueText(val) );
+  this->RecordOrdering(parser);
 
   // cache the slice number
-  this->SliceNumber = atoi( (char *) val);
+  this->SliceNumber = ord.SliceNumber;
 }
 
 
@@ -465,25 +531,11 @@ void DICOMAppHelper::SliceLocationCallback(DICOMParser *parser,
                                            doublebyte,
                                            DICOMParser::VRTypes,
                                            unsigned char* val,
-                                           quadbyte) 
+                                           valuelength) 
 {
-  // Look for the current file in the map of slice ordering data
-  dicom_stl::map<dicom_stl::string, DICOMOrderingElements, ltstdstr>::iterator it;
-  it = this->Implementation->SliceOrderingMap.find(parser->GetFileName());
-  if (it == Implementation->SliceOrderingMap.end())
-    {
-    // file not found, create a new entry
-    DICOMOrderingElements ord;
-    ord.SliceLocation = (float)atof( (char *) val);
-
-    // insert into the map
-    this->Implementation->SliceOrderingMap.insert(dicom_stl::pair<const dicom_stl::string, DICOMOrderingElements>(parser->GetFileName(), ord));
-    }
-  else
-    {
-    // file found, add new values
-    (*it).second.SliceLocation = (float)atof( (char *)val );
-    }
+  DICOMOrderingElements& ord = this->GetOrdering(parser);
+  ord.SliceLocation = (float)atof( DICOMValueText(val) );
+  this->RecordOrdering(parser);
 }
 
 void DICOMAppHelper::ImagePositionPatientCallback(DICOMParser *parser,
@@ -491,39 +543,18 @@ void DICOMAppHelper::ImagePositionPatientCallback(DICOMParser *parser,
                                                   doublebyte,
                                                   DICOMParser::VRTypes,
                                                   unsigned char* val,
-                                                  quadbyte) 
-{
-  // Look for the current file in the map of slice ordering data
-  dicom_stl::map<dicom_stl::string, DICOMOrderingElements, ltstdstr>::iterator it;
-  it = this->Implementation->SliceOrderingMap.find(parser->GetFileName());
-  if (it == Implementation->SliceOrderingMap.end())
-    {
-    // file not found, create a new entry
-    DICOMOrderingElements ord;
-    sscanf( (char*)(val), "%f\\%f\\%f",
-            &ord.ImagePositionPatient[0],
-            &ord.ImagePositionPatient[1],
-            &ord.ImagePositionPatient[2] );
-    
-    // insert into the map
-    this->Implementation->SliceOrderingMap.insert(dicom_stl::pair<const dicom_stl::string, DICOMOrderingElements>(parser->GetFileName(), ord));
-
-    // cache the value
-    memcpy( this->ImagePositionPatient, ord.ImagePositionPatient,
-            3*sizeof(float) );
-    }
-  else
-    {
-    // file found, add new values
-    sscanf( (char*)(val), "%f\\%f\\%f",
-            &(*it).second.ImagePositionPatient[0],
-            &(*it).second.ImagePositionPatient[1],
-            &(*it).second.ImagePositionPatient[2] );
-
-    // cache the value
-    memcpy( this->ImagePositionPatient, (*it).second.ImagePositionPatient,
-            3*sizeof(float) );
-    }
+                                                  valuelength) 
+{
+  DICOMOrderingElements& ord = this->GetOrdering(parser);
+  sscanf( DICOMValueText(val), "%f\\%f\\%f",
+          &ord.ImagePositionPatient[0],
+          &ord.ImagePositionPatient[1],
+          &ord.ImagePositionPatient[2] );
+  this->RecordOrdering(parser);
+
+  // cache the value
+  memcpy( this->ImagePositionPatient, ord.ImagePositionPatient,
+          3*sizeof(float) );
 }
 
 
@@ -532,46 +563,26 @@ void DICOMAppHelper::ImageOrientationPatientCallback(DICOMParser *parser,
                                                      doublebyte,
                                                      DICOMParser::VRTypes,
                                                      unsigned char* val,
-                                                     quadbyte) 
-{
-  // Look for the current file in the map of slice ordering data
-  dicom_stl::map<dicom_stl::string, DICOMOrderingElements, ltstdstr>::iterator it;
-  it = this->Implementation->SliceOrderingMap.find(parser->GetFileName());
-  if (it == Implementation->SliceOrderingMap.end())
-    {
-    // file not found, create a new entry
-    DICOMOrderingElements ord;
-    sscanf( (char*)(val), "%f\\%f\\%f\\%f\\%f\\%f",
-            &ord.ImageOrientationPatient[0],
-            &ord.ImageOrientationPatient[1],
-            &ord.ImageOrientationPatient[2],
-            &ord.ImageOrientationPatient[3],
-            &ord.ImageOrientationPatient[4],
-            &ord.ImageOrientationPatient[5] );
-    
-    // insert into the map
-    this->Implementation->SliceOrderingMap.insert(dicom_stl::pair<const dicom_stl::string, DICOMOrderingElements>(parser->GetFileName(), ord));
-    }
-  else
-    {
-    // file found, add new values
-    sscanf( (char*)(val), "%f\\%f\\%f\\%f\\%f\\%f",
-            &(*it).second.ImageOrientationPatient[0],
-            &(*it).second.ImageOrientationPatient[1],
-            &(*it).second.ImageOrientationPatient[2],
-            &(*it).second.ImageOrientationPatient[3],
-            &(*it).second.ImageOrientationPatient[4],
-            &(*it).second.ImageOrientationPatient[5] );
-    }
+                                                     valuelength) 
+{
+  DICOMOrderingElements& ord = this->GetOrdering(parser);
+  sscanf( DICOMValueText(val), "%f\\%f\\%f\\%f\\%f\\%f",
+          &ord.ImageOrientationPatient[0],
+          &ord.ImageOrientationPatient[1],
+          &ord.ImageOrientationPatient[2],
+          &ord.ImageOrientationPatient[3],
+          &ord.ImageOrientationPatient[4],
+          &ord.ImageOrientationPatient[5] );
+  this->RecordOrdering(parser);
 }
 
 
-void DICOMAppHelper::TransferSyntaxCallback(DICOMParser *parser,
+void DICOMAppHelper::TransferSyntaxCallback(DICOMParser *,
                                             doublebyte,
                                             doublebyte,
                                             DICOMParser::VRTypes,
                                             unsigned char* val,
-                                            quadbyte) 
+                                            valuelength) 
 {
 
 #ifdef DEBUG_DICOM_APP_HELPER
@@ -585,36 +596,29 @@ void DICOMAppHelper::TransferSyntaxCallback(DICOMParser *parser,
 
   static const char* TRANSFER_UID_EXPLICIT_BIG_ENDIAN = "1.2.840.10008.1.2.2";
 
-  // Only add the ToggleSwapBytes callback when we need it.
-  if (strcmp(TRANSFER_UID_EXPLICIT_BIG_ENDIAN, (char*) val) == 0)
-    {
-    this->ByteSwapData = true;
-    parser->AddDICOMTagCallback(0x0800, 0x0000, DICOMParser::VR_UNKNOWN, ToggleSwapBytesCB);
-#ifdef DEBUG_DICOM_APP_HELPER
-    dicom_stream::cerr <<"Registering callback for swapping bytes." << dicom_stream::endl;
-#endif
-    }
+  //
+  // The parser switches to big endian itself where the data set
+  // starts; the ToggleSwapBytes callback on (0800,0000) relied
+  // on a group length element most files don't have.
+  //
+  this->ByteSwapData = (strcmp(TRANSFER_UID_EXPLICIT_BIG_ENDIAN, DICOMValueText(val)) == 0);
   
-  if (this->TransferSyntaxUID)
-    {
-    delete this->TransferSyntaxUID;
-    }
-  this->TransferSyntaxUID = new dicom_stl::string((char*) val);
+  this->TransferSyntaxUID.assign(DICOMValueText(val));
 
 #ifdef DEBUG_DICOM_APP_HELPER
-  dicom_stream::cout << "Transfer Syntax UID: " << *this->TransferSyntaxUID;
-  dicom_stream::cout << " " << this->TransferSyntaxUIDDescription(this->TransferSyntaxUID->c_str()) << dicom_stream::endl;
+  dicom_stream::cout << "Transfer Syntax UID: " << this->TransferSyntaxUID;
+  dicom_stream::cout << " " << this->TransferSyntaxUIDDescription(this->TransferSyntaxUID.c_str()) << dicom_stream::endl;
 #endif
 }
 
-void DICOMAppHelper::BitsAllocatedCallback(DICOMParser *parser,
+void DICOMAppHelper::BitsAllocatedCallback(DICOMParser *,
                                            doublebyte,
                                            doublebyte,
                                            DICOMParser::VRTypes,
                                            unsigned char* val,
-                                           quadbyte) 
+                                           valuelength len) 
 {
-  this->BitsAllocated = parser->GetDICOMFile()->ReturnAsUnsignedShort(val, parser->GetDICOMFile()->GetPlatformIsBigEndian());
+  this->BitsAllocated = DICOMValueUnsignedShort(val, len);
 #ifdef DEBUG_DICOM_APP_HELPER
   dicom_stream::cout << "Bits allocated: " << this->BitsAllocated << dicom_stream::endl;
 #endif
@@ -626,7 +630,7 @@ void DICOMAppHelper::ToggleSwapBytesCallback(DICOMParser *parser,
                                              doublebyte,
                                              DICOMParser::VRTypes,
                                              unsigned char* ,
-                                             quadbyte len) 
+                                             valuelength len) 
 {
 #ifdef DEBUG_DICOM_APP_HELPER
   dicom_stream::cout << "ToggleSwapBytesCallback" << dicom_stream::endl;
@@ -638,7 +642,7 @@ void DICOMAppHelper::ToggleSwapBytesCallback(DICOMParser *parser,
   dicom_stream::cout << "Set byte swap to: " << parser->GetDICOMFile()->GetPlatformIsBigEndian() << dicom_stream::endl;
 #endif
 
-  long pos = parser->GetDICOMFile()->Tell();
+  fileoffset pos = parser->GetDICOMFile()->Tell();
 
   //
   // The +4 is probably a hack, but it's a guess at the length of the previous field.
@@ -647,14 +651,14 @@ void DICOMAppHelper::ToggleSwapBytesCallback(DICOMParser *parser,
 }
 
 
-void DICOMAppHelper::PixelSpacingCallback(DICOMParser *parser,
+void DICOMAppHelper::PixelSpacingCallback(DICOMParser *,
                                           doublebyte group,
                                           doublebyte element,
                                           DICOMParser::VRTypes,
                                           unsigned char* val,
-                                          quadbyte) 
+                                          valuelength) 
 {
-  float fval = DICOMFile::ReturnAsFloat(val, parser->GetDICOMFile()->GetPlatformIsBigEndian());
+  float fval = static_cast<float> (atof(DICOMValueText(val)));
 
   if (group == 0x0028 && element == 0x0030)
     {
@@ -666,14 +670,14 @@ void DICOMAppHelper::PixelSpacingCallback(DICOMParser *parser,
     }
 }
 
-void DICOMAppHelper::WidthCallback(DICOMParser *parser,
+void DICOMAppHelper::WidthCallback(DICOMParser *,
                                    doublebyte,
                                    doublebyte,
                                    DICOMParser::VRTypes,
                                    unsigned char* val,
-                                   quadbyte)
+                                   valuelength len)
 {
-  unsigned short uival = DICOMFile::ReturnAsUnsignedShort(val, parser->GetDICOMFile()->GetPlatformIsBigEndian()); 
+  unsigned short uival = DICOMValueUnsignedShort(val, len);
 #ifdef DEBUG_DICOM_APP_HELPER
   dicom_stream::cout << "Width: " << uival << dicom_stream::endl;
 #endif
@@ -682,14 +686,14 @@ void DICOMAppHelper::WidthCallback(DICOMParser *parser,
   this->Dimensions[0] = this->Width;
 }
 
-void DICOMAppHelper::HeightCallback(DICOMParser *parser,
+void DICOMAppHelper::HeightCallback(DICOMParser *,
                                     doublebyte,
                                     doublebyte,
                                     DICOMParser::VRTypes,
                                     unsigned char* val,
-                                    quadbyte) 
+                                    valuelength len) 
 {
-  unsigned short uival = DICOMFile::ReturnAsUnsignedShort(val, parser->GetDICOMFile()->GetPlatformIsBigEndian()); 
+  unsigned short uival = DICOMValueUnsignedShort(val, len);
 #ifdef DEBUG_DICOM_APP_HELPER
   dicom_stream::cout << "Height: " << uival << dicom_stream::endl;
 #endif
@@ -698,14 +702,14 @@ void DICOMAppHelper::HeightCallback(DICOMParser *parser,
 }
 
 
-void DICOMAppHelper::PixelRepresentationCallback( DICOMParser *parser,
+void DICOMAppHelper::PixelRepresentationCallback( DICOMParser *,
                                                   doublebyte,
                                                   doublebyte,
                                                   DICOMParser::VRTypes,
                                                   unsigned char* val,
-                                                  quadbyte)
+                                                  valuelength len)
 {
-  unsigned short uival = DICOMFile::ReturnAsUnsignedShort(val, parser->GetDICOMFile()->GetPlatformIsBigEndian());
+  unsigned short uival = DICOMValueUnsignedShort(val, len);
 #ifdef DEBUG_DICOM_APP_HELPER
   dicom_stream::cout << "Pixel Representation: " << (uival ? "Signed" : "Unsigned") << dicom_stream::endl;
 #endif
@@ -717,154 +721,409 @@ void DICOMAppHelper::PhotometricInterpretationCallback( DICOMParser *,
                                                         doublebyte,
                                                         DICOMParser::VRTypes,
                                                         unsigned char* val,
-                                                        quadbyte)
+                                                        valuelength)
 {
 #ifdef DEBUG_DICOM_APP_HELPER
-  dicom_stream::cout << "Photometric Interpretation: " << (char*) val << dicom_stream::endl;
+  dicom_stream::cout << "Photometric Interpretation: " << DICOMValueText(val) << dicom_stream::endl;
 #endif
-  if (this->PhotometricInterpretation)
+  this->PhotometricInterpretation.assign(DICOMValueText(val));
+}
+
+//
+// Kinds of rescale a pixel decoder applies.  Identity is a slope
+// of 1 and an offset of 0, integer is any other integer valued
+// pair and float is the rest, which gives float output.
+//
+enum DICOMRescaleKinds
+{
+  RESCALE_IDENTITY,
+  RESCALE_INTEGER,
+  RESCALE_FLOAT
+};
+
+//
+// Some scanners have cylindrical scanning bounds, but the output
+// image is square.  The pixels that fall outside of these bounds
+// get the fixed value -2000.  16 bit integer output sets these
+// values to 0, which currently corresponds to air.
+// https://www.kaggle.com/gzuidhof/full-preprocessing-tutorial
+//
+static const short DICOMPaddingValue = -2000;
+
+//
+// Pixel conversion from stored values of type TStored to output
+// values of type TOutput, for rescale kind TRescale.  Only the
+// combinations the helper produces are defined, each one going
+// straight to its kernel, so there is nothing left to decide per
+// pixel or per image.
+//
+template <class TStored, class TOutput, int TRescale>
+struct DICOMPixelDecoder;
+
+template <>
+struct DICOMPixelDecoder<unsigned char, char, RESCALE_IDENTITY>
+{
+  static void Decode(const unsigned char* in, char* out, int n, float, float,
+                     bool swap, DICOMPixelStatistics* stats)
     {
-    delete this->PhotometricInterpretation;
+    if (swap || stats)
+      {
+      DICOMPixelKernels::DecodeUCharToChar(in, out, n, 1.0f, 0.0f, swap, stats);
+      }
+    else
+      {
+      memcpy(out, in, n);
+      }
     }
+};
 
-  this->PhotometricInterpretation = new dicom_stl::string((char*) val);
-}
+template <>
+struct DICOMPixelDecoder<unsigned char, char, RESCALE_INTEGER>
+{
+  static void Decode(const unsigned char* in, char* out, int n, float slope, float offset,
+                     bool swap, DICOMPixelStatistics* stats)
+    {
+    DICOMPixelKernels::DecodeUCharToChar(in, out, n, slope, offset, swap, stats);
+    }
+};
 
-void DICOMAppHelper::PixelDataCallback( DICOMParser *,
-                                        doublebyte,
-                                        doublebyte,
-                                        DICOMParser::VRTypes,
-                                        unsigned char* data,
-                                        quadbyte len)
+template <>
+struct DICOMPixelDecoder<unsigned char, float, RESCALE_FLOAT>
 {
-  int numPixels = this->Dimensions[0] * this->Dimensions[1] * this->GetNumberOfComponents();
-  if (len < numPixels)
+  static void Decode(const unsigned char* in, float* out, int n, float slope, float offset,
+                     bool swap, DICOMPixelStatistics* stats)
     {
-    numPixels = len;
+    DICOMPixelKernels::DecodeUCharToFloat(in, out, n, slope, offset, swap, stats);
     }
-  if (numPixels < 0)
+};
+
+template <>
+struct DICOMPixelDecoder<unsigned short, float, RESCALE_FLOAT>
+{
+  static void Decode(const unsigned short* in, float* out, int n, float slope, float offset,
+                     bool swap, DICOMPixelStatistics* stats)
     {
-    numPixels = 0;
+    DICOMPixelKernels::DecodeUShortToFloat(in, out, n, slope, offset, swap, stats);
     }
+};
 
-#ifdef DEBUG_DICOM_APP_HELPER
-  dicom_stream::cout << "numPixels : " << numPixels << dicom_stream::endl;
-#endif
+template <>
+struct DICOMPixelDecoder<short, short, RESCALE_IDENTITY>
+{
+  static void Decode(const short* in, short* out, int n, float, float,
+                     bool swap, DICOMPixelStatistics* stats)
+    {
+    DICOMPixelKernels::CopyShortToShort(in, out, n, DICOMPaddingValue, swap, stats);
+    }
+};
 
-  int ptrIncr = int(this->BitsAllocated/8.0);
+template <>
+struct DICOMPixelDecoder<short, short, RESCALE_INTEGER>
+{
+  static void Decode(const short* in, short* out, int n, float slope, float offset,
+                     bool swap, DICOMPixelStatistics* stats)
+    {
+    DICOMPixelKernels::DecodeShortToShort(in, out, n, slope, offset, DICOMPaddingValue, swap, stats);
+    }
+};
 
-  unsigned short* ushortInputData = reinterpret_cast<unsigned short*>(data);
-  unsigned char* ucharInputData = data;
-  short* shortInputData = reinterpret_cast<short*> (data);
+//
+// The decoders as DICOMAppHelper::PixelDecodeFunction: the one
+// place the raw pixel data is given its stored type.
+//
+template <class TStored, class TOutput, int TRescale>
+static void DICOMDecodePixels(const unsigned char* data, void* output, int n,
+                              float slope, float offset,
+                              bool swap, DICOMPixelStatistics* stats)
+{
+  DICOMPixelDecoder<TStored, TOutput, TRescale>::Decode(reinterpret_cast<const TStored*> (data),
+                                                        static_cast<TOutput*> (output), n,
+                                                        slope, offset, swap, stats);
+}
 
-  float* floatOutputData; // = NULL;
-  
+void DICOMAppHelper::SelectPixelDecoder()
+{
+  int ptrIncr = int(this->BitsAllocated/8.0);
   bool isFloat = this->RescaledImageDataIsFloat();
+  bool isIdentity = (this->RescaleSlope == 1.0f && this->RescaleOffset == 0.0f);
+
+  this->PixelDecoder = NULL;
+  this->PixelDecoderType = DICOMParser::VR_UNKNOWN;
+  this->PixelDecoderValueSize = 0;
 
   if (isFloat)
     {
-#ifdef DEBUG_DICOM_APP_HELPER
-    dicom_stream::cout << "Slope and offset are not integer valued : ";
-    dicom_stream::cout << this->RescaleSlope << ", " << this->RescaleOffset << dicom_stream::endl;
-#endif
-    if (this->ImageData)
-      {
-      delete [] (static_cast<char*> (this->ImageData));
-      }
-    this->ImageData = new float[numPixels];
-    floatOutputData = static_cast<float*> (this->ImageData);
-
-    this->ImageDataType = DICOMParser::VR_FL;
-    this->ImageDataLengthInBytes = numPixels * sizeof(float);
-    float newFloatPixel;
-
     if (ptrIncr == 1)
       {
-      for (int i = 0; i < numPixels; i++)
-        {
-        newFloatPixel = float(this->RescaleSlope * ucharInputData[i] + this->RescaleOffset);
-        floatOutputData[i] = newFloatPixel;
-        }
-#ifdef DEBUG_DICOM_APP_HELPER
-      dicom_stream::cout << "Did rescale, offset to float from char." << dicom_stream::endl;
-      dicom_stream::cout << numPixels << " pixels." << dicom_stream::endl;
-#endif
+      this->PixelDecoder = &DICOMDecodePixels<unsigned char, float, RESCALE_FLOAT>;
       }
     else if (ptrIncr == 2)
       {
-      for (int i = 0; i < numPixels; i++)
-        {
-        newFloatPixel = float(this->RescaleSlope * ushortInputData[i] + this->RescaleOffset);
-        floatOutputData[i] = newFloatPixel;
-        }
-#ifdef DEBUG_DICOM_APP_HELPER
-      dicom_stream::cout << "Did rescale, offset to float from short." << dicom_stream::endl;
-      dicom_stream::cout << numPixels << " pixels." << dicom_stream::endl;
-#endif
+      this->PixelDecoder = &DICOMDecodePixels<unsigned short, float, RESCALE_FLOAT>;
       }
+    this->PixelDecoderType = DICOMParser::VR_FL;
+    this->PixelDecoderValueSize = sizeof(float);
     }
-  else
+  else if (ptrIncr == 1)
     {
+    this->PixelDecoder = isIdentity ?
+      &DICOMDecodePixels<unsigned char, char, RESCALE_IDENTITY> :
+      &DICOMDecodePixels<unsigned char, char, RESCALE_INTEGER>;
+    this->PixelDecoderType = DICOMParser::VR_OB;
+    this->PixelDecoderValueSize = sizeof(char);
+    }
+  else if (ptrIncr == 2)
+    {
+    this->PixelDecoder = isIdentity ?
+      &DICOMDecodePixels<short, short, RESCALE_IDENTITY> :
+      &DICOMDecodePixels<short, short, RESCALE_INTEGER>;
+    this->PixelDecoderType = DICOMParser::VR_OW;
+    this->PixelDecoderValueSize = sizeof(short);
+    }
+
+  this->PixelDecoderBitsAllocated = this->BitsAllocated;
+  this->PixelDecoderSlope = this->RescaleSlope;
+  this->PixelDecoderOffset = this->RescaleOffset;
+  this->PixelDecoderSelected = true;
+
 #ifdef DEBUG_DICOM_APP_HELPER
-    dicom_stream::cout << "Slope and offset are integer valued : ";
-    dicom_stream::cout << this->RescaleSlope << ", " << this->RescaleOffset << dicom_stream::endl;
+  dicom_stream::cout << "Pixel decoder for " << this->BitsAllocated << " bits, slope and offset ";
+  dicom_stream::cout << this->RescaleSlope << ", " << this->RescaleOffset << dicom_stream::endl;
 #endif
+}
 
-    if (ptrIncr == 1)
-      {
-      if (this->ImageData)
-        {
-        delete [] (static_cast<char*> (this->ImageData));
-        }
-      this->ImageData = new char[numPixels];
-  
-      char*  charOutputData =  static_cast<char*>  (this->ImageData);
+void DICOMAppHelper::PixelDataCallback( DICOMParser *parser,
+                                        doublebyte,
+                                        doublebyte,
+                                        DICOMParser::VRTypes,
+                                        unsigned char* data,
+                                        valuelength len)
+{
+  //
+  // The decoder only depends on these, which rarely change
+  // within a series.
+  //
+  if (!this->PixelDecoderSelected ||
+      this->PixelDecoderBitsAllocated != this->BitsAllocated ||
+      this->PixelDecoderSlope != this->RescaleSlope ||
+      this->PixelDecoderOffset != this->RescaleOffset)
+    {
+    this->SelectPixelDecoder();
+    }
 
-      this->ImageDataType = DICOMParser::VR_OB;
-      this->ImageDataLengthInBytes = numPixels * sizeof(char);
-      char newCharPixel;
+  this->ImageStatistics.Clear();
+  this->UpdateNumberOfFrames(parser);
+
+  if (!this->PixelDecoder)
+    {
+    // no conversion for this kind of pixel data
+    this->DecodedData = this->ImageData;
+    this->ImageDataType = DICOMParser::VR_UNKNOWN;
+    this->ImageDataLengthInBytes = 0;
+    return;
+    }
+
+  int ptrIncr = int(this->BitsAllocated/8.0);
+
+  //
+  // Decode every frame of the value, which holds just some of
+  // them when it was read by ReadFrames.  Never read past the
+  // value, however large the header says the image is.  An
+  // encapsulated value always holds every frame; ReadFrames
+  // says which to decode.
+  //
+  bool encapsulated = parser->GetPixelDataEncapsulated();
+  int firstFrame = 0;
+  int numberOfFrames = this->NumberOfFrames > 1 ? this->NumberOfFrames : 1;
+  if (encapsulated && this->DecodeFrameCount > 0)
+    {
+    firstFrame = this->DecodeFirstFrame;
+    numberOfFrames = this->DecodeFrameCount;
+    }
+
+  size_t numPixels = 0;
+  if (this->Dimensions[0] > 0 && this->Dimensions[1] > 0 && len > 0)
+    {
+    numPixels = static_cast<size_t> (this->Dimensions[0]) * this->Dimensions[1] *
+      this->GetNumberOfComponents() * numberOfFrames;
+    if (!encapsulated && static_cast<uint64_t> (len / ptrIncr) < numPixels)
+      {
+      numPixels = static_cast<size_t> (len / ptrIncr);
+      }
+    }
 
-      for (int i = 0; i < numPixels; i++)
-        {
-        newCharPixel = char(this->RescaleSlope * ucharInputData[i] + this->RescaleOffset);
-        charOutputData[i] = newCharPixel;
-        }
 #ifdef DEBUG_DICOM_APP_HELPER
-      dicom_stream::cout << "Did rescale, offset to char from char." << dicom_stream::endl;
-      dicom_stream::cout << numPixels << " pixels." << dicom_stream::endl;
+  dicom_stream::cout << "numPixels : " << numPixels << dicom_stream::endl;
 #endif
+
+  size_t bytes = numPixels * this->PixelDecoderValueSize;
+
+  //
+  // Decode into the caller's destination when the image fits
+  // it, and into our own buffer otherwise.
+  //
+  if (this->Destination &&
+      this->DestinationType == this->PixelDecoderType &&
+      bytes <= this->DestinationLengthInBytes)
+    {
+    this->DecodedData = this->Destination;
+    }
+  else
+    {
+    this->ReserveImageData(bytes);
+    this->DecodedData = this->ImageData;
+    }
+  this->ImageDataType = this->PixelDecoderType;
+  this->ImageDataLengthInBytes = bytes;
+
+  if (encapsulated)
+    {
+    if (numPixels == 0 ||
+        !this->DecodeEncapsulatedPixelData(data, static_cast<size_t> (len), firstFrame, numberOfFrames))
+      {
+      this->ImageDataType = DICOMParser::VR_UNKNOWN;
+      this->ImageDataLengthInBytes = 0;
+      this->ImageStatistics.Clear();
       }
-    else if (ptrIncr == 2)
+    return;
+    }
+
+  //
+  // Swapping, padding, rescaling and the statistics are all
+  // done by the one pass of the decoder over data.
+  //
+  this->DecodePixels(data, this->DecodedData, numPixels,
+                     parser->GetPixelDataNeedsSwap(),
+                     this->ComputeImageStatistics ? &this->ImageStatistics : NULL);
+}
+
+void DICOMAppHelper::DecodePixels(const unsigned char* in, void* out, size_t n,
+                                  bool swap, DICOMPixelStatistics* stats) const
+{
+  //
+  // The decoders count in int, so more than DECODE_CHUNK_PIXELS
+  // values are decoded a piece at a time.
+  //
+  int ptrIncr = int(this->BitsAllocated/8.0);
+  unsigned char* o = static_cast<unsigned char*> (out);
+  DICOMPixelStatistics chunkStatistics;
+  while (n > 0)
+    {
+    size_t chunk = n < DECODE_CHUNK_PIXELS ? n : static_cast<size_t> (DECODE_CHUNK_PIXELS);
+    chunkStatistics.Clear();
+    this->PixelDecoder(in, o, static_cast<int> (chunk),
+                       this->RescaleSlope, this->RescaleOffset,
+                       swap, stats ? &chunkStatistics : NULL);
+    if (stats)
       {
-      if (this->ImageData)
-        {
-        delete [] (static_cast<char*> (this->ImageData));
-        }
-      this->ImageData = new short[numPixels];
-      short* shortOutputData = static_cast<short*> (this->ImageData);
+      stats->Merge(chunkStatistics);
+      }
+    in += chunk * ptrIncr;
+    o += chunk * this->PixelDecoderValueSize;
+    n -= chunk;
+    }
+}
+
+bool DICOMAppHelper::DecodeEncapsulatedPixelData(const unsigned char* data, size_t len,
+                                                 int firstFrame, int numberOfFrames)
+{
+  static const char* TRANSFER_UID_RLE_LOSSLESS = "1.2.840.10008.1.2.5";
+
+  if (strcmp(this->TransferSyntaxUID.c_str(), TRANSFER_UID_RLE_LOSSLESS) != 0)
+    {
+    return false;
+    }
 
-      this->ImageDataType = DICOMParser::VR_OW;
-      this->ImageDataLengthInBytes = numPixels * sizeof(short);
-      short newShortPixel;
-      for (int i = 0; i < numPixels; i++)
+  DICOMEncapsulatedDecodeJob job;
+  if (!job.Index.Build(data, len, this->NumberOfFrames > 1 ? this->NumberOfFrames : 1) ||
+      firstFrame < 0 || numberOfFrames < 1 ||
+      firstFrame + numberOfFrames > job.Index.GetNumberOfFrames())
+    {
+    return false;
+    }
+
+  job.FirstFrame = firstFrame;
+  job.NumberOfFrames = static_cast<size_t> (numberOfFrames);
+  job.PixelsPerFrame = static_cast<size_t> (this->Dimensions[0]) * this->Dimensions[1];
+  job.SamplesPerPixel = this->GetNumberOfComponents();
+  job.BytesPerSample = int(this->BitsAllocated/8.0);
+  job.Output = static_cast<unsigned char*> (this->DecodedData);
+  job.OutputFrameLength = job.PixelsPerFrame * job.SamplesPerPixel * this->PixelDecoderValueSize;
+  if (this->ComputeImageStatistics)
+    {
+    job.Statistics.resize(job.NumberOfFrames);
+    }
+  job.NextFrame = 0;
+  job.Failed = false;
+
+  //
+  // Frames are independent, so each is decoded, rescaled and
+  // summarized by one thread.  The statistics are merged in frame
+  // order afterwards, so they don't depend on the threads.
+  //
+  size_t threads = this->NumberOfThreads > 0 ?
+    static_cast<size_t> (this->NumberOfThreads) : std::thread::hardware_concurrency();
+  if (threads > job.NumberOfFrames)
+    {
+    threads = job.NumberOfFrames;
+    }
+
+  dicom_stl::vector<std::thread> workers;
+  for (size_t t = 1; t < threads; t++)
+    {
+    workers.push_back(std::thread(&DICOMAppHelper::DecodeEncapsulatedFrames, this, &job));
+    }
+  this->DecodeEncapsulatedFrames(&job);
+  for (size_t t = 0; t < workers.size(); t++)
+    {
+    workers[t].join();
+    }
+
+  for (size_t i = 0; i < job.Statistics.size(); i++)
+    {
+    this->ImageStatistics.Merge(job.Statistics[i]);
+    }
+
+  return !job.Failed;
+}
+
+void DICOMAppHelper::DecodeEncapsulatedFrames(DICOMEncapsulatedDecodeJob* job) const
+{
+  size_t values = job->PixelsPerFrame * job->SamplesPerPixel;
+  dicom_stl::vector<unsigned char> decoded(values * job->BytesPerSample);
+  dicom_stl::vector<unsigned char> joined;
+
+  for (size_t i = job->NextFrame++; i < job->NumberOfFrames && !job->Failed; i = job->NextFrame++)
+    {
+    size_t length = 0;
+    const unsigned char* in = job->Index.GetFrameData(job->FirstFrame + static_cast<int> (i), length, joined);
+
+    if (!DICOMRLEDecoder::DecodeFrame(in, length, &decoded[0], job->PixelsPerFrame,
+                                      job->SamplesPerPixel, job->BytesPerSample))
       {
-        // Some scanners have cylindrical scanning bounds, but the output image is square.
-        // The pixels that fall outside of these bounds get the fixed value -2000.
-        // The first step is setting these values to 0, which currently corresponds to air.
-        // https://www.kaggle.com/gzuidhof/full-preprocessing-tutorial
-        short val = shortInputData[i];
-        if (val == -2000)
-        {
-          val = 0;
-        }
-        newShortPixel = short(this->RescaleSlope * val + this->RescaleOffset);
-        shortOutputData[i] = newShortPixel;
+      job->Failed = true;
+      break;
       }
-#ifdef DEBUG_DICOM_APP_HELPER
-      dicom_stream::cout << "Did rescale, offset to short from short." << dicom_stream::endl;
-      dicom_stream::cout << numPixels << " pixels." << dicom_stream::endl;
-#endif
+
+    this->DecodePixels(&decoded[0], job->Output + i * job->OutputFrameLength, values, false,
+                       job->Statistics.empty() ? NULL : &job->Statistics[i]);
+    }
+}
+
+void DICOMAppHelper::ReserveImageData(size_t bytes)
+{
+  //
+  // The buffer only ever grows, so reading a series of
+  // same-sized images allocates it once.
+  //
+  if (bytes > this->ImageDataCapacity || !this->ImageData)
+    {
+    if (this->ImageData)
+      {
+      delete [] (static_cast<char*> (this->ImageData));
       }
+    this->ImageData = new char[bytes > 0 ? bytes : 1];
+    this->ImageDataCapacity = bytes;
     }
 }
 
@@ -874,20 +1133,45 @@ void DICOMAppHelper::RegisterPixelDataCallback(DICOMParser* parser)
   parser->AddDICOMTagCallback(0x7FE0, 0x0010, DICOMParser::VR_OW, this->PixelDataCB);
 }
 
-void DICOMAppHelper::RescaleOffsetCallback( DICOMParser *parser,
+void DICOMAppHelper::RescaleOffsetCallback( DICOMParser *,
                                             doublebyte,
                                             doublebyte,
                                             DICOMParser::VRTypes,
                                             unsigned char* val,
-                                            quadbyte)
+                                            valuelength)
 {
-  float fval = DICOMFile::ReturnAsFloat(val, parser->GetDICOMFile()->GetPlatformIsBigEndian());
+  float fval = static_cast<float> (atof(DICOMValueText(val)));
   this->RescaleOffset = fval;
 #ifdef DEBUG_DICOM_APP_HELPER
   dicom_stream::cout << "Pixel offset: " << this->RescaleOffset << dicom_stream::endl;
 #endif
 }
 
+void DICOMAppHelper::NumberOfFramesCallback( DICOMParser *parser,
+                                             doublebyte,
+                                             doublebyte,
+                                             DICOMParser::VRTypes,
+                                             unsigned char* val,
+                                             valuelength)
+{
+  // an empty value is 1 frame, as is a missing one
+  int frames = atoi(DICOMValueText(val));
+  this->NumberOfFrames = frames > 0 ? frames : 1;
+  this->NumberOfFramesFileName = parser->GetFileName();
+#ifdef DEBUG_DICOM_APP_HELPER
+  dicom_stream::cout << "Number of frames: " << this->NumberOfFrames << dicom_stream::endl;
+#endif
+}
+
+void DICOMAppHelper::UpdateNumberOfFrames(DICOMParser* parser)
+{
+  if (this->NumberOfFramesFileName != parser->GetFileName())
+    {
+    this->NumberOfFramesFileName = parser->GetFileName();
+    this->NumberOfFrames = 1;
+    }
+}
+
 const char* DICOMAppHelper::TransferSyntaxUIDDescription(const char* uid)
 {
   static const char* DICOM_IMPLICIT_VR_LITTLE_ENDIAN = "1.2.840.10008.1.2";
@@ -897,6 +1181,8 @@ const char* DICOMAppHelper::TransferSyntaxUIDDescription(const char* uid)
   static const char* DICOM_EXPLICIT_VR_LITTLE_ENDIAN = "1.2.840.10008.1.2.1";
   static const char* DICOM_EXPLICIT_VR_BIG_ENDIAN = "1.2.840.10008.1.2.2";
   static const char* DICOM_GE_PRIVATE_IMPLICIT_BIG_ENDIAN = "1.2.840.113619.5.2";
+  static const char* DICOM_RLE_LOSSLESS = "1.2.840.10008.1.2.5";
+  static const char* DICOM_DEFLATED_EXPLICIT_VR_LITTLE_ENDIAN = "1.2.840.10008.1.2.1.99";
 
   if (!strcmp(DICOM_IMPLICIT_VR_LITTLE_ENDIAN, uid))
     {
@@ -926,6 +1212,14 @@ const char* DICOMAppHelper::TransferSyntaxUIDDescription(const char* uid)
     {
     return "GE Private, Implicit VR, Big Endian Image Data.";
     }
+  else if (!strcmp(DICOM_RLE_LOSSLESS, uid))
+    {
+    return "RLE Lossless.";
+    }
+  else if (!strcmp(DICOM_DEFLATED_EXPLICIT_VR_LITTLE_ENDIAN, uid))
+    {
+    return "Deflated Explicit VR, Little Endian.";
+    }
   else
     {
     return "Unknown.";
@@ -934,15 +1228,15 @@ const char* DICOMAppHelper::TransferSyntaxUIDDescription(const char* uid)
 }
 
 
-void DICOMAppHelper::RescaleSlopeCallback(DICOMParser *parser,
+void DICOMAppHelper::RescaleSlopeCallback(DICOMParser *,
                                           doublebyte,
                                           doublebyte ,
                                           DICOMParser::VRTypes ,
                                           unsigned char* val,
-                                          quadbyte )
+                                          valuelength )
 {
-  float fval = DICOMFile::ReturnAsFloat(val,
-                                        parser->GetDICOMFile()->GetPlatformIsBigEndian ());
+  // an empty slope is no rescale rather than a slope of 0
+  float fval = val ? static_cast<float> (atof(DICOMValueText(val))) : 1.0f;
 #ifdef DEBUG_DICOM_APP_HELPER
   dicom_stream::cout << "Rescale slope: " << fval << dicom_stream::endl;
 #endif
@@ -970,13 +1264,76 @@ bool DICOMAppHelper::RescaledImageDataIsFloat()
     }
 }
 
-void DICOMAppHelper::GetImageData(void*& data, DICOMParser::VRTypes& dataType, unsigned long& len)
+void DICOMAppHelper::GetImageData(void*& data, DICOMParser::VRTypes& dataType, size_t& len)
 {
-  data = this->ImageData;
+  data = this->DecodedData;
   dataType = this->ImageDataType;
   len = this->ImageDataLengthInBytes;
 }
 
+//
+// View of data if it holds values of type T, which the output
+// type wanted stands for.
+//
+template <class T>
+static bool DICOMGetImageView(void* data, DICOMParser::VRTypes dataType, size_t len,
+                              DICOMParser::VRTypes wanted, DICOMImageView<T>& view)
+{
+  if (dataType != wanted || !data)
+    {
+    view = DICOMImageView<T>();
+    return false;
+    }
+  view = DICOMImageView<T>(static_cast<T*> (data), len / sizeof(T));
+  return true;
+}
+
+void DICOMAppHelper::SetImageDestination(const DICOMImageView<char>& view)
+{
+  this->Destination = view.GetData();
+  this->DestinationType = DICOMParser::VR_OB;
+  this->DestinationLengthInBytes = view.GetSizeInBytes();
+}
+
+void DICOMAppHelper::SetImageDestination(const DICOMImageView<short>& view)
+{
+  this->Destination = view.GetData();
+  this->DestinationType = DICOMParser::VR_OW;
+  this->DestinationLengthInBytes = view.GetSizeInBytes();
+}
+
+void DICOMAppHelper::SetImageDestination(const DICOMImageView<float>& view)
+{
+  this->Destination = view.GetData();
+  this->DestinationType = DICOMParser::VR_FL;
+  this->DestinationLengthInBytes = view.GetSizeInBytes();
+}
+
+void DICOMAppHelper::ClearImageDestination()
+{
+  this->Destination = NULL;
+  this->DestinationType = DICOMParser::VR_UNKNOWN;
+  this->DestinationLengthInBytes = 0;
+}
+
+bool DICOMAppHelper::GetImageView(DICOMImageView<char>& view)
+{
+  return DICOMGetImageView(this->DecodedData, this->ImageDataType, this->ImageDataLengthInBytes,
+                           DICOMParser::VR_OB, view);
+}
+
+bool DICOMAppHelper::GetImageView(DICOMImageView<short>& view)
+{
+  return DICOMGetImageView(this->DecodedData, this->ImageDataType, this->ImageDataLengthInBytes,
+                           DICOMParser::VR_OW, view);
+}
+
+bool DICOMAppHelper::GetImageView(DICOMImageView<float>& view)
+{
+  return DICOMGetImageView(this->DecodedData, this->ImageDataType, this->ImageDataLengthInBytes,
+                           DICOMParser::VR_FL, view);
+}
+
 bool DICOMAppHelper::RescaledImageDataIsSigned()
 {
   bool rescaleSigned = (this->RescaleSlope < 0.0);
@@ -1163,6 +1520,95 @@ void DICOMAppHelper::GetSeriesUIDs(dicom_stl::vector<dicom_stl::string> &v)
     }
 }
 
+void DICOMAppHelper::GetImageInfo(DICOMParser* parser, DICOMImageInfo& info)
+{
+  info.FileName = parser->GetFileName();
+  info.SeriesUID = this->SeriesUID;
+
+  if (this->OrderingFileName == info.FileName)
+    {
+    info.Ordering = this->Ordering;
+    }
+  else
+    {
+    info.Ordering = DICOMOrderingElements();
+    }
+
+  info.Dimensions[0] = this->Dimensions[0];
+  info.Dimensions[1] = this->Dimensions[1];
+  info.PixelSpacing[0] = this->PixelSpacing[0];
+  info.PixelSpacing[1] = this->PixelSpacing[1];
+  info.PixelSpacing[2] = this->PixelSpacing[2];
+  info.BitsAllocated = this->BitsAllocated;
+  info.PixelRepresentation = this->PixelRepresentation;
+  info.PhotometricInterpretation = this->PhotometricInterpretation;
+  info.RescaleSlope = this->RescaleSlope;
+  info.RescaleOffset = this->RescaleOffset;
+  this->UpdateNumberOfFrames(parser);
+  info.NumberOfFrames = this->NumberOfFrames;
+  info.TransferSyntaxUID = this->TransferSyntaxUID;
+  info.PixelData = parser->GetStopElementLocation();
+}
+
+void DICOMAppHelper::RestoreImageInfo(const DICOMImageInfo& info)
+{
+  this->Width = this->Dimensions[0] = info.Dimensions[0];
+  this->Height = this->Dimensions[1] = info.Dimensions[1];
+  this->BitsAllocated = info.BitsAllocated;
+  this->PixelRepresentation = info.PixelRepresentation;
+  this->RescaleSlope = info.RescaleSlope;
+  this->RescaleOffset = info.RescaleOffset;
+  this->PhotometricInterpretation = info.PhotometricInterpretation;
+  this->NumberOfFrames = info.NumberOfFrames;
+  this->NumberOfFramesFileName = info.FileName;
+  this->TransferSyntaxUID = info.TransferSyntaxUID;
+}
+
+bool DICOMAppHelper::ReadPixelData(DICOMParser* parser, const DICOMImageInfo& info)
+{
+  //
+  // PixelDataCallback works from the cached header values, so put
+  // back the ones that belong to this file.
+  //
+  this->RestoreImageInfo(info);
+
+  return parser->ReadElement(info.PixelData);
+}
+
+bool DICOMAppHelper::ReadFrames(DICOMParser* parser, const DICOMImageInfo& info,
+                                int firstFrame, int numberOfFrames)
+{
+  fileoffset frameLength = info.GetFrameLengthInBytes();
+  if (firstFrame < 0 || numberOfFrames < 1 || frameLength <= 0 ||
+      numberOfFrames > info.NumberOfFrames - firstFrame)
+    {
+    return false;
+    }
+
+  this->RestoreImageInfo(info);
+
+  //
+  // Encapsulated pixel data is read whole, and PixelDataCallback
+  // picks the frames out of it.
+  //
+  if (info.PixelData.Encapsulated)
+    {
+    this->DecodeFirstFrame = firstFrame;
+    this->DecodeFrameCount = numberOfFrames;
+    bool read = parser->ReadElement(info.PixelData);
+    this->DecodeFirstFrame = 0;
+    this->DecodeFrameCount = 0;
+    return read;
+    }
+
+  //
+  // PixelDataCallback decodes as many frames as it is given.
+  //
+  return parser->ReadElement(info.PixelData,
+                             firstFrame * frameLength,
+                             numberOfFrames * frameLength);
+}
+
 void DICOMAppHelper::Clear()
 { 
   this->Implementation->SliceOrderingMap.clear();
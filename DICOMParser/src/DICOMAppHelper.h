@@ -30,13 +30,15 @@
 #include "DICOMConfig.h"
 #include "DICOMTypes.h"
 #include "DICOMCallback.h"
+#include "DICOMImageView.h"
+#include "DICOMPixelKernels.h"
 
 class DICOMParser;
 
 // Function object for sorting strings
 struct ltstdstr
 {
-  bool operator()(const dicom_stl::string s1, const dicom_stl::string s2) const
+  bool operator()(const dicom_stl::string& s1, const dicom_stl::string& s2) const
   {
     return s1 < s2;
   }
@@ -79,7 +81,66 @@ public:
   float ImageOrientationPatient[6];
 };
 
+// Everything the DICOMAppHelper learned from the header of one
+// file, including where its pixel data is.  This is enough to
+// order the file within its series and to decode its pixels
+// later without parsing the header again.
+class DICOM_EXPORT DICOMImageInfo
+{
+public:
+  DICOMImageInfo()
+    {
+      Dimensions[0] = Dimensions[1] = 0;
+      PixelSpacing[0] = PixelSpacing[1] = PixelSpacing[2] = 1.0;
+      BitsAllocated = 8;
+      PixelRepresentation = 0;
+      RescaleSlope = 1.0;
+      RescaleOffset = 0.0;
+      NumberOfFrames = 1;
+    }
+
+  int GetNumberOfComponents() const
+    {
+      return PhotometricInterpretation == "RGB " ? 3 : 1;
+    }
+
+  // Bytes of pixel data per frame, once decoded.  The frames of
+  // native (not encapsulated) pixel data follow each other with
+  // no gaps.
+  fileoffset GetFrameLengthInBytes() const
+    {
+      return static_cast<fileoffset> (Dimensions[0]) * Dimensions[1] *
+        GetNumberOfComponents() * (BitsAllocated / 8);
+    }
+
+  // Where frame i starts in the file, or -1 if there is no such
+  // frame or no native pixel data.
+  fileoffset GetFrameOffset(int i) const
+    {
+      if (PixelData.Offset < 0 || PixelData.Encapsulated || i < 0 || i >= NumberOfFrames)
+        {
+        return -1;
+        }
+      return PixelData.Offset + i * GetFrameLengthInBytes();
+    }
+
+  dicom_stl::string FileName;
+  dicom_stl::string SeriesUID;
+  DICOMOrderingElements Ordering;
+  int Dimensions[2];
+  float PixelSpacing[3];
+  int BitsAllocated;
+  int PixelRepresentation;
+  dicom_stl::string PhotometricInterpretation;
+  float RescaleSlope;
+  float RescaleOffset;
+  int NumberOfFrames;
+  dicom_stl::string TransferSyntaxUID;
+  DICOMParser::ElementLocation PixelData;
+};
+
 class DICOMAppHelperImplementation;
+struct DICOMEncapsulatedDecodeJob;
 
 /**
  * \class DICOMAppHelper
@@ -102,6 +163,16 @@ class DICOMAppHelperImplementation;
  * patient position. This allows the DICOMAppHelper to assist an
  * application is collecting all the images from one series into a
  * volume.
+ *
+ * Threading: the values a DICOMAppHelper caches (dimensions, slice
+ * number, image position, pixel data and so on) are overwritten by
+ * the callbacks as each file is parsed, so a helper belongs to one
+ * parser and both must be used by a single thread at a time.  Use one
+ * parser/helper pair per thread; there is no shared or static state
+ * between instances.  To keep the results for a file once the next
+ * one is parsed, take them as a value with GetImageInfo().  Decoding
+ * compressed multi-frame pixel data may start worker threads of its
+ * own; see SetNumberOfThreads().
  */
 class DICOM_EXPORT DICOMAppHelper
 {
@@ -120,119 +191,126 @@ public:
                                     doublebyte element,
                                     DICOMParser::VRTypes type,
                                     unsigned char* val,
-                                    quadbyte len);
+                                    valuelength len);
 
   virtual void ArrayCallback(DICOMParser *parser,
                              doublebyte group,
                              doublebyte element,
                              DICOMParser::VRTypes type,
                              unsigned char* val,
-                             quadbyte len);
+                             valuelength len);
   
   virtual void SliceNumberCallback(DICOMParser *parser,
                                    doublebyte group,
                                    doublebyte element,
                                    DICOMParser::VRTypes type,
                                    unsigned char* val,
-                                   quadbyte len) ;
+                                   valuelength len) ;
 
   virtual void SliceLocationCallback(DICOMParser *parser,
                                      doublebyte group,
                                      doublebyte element,
                                      DICOMParser::VRTypes type,
                                      unsigned char* val,
-                                     quadbyte len) ;
+                                     valuelength len) ;
 
   virtual void ImagePositionPatientCallback(DICOMParser *parser,
                                             doublebyte group,
                                             doublebyte element,
                                             DICOMParser::VRTypes type,
                                             unsigned char* val,
-                                            quadbyte len) ;
+                                            valuelength len) ;
   
   virtual void ImageOrientationPatientCallback(DICOMParser *parser,
                                                doublebyte group,
                                                doublebyte element,
                                                DICOMParser::VRTypes type,
                                                unsigned char* val,
-                                               quadbyte len) ;
+                                               valuelength len) ;
   
   virtual void SeriesUIDCallback(DICOMParser *parser,
                                  doublebyte group,
                                  doublebyte element,
                                  DICOMParser::VRTypes type,
                                  unsigned char* val,
-                                 quadbyte len) ;
+                                 valuelength len) ;
   
   virtual void TransferSyntaxCallback(DICOMParser *parser,
                                       doublebyte group,
                                       doublebyte element,
                                       DICOMParser::VRTypes type,
                                       unsigned char* val,
-                                      quadbyte len) ;
+                                      valuelength len) ;
   
   virtual void BitsAllocatedCallback(DICOMParser *parser,
                                      doublebyte group,
                                      doublebyte element,
                                      DICOMParser::VRTypes type,
                                      unsigned char* val,
-                                     quadbyte len) ;
+                                     valuelength len) ;
   
   virtual void ToggleSwapBytesCallback(DICOMParser *parser,
                                        doublebyte,
                                        doublebyte,
                                        DICOMParser::VRTypes,
                                        unsigned char*,
-                                       quadbyte);
+                                       valuelength);
   
   virtual void PixelSpacingCallback(DICOMParser *parser,
                                     doublebyte group,
                                     doublebyte element,
                                     DICOMParser::VRTypes type,
                                     unsigned char* val,
-                                    quadbyte len) ;
+                                    valuelength len) ;
 
   virtual void HeightCallback(DICOMParser *parser,
                               doublebyte group,
                               doublebyte element,
                               DICOMParser::VRTypes type,
                               unsigned char* val,
-                              quadbyte len);
+                              valuelength len);
 
   virtual void WidthCallback( DICOMParser *parser,
                               doublebyte group,
                               doublebyte element,
                               DICOMParser::VRTypes type,
                               unsigned char* val,
-                              quadbyte len);
+                              valuelength len);
 
   virtual void PixelRepresentationCallback(DICOMParser *parser,
                                            doublebyte group,
                                            doublebyte element,
                                            DICOMParser::VRTypes type,
                                            unsigned char* val,
-                                           quadbyte len);
+                                           valuelength len);
 
   virtual void PhotometricInterpretationCallback(DICOMParser *parser,
                                                  doublebyte,
                                                  doublebyte,
                                                  DICOMParser::VRTypes,
                                                  unsigned char* val,
-                                                 quadbyte len);
+                                                 valuelength len);
 
   virtual void PixelDataCallback(DICOMParser *parser,
                                  doublebyte,
                                  doublebyte,
                                  DICOMParser::VRTypes,
                                  unsigned char* val,
-                                 quadbyte len);
+                                 valuelength len);
 
   virtual void RescaleOffsetCallback( DICOMParser *parser,
                                       doublebyte,
                                       doublebyte,
                                       DICOMParser::VRTypes,
                                       unsigned char* val,
-                                      quadbyte);
+                                      valuelength);
+
+  virtual void NumberOfFramesCallback(DICOMParser *parser,
+                                      doublebyte,
+                                      doublebyte,
+                                      DICOMParser::VRTypes,
+                                      unsigned char* val,
+                                      valuelength);
 
   /** Register all the standard callbacks with the DICOM Parser.  This
    * associates a callback with each (group, element) tag pair in the
@@ -309,20 +387,12 @@ public:
    *  DICOMParser. */
   int GetNumberOfComponents()
     {
-    if (!this->PhotometricInterpretation)
-      {
-      return 1;
-      }
-
     //
     // DICOM standard says that spaces (0x20) are to
     // be ignored for CS types.  We don't handle this
     // well yet.
     //
-    dicom_stl::string str1(*this->PhotometricInterpretation);
-    dicom_stl::string rgb("RGB ");
-
-    if (str1 == rgb)
+    if (this->PhotometricInterpretation == "RGB ")
       {
       return 3;
       }
@@ -332,11 +402,19 @@ public:
       }
     }
 
+  /** Get the number of frames of the last image processed by the
+   *  DICOMParser: its Number of Frames (0028,0008), or 1 if it has
+   *  none. */
+  int GetNumberOfFrames()
+    {
+    return this->NumberOfFrames;
+    }
+
   /** Get the transfer syntax UID for the last image processed by the
    *  DICOMParser. */
   dicom_stl::string GetTransferSyntaxUID()
     {
-    return *(this->TransferSyntaxUID);
+    return this->TransferSyntaxUID;
     }
 
   /** Get a textual description of the transfer syntax of the last
@@ -348,7 +426,36 @@ public:
    * registered.
    * \sa RegisterPixelDataCallback()
   */
-  void GetImageData(void* & data, DICOMParser::VRTypes& dataType, unsigned long& len);
+  void GetImageData(void* & data, DICOMParser::VRTypes& dataType, size_t& len);
+
+  /** Get the image data from the last image processed by the
+   * DICOMParser as a typed view: char for 8 bit integer output,
+   * short for 16 bit integer output and float when the rescale is
+   * not integer valued.  Returns false and an empty view when the
+   * image data is of another type, or there is none.  The view is
+   * valid until the next image is decoded.  Prefer this to
+   * GetImageData().
+   * \sa RegisterPixelDataCallback()
+   */
+  bool GetImageView(DICOMImageView<char>& view);
+  bool GetImageView(DICOMImageView<short>& view);
+  bool GetImageView(DICOMImageView<float>& view);
+
+  /** Decode the next images straight into view, for instance one
+   * slice of a volume, instead of into the helper's own buffer.  An
+   * image is only decoded there if its output type is the type of
+   * view and it fits; otherwise it goes to the helper's buffer as
+   * usual.  Either way GetImageView() and GetImageData() return
+   * where it went, so a caller can tell by comparing pointers.  The
+   * caller keeps ownership of the storage, which must stay valid
+   * until ClearImageDestination() or the next SetImageDestination().
+   */
+  void SetImageDestination(const DICOMImageView<char>& view);
+  void SetImageDestination(const DICOMImageView<short>& view);
+  void SetImageDestination(const DICOMImageView<float>& view);
+
+  /** Go back to decoding into the helper's own buffer. */
+  void ClearImageDestination();
 
   /** Determine whether the image data was rescaled (by the
    *  RescaleSlope tag) to be floating point. */
@@ -365,6 +472,103 @@ public:
     return this->SliceNumber;
     }
 
+  /** Get the header information cached for the last file read by
+   * the DICOMParser.  When the header was read with
+   * DICOMParser::ReadHeaderOnly(), PixelData holds the location of
+   * the pixel data. */
+  void GetImageInfo(DICOMParser* parser, DICOMImageInfo& info);
+
+  /** Decode the pixel data described by info, which came from
+   * GetImageInfo(), from the file open in parser.  The header is not
+   * parsed again; the cached header values are replaced by the ones
+   * in info before the PixelDataCallback runs.  The result is
+   * available from GetImageData().
+   * \sa RegisterPixelDataCallback()
+   */
+  bool ReadPixelData(DICOMParser* parser, const DICOMImageInfo& info);
+
+  /** Like ReadPixelData(), but only read and decode numberOfFrames
+   * frames of multi-frame pixel data, starting with frame firstFrame.
+   * Only the bytes of those frames are read from the file, unless the
+   * pixel data is encapsulated; then all of it is read but only those
+   * frames are decoded.  The frames are available, one after the
+   * other, from GetImageView() and GetImageData().  Returns false if
+   * the frames are not all in the file.
+   */
+  bool ReadFrames(DICOMParser* parser, const DICOMImageInfo& info,
+                  int firstFrame, int numberOfFrames = 1);
+
+  /** Get the rescale slope of the last image processed by the
+   *  DICOMParser. */
+  float GetRescaleSlope()
+    {
+    return this->RescaleSlope;
+    }
+
+  /** Get the rescale offset of the last image processed by the
+   *  DICOMParser. */
+  float GetRescaleOffset()
+    {
+    return this->RescaleOffset;
+    }
+
+  /** Set/Get how many threads decode the frames of compressed
+   * multi-frame pixel data, each frame on one thread.  0, the
+   * default, uses as many as the machine has cores; 1 decodes on the
+   * calling thread only.  Native pixel data and single frames are
+   * always decoded on the calling thread.  The result doesn't depend
+   * on the number of threads. */
+  void SetNumberOfThreads(int n)
+    {
+    this->NumberOfThreads = n > 0 ? n : 0;
+    }
+
+  int GetNumberOfThreads()
+    {
+    return this->NumberOfThreads;
+    }
+
+  /** Set/Get whether the PixelDataCallback summarizes the image data
+   * it produces while it decodes it: range, sum and a coarse
+   * histogram, available from GetImageStatistics().  Callers that
+   * need any of these should turn it on rather than scan the image
+   * data again.  Off by default. */
+  void SetComputeImageStatistics(bool v)
+    {
+    this->ComputeImageStatistics = v;
+    }
+
+  bool GetComputeImageStatistics()
+    {
+    return this->ComputeImageStatistics;
+    }
+
+  /** Get the statistics of the image data of the last image
+   * processed by the DICOMParser.  Count is 0 unless
+   * ComputeImageStatistics was on.
+   * \sa SetComputeImageStatistics()
+   */
+  const DICOMPixelStatistics& GetImageStatistics()
+    {
+    return this->ImageStatistics;
+    }
+
+  /** Set/Get whether the files parsed are recorded in the internal
+   * databases that group them by SeriesUID and order them within a
+   * series.  On by default.  The Get...FilenamePairs(),
+   * GetSeriesUIDs() and OutputSeries() methods need it; a caller
+   * that only uses GetImageInfo() can turn it off so that parsing a
+   * file adds nothing to the helper. */
+  void SetRecordSeriesDatabase(bool v)
+    {
+    this->RecordSeriesDatabase = v;
+    }
+
+  bool GetRecordSeriesDatabase()
+    {
+    return this->RecordSeriesDatabase;
+    }
+
   /** Clear the internal databases. This will reset the internal
    * databases that are grouping filenames based on SeriesUID's and
    * ordering filenames based on image locations. */
@@ -410,6 +614,13 @@ public:
   int SliceNumber; 
   int Dimensions[2];
   float ImagePositionPatient[3];
+  dicom_stl::string SeriesUID;
+
+  // ordering tags of the file named OrderingFileName, the one
+  // being parsed
+  DICOMOrderingElements Ordering;
+  dicom_stl::string OrderingFileName;
+  bool RecordSeriesDatabase;
 
   // map from series UID to vector of files in the series 
   // dicom_stl::map<dicom_stl::string, dicom_stl::vector<dicom_stl::string>, ltstdstr> SeriesUIDMap;
@@ -425,13 +636,88 @@ public:
   // 0 unsigned
   // 1 2s complement (signed)
   int PixelRepresentation;
-  dicom_stl::string* PhotometricInterpretation;
-  dicom_stl::string* TransferSyntaxUID;
+  dicom_stl::string PhotometricInterpretation;
+  dicom_stl::string TransferSyntaxUID;
   float RescaleOffset;
   float RescaleSlope;
+  int NumberOfFrames;
+  // file NumberOfFrames was read from; other files have 1 frame
+  dicom_stl::string NumberOfFramesFileName;
   void* ImageData;
+  // where the last image was decoded: ImageData or Destination
+  void* DecodedData;
+  // caller's storage for the next images, if any
+  void* Destination;
+  DICOMParser::VRTypes DestinationType;
+  size_t DestinationLengthInBytes;
   DICOMParser::VRTypes ImageDataType;
-  unsigned long ImageDataLengthInBytes;
+  size_t ImageDataLengthInBytes;
+  // size of the ImageData buffer, which is kept between files
+  size_t ImageDataCapacity;
+
+  bool ComputeImageStatistics;
+  DICOMPixelStatistics ImageStatistics;
+
+  // Conversion of the pixel data for the current BitsAllocated,
+  // RescaleSlope and RescaleOffset, picked by SelectPixelDecoder
+  // when one of them changes.  NULL when there is none for them.
+  typedef void (*PixelDecodeFunction)(const unsigned char* data, void* output, int n,
+                                      float slope, float offset,
+                                      bool swap, DICOMPixelStatistics* stats);
+  PixelDecodeFunction PixelDecoder;
+  DICOMParser::VRTypes PixelDecoderType;
+  int PixelDecoderValueSize;
+  bool PixelDecoderSelected;
+  int PixelDecoderBitsAllocated;
+  float PixelDecoderSlope;
+  float PixelDecoderOffset;
+
+  void SelectPixelDecoder();
+
+  // Most pixels PixelDataCallback hands the decoder at once.
+  enum { DECODE_CHUNK_PIXELS = 1 << 30 };
+
+  // Run PixelDecoder over n values of in, a piece at a time if
+  // need be, adding to stats if it isn't NULL.  Safe to call from
+  // several threads for different output.
+  void DecodePixels(const unsigned char* in, void* out, size_t n,
+                    bool swap, DICOMPixelStatistics* stats) const;
+
+  // Decode frames [firstFrame, firstFrame + numberOfFrames) of
+  // the encapsulated pixel data in the len bytes at data to
+  // DecodedData, if its transfer syntax has a decoder here.
+  // Returns false if it hasn't or the data is malformed.
+  bool DecodeEncapsulatedPixelData(const unsigned char* data, size_t len,
+                                   int firstFrame, int numberOfFrames);
+
+  // Body of the threads DecodeEncapsulatedPixelData runs.
+  void DecodeEncapsulatedFrames(DICOMEncapsulatedDecodeJob* job) const;
+
+  int NumberOfThreads;
+
+  // Frames of encapsulated pixel data ReadFrames wants decoded;
+  // all of them when DecodeFrameCount is 0.
+  int DecodeFirstFrame;
+  int DecodeFrameCount;
+
+  // Make ImageData at least bytes long.
+  void ReserveImageData(size_t bytes);
+
+  // Put back the header values of info, which PixelDataCallback
+  // works from.
+  void RestoreImageInfo(const DICOMImageInfo& info);
+
+  // Reset NumberOfFrames to 1 if it was read from another file
+  // than the one open in parser.
+  void UpdateNumberOfFrames(DICOMParser* parser);
+
+  // Ordering for the file open in parser, started afresh when
+  // the parser has moved on to another file.
+  DICOMOrderingElements& GetOrdering(DICOMParser* parser);
+
+  // Record the ordering of the file open in parser in the
+  // slice ordering database, if it is kept.
+  void RecordOrdering(DICOMParser* parser);
 
   DICOMMemberCallback<DICOMAppHelper>* SeriesUIDCB;
   DICOMMemberCallback<DICOMAppHelper>* SliceNumberCB;
@@ -448,6 +734,7 @@ public:
   DICOMMemberCallback<DICOMAppHelper>* PhotometricInterpretationCB;
   DICOMMemberCallback<DICOMAppHelper>* RescaleOffsetCB;
   DICOMMemberCallback<DICOMAppHelper>* RescaleSlopeCB;
+  DICOMMemberCallback<DICOMAppHelper>* NumberOfFramesCB;
   DICOMMemberCallback<DICOMAppHelper>* PixelDataCB;
 
   //
@@ -0,0 +1,149 @@
+/*=========================================================================
+
+  Program:   DICOMParser
+  Module:    $RCSfile: DICOMArena.cxx,v $
+  Language:  C++
+  Date:      $Date: 2003/10/23 19:13:34 $
+  Version:   $Revision: 1.1.1.1 $
+
+  Copyright (c) 2003 Matt Turek
+  All rights reserved.
+  See Copyright.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifdef _MSC_VER
+#pragma warning ( disable : 4514 )
+#pragma warning ( disable : 4710 )
+#pragma warning ( push, 3 )
+#endif
+
+#include "DICOMConfig.h"
+#include "DICOMArena.h"
+
+//
+// Round size up to a multiple of the alignment.
+//
+static size_t DICOMArenaAlign(size_t size)
+{
+  return (size + DICOMArena::ALIGNMENT - 1) & ~static_cast<size_t> (DICOMArena::ALIGNMENT - 1);
+}
+
+DICOMArena::DICOMArena(size_t blockSize)
+{
+  this->Blocks = NULL;
+  this->Current = NULL;
+  this->Cursor = NULL;
+  this->End = NULL;
+  this->BlockSize = blockSize > 0 ? DICOMArenaAlign(blockSize) : static_cast<size_t> (DEFAULT_BLOCK_SIZE);
+  this->Capacity = 0;
+  this->Merge = false;
+}
+
+DICOMArena::~DICOMArena()
+{
+  this->FreeBlocks();
+}
+
+unsigned char* DICOMArena::GetData(Block* block)
+{
+  return reinterpret_cast<unsigned char*> (block) + DICOMArenaAlign(sizeof(Block));
+}
+
+void* DICOMArena::Allocate(size_t size)
+{
+  if (this->Merge)
+    {
+    this->MergeBlocks();
+    }
+
+  size = DICOMArenaAlign(size > 0 ? size : 1);
+
+  while (static_cast<size_t> (this->End - this->Cursor) < size)
+    {
+    if (this->Current && this->Current->Next)
+      {
+      this->Current = this->Current->Next;
+      this->Cursor = GetData(this->Current);
+      this->End = this->Cursor + this->Current->Size;
+      }
+    else
+      {
+      this->AddBlock(size);
+      }
+    }
+
+  void* p = this->Cursor;
+  this->Cursor += size;
+  return p;
+}
+
+void DICOMArena::Reset()
+{
+  this->Current = this->Blocks;
+  if (this->Blocks)
+    {
+    this->Cursor = GetData(this->Blocks);
+    this->End = this->Cursor + this->Blocks->Size;
+    this->Merge = (this->Blocks->Next != NULL);
+    }
+  else
+    {
+    this->Cursor = NULL;
+    this->End = NULL;
+    }
+}
+
+void DICOMArena::AddBlock(size_t size)
+{
+  size_t n = size > this->BlockSize ? size : this->BlockSize;
+
+  Block* block = reinterpret_cast<Block*> (new unsigned char[DICOMArenaAlign(sizeof(Block)) + n]);
+  block->Next = NULL;
+  block->Size = n;
+
+  if (this->Current)
+    {
+    this->Current->Next = block;
+    }
+  else
+    {
+    this->Blocks = block;
+    }
+  this->Current = block;
+  this->Cursor = GetData(block);
+  this->End = this->Cursor + n;
+  this->Capacity += n;
+}
+
+void DICOMArena::MergeBlocks()
+{
+  size_t total = this->Capacity;
+  this->FreeBlocks();
+  this->AddBlock(total);
+}
+
+void DICOMArena::FreeBlocks()
+{
+  Block* block = this->Blocks;
+  while (block)
+    {
+    Block* next = block->Next;
+    delete [] reinterpret_cast<unsigned char*> (block);
+    block = next;
+    }
+  this->Blocks = NULL;
+  this->Current = NULL;
+  this->Cursor = NULL;
+  this->End = NULL;
+  this->Capacity = 0;
+  this->Merge = false;
+}
+
+#ifdef _MSC_VER
+#pragma warning ( pop )
+#endif
@@ -0,0 +1,115 @@
+/*=========================================================================
+
+  Program:   DICOMParser
+  Module:    $RCSfile: DICOMArena.h,v $
+  Language:  C++
+  Date:      $Date: 2003/10/23 19:13:34 $
+  Version:   $Revision: 1.1.1.1 $
+
+  Copyright (c) 2003 Matt Turek
+  All rights reserved.
+  See Copyright.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __DICOMARENA_H_
+#define __DICOMARENA_H_
+
+#ifdef _MSC_VER
+#pragma warning ( disable : 4514 )
+#pragma warning ( push, 3 )
+#endif
+
+#include <stddef.h>
+
+#include "DICOMConfig.h"
+
+//
+// Bump allocator for the values a DICOMParser hands to its
+// callbacks.  Allocate carves storage out of large blocks and
+// Reset releases everything at once, in constant time, keeping
+// the blocks for the next file.  When a file needed more than
+// one block, the blocks are merged into one on the first
+// Allocate after the Reset, so once the largest file has been
+// seen parsing does no heap allocation at all.
+//
+// Subclass it to put the storage somewhere else; the parser
+// only calls Allocate and Reset.
+//
+class DICOM_EXPORT DICOMArena
+{
+ public:
+  //
+  // Size of a block, and the alignment of every allocation.
+  //
+  enum { DEFAULT_BLOCK_SIZE = 65536, ALIGNMENT = 16 };
+
+  DICOMArena(size_t blockSize = DEFAULT_BLOCK_SIZE);
+  virtual ~DICOMArena();
+
+  //
+  // Return size bytes aligned to ALIGNMENT.  The storage stays
+  // valid until the next Reset.
+  //
+  virtual void* Allocate(size_t size);
+
+  //
+  // Make all the storage available again.
+  //
+  virtual void Reset();
+
+  //
+  // Total size of the blocks held.
+  //
+  size_t GetCapacity()
+    {
+    return this->Capacity;
+    }
+
+ protected:
+  struct Block
+    {
+    Block* Next;
+    size_t Size;
+    };
+
+  //
+  // Add a block of at least size bytes after Current and make
+  // it current.
+  //
+  void AddBlock(size_t size);
+
+  //
+  // Replace the blocks with a single one of Capacity bytes.
+  //
+  void MergeBlocks();
+
+  void FreeBlocks();
+
+  //
+  // Start of a block's storage, just past its header.
+  //
+  static unsigned char* GetData(Block* block);
+
+  Block* Blocks;
+  Block* Current;
+  unsigned char* Cursor;
+  unsigned char* End;
+  size_t BlockSize;
+  size_t Capacity;
+  bool Merge;
+
+ private:
+  DICOMArena(const DICOMArena&);
+  void operator=(const DICOMArena&);
+};
+
+#ifdef _MSC_VER
+#pragma warning ( pop )
+#endif
+
+#endif // __DICOMARENA_H_
@@ -0,0 +1,213 @@
+/*=========================================================================
+
+  Program:   DICOMParser
+  Module:    $RCSfile: DICOMBufferedFile.cxx,v $
+  Language:  C++
+  Date:      $Date: 2003/10/23 19:13:34 $
+  Version:   $Revision: 1.1.1.1 $
+
+  Copyright (c) 2003 Matt Turek
+  All rights reserved.
+  See Copyright.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifdef _MSC_VER
+#pragma warning ( disable : 4514 )
+#pragma warning ( disable : 4710 )
+#pragma warning ( push, 3 )
+#endif
+
+#include <string.h>
+#include <string>
+
+#include "DICOMConfig.h"
+#include "DICOMBufferedFile.h"
+
+DICOMBufferedFile::DICOMBufferedFile() : DICOMFile()
+{
+  this->Buffer = NULL;
+  this->WindowOffset = 0;
+  this->Size = 0;
+
+  //
+  // Don't let the stream buffer as well; the window is
+  // the buffer and refills go straight to the file.  A one
+  // byte buffer is unbuffered, but unlike pubsetbuf(NULL, 0)
+  // the stream doesn't allocate it on every open.
+  //
+  this->StreamBufferSize = 1;
+}
+
+DICOMBufferedFile::~DICOMBufferedFile()
+{
+  this->Close();
+  delete [] this->Buffer;
+}
+
+bool DICOMBufferedFile::Open(const dicom_stl::string& filename)
+{
+  this->Close();
+
+  if (!DICOMFile::Open(filename))
+    {
+    return false;
+    }
+
+  this->InputStream.seekg(0, dicom_stream::ios::end);
+  this->Size = static_cast<fileoffset> (this->InputStream.tellg());
+  this->InputStream.seekg(0, dicom_stream::ios::beg);
+
+  if (!this->Buffer)
+    {
+    this->Buffer = new unsigned char[WINDOW_SIZE];
+    }
+  this->WindowOffset = 0;
+  this->WindowStart = this->Buffer;
+  this->WindowCursor = this->Buffer;
+  this->WindowEnd = this->Buffer;
+
+  return true;
+}
+
+void DICOMBufferedFile::Close()
+{
+  DICOMFile::Close();
+  this->InputStream.clear();
+  this->Size = 0;
+  this->WindowOffset = 0;
+  this->WindowStart = NULL;
+  this->WindowCursor = NULL;
+  this->WindowEnd = NULL;
+}
+
+fileoffset DICOMBufferedFile::Tell()
+{
+  return this->WindowOffset + static_cast<fileoffset> (this->WindowCursor - this->WindowStart);
+}
+
+void DICOMBufferedFile::SkipToPos(fileoffset pos)
+{
+  if (pos < 0)
+    {
+    pos = 0;
+    }
+  else if (pos > this->Size)
+    {
+    pos = this->Size;
+    }
+
+  if (pos >= this->WindowOffset &&
+      pos <= this->WindowOffset + static_cast<fileoffset> (this->WindowEnd - this->WindowStart))
+    {
+    this->WindowCursor = this->WindowStart + (pos - this->WindowOffset);
+    }
+  else
+    {
+    //
+    // Leave the window empty at the new position; the next
+    // read refills it from there.
+    //
+    this->WindowOffset = pos;
+    this->WindowStart = this->Buffer;
+    this->WindowCursor = this->Buffer;
+    this->WindowEnd = this->Buffer;
+    }
+}
+
+fileoffset DICOMBufferedFile::GetSize()
+{
+  return this->Size;
+}
+
+void DICOMBufferedFile::Skip(fileoffset increment)
+{
+  this->SkipToPos(this->Tell() + increment);
+}
+
+void DICOMBufferedFile::SkipToStart()
+{
+  this->SkipToPos(0);
+}
+
+void DICOMBufferedFile::FillWindow(fileoffset pos)
+{
+  this->InputStream.clear();
+  this->InputStream.seekg(pos, dicom_stream::ios::beg);
+  this->InputStream.read(reinterpret_cast<char*> (this->Buffer), WINDOW_SIZE);
+  fileoffset count = static_cast<fileoffset> (this->InputStream.gcount());
+
+  this->WindowOffset = pos;
+  this->WindowStart = this->Buffer;
+  this->WindowCursor = this->Buffer;
+  this->WindowEnd = this->Buffer + count;
+}
+
+void DICOMBufferedFile::Read(void* ptr, fileoffset nbytes)
+{
+  if (nbytes <= 0 || !this->Buffer)
+    {
+    return;
+    }
+
+  char* out = static_cast<char*> (ptr);
+
+  fileoffset avail = static_cast<fileoffset> (this->WindowEnd - this->WindowCursor);
+  fileoffset count = nbytes < avail ? nbytes : avail;
+  memcpy(out, this->WindowCursor, count);
+  this->WindowCursor += count;
+  out += count;
+  nbytes -= count;
+
+  if (nbytes == 0)
+    {
+    return;
+    }
+
+  fileoffset pos = this->Tell();
+  if (nbytes >= WINDOW_SIZE)
+    {
+    //
+    // Big reads (pixel data) go straight to the caller.
+    //
+    this->InputStream.clear();
+    this->InputStream.seekg(pos, dicom_stream::ios::beg);
+    this->InputStream.read(out, nbytes);
+    count = static_cast<fileoffset> (this->InputStream.gcount());
+    this->SkipToPos(pos + count);
+    }
+  else
+    {
+    this->FillWindow(pos);
+    avail = static_cast<fileoffset> (this->WindowEnd - this->WindowCursor);
+    count = nbytes < avail ? nbytes : avail;
+    memcpy(out, this->WindowCursor, count);
+    this->WindowCursor += count;
+    }
+
+  if (count < nbytes)
+    {
+    memset(out + count, 0, nbytes - count);
+    }
+}
+
+const unsigned char* DICOMBufferedFile::ReadView(fileoffset len)
+{
+  if (len < 0 || len > WINDOW_SIZE || !this->Buffer)
+    {
+    return NULL;
+    }
+  if (len > this->WindowEnd - this->WindowCursor)
+    {
+    this->FillWindow(this->Tell());
+    }
+  return DICOMFile::ReadView(len);
+}
+
+#ifdef _MSC_VER
+#pragma warning ( pop )
+#endif
@@ -0,0 +1,127 @@
+/*=========================================================================
+
+  Program:   DICOMParser
+  Module:    $RCSfile: DICOMBufferedFile.h,v $
+  Language:  C++
+  Date:      $Date: 2003/10/23 19:13:34 $
+  Version:   $Revision: 1.1.1.1 $
+
+  Copyright (c) 2003 Matt Turek
+  All rights reserved.
+  See Copyright.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __DICOMBUFFEREDFILE_H_
+#define __DICOMBUFFEREDFILE_H_
+
+#ifdef _MSC_VER
+#pragma warning ( disable : 4514 )
+#pragma warning ( push, 3 )
+#endif
+
+#include <string>
+
+#include "DICOMConfig.h"
+#include "DICOMFile.h"
+
+//
+// DICOMFile that reads the file in large blocks into a
+// contiguous window and serves small reads and skips from
+// it.  Useful where mapping a file is unavailable or slow,
+// e.g. network or FUSE file systems, since each refill is a
+// single bulk read.
+//
+class DICOM_EXPORT DICOMBufferedFile : public DICOMFile
+{
+ public:
+  //
+  // Size of the window in bytes.
+  //
+  enum { WINDOW_SIZE = 65536 };
+
+  DICOMBufferedFile();
+  virtual ~DICOMBufferedFile();
+
+  //
+  // Open a file with filename.  Returns a bool
+  // that is true if the file is successfully
+  // opened.
+  //
+  virtual bool Open(const dicom_stl::string& filename);
+
+  //
+  // Close a file.
+  //
+  virtual void Close();
+
+  //
+  // Return the position in the file.
+  //
+  virtual fileoffset Tell();
+
+  //
+  // Move to a particular position in the file.  Stays
+  // inside the window if it can.  The position is
+  // clamped to the file.
+  //
+  virtual void SkipToPos(fileoffset);
+
+  //
+  // Return the size of the file.
+  //
+  virtual fileoffset GetSize();
+
+  //
+  // Skip a number of bytes.
+  //
+  virtual void Skip(fileoffset);
+
+  //
+  // Skip to the beginning of the file.
+  //
+  virtual void SkipToStart();
+
+  //
+  // Read data of length len.  Reads larger than the window
+  // bypass it.  Bytes requested past the end of the file
+  // are set to zero.
+  //
+  virtual void Read(void* data, fileoffset len);
+
+  //
+  // Return a pointer to the next len bytes, refilling the
+  // window first if needed.  Returns NULL for values that
+  // don't fit in the window.
+  //
+  virtual const unsigned char* ReadView(fileoffset len);
+
+ protected:
+  //
+  // Refill the window starting at file position pos.
+  //
+  void FillWindow(fileoffset pos);
+
+  unsigned char* Buffer;
+
+  //
+  // File position of WindowStart.
+  //
+  fileoffset WindowOffset;
+
+  fileoffset Size;
+
+ private:
+  DICOMBufferedFile(const DICOMBufferedFile&);
+  void operator=(const DICOMBufferedFile&);
+};
+
+#ifdef _MSC_VER
+#pragma warning ( pop )
+#endif
+
+#endif // __DICOMBUFFEREDFILE_H_
@@ -50,7 +50,7 @@ class DICOM_EXPORT DICOMCallback
                        doublebyte element,
                        DICOMParser::VRTypes type,
                        unsigned char* val,
-                       quadbyte len) = 0;
+                       valuelength len) = 0;
 };
 
 //
@@ -66,7 +66,7 @@ class DICOMMemberCallback : public DICOMCallback
                                              doublebyte element,
                                              DICOMParser::VRTypes type,
                                              unsigned char* val,
-                                             quadbyte len);
+                                             valuelength len);
 
         
   //
@@ -88,7 +88,7 @@ class DICOMMemberCallback : public DICOMCallback
                doublebyte element,
                DICOMParser::VRTypes type,
                unsigned char* val,
-               quadbyte len)
+               valuelength len)
   {
     if (MemberFunction)
       {
@@ -23,6 +23,7 @@
 #endif 
 
 #include <stdio.h>
+#include <string.h>
 #include <string>
 
 #include "DICOMConfig.h"
@@ -30,6 +31,12 @@
 
 DICOMFile::DICOMFile() : InputStream()
 {
+  this->WindowStart = NULL;
+  this->WindowCursor = NULL;
+  this->WindowEnd = NULL;
+  this->StreamBuffer = NULL;
+  this->StreamBufferSize = STREAM_BUFFER_SIZE;
+
   /* Are we little or big endian?  From Harbison&Steele.  */
   union
   {
@@ -51,10 +58,13 @@ DICOMFile::DICOMFile() : InputStream()
 DICOMFile::~DICOMFile()
 {
   this->Close();
+  delete [] this->StreamBuffer;
 }
 
 DICOMFile::DICOMFile(const DICOMFile& in)
 {
+  this->StreamBuffer = NULL;
+  this->StreamBufferSize = STREAM_BUFFER_SIZE;
   if (strcmp(in.PlatformEndian, "LittleEndian") == 0)
     {
     PlatformEndian = "LittleEndian";
@@ -87,6 +97,12 @@ void DICOMFile::operator=(const DICOMFile& in)
 
 bool DICOMFile::Open(const dicom_stl::string& filename)
 {
+  if (!this->StreamBuffer)
+    {
+    this->StreamBuffer = new char[this->StreamBufferSize];
+    }
+  InputStream.rdbuf()->pubsetbuf(this->StreamBuffer, this->StreamBufferSize);
+
 #ifdef _WIN32
   InputStream.open(filename.c_str(), dicom_stream::ios::binary | dicom_stream::ios::in);
 #else  
@@ -109,32 +125,32 @@ void DICOMFile::Close()
   InputStream.close();
 }
 
-long DICOMFile::Tell() 
+fileoffset DICOMFile::Tell() 
 {
-  long loc = InputStream.tellg();
+  fileoffset loc = static_cast<fileoffset> (InputStream.tellg());
   // dicom_stream::cout << "Tell: " << loc << dicom_stream::endl;
   return loc;
 }
 
-void DICOMFile::SkipToPos(long increment) 
+void DICOMFile::SkipToPos(fileoffset increment) 
 {
   InputStream.seekg(increment, dicom_stream::ios::beg);
 }
 
-long DICOMFile::GetSize() 
+fileoffset DICOMFile::GetSize() 
 {
-  long curpos = this->Tell();
+  fileoffset curpos = this->Tell();
 
   InputStream.seekg(0,dicom_stream::ios::end);
 
-  long size = this->Tell();
+  fileoffset size = this->Tell();
   // dicom_stream::cout << "Tell says size is: " << size << dicom_stream::endl;
   this->SkipToPos(curpos);
 
   return size;
 }
 
-void DICOMFile::Skip(long increment) 
+void DICOMFile::Skip(fileoffset increment) 
 {
   InputStream.seekg(increment, dicom_stream::ios::cur);
 }
@@ -144,46 +160,25 @@ void DICOMFile::SkipToStart()
   InputStream.seekg(0, dicom_stream::ios::beg);
 }
 
-void DICOMFile::Read(void* ptr, long nbytes) 
+void DICOMFile::Read(void* ptr, fileoffset nbytes) 
 {
   InputStream.read((char*)ptr, nbytes);
   // dicom_stream::cout << (char*) ptr << dicom_stream::endl;
 }
 
-doublebyte DICOMFile::ReadDoubleByte() 
+const unsigned char* DICOMFile::ReadView(fileoffset len) 
 {
-  doublebyte sh = 0;
-  int sz = sizeof(doublebyte);
-  this->Read((char*)&(sh),sz); 
-  if (PlatformIsBigEndian) 
-    {
-    sh = swapShort(sh);
-    }
-  return(sh);
-}
-
-doublebyte DICOMFile::ReadDoubleByteAsLittleEndian() 
-{
-  doublebyte sh = 0;
-  int sz = sizeof(doublebyte);
-  this->Read((char*)&(sh),sz); 
-  if (PlatformIsBigEndian)
-    {
-    sh = swapShort(sh);
-    }
-  return(sh);
-}
-
-quadbyte DICOMFile::ReadQuadByte() 
-{
-  quadbyte sh;
-  int sz = sizeof(quadbyte);
-  this->Read((char*)&(sh),sz);
-  if (PlatformIsBigEndian) 
+  //
+  // Lend from the window if it holds the bytes.  A plain
+  // stream has no window and nothing to lend.
+  //
+  if (len < 0 || len > this->WindowEnd - this->WindowCursor)
     {
-    sh = swapLong(sh);
+    return NULL;
     }
-  return(sh);
+  const unsigned char* view = this->WindowCursor;
+  this->WindowCursor += len;
+  return view;
 }
 
 quadbyte DICOMFile::ReadNBytes(int len) 
@@ -203,7 +198,9 @@ quadbyte DICOMFile::ReadNBytes(int len)
       ret = ReadQuadByte();
       break;
     default:
+#ifdef DEBUG_DICOM
       dicom_stream::cerr << "Unable to read " << len << " bytes" << dicom_stream::endl;
+#endif
       break;
     }
   return (ret);
@@ -233,7 +230,9 @@ float DICOMFile::ReadAsciiFloat(int len)
   sscanf(val,"%e",&ret);
 #endif
 
+#ifdef DEBUG_DICOM
   dicom_stream::cout << "Read ASCII float: " << ret << dicom_stream::endl;
+#endif
 
   delete [] val;
   return (ret);
@@ -262,7 +261,9 @@ int DICOMFile::ReadAsciiInt(int len)
   sscanf(val,"%d",&ret);
 #endif
 
+#ifdef DEBUG_DICOM
   dicom_stream::cout << "Read ASCII int: " << ret << dicom_stream::endl;
+#endif
 
   delete [] val;
   return (ret);
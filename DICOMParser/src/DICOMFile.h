@@ -26,10 +26,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <string>
+#include <stdint.h>
 
 #include "DICOMTypes.h"
 #include "DICOMConfig.h"
+#include "DICOMPixelKernels.h"
 
 //
 // Abstraction of a file used by the DICOMParser.
@@ -47,55 +50,118 @@ class DICOM_EXPORT DICOMFile
   // that is true if the file is successfully
   // opened.
   //
-  bool Open(const dicom_stl::string& filename);
+  virtual bool Open(const dicom_stl::string& filename);
   
   //
   // Close a file.
   //
-  void Close();
+  virtual void Close();
   
   //
   // Return the position in the file.
   //
-  long Tell();
+  virtual fileoffset Tell();
   
   // 
   // Move to a particular position in the file.
   //
-  void SkipToPos(long);
+  virtual void SkipToPos(fileoffset);
   
   //
   // Return the size of the file.
   //
-  long GetSize();
+  virtual fileoffset GetSize();
   
   //
   // Skip a number of bytes.
   // 
-  void Skip(long);
+  virtual void Skip(fileoffset);
   
   //
   // Skip to the beginning of the file.
   //
-  void SkipToStart();
+  virtual void SkipToStart();
   
   //
   // Read data of length len.
   //
-  void Read(void* data, long len);
+  virtual void Read(void* data, fileoffset len);
+
+  //
+  // Return a read-only pointer to the next len bytes and
+  // skip past them, if the file already holds them in
+  // memory.  Returns NULL without moving otherwise.  The
+  // pointer is valid until the file is closed or, for a
+  // buffered file, until the next read.
+  //
+  virtual const unsigned char* ReadView(fileoffset len);
   
   //
-  // Read a double byte of data.
+  // Read a double byte of data.  Served inline from the
+  // window when it holds enough bytes.
   //
-  doublebyte ReadDoubleByte();
+  doublebyte ReadDoubleByte()
+    {
+    doublebyte sh = 0;
+    if (this->WindowEnd - this->WindowCursor >= 2)
+      {
+      memcpy(&sh, this->WindowCursor, sizeof(doublebyte));
+      this->WindowCursor += sizeof(doublebyte);
+      }
+    else
+      {
+      this->Read((char*)&(sh), sizeof(doublebyte));
+      }
+    if (PlatformIsBigEndian)
+      {
+      sh = swapUInt16(sh);
+      }
+    return sh;
+    }
 
-  
-  doublebyte ReadDoubleByteAsLittleEndian();
+  //
+  // Read a double byte stored little endian, whatever the
+  // byte order of the data set.  Used for the two characters
+  // of an explicit VR, which are never swapped.
+  //
+  doublebyte ReadDoubleByteAsLittleEndian()
+    {
+    unsigned char b[2] = {0, 0};
+    if (this->WindowEnd - this->WindowCursor >= 2)
+      {
+      b[0] = this->WindowCursor[0];
+      b[1] = this->WindowCursor[1];
+      this->WindowCursor += 2;
+      }
+    else
+      {
+      this->Read((char*) b, 2);
+      }
+    return doublebyte(b[0] | (b[1] << 8));
+    }
 
   //
-  // Read a quadbyte of data.
+  // Read a quadbyte of data.  Served inline from the
+  // window when it holds enough bytes.
   //
-  quadbyte   ReadQuadByte();
+  quadbyte   ReadQuadByte()
+    {
+    quadbyte sh = 0;
+    if (this->WindowEnd - this->WindowCursor >= 4)
+      {
+      memcpy(&sh, this->WindowCursor, sizeof(quadbyte));
+      this->WindowCursor += sizeof(quadbyte);
+      }
+    else
+      {
+      this->Read((char*)&(sh), sizeof(quadbyte));
+      }
+    if (PlatformIsBigEndian)
+      {
+      sh = quadbyte(swapUInt32(uint32_t(sh)));
+      }
+    return sh;
+    }
   
   //
   // Read nbytes of data up to 4 bytes.
@@ -132,8 +198,9 @@ class DICOM_EXPORT DICOMFile
   //
   static ulong ReturnAsUnsignedLong(unsigned char* data, bool )
   {
-    unsigned char* data2 = data;
-    return *((ulong*) data2);
+    uint32_t v;
+    memcpy(&v, data, sizeof(v));
+    return ulong(v);
   }
   
   //
@@ -177,20 +244,61 @@ class DICOM_EXPORT DICOMFile
     this->PlatformIsBigEndian = v;
     }
 
+  //
+  // Swap the bytes of count 16, 32 or 64 bit values.  ip and op
+  // may be the same array.  These use DICOMPixelKernels, so
+  // large arrays are swapped with SIMD where the CPU has it.
+  //
+  static void swapUInt16s(const uint16_t *ip, uint16_t *op, size_t count)
+  {
+    DICOMPixelKernels::SwapBytes16(ip, op, count);
+  }
+
+  static void swapUInt32s(const uint32_t *ip, uint32_t *op, size_t count)
+  {
+    DICOMPixelKernels::SwapBytes32(ip, op, count);
+  }
+
+  static void swapUInt64s(const uint64_t *ip, uint64_t *op, size_t count)
+  {
+    DICOMPixelKernels::SwapBytes64(ip, op, count);
+  }
+
+  //
+  // Swap the bytes of a single 16, 32 or 64 bit value.
+  //
+  static uint16_t swapUInt16(uint16_t v)
+  {
+    return uint16_t((v << 8) | (v >> 8));
+  }
+
+  static uint32_t swapUInt32(uint32_t v)
+  {
+    return (v << 24)
+      | ((v << 8) & 0x00ff0000u)
+      | ((v >> 8) & 0x0000ff00u)
+      | (v >> 24);
+  }
+
+  static uint64_t swapUInt64(uint64_t v)
+  {
+    return (uint64_t(swapUInt32(uint32_t(v))) << 32)
+      | swapUInt32(uint32_t(v >> 32));
+  }
+
   //
   // Swap the bytes in an array of unsigned shorts.
   //
   static void swapShorts(ushort *ip, ushort *op, int count)
   {
-    while (count)
-      {
-      *op++ = swapShort(*ip++);
-      count--;
-      }
+    swapUInt16s(ip, op, size_t(count));
   }
   
   //
-  // Swap the bytes in an array of unsigned longs.
+  // Swap the bytes of the 32 bit value held in each of an
+  // array of unsigned longs.  ulong is 64 bits on some
+  // platforms, so this does not suit 32 bit values read from
+  // a file; use swapUInt32s for those.
   //
   static void swapLongs(ulong *ip, ulong *op, int count)
   {
@@ -207,19 +315,15 @@ class DICOM_EXPORT DICOMFile
   //
   static ushort swapShort(ushort v)
   {
-    return ushort((v << 8)
-      | (v >> 8));
+    return swapUInt16(v);
   }
   
   // 
-  // Swap the bytes in an unsigned long.
+  // Swap the bytes of the low 32 bits of an unsigned long.
   //
   static ulong swapLong(ulong v)
     {
-    return ulong((v << 24) 
-      | (v << 8) & 0x00ff0000
-      | (v >> 8) & 0x0000ff00
-      | (v >> 24));
+    return ulong(swapUInt32(uint32_t(v)));
     }
 
  const char* GetPlatformEndian() {return this->PlatformEndian;}
@@ -236,6 +340,25 @@ class DICOM_EXPORT DICOMFile
   // FILE* Fptr;
   
   dicom_stream::ifstream InputStream;
+
+  //
+  // Bytes of the file that are already in memory, for
+  // backends that have them: [WindowStart, WindowEnd) with
+  // WindowCursor at the current position.  All three are
+  // NULL for a plain stream.
+  //
+  const unsigned char* WindowStart;
+  const unsigned char* WindowCursor;
+  const unsigned char* WindowEnd;
+
+  //
+  // Buffer InputStream reads through.  It is allocated by the
+  // first Open and handed to the stream again by every later
+  // one, so reopening doesn't allocate.
+  //
+  enum { STREAM_BUFFER_SIZE = 8192 };
+  char* StreamBuffer;
+  long StreamBufferSize;
   
   //
   // Flag for swaping bytes.
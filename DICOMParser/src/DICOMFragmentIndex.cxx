@@ -0,0 +1,191 @@
+/*=========================================================================
+
+  Program:   DICOMParser
+  Module:    $RCSfile: DICOMFragmentIndex.cxx,v $
+  Language:  C++
+  Date:      $Date: 2003/10/23 19:13:34 $
+  Version:   $Revision: 1.1.1.1 $
+
+  Copyright (c) 2003 Matt Turek
+  All rights reserved.
+  See Copyright.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifdef _MSC_VER
+#pragma warning ( disable : 4514 )
+#pragma warning ( disable : 4710 )
+#pragma warning ( push, 3 )
+#endif
+
+#include "DICOMConfig.h"
+#include "DICOMFragmentIndex.h"
+
+static size_t DICOMReadLittleEndianUInt32(const unsigned char* p)
+{
+  return static_cast<size_t> (p[0]) | (static_cast<size_t> (p[1]) << 8) |
+    (static_cast<size_t> (p[2]) << 16) | (static_cast<size_t> (p[3]) << 24);
+}
+
+DICOMFragmentIndex::DICOMFragmentIndex()
+{
+  this->Clear();
+}
+
+void DICOMFragmentIndex::Clear()
+{
+  this->OffsetTable.Data = NULL;
+  this->OffsetTable.Length = 0;
+  this->OffsetTable.Offset = 0;
+  this->Fragments.clear();
+  this->FrameStarts.clear();
+}
+
+bool DICOMFragmentIndex::Build(const unsigned char* data, size_t length, int numberOfFrames)
+{
+  this->Clear();
+  if (!this->ReadItems(data, length))
+    {
+    this->Clear();
+    return false;
+    }
+  return numberOfFrames > 0 && this->GroupFrames(static_cast<size_t> (numberOfFrames));
+}
+
+bool DICOMFragmentIndex::ReadItems(const unsigned char* data, size_t length)
+{
+  size_t pos = 0;
+  size_t firstFragment = 0;
+  bool haveOffsetTable = false;
+  while (data && pos + 8 <= length)
+    {
+    size_t group = static_cast<size_t> (data[pos]) | (static_cast<size_t> (data[pos + 1]) << 8);
+    size_t element = static_cast<size_t> (data[pos + 2]) | (static_cast<size_t> (data[pos + 3]) << 8);
+    size_t itemLength = DICOMReadLittleEndianUInt32(data + pos + 4);
+    size_t tag = pos;
+    pos += 8;
+
+    if (group != 0xFFFE)
+      {
+      return false;
+      }
+    if (element == 0xE0DD)
+      {
+      return haveOffsetTable;
+      }
+    if (element != 0xE000 || itemLength > length - pos)
+      {
+      return false;
+      }
+
+    DICOMFragmentSpan item;
+    item.Data = data + pos;
+    item.Length = itemLength;
+    item.Offset = 0;
+    if (!haveOffsetTable)
+      {
+      this->OffsetTable = item;
+      haveOffsetTable = true;
+      firstFragment = pos + itemLength;
+      }
+    else
+      {
+      item.Offset = tag - firstFragment;
+      this->Fragments.push_back(item);
+      }
+    pos += itemLength;
+    }
+
+  return false;
+}
+
+bool DICOMFragmentIndex::GroupFrames(size_t count)
+{
+  const dicom_stl::vector<DICOMFragmentSpan>& fragments = this->Fragments;
+  if (fragments.empty())
+    {
+    return false;
+    }
+
+  if (this->OffsetTable.Length == 4 * count)
+    {
+    const unsigned char* table = this->OffsetTable.Data;
+    size_t f = 0;
+    for (size_t i = 0; i < count; i++)
+      {
+      size_t start = DICOMReadLittleEndianUInt32(table + 4 * i);
+      if (f == fragments.size() || fragments[f].Offset != start)
+        {
+        this->FrameStarts.clear();
+        return false;
+        }
+      this->FrameStarts.push_back(f);
+      size_t end = i + 1 < count ? DICOMReadLittleEndianUInt32(table + 4 * i + 4) : 0;
+      do
+        {
+        f++;
+        }
+      while (f < fragments.size() && (i + 1 == count || fragments[f].Offset < end));
+      }
+    this->FrameStarts.push_back(f);
+    return true;
+    }
+
+  if (fragments.size() == count)
+    {
+    for (size_t i = 0; i <= count; i++)
+      {
+      this->FrameStarts.push_back(i);
+      }
+    return true;
+    }
+
+  if (count == 1)
+    {
+    this->FrameStarts.push_back(0);
+    this->FrameStarts.push_back(fragments.size());
+    return true;
+    }
+
+  return false;
+}
+
+size_t DICOMFragmentIndex::GetFrameLength(int i) const
+{
+  const DICOMFragmentSpan* fragment = this->GetFrameFragments(i);
+  size_t count = this->GetFrameFragmentCount(i);
+  size_t length = 0;
+  for (size_t f = 0; f < count; f++)
+    {
+    length += fragment[f].Length;
+    }
+  return length;
+}
+
+const unsigned char* DICOMFragmentIndex::GetFrameData(int i, size_t& length,
+                                                      dicom_stl::vector<unsigned char>& joined) const
+{
+  const DICOMFragmentSpan* fragment = this->GetFrameFragments(i);
+  size_t count = this->GetFrameFragmentCount(i);
+  if (count == 1)
+    {
+    length = fragment->Length;
+    return fragment->Data;
+    }
+
+  joined.clear();
+  for (size_t f = 0; f < count; f++)
+    {
+    joined.insert(joined.end(), fragment[f].Data, fragment[f].Data + fragment[f].Length);
+    }
+  length = joined.size();
+  return joined.empty() ? NULL : &joined[0];
+}
+
+#ifdef _MSC_VER
+#pragma warning ( pop )
+#endif
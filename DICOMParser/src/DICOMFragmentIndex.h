@@ -0,0 +1,151 @@
+/*=========================================================================
+
+  Program:   DICOMParser
+  Module:    $RCSfile: DICOMFragmentIndex.h,v $
+  Language:  C++
+  Date:      $Date: 2003/10/23 19:13:34 $
+  Version:   $Revision: 1.1.1.1 $
+
+  Copyright (c) 2003 Matt Turek
+  All rights reserved.
+  See Copyright.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __DICOMFRAGMENTINDEX_H_
+#define __DICOMFRAGMENTINDEX_H_
+
+#ifdef _MSC_VER
+#pragma warning ( disable : 4514 )
+#pragma warning ( disable : 4786 )
+#pragma warning ( push, 3 )
+#endif
+
+#include <stddef.h>
+#include <vector>
+
+#include "DICOMConfig.h"
+
+//
+// One item of encapsulated pixel data: its value, and where its
+// item tag is relative to the first fragment's, which is what
+// the Basic Offset Table counts from.
+//
+struct DICOMFragmentSpan
+{
+  const unsigned char* Data;
+  size_t Length;
+  size_t Offset;
+};
+
+//
+// Index of encapsulated pixel data, the form compressed transfer
+// syntaxes store pixel data in: a value of undefined length made
+// of items (FFFE,E000), the Basic Offset Table first and then the
+// fragments of the compressed frames, ended by a sequence
+// delimiter (FFFE,E0DD).  The index lists the fragments and which
+// of them make up each frame.  It copies nothing: its spans point
+// into the value it was built from, so it is only valid as long as
+// that is.  A built index is only read, so several threads may use
+// it at once, e.g. to decode frames in parallel.
+//
+class DICOM_EXPORT DICOMFragmentIndex
+{
+ public:
+  DICOMFragmentIndex();
+
+  //
+  // Index the encapsulated value of length bytes at data, whose
+  // items are little endian, holding numberOfFrames frames.  The
+  // fragments are grouped into frames by the Basic Offset Table
+  // when it has an entry per frame, one fragment per frame when
+  // there are as many, and all of them for a single frame.
+  // Returns false if the items are malformed, in which case the
+  // index is empty, or if the fragments can't be grouped into
+  // numberOfFrames frames, in which case only the fragments are
+  // listed.
+  //
+  bool Build(const unsigned char* data, size_t length, int numberOfFrames);
+
+  //
+  // Forget everything.
+  //
+  void Clear();
+
+  //
+  // The Basic Offset Table; its Length is 0 if it is empty.
+  //
+  const DICOMFragmentSpan& GetOffsetTable() const
+    {
+    return this->OffsetTable;
+    }
+
+  size_t GetNumberOfFragments() const
+    {
+    return this->Fragments.size();
+    }
+
+  const DICOMFragmentSpan& GetFragment(size_t i) const
+    {
+    return this->Fragments[i];
+    }
+
+  //
+  // Number of frames the fragments were grouped into; 0 if they
+  // couldn't be.
+  //
+  int GetNumberOfFrames() const
+    {
+    return this->FrameStarts.empty() ? 0 : static_cast<int> (this->FrameStarts.size() - 1);
+    }
+
+  //
+  // The fragments of frame i, in order: GetFrameFragmentCount(i)
+  // spans from GetFrameFragments(i) on.
+  //
+  const DICOMFragmentSpan* GetFrameFragments(int i) const
+    {
+    return &this->Fragments[this->FrameStarts[i]];
+    }
+
+  size_t GetFrameFragmentCount(int i) const
+    {
+    return this->FrameStarts[i + 1] - this->FrameStarts[i];
+    }
+
+  //
+  // Total compressed length of frame i.
+  //
+  size_t GetFrameLength(int i) const;
+
+  //
+  // The compressed bytes of frame i as one run, as decoders want
+  // them, and its length.  A frame in one fragment is returned in
+  // place; one in several is put together in joined, which must
+  // not be shared between threads.
+  //
+  const unsigned char* GetFrameData(int i, size_t& length,
+                                    dicom_stl::vector<unsigned char>& joined) const;
+
+ protected:
+  bool ReadItems(const unsigned char* data, size_t length);
+  bool GroupFrames(size_t numberOfFrames);
+
+  DICOMFragmentSpan OffsetTable;
+  dicom_stl::vector<DICOMFragmentSpan> Fragments;
+
+  //
+  // Frame i is fragments [FrameStarts[i], FrameStarts[i + 1]).
+  //
+  dicom_stl::vector<size_t> FrameStarts;
+};
+
+#ifdef _MSC_VER
+#pragma warning ( pop )
+#endif
+
+#endif // __DICOMFRAGMENTINDEX_H_
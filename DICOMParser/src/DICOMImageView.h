@@ -0,0 +1,93 @@
+/*=========================================================================
+
+  Program:   DICOMParser
+  Module:    $RCSfile: DICOMImageView.h,v $
+  Language:  C++
+  Date:      $Date: 2003/10/23 19:13:34 $
+  Version:   $Revision: 1.1.1.1 $
+
+  Copyright (c) 2003 Matt Turek
+  All rights reserved.
+  See Copyright.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __DICOMIMAGEVIEW_H_
+#define __DICOMIMAGEVIEW_H_
+
+#ifdef _MSC_VER
+#pragma warning ( disable : 4514 )
+#pragma warning ( push, 3 )
+#endif
+
+#include <stddef.h>
+
+#include "DICOMConfig.h"
+
+//
+// Typed, non-owning view of decoded image data: a pointer to
+// the first value and the number of values.  An empty view has
+// no data and a size of 0.  The view is only as long lived as
+// the storage it points to; see DICOMAppHelper::GetImageView.
+//
+template <class T>
+class DICOMImageView
+{
+ public:
+  typedef T ValueType;
+
+  DICOMImageView() : Data(NULL), Size(0) {}
+  DICOMImageView(T* data, size_t size) : Data(data), Size(size) {}
+
+  T* GetData() const
+    {
+    return this->Data;
+    }
+
+  //
+  // Number of values, not bytes.
+  //
+  size_t GetSize() const
+    {
+    return this->Size;
+    }
+
+  size_t GetSizeInBytes() const
+    {
+    return this->Size * sizeof(T);
+    }
+
+  bool IsEmpty() const
+    {
+    return this->Size == 0;
+    }
+
+  T& operator[](size_t i) const
+    {
+    return this->Data[i];
+    }
+
+  T* begin() const
+    {
+    return this->Data;
+    }
+
+  T* end() const
+    {
+    return this->Data + this->Size;
+    }
+
+ private:
+  T* Data;
+  size_t Size;
+};
+
+#ifdef _MSC_VER
+#pragma warning ( pop )
+#endif
+
+#endif // __DICOMIMAGEVIEW_H_
@@ -0,0 +1,397 @@
+/*=========================================================================
+
+  Program:   DICOMParser
+  Module:    $RCSfile: DICOMInflateFile.cxx,v $
+  Language:  C++
+  Date:      $Date: 2003/10/23 19:13:34 $
+  Version:   $Revision: 1.1.1.1 $
+
+  Copyright (c) 2003 Matt Turek
+  All rights reserved.
+  See Copyright.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifdef _MSC_VER
+#pragma warning ( disable : 4514 )
+#pragma warning ( disable : 4710 )
+#pragma warning ( push, 3 )
+#endif
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+#include "DICOMConfig.h"
+#include "DICOMInflateFile.h"
+
+#ifdef DICOM_USE_ZLIB
+#include <zlib.h>
+
+struct DICOMInflateStream
+{
+  z_stream Z;
+};
+#else
+struct DICOMInflateStream
+{
+  int Unused;
+};
+#endif
+
+DICOMInflateFile::DICOMInflateFile() : DICOMFile()
+{
+  this->Stream = NULL;
+  this->Source = NULL;
+  this->StartOffset = -1;
+  this->SourceOffset = 0;
+  this->SourceSize = 0;
+  this->Buffer = NULL;
+  this->Input = NULL;
+  this->WindowOffset = 0;
+  this->StreamOffset = 0;
+  this->StreamEnded = true;
+}
+
+DICOMInflateFile::~DICOMInflateFile()
+{
+  this->Close();
+#ifdef DICOM_USE_ZLIB
+  if (this->Stream)
+    {
+    inflateEnd(&this->Stream->Z);
+    }
+#endif
+  delete this->Stream;
+  delete [] this->Buffer;
+  delete [] this->Input;
+}
+
+bool DICOMInflateFile::IsAvailable()
+{
+#ifdef DICOM_USE_ZLIB
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool DICOMInflateFile::Start(DICOMFile* file, fileoffset start)
+{
+  this->Close();
+
+  if (!IsAvailable() || !file || start < 0)
+    {
+    return false;
+    }
+
+#ifdef DICOM_USE_ZLIB
+  if (!this->Stream)
+    {
+    this->Stream = new DICOMInflateStream;
+    memset(&this->Stream->Z, 0, sizeof(z_stream));
+    if (inflateInit2(&this->Stream->Z, -MAX_WBITS) != Z_OK)
+      {
+      delete this->Stream;
+      this->Stream = NULL;
+      return false;
+      }
+    }
+#endif
+
+  if (!this->Buffer)
+    {
+    this->Buffer = new unsigned char[WINDOW_SIZE];
+    this->Input = new unsigned char[INPUT_SIZE];
+    }
+
+  this->Source = file;
+  this->StartOffset = start;
+  this->SourceSize = file->GetSize();
+  this->Restart();
+  return true;
+}
+
+bool DICOMInflateFile::Open(const dicom_stl::string&)
+{
+  return false;
+}
+
+void DICOMInflateFile::Close()
+{
+  DICOMFile::Close();
+  this->Source = NULL;
+  this->StartOffset = -1;
+  this->StreamEnded = true;
+  this->WindowOffset = 0;
+  this->StreamOffset = 0;
+  this->WindowStart = NULL;
+  this->WindowCursor = NULL;
+  this->WindowEnd = NULL;
+}
+
+void DICOMInflateFile::Restart()
+{
+  this->Source->SkipToPos(this->StartOffset);
+  this->SourceOffset = this->StartOffset;
+  this->StreamEnded = false;
+  this->WindowOffset = this->StartOffset;
+  this->StreamOffset = this->StartOffset;
+  this->WindowStart = this->Buffer;
+  this->WindowCursor = this->Buffer;
+  this->WindowEnd = this->Buffer;
+
+#ifdef DICOM_USE_ZLIB
+  //
+  // The standard asks for a bare deflate stream, but some
+  // writers put a zlib header in front of it.  Take either.
+  //
+  int windowBits = -MAX_WBITS;
+  if (this->SourceSize - this->StartOffset >= 2)
+    {
+    unsigned char header[2];
+    this->Source->Read(header, 2);
+    this->Source->SkipToPos(this->StartOffset);
+    if ((header[0] & 0x0F) == Z_DEFLATED && (header[0] * 256 + header[1]) % 31 == 0)
+      {
+      windowBits = MAX_WBITS;
+      }
+    }
+
+  z_stream& z = this->Stream->Z;
+  z.next_in = NULL;
+  z.avail_in = 0;
+  if (inflateReset2(&z, windowBits) != Z_OK)
+    {
+    this->StreamEnded = true;
+    }
+#else
+  this->StreamEnded = true;
+#endif
+}
+
+size_t DICOMInflateFile::Inflate(unsigned char* out, size_t len)
+{
+  size_t done = 0;
+
+#ifdef DICOM_USE_ZLIB
+  z_stream& z = this->Stream->Z;
+  while (done < len && !this->StreamEnded)
+    {
+    if (z.avail_in == 0)
+      {
+      fileoffset left = this->SourceSize - this->SourceOffset;
+      if (left <= 0)
+        {
+        //
+        // The file ended before the stream did.
+        //
+        this->StreamEnded = true;
+        break;
+        }
+
+      //
+      // Take the compressed bytes straight from the file's
+      // memory where it has them.  zlib is done with them
+      // before the file is read again.
+      //
+      uInt count = left < INPUT_SIZE ? static_cast<uInt> (left) : static_cast<uInt> (INPUT_SIZE);
+      const unsigned char* view = this->Source->ReadView(count);
+      if (!view)
+        {
+        this->Source->Read(this->Input, count);
+        view = this->Input;
+        }
+      this->SourceOffset += count;
+      z.next_in = const_cast<Bytef*> (view);
+      z.avail_in = count;
+      }
+
+    size_t chunk = len - done;
+    if (chunk > UINT_MAX)
+      {
+      chunk = UINT_MAX;
+      }
+    z.next_out = out + done;
+    z.avail_out = static_cast<uInt> (chunk);
+    int status = inflate(&z, Z_NO_FLUSH);
+    done += chunk - z.avail_out;
+
+    if (status != Z_OK)
+      {
+      //
+      // The end of the stream, or a corrupt one; either way
+      // there is nothing more to inflate.
+      //
+      this->StreamEnded = true;
+      }
+    }
+#else
+  (void) out;
+  (void) len;
+  this->StreamEnded = true;
+#endif
+
+  this->StreamOffset += static_cast<fileoffset> (done);
+  return done;
+}
+
+void DICOMInflateFile::FillWindow(size_t need)
+{
+  size_t unread = static_cast<size_t> (this->WindowEnd - this->WindowCursor);
+  if (unread >= need || this->StreamEnded)
+    {
+    return;
+    }
+
+  //
+  // Keep the unread bytes and a little of what was read
+  // before them, and inflate behind those.
+  //
+  size_t behind = static_cast<size_t> (this->WindowCursor - this->WindowStart);
+  size_t keep = behind < HISTORY_SIZE ? behind : static_cast<size_t> (HISTORY_SIZE);
+  const unsigned char* first = this->WindowCursor - keep;
+  memmove(this->Buffer, first, keep + unread);
+
+  this->WindowOffset += static_cast<fileoffset> (first - this->WindowStart);
+  this->WindowStart = this->Buffer;
+  this->WindowCursor = this->Buffer + keep;
+  unsigned char* end = this->Buffer + keep + unread;
+  end += this->Inflate(end, WINDOW_SIZE - (keep + unread));
+  this->WindowEnd = end;
+}
+
+fileoffset DICOMInflateFile::Tell()
+{
+  return this->WindowOffset + static_cast<fileoffset> (this->WindowCursor - this->WindowStart);
+}
+
+void DICOMInflateFile::SkipToPos(fileoffset pos)
+{
+  if (!this->Source)
+    {
+    return;
+    }
+  if (pos < this->StartOffset)
+    {
+    pos = this->StartOffset;
+    }
+  if (pos < this->WindowOffset)
+    {
+    this->Restart();
+    }
+
+  for (;;)
+    {
+    if (pos <= this->StreamOffset)
+      {
+      this->WindowCursor = this->WindowStart + (pos - this->WindowOffset);
+      return;
+      }
+    this->WindowCursor = this->WindowEnd;
+    if (this->StreamEnded)
+      {
+      return;
+      }
+    this->FillWindow(1);
+    }
+}
+
+fileoffset DICOMInflateFile::GetSize()
+{
+  if (!this->Source)
+    {
+    return 0;
+    }
+
+  //
+  // At the end of the window, inflate on to see whether the
+  // stream has more.
+  //
+  if (this->WindowCursor == this->WindowEnd)
+    {
+    this->FillWindow(1);
+    }
+  return this->StreamEnded ? this->StreamOffset : INT64_MAX;
+}
+
+void DICOMInflateFile::Skip(fileoffset increment)
+{
+  this->SkipToPos(this->Tell() + increment);
+}
+
+void DICOMInflateFile::SkipToStart()
+{
+  this->SkipToPos(this->StartOffset);
+}
+
+void DICOMInflateFile::Read(void* ptr, fileoffset nbytes)
+{
+  if (nbytes <= 0 || !this->Source)
+    {
+    return;
+    }
+
+  unsigned char* out = static_cast<unsigned char*> (ptr);
+  size_t left = static_cast<size_t> (nbytes);
+
+  size_t avail = static_cast<size_t> (this->WindowEnd - this->WindowCursor);
+  size_t count = left < avail ? left : avail;
+  memcpy(out, this->WindowCursor, count);
+  this->WindowCursor += count;
+  out += count;
+  left -= count;
+
+  if (left == 0)
+    {
+    return;
+    }
+
+  if (left > WINDOW_SIZE - HISTORY_SIZE)
+    {
+    //
+    // Big reads (pixel data) are inflated straight to the
+    // caller, leaving the window empty behind them.
+    //
+    count = this->Inflate(out, left);
+    this->WindowOffset = this->StreamOffset;
+    this->WindowStart = this->Buffer;
+    this->WindowCursor = this->Buffer;
+    this->WindowEnd = this->Buffer;
+    }
+  else
+    {
+    this->FillWindow(left);
+    avail = static_cast<size_t> (this->WindowEnd - this->WindowCursor);
+    count = left < avail ? left : avail;
+    memcpy(out, this->WindowCursor, count);
+    this->WindowCursor += count;
+    }
+
+  if (count < left)
+    {
+    memset(out + count, 0, left - count);
+    }
+}
+
+const unsigned char* DICOMInflateFile::ReadView(fileoffset len)
+{
+  if (len < 0 || len > WINDOW_SIZE - HISTORY_SIZE || !this->Source)
+    {
+    return NULL;
+    }
+  if (len > this->WindowEnd - this->WindowCursor)
+    {
+    this->FillWindow(static_cast<size_t> (len));
+    }
+  return DICOMFile::ReadView(len);
+}
+
+#ifdef _MSC_VER
+#pragma warning ( pop )
+#endif
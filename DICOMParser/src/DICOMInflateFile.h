@@ -0,0 +1,190 @@
+/*=========================================================================
+
+  Program:   DICOMParser
+  Module:    $RCSfile: DICOMInflateFile.h,v $
+  Language:  C++
+  Date:      $Date: 2003/10/23 19:13:34 $
+  Version:   $Revision: 1.1.1.1 $
+
+  Copyright (c) 2003 Matt Turek
+  All rights reserved.
+  See Copyright.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __DICOMINFLATEFILE_H_
+#define __DICOMINFLATEFILE_H_
+
+#ifdef _MSC_VER
+#pragma warning ( disable : 4514 )
+#pragma warning ( push, 3 )
+#endif
+
+#include <string>
+
+#include "DICOMConfig.h"
+#include "DICOMFile.h"
+
+struct DICOMInflateStream;
+
+//
+// DICOMFile that reads a data set stored with the Deflated
+// Explicit VR Little Endian transfer syntax
+// (1.2.840.10008.1.2.1.99) by inflating it from another,
+// already open, DICOMFile as it is read.  Only a window of
+// inflated bytes is kept in memory, never the whole data set.
+//
+// Positions are those the data set would have if it were
+// stored uncompressed after the file meta information: the
+// first inflated byte is at the offset where the compressed
+// stream starts.  Skipping forward inflates and drops the
+// bytes skipped; moving back further than the window holds
+// starts inflating again from the beginning.  The size is
+// only known once the stream has ended; until then GetSize
+// returns the largest offset there is.
+//
+// Inflating needs zlib.  Without it (DICOM_USE_ZLIB not set)
+// Start always fails.
+//
+class DICOM_EXPORT DICOMInflateFile : public DICOMFile
+{
+ public:
+  //
+  // Size of the window in bytes, of the part of it kept
+  // behind the cursor when it is refilled, so that short
+  // steps back stay in memory, and of the reads from the
+  // compressed file.
+  //
+  enum { WINDOW_SIZE = 65536, HISTORY_SIZE = 4096, INPUT_SIZE = 16384 };
+
+  DICOMInflateFile();
+  virtual ~DICOMInflateFile();
+
+  //
+  // True if this build can inflate.
+  //
+  static bool IsAvailable();
+
+  //
+  // Start inflating the stream at offset start in file.  The
+  // file stays owned by the caller and must stay open until
+  // this is closed.  Returns false if zlib is unavailable or
+  // can't be set up.
+  //
+  bool Start(DICOMFile* file, fileoffset start);
+
+  //
+  // The compressed file and where the stream starts in it;
+  // NULL and -1 when nothing is being inflated.
+  //
+  DICOMFile* GetSourceFile()
+    {
+    return this->Source;
+    }
+
+  fileoffset GetStartOffset()
+    {
+    return this->StartOffset;
+    }
+
+  //
+  // An inflated stream can't be opened by name; always
+  // returns false.  Use Start.
+  //
+  virtual bool Open(const dicom_stl::string& filename);
+
+  //
+  // Stop inflating.  The compressed file is left open.
+  //
+  virtual void Close();
+
+  virtual fileoffset Tell();
+
+  //
+  // Move to a position in the inflated data set.  The
+  // position is clamped to the data set.
+  //
+  virtual void SkipToPos(fileoffset);
+
+  virtual fileoffset GetSize();
+  virtual void Skip(fileoffset);
+
+  //
+  // Go to the start of the inflated data set.
+  //
+  virtual void SkipToStart();
+
+  //
+  // Read data of length len.  Reads larger than the window
+  // are inflated straight into data.  Bytes past the end of
+  // the stream, or past a corrupt part of it, are set to
+  // zero.
+  //
+  virtual void Read(void* data, fileoffset len);
+
+  //
+  // Return a pointer to the next len bytes, inflating more
+  // into the window first if needed.  Returns NULL for values
+  // that don't fit in the window.  The pointer is valid until
+  // the next read.
+  //
+  virtual const unsigned char* ReadView(fileoffset len);
+
+ protected:
+  //
+  // Inflate up to len bytes to out.  Returns the number of
+  // bytes inflated, which is less than len only at the end
+  // of the stream.
+  //
+  size_t Inflate(unsigned char* out, size_t len);
+
+  //
+  // Inflate into the window until it holds at least need
+  // bytes from the cursor on, or the stream ends.
+  //
+  void FillWindow(size_t need);
+
+  //
+  // Go back to the start of the stream.
+  //
+  void Restart();
+
+  DICOMInflateStream* Stream;
+  DICOMFile* Source;
+  fileoffset StartOffset;
+
+  //
+  // Bytes of the compressed file not yet handed to zlib.
+  //
+  fileoffset SourceOffset;
+  fileoffset SourceSize;
+
+  unsigned char* Buffer;
+  unsigned char* Input;
+
+  //
+  // Position of WindowStart, and of the next byte to be
+  // inflated, which is always at WindowEnd.
+  //
+  fileoffset WindowOffset;
+  fileoffset StreamOffset;
+
+  //
+  // True once the stream has ended, or turned out corrupt.
+  //
+  bool StreamEnded;
+
+ private:
+  DICOMInflateFile(const DICOMInflateFile&);
+  void operator=(const DICOMInflateFile&);
+};
+
+#ifdef _MSC_VER
+#pragma warning ( pop )
+#endif
+
+#endif // __DICOMINFLATEFILE_H_
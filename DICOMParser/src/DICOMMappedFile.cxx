@@ -0,0 +1,216 @@
+/*=========================================================================
+
+  Program:   DICOMParser
+  Module:    $RCSfile: DICOMMappedFile.cxx,v $
+  Language:  C++
+  Date:      $Date: 2003/10/23 19:13:34 $
+  Version:   $Revision: 1.1.1.1 $
+
+  Copyright (c) 2003 Matt Turek
+  All rights reserved.
+  See Copyright.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifdef _MSC_VER
+#pragma warning ( disable : 4514 )
+#pragma warning ( disable : 4710 )
+#pragma warning ( push, 3 )
+#endif
+
+#include <string.h>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "DICOMConfig.h"
+#include "DICOMMappedFile.h"
+
+DICOMMappedFile::DICOMMappedFile() : DICOMFile()
+{
+  this->Data = NULL;
+  this->Size = 0;
+}
+
+DICOMMappedFile::~DICOMMappedFile()
+{
+  this->Close();
+}
+
+bool DICOMMappedFile::Open(const dicom_stl::string& filename)
+{
+  this->Close();
+
+#ifdef _WIN32
+  HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    {
+    return false;
+    }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size))
+    {
+    CloseHandle(file);
+    return false;
+    }
+
+  if (size.QuadPart > 0)
+    {
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+      {
+      CloseHandle(file);
+      return false;
+      }
+    //
+    // The view keeps the mapping and the file open, so both
+    // handles can be released right away.
+    //
+    this->Data = static_cast<unsigned char*> (MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    CloseHandle(mapping);
+    if (this->Data == NULL)
+      {
+      CloseHandle(file);
+      return false;
+      }
+    }
+  CloseHandle(file);
+  this->Size = static_cast<fileoffset> (size.QuadPart);
+#else
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    {
+    return false;
+    }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+    {
+    close(fd);
+    return false;
+    }
+
+  //
+  // A file larger than the address space can't be mapped.
+  //
+  if (static_cast<uint64_t> (st.st_size) > static_cast<uint64_t> (SIZE_MAX))
+    {
+    close(fd);
+    return false;
+    }
+
+  if (st.st_size > 0)
+    {
+    void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+      {
+      close(fd);
+      return false;
+      }
+    this->Data = static_cast<unsigned char*> (addr);
+    }
+  //
+  // The mapping stays valid after the descriptor is closed.
+  //
+  close(fd);
+  this->Size = static_cast<fileoffset> (st.st_size);
+#endif
+
+  this->WindowStart = this->Data;
+  this->WindowCursor = this->Data;
+  this->WindowEnd = this->Data + this->Size;
+  return true;
+}
+
+void DICOMMappedFile::Close()
+{
+  if (this->Data)
+    {
+#ifdef _WIN32
+    UnmapViewOfFile(this->Data);
+#else
+    munmap(this->Data, this->Size);
+#endif
+    }
+  this->Data = NULL;
+  this->Size = 0;
+  this->WindowStart = NULL;
+  this->WindowCursor = NULL;
+  this->WindowEnd = NULL;
+}
+
+fileoffset DICOMMappedFile::Tell()
+{
+  return static_cast<fileoffset> (this->WindowCursor - this->WindowStart);
+}
+
+void DICOMMappedFile::SkipToPos(fileoffset pos)
+{
+  if (pos < 0)
+    {
+    pos = 0;
+    }
+  else if (pos > this->Size)
+    {
+    pos = this->Size;
+    }
+  this->WindowCursor = this->WindowStart + pos;
+}
+
+fileoffset DICOMMappedFile::GetSize()
+{
+  return this->Size;
+}
+
+void DICOMMappedFile::Skip(fileoffset increment)
+{
+  this->SkipToPos(this->Tell() + increment);
+}
+
+void DICOMMappedFile::SkipToStart()
+{
+  this->WindowCursor = this->WindowStart;
+}
+
+void DICOMMappedFile::Read(void* ptr, fileoffset nbytes)
+{
+  if (nbytes <= 0)
+    {
+    return;
+    }
+
+  fileoffset avail = static_cast<fileoffset> (this->WindowEnd - this->WindowCursor);
+  fileoffset count = nbytes < avail ? nbytes : avail;
+  if (count > 0)
+    {
+    memcpy(ptr, this->WindowCursor, count);
+    this->WindowCursor += count;
+    }
+  if (count < nbytes)
+    {
+    memset(static_cast<char*> (ptr) + count, 0, nbytes - count);
+    }
+}
+
+#ifdef _MSC_VER
+#pragma warning ( pop )
+#endif
@@ -0,0 +1,107 @@
+/*=========================================================================
+
+  Program:   DICOMParser
+  Module:    $RCSfile: DICOMMappedFile.h,v $
+  Language:  C++
+  Date:      $Date: 2003/10/23 19:13:34 $
+  Version:   $Revision: 1.1.1.1 $
+
+  Copyright (c) 2003 Matt Turek
+  All rights reserved.
+  See Copyright.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __DICOMMAPPEDFILE_H_
+#define __DICOMMAPPEDFILE_H_
+
+#ifdef _MSC_VER
+#pragma warning ( disable : 4514 )
+#pragma warning ( push, 3 )
+#endif
+
+#include <string>
+
+#include "DICOMConfig.h"
+#include "DICOMFile.h"
+
+//
+// DICOMFile that maps the whole file read-only into memory
+// instead of going through a stream.  Reads and skips are
+// served straight from the mapped region, so the many small
+// reads done while parsing a header are plain memory loads,
+// and processes reading the same files share the page cache.
+//
+class DICOM_EXPORT DICOMMappedFile : public DICOMFile
+{
+ public:
+  DICOMMappedFile();
+  virtual ~DICOMMappedFile();
+
+  //
+  // Map a file with filename.  Returns a bool
+  // that is true if the file is successfully
+  // mapped.
+  //
+  virtual bool Open(const dicom_stl::string& filename);
+
+  //
+  // Unmap the file.
+  //
+  virtual void Close();
+
+  //
+  // Return the position in the file.
+  //
+  virtual fileoffset Tell();
+
+  //
+  // Move to a particular position in the file.
+  // The position is clamped to the mapped region.
+  //
+  virtual void SkipToPos(fileoffset);
+
+  //
+  // Return the size of the file.
+  //
+  virtual fileoffset GetSize();
+
+  //
+  // Skip a number of bytes.  The position is
+  // clamped to the mapped region.
+  //
+  virtual void Skip(fileoffset);
+
+  //
+  // Skip to the beginning of the file.
+  //
+  virtual void SkipToStart();
+
+  //
+  // Read data of length len.  Bytes requested past
+  // the end of the file are set to zero.
+  //
+  virtual void Read(void* data, fileoffset len);
+
+ protected:
+  //
+  // Start and size of the mapped region.  The window covers
+  // the whole mapping, so ReadView lends straight from it.
+  //
+  unsigned char* Data;
+  fileoffset Size;
+
+ private:
+  DICOMMappedFile(const DICOMMappedFile&);
+  void operator=(const DICOMMappedFile&);
+};
+
+#ifdef _MSC_VER
+#pragma warning ( pop )
+#endif
+
+#endif // __DICOMMAPPEDFILE_H_
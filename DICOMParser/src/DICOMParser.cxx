@@ -41,7 +41,12 @@
 
 #include "DICOMConfig.h"
 #include "DICOMParser.h"
+#include "DICOMArena.h"
 #include "DICOMCallback.h"
+#include "DICOMFragmentIndex.h"
+#include "DICOMMappedFile.h"
+#include "DICOMBufferedFile.h"
+#include "DICOMInflateFile.h"
 
 
 // Define DEBUG_DICOM to get debug messages sent to dicom_stream::cerr
@@ -61,7 +66,7 @@ static const int   OPTIONAL_SKIP = 128;
 class DICOMParserImplementation 
 {
 public:
-  DICOMParserImplementation() : Groups(), Elements(), Datatypes(), Map(), TypeMap()
+  DICOMParserImplementation() : Groups(), Elements(), Datatypes(), Map(), MapCursor(0), TypeMap(), ScratchValue(), DefaultArena(), InflateFile()
   {
 
   };
@@ -70,11 +75,17 @@ public:
   dicom_stl::vector<doublebyte> Elements;
   dicom_stl::vector<DICOMParser::VRTypes> Datatypes;
   //
-  // Stores a map from pair<group, element> keys to
-  // values of pair<vector<DICOMCallback*>, datatype>
+  // Stores the callbacks and datatype registered for
+  // each (group, element).
   //
   DICOMParserMap Map;
 
+  //
+  // Where the last lookup in Map ended while reading
+  // records in order.
+  //
+  size_t MapCursor;
+
   //
   // Stores a map from pair<group, element> keys to
   // values of datatype.  We use this to store the 
@@ -83,13 +94,41 @@ public:
   //
   DICOMImplicitTypeMap TypeMap;
 
+  //
+  // Reused storage for values handed to callbacks when
+  // ZeroCopyValues is on and the value can't be borrowed
+  // from the file directly.
+  //
+  dicom_stl::vector<unsigned char> ScratchValue;
+
+  //
+  // Arena used unless the caller supplies one.
+  //
+  DICOMArena DefaultArena;
+
+  //
+  // Layered over the open file while a deflated data set is
+  // read.
+  //
+  DICOMInflateFile InflateFile;
+
 };
 
 DICOMParser::DICOMParser() : ParserOutputFile()
 {
   this->Implementation = new DICOMParserImplementation();
   this->DataFile = NULL;
+  this->DataFileMode = ACCESS_STREAM;
+  this->FileAccessMode = ACCESS_STREAM;
+  this->ZeroCopyValues = false;
+  this->DeferPixelDataSwap = false;
+  this->PixelDataNeedsSwap = false;
+  this->PixelDataEncapsulated = false;
+  this->Arena = &this->Implementation->DefaultArena;
   this->ToggleByteSwapImageData = false;
+  this->DataSetByteSwapPending = false;
+  this->DataSetInflatePending = false;
+  this->MetaInformationEnd = -1;
   this->TransferSyntaxCB = new DICOMMemberCallback<DICOMParser>;
   this->InitTypeMap();
   this->FileName = "";
@@ -101,15 +140,62 @@ DICOMParser::GetFileName()
   return this->FileName;
 }
 
+void DICOMParser::SetArena(DICOMArena* arena)
+{
+  this->Arena = arena ? arena : &this->Implementation->DefaultArena;
+}
+
 bool DICOMParser::OpenFile(const dicom_stl::string& filename)
 {
-  if (this->DataFile)
+  //
+  // The values copied for the previous file are no longer
+  // needed.
+  //
+  this->Arena->Reset();
+  this->EndInflate();
+
+  if (this->DataFile && this->DataFileMode != this->FileAccessMode)
     {
     // Deleting the DataFile closes the file
     delete this->DataFile;
+    this->DataFile = NULL;
+    }
+
+  if (this->DataFile)
+    {
+    //
+    // Reuse the file object, and with it any buffer it has.
+    // A callback may have toggled its byte order for the last
+    // file, so put back the platform's.
+    //
+    this->DataFile->Close();
+    this->DataFile->SetPlatformIsBigEndian(strcmp(this->DataFile->GetPlatformEndian(), "BigEndian") == 0);
     }
-  this->DataFile = new DICOMFile();
+  else if (this->FileAccessMode == ACCESS_MAPPED)
+    {
+    this->DataFile = new DICOMMappedFile();
+    }
+  else if (this->FileAccessMode == ACCESS_BUFFERED)
+    {
+    this->DataFile = new DICOMBufferedFile();
+    }
+  else
+    {
+    this->DataFile = new DICOMFile();
+    }
+  this->DataFileMode = this->FileAccessMode;
+
   bool val = this->DataFile->Open(filename);
+  if (!val && this->DataFileMode == ACCESS_MAPPED)
+    {
+    //
+    // Fall back to a stream if the file can't be mapped.
+    //
+    delete this->DataFile;
+    this->DataFile = new DICOMFile();
+    this->DataFileMode = ACCESS_STREAM;
+    val = this->DataFile->Open(filename);
+    }
 
   if (val)
     {
@@ -134,12 +220,50 @@ bool DICOMParser::OpenFile(const dicom_stl::string& filename)
   return val;
 }
 
+DICOMFile* DICOMParser::DetachFile()
+{
+  this->EndInflate();
+  DICOMFile* file = this->DataFile;
+  this->DataFile = NULL;
+  return file;
+}
+
+void DICOMParser::AttachFile(DICOMFile* file, const dicom_stl::string& filename)
+{
+  this->EndInflate();
+  if (this->DataFile && this->DataFile != file)
+    {
+    delete this->DataFile;
+    }
+  this->DataFile = file;
+  this->FileName = filename;
+  this->Arena->Reset();
+
+  //
+  // Work out what kind of file it is so OpenFile knows
+  // whether it can reuse it.
+  //
+  if (dynamic_cast<DICOMMappedFile*> (file))
+    {
+    this->DataFileMode = ACCESS_MAPPED;
+    }
+  else if (dynamic_cast<DICOMBufferedFile*> (file))
+    {
+    this->DataFileMode = ACCESS_BUFFERED;
+    }
+  else
+    {
+    this->DataFileMode = ACCESS_STREAM;
+    }
+}
+
 DICOMParser::~DICOMParser() {
   //
   // Delete the callbacks.
   //
   this->ClearAllDICOMTagCallbacks();
 
+  this->EndInflate();
   if (this->DataFile)
     {
     delete this->DataFile;
@@ -156,40 +280,201 @@ DICOMParser::~DICOMParser() {
 }
 
 bool DICOMParser::ReadHeader() {
+  return this->ReadRecords(false, 0, 0);
+}
+
+bool DICOMParser::ReadHeaderOnly(doublebyte stopGroup, doublebyte stopElement)
+{
+  return this->ReadRecords(true, stopGroup, stopElement);
+}
+
+bool DICOMParser::ReadRecords(bool stopAtElement, doublebyte stopGroup, doublebyte stopElement)
+{
+  this->StopElementLocation = ElementLocation();
+
+  this->EndInflate();
   bool dicom = this->IsDICOMFile(this->DataFile);
   if (!dicom)
     {
     return false;
     }
 
+  //
+  // Register the transfer syntax callback once; it used to be
+  // added again for every file, so each file ran it once per
+  // file parsed before it.
+  //
   this->TransferSyntaxCB->SetCallbackFunction(this, &DICOMParser::TransferSyntaxCallback);
-  this->AddDICOMTagCallback(0x0002, 0x0010, DICOMParser::VR_UI, this->TransferSyntaxCB);
+  if (!this->Implementation->Map.HasCallback(DICOMMakeMapTag(0x0002, 0x0010), this->TransferSyntaxCB))
+    {
+    this->AddDICOMTagCallback(0x0002, 0x0010, DICOMParser::VR_UI, this->TransferSyntaxCB);
+    }
+  this->Implementation->MapCursor = 0;
 
   this->ToggleByteSwapImageData = false;
+  this->DataSetByteSwapPending = false;
+  this->DataSetInflatePending = false;
+  this->MetaInformationEnd = -1;
+  this->PixelDataEncapsulated = false;
 
   doublebyte group = 0;
   doublebyte element = 0;
   DICOMParser::VRTypes datatype = DICOMParser::VR_UNKNOWN;
+  valuelength length = 0;
 
   this->Implementation->Groups.clear();
   this->Implementation->Elements.clear();
   this->Implementation->Datatypes.clear();
 
-  long fileSize = DataFile->GetSize();
+  fileoffset fileSize = DataFile->GetSize();
   do 
     {
-    this->ReadNextRecord(group, element, datatype);
+    this->ReadNextRecordHeader(group, element, datatype, length);
 
     this->Implementation->Groups.push_back(group);
     this->Implementation->Elements.push_back(element);
     this->Implementation->Datatypes.push_back(datatype);
 
+    if (stopAtElement && group == stopGroup && element == stopElement)
+      {
+      //
+      // Leave the file at the start of the value and remember
+      // everything needed to read it later.
+      //
+      ElementLocation& loc = this->StopElementLocation;
+      loc.Group = group;
+      loc.Element = element;
+      loc.Type = datatype;
+      loc.Offset = DataFile->Tell();
+      loc.Length = length;
+      loc.ToggleByteSwapImageData = this->ToggleByteSwapImageData;
+      loc.FileByteSwap = DataFile->GetPlatformIsBigEndian();
+      loc.Encapsulated = this->PixelDataEncapsulated;
+      loc.DeflateOffset = this->DataFile == &this->Implementation->InflateFile ?
+        this->Implementation->InflateFile.GetStartOffset() : -1;
+      this->PixelDataEncapsulated = false;
+      break;
+      }
+
+    this->ReadRecordValue(group, element, datatype, length);
+
+    //
+    // An inflated data set's size is only known once its end
+    // has been inflated.
+    //
+    if (this->DataFile == &this->Implementation->InflateFile)
+      {
+      fileSize = DataFile->GetSize();
+      }
+
     } while ((DataFile->Tell() >= 0) && (DataFile->Tell() < fileSize));
 
 
   return true;
 }
 
+bool DICOMParser::ReadElement(const ElementLocation& loc)
+{
+  if (!this->DataFile || loc.Offset < 0)
+    {
+    return false;
+    }
+
+  if (loc.DeflateOffset >= 0)
+    {
+    if (!this->BeginInflate(loc.DeflateOffset))
+      {
+      return false;
+      }
+    }
+  else
+    {
+    this->EndInflate();
+    }
+
+  this->ToggleByteSwapImageData = loc.ToggleByteSwapImageData;
+  this->PixelDataEncapsulated = loc.Encapsulated;
+  this->DataFile->SetPlatformIsBigEndian(loc.FileByteSwap);
+  this->DataFile->SkipToPos(loc.Offset);
+  this->Implementation->MapCursor = 0;
+  this->ReadRecordValue(loc.Group, loc.Element, loc.Type, loc.Length);
+  return true;
+}
+
+bool DICOMParser::ReadElement(const ElementLocation& loc, fileoffset offset, valuelength length)
+{
+  if (!this->DataFile || loc.Offset < 0 || offset < 0 || length < 0 || loc.Encapsulated)
+    {
+    return false;
+    }
+
+  //
+  // An undefined length gives no bound to check against.
+  //
+  if (loc.Length != -1 && offset + length > loc.Length)
+    {
+    return false;
+    }
+
+  if (loc.DeflateOffset >= 0)
+    {
+    if (!this->BeginInflate(loc.DeflateOffset))
+      {
+      return false;
+      }
+    }
+  else
+    {
+    this->EndInflate();
+    }
+
+  this->ToggleByteSwapImageData = loc.ToggleByteSwapImageData;
+  this->DataFile->SetPlatformIsBigEndian(loc.FileByteSwap);
+  this->DataFile->SkipToPos(loc.Offset + offset);
+  this->Implementation->MapCursor = 0;
+  this->ReadRecordValue(loc.Group, loc.Element, loc.Type, length);
+  return true;
+}
+
+bool DICOMParser::ReadFragmentIndex(const ElementLocation& loc, int numberOfFrames, DICOMFragmentIndex& index)
+{
+  index.Clear();
+  if (!this->DataFile || loc.Offset < 0 || !loc.Encapsulated || loc.Length <= 0)
+    {
+    return false;
+    }
+
+  if (loc.DeflateOffset >= 0)
+    {
+    if (!this->BeginInflate(loc.DeflateOffset))
+      {
+      return false;
+      }
+    }
+  else
+    {
+    this->EndInflate();
+    }
+  this->DataFile->SkipToPos(loc.Offset);
+
+  //
+  // Only a mapping lends bytes that outlive the next read.
+  //
+  const unsigned char* data = NULL;
+  if (this->DataFileMode == ACCESS_MAPPED && this->DataFile != &this->Implementation->InflateFile)
+    {
+    data = this->DataFile->ReadView(loc.Length);
+    }
+  if (!data)
+    {
+    unsigned char* copy = static_cast<unsigned char*> (this->Arena->Allocate(static_cast<size_t> (loc.Length)));
+    this->DataFile->Read(copy, loc.Length);
+    data = copy;
+    }
+
+  return index.Build(data, static_cast<size_t> (loc.Length), numberOfFrames);
+}
+
 //
 // read magic number from file
 // return true if this is your image type, false if it is not
@@ -227,8 +512,10 @@ bool DICOMParser::IsDICOMFile(DICOMFile* file) {
       bool dicom;
       if (group == 0x0002 || group == 0x0008)
         {
+#ifdef DEBUG_DICOM
         dicom_stream::cerr << "No DICOM magic number found, but file appears to be DICOM." << dicom_stream::endl;
         dicom_stream::cerr << "Proceeding without caution."  << dicom_stream::endl;
+#endif
         dicom = true;
         }
       else
@@ -245,7 +532,16 @@ bool DICOMParser::IsDICOMFile(DICOMFile* file) {
 }
 
 
-bool DICOMParser::IsValidRepresentation(doublebyte rep, quadbyte& len, VRTypes &mytype)
+//
+// A 32 bit value length as read from the file.  It is unsigned;
+// 0xFFFFFFFF, undefined, stays -1.
+//
+static valuelength DICOMValueLength(quadbyte length)
+{
+  return length == -1 ? -1 : static_cast<valuelength> (static_cast<uint32_t> (length));
+}
+
+bool DICOMParser::IsValidRepresentation(doublebyte rep, valuelength& len, VRTypes &mytype)
 {
   switch (rep)
     {
@@ -281,7 +577,7 @@ bool DICOMParser::IsValidRepresentation(doublebyte rep, quadbyte& len, VRTypes &
     case DICOMParser::VR_UN:      
     case DICOMParser::VR_SQ:
       DataFile->ReadDoubleByte();
-      len = DataFile->ReadQuadByte();
+      len = DICOMValueLength(DataFile->ReadQuadByte());
       mytype = VRTypes(rep);
       return true;
 
@@ -291,7 +587,7 @@ bool DICOMParser::IsValidRepresentation(doublebyte rep, quadbyte& len, VRTypes &
       // Need to comment out in new paradigm.
       //
       DataFile->Skip(-2);
-      len = DataFile->ReadQuadByte();
+      len = DICOMValueLength(DataFile->ReadQuadByte());
       mytype = DICOMParser::VR_UNKNOWN;
       return false;  
     }
@@ -323,28 +619,173 @@ void DICOMParser::ReadNextRecord(doublebyte& group, doublebyte& element, DICOMPa
   //
   //
 
+  valuelength length = 0;
+  this->ReadNextRecordHeader(group, element, mytype, length);
+  this->ReadRecordValue(group, element, mytype, length);
+}
+
+void DICOMParser::ReadNextRecordHeader(doublebyte& group, doublebyte& element, DICOMParser::VRTypes& mytype, valuelength& length)
+{
   group = DataFile->ReadDoubleByte();
+
+  //
+  // A deflated data set starts where the file meta information
+  // ends, found from its group length or else from the first
+  // group that isn't 0002.  From there on the values are read
+  // through an inflating file.
+  //
+  if (this->DataSetInflatePending &&
+      (this->MetaInformationEnd >= 0 ? DataFile->Tell() - 2 >= this->MetaInformationEnd : group != 0x0002))
+    {
+    this->DataSetInflatePending = false;
+    DataFile->Skip(-2);
+    if (!this->BeginInflate(DataFile->Tell()))
+      {
+      //
+      // Nothing more can be read; finish the file.
+      //
+      DataFile->SkipToPos(DataFile->GetSize());
+      group = 0;
+      element = 0;
+      mytype = DICOMParser::VR_UNKNOWN;
+      length = 0;
+      return;
+      }
+    group = DataFile->ReadDoubleByte();
+    }
+
+  //
+  // The file meta information is always little endian.  An
+  // explicit big endian data set starts with the first group
+  // after it, so switch the byte order there.
+  //
+  if (this->DataSetByteSwapPending && group != 0x0002)
+    {
+    this->DataSetByteSwapPending = false;
+    this->DataFile->SetPlatformIsBigEndian(!this->DataFile->GetPlatformIsBigEndian());
+    group = DICOMFile::swapUInt16(group);
+    }
+
   element = DataFile->ReadDoubleByte();
 
   doublebyte representation = DataFile->ReadDoubleByteAsLittleEndian();
-  quadbyte length = 0;
+  length = 0;
   mytype = DICOMParser::VR_UNKNOWN;
   this->IsValidRepresentation(representation, length, mytype);
 
-  DICOMParserMap::iterator iter = 
-    Implementation->Map.find(DICOMMapKey(group,element));
+  //
+  // The file meta information group length says where a
+  // deflated data set starts.
+  //
+  if (group == 0x0002 && element == 0x0000 && length == 4)
+    {
+    uint32_t metaLength = static_cast<uint32_t> (DataFile->ReadQuadByte());
+    this->MetaInformationEnd = DataFile->Tell() + metaLength;
+    DataFile->Skip(-4);
+    }
+
+  //
+  // Pixel data of undefined length is encapsulated.  Find where
+  // it ends so it can be read, or skipped, like any other value.
+  //
+  if (length == -1 && group == 0x7FE0 && element == 0x0010)
+    {
+    length = this->ReadEncapsulatedLength();
+    this->PixelDataEncapsulated = (length != -1);
+    }
+}
+
+valuelength DICOMParser::ReadEncapsulatedLength()
+{
+  fileoffset start = DataFile->Tell();
+  fileoffset fileSize = DataFile->GetSize();
+  valuelength length = -1;
+
+  fileoffset pos = start;
+  while (pos >= 0 && pos + 8 <= fileSize)
+    {
+    doublebyte group = DataFile->ReadDoubleByte();
+    doublebyte element = DataFile->ReadDoubleByte();
+    valuelength itemLength = DICOMValueLength(DataFile->ReadQuadByte());
+    pos += 8;
+
+    if (group != 0xFFFE || itemLength < 0 || pos + itemLength > fileSize)
+      {
+      break;
+      }
+    if (element == 0xE0DD)
+      {
+      length = pos - start;
+      break;
+      }
+    if (element != 0xE000)
+      {
+      break;
+      }
+
+    DataFile->Skip(itemLength);
+    pos += itemLength;
+    }
+
+  DataFile->SkipToPos(start);
+  return length;
+}
+
+bool DICOMParser::BeginInflate(fileoffset start)
+{
+  DICOMInflateFile* inflate = &this->Implementation->InflateFile;
+  if (this->DataFile == inflate)
+    {
+    if (inflate->GetStartOffset() == start)
+      {
+      return true;
+      }
+    this->EndInflate();
+    }
+
+  if (!this->DataFile || !inflate->Start(this->DataFile, start))
+    {
+    return false;
+    }
+  inflate->SetPlatformIsBigEndian(this->DataFile->GetPlatformIsBigEndian());
+  this->DataFile = inflate;
+  return true;
+}
+
+void DICOMParser::EndInflate()
+{
+  DICOMInflateFile* inflate = &this->Implementation->InflateFile;
+  if (this->DataFile != inflate)
+    {
+    return;
+    }
+  this->DataFile = inflate->GetSourceFile();
+  this->DataFile->SetPlatformIsBigEndian(inflate->GetPlatformIsBigEndian());
+  inflate->Close();
+}
+
+void DICOMParser::ReadRecordValue(doublebyte group, doublebyte element, DICOMParser::VRTypes mytype, valuelength length)
+{
+  const DICOMParserMap::Entry* found =
+    Implementation->Map.Find(DICOMMakeMapTag(group, element), Implementation->MapCursor);
 
   VRTypes callbackType;
 
-  if (iter != Implementation->Map.end())
+  if (found)
     {
     //
-    // Only read the data if there's a registered callback.
+    // Work from a copy; a callback may register more callbacks,
+    // which can move the entries around and grow the overflow
+    // vector, so that is copied too rather than shared.
     //
-    unsigned char* tempdata = (unsigned char*) DataFile->ReadAsciiCharArray(length);
-
-    DICOMMapKey ge = (*iter).first;
-    callbackType = VRTypes(((*iter).second.first));
+    DICOMParserMap::Entry entry = *found;
+    dicom_stl::vector<DICOMCallback*> overflowCallbacks;
+    if (entry.OverflowCallbacks)
+      {
+      overflowCallbacks = *entry.OverflowCallbacks;
+      entry.OverflowCallbacks = &overflowCallbacks;
+      }
+    callbackType = VRTypes(entry.Datatype);
   
     if (callbackType != mytype &&
         mytype != VR_UNKNOWN)
@@ -354,20 +795,46 @@ void DICOMParser::ReadNextRecord(doublebyte& group, doublebyte& element, DICOMPa
       //
       callbackType = mytype;
       }
+
+    bool isPixelData = (group == 0x7FE0 && element == 0x0010);
+
+    //
+    // Encapsulated pixel data is a byte stream whatever its VR.
+    //
+    bool doSwap = (this->ToggleByteSwapImageData ^ this->DataFile->GetPlatformIsBigEndian()) && callbackType == VR_OW &&
+      !(isPixelData && this->PixelDataEncapsulated);
+
+    //
+    // Deferred pixel data is handed over in file byte order and
+    // the callbacks swap it as they decode it.
+    //
+    bool swapsPixelData = doSwap && !this->DeferPixelDataSwap;
+    bool swapsValue = isPixelData ? swapsPixelData :
+      (this->DataFile->GetPlatformIsBigEndian() &&
+       (callbackType == VR_OW || callbackType == VR_US || callbackType == VR_SS ||
+        callbackType == VR_SL || callbackType == VR_UL));
+
+    //
+    // Only read the data if there's a registered callback.
+    //
+    unsigned char* tempdata;
+    if (this->ZeroCopyValues)
+      {
+      tempdata = this->ReadBorrowedValue(length, callbackType, swapsValue);
+      }
+    else
+      {
+      tempdata = this->ReadCopiedValue(length);
+      }
  
 #ifdef DEBUG_DICOM
     this->DumpTag(this->ParserOutputFile, group, element, callbackType, tempdata, length);
 #endif
 
-    dicom_stl::pair<const DICOMMapKey,DICOMMapValue> p = *iter;
-    DICOMMapValue mv = p.second;
-
-    bool doSwap = (this->ToggleByteSwapImageData ^ this->DataFile->GetPlatformIsBigEndian()) && callbackType == VR_OW;
-
-    if (group == 0x7FE0 &&
-        element == 0x0010 )
+    if (isPixelData)
       {
-      if (doSwap)
+      this->PixelDataNeedsSwap = doSwap && this->DeferPixelDataSwap;
+      if (swapsPixelData)
         {
 #ifdef DEBUG_DICOM
         dicom_stream::cout << "==============================" << dicom_stream::endl;
@@ -376,7 +843,7 @@ void DICOMParser::ReadNextRecord(doublebyte& group, doublebyte& element, DICOMPa
         dicom_stream::cout << " DataFile Byte Swap : " << this->DataFile->GetPlatformIsBigEndian() << dicom_stream::endl;
         dicom_stream::cout << "==============================" << dicom_stream::endl;
 #endif
-        DICOMFile::swapShorts((ushort*) tempdata, (ushort*) tempdata, length/sizeof(ushort));
+        DICOMFile::swapUInt16s((uint16_t*) tempdata, (uint16_t*) tempdata, length/sizeof(uint16_t));
         }
       else
         {
@@ -412,7 +879,7 @@ void DICOMParser::ReadNextRecord(doublebyte& group, doublebyte& element, DICOMPa
           case DICOMParser::VR_OW:
           case DICOMParser::VR_US:
           case DICOMParser::VR_SS:
-            DICOMFile::swapShorts((ushort*) tempdata, (ushort*) tempdata, length/sizeof(ushort));
+            DICOMFile::swapUInt16s((uint16_t*) tempdata, (uint16_t*) tempdata, length/sizeof(uint16_t));
             // dicom_stream::cout << "16 bit byte swap needed!" << dicom_stream::endl;
             break;
           case DICOMParser::VR_FL:
@@ -421,13 +888,13 @@ void DICOMParser::ReadNextRecord(doublebyte& group, doublebyte& element, DICOMPa
             /*
             if (this->DataFile->GetPlatformIsBigEndian())
               {
-              DICOMFile::swapShorts((ushort*) tempdata, (ushort*) tempdata, length/sizeof(ushort));
+              DICOMFile::swapUInt16s((uint16_t*) tempdata, (uint16_t*) tempdata, length/sizeof(uint16_t));
               }
             */
             break;
           case DICOMParser::VR_SL:
           case DICOMParser::VR_UL:
-            DICOMFile::swapLongs((ulong*) tempdata, (ulong*) tempdata, length/sizeof(ulong));
+            DICOMFile::swapUInt32s((uint32_t*) tempdata, (uint32_t*) tempdata, length/sizeof(uint32_t));
             // dicom_stream::cout << "32 bit byte swap needed!" << dicom_stream::endl;
             break;
           case DICOMParser::VR_AT:
@@ -439,23 +906,22 @@ void DICOMParser::ReadNextRecord(doublebyte& group, doublebyte& element, DICOMPa
         }
       }
 
-    dicom_stl::vector<DICOMCallback*> * cbVector = mv.second;
-    for (dicom_stl::vector<DICOMCallback*>::iterator cbiter = cbVector->begin();
-         cbiter != cbVector->end();
-         cbiter++)
+    for (int i = 0; i < entry.NumberOfCallbacks; i++)
       {
-      (*cbiter)->Execute(this,      // parser
-                       ge.first,  // group
-                       ge.second,  // element
+      entry.GetCallbacks()[i]->Execute(this,      // parser
+                       group,  // group
+                       element,  // element
                        callbackType,  // type
                        tempdata, // data
                        length);  // length
       }
-
-    delete [] tempdata;
+    this->PixelDataNeedsSwap = false;
+    this->PixelDataEncapsulated = false;
     }
   else
     {
+    this->PixelDataEncapsulated = false;
+
     //
     // Some lengths are negative, but we don't 
     // want to back up the file pointer.
@@ -472,6 +938,70 @@ void DICOMParser::ReadNextRecord(doublebyte& group, doublebyte& element, DICOMPa
 
 }
 
+unsigned char* DICOMParser::ReadBorrowedValue(valuelength length, VRTypes type, bool modified)
+{
+  if (length <= 0)
+    {
+    return NULL;
+    }
+
+  //
+  // Binary values that are passed on unchanged can be handed out
+  // straight from the file's memory.  Text values need a NULL
+  // terminator and swapped values need a writable copy, so those
+  // go through the scratch buffer.
+  //
+  bool binary = false;
+  switch (type)
+    {
+    case DICOMParser::VR_OB:
+    case DICOMParser::VR_OW:
+    case DICOMParser::VR_UN:
+    case DICOMParser::VR_US:
+    case DICOMParser::VR_SS:
+    case DICOMParser::VR_UL:
+    case DICOMParser::VR_SL:
+    case DICOMParser::VR_FL:
+    case DICOMParser::VR_FD:
+    case DICOMParser::VR_AT:
+      binary = true;
+      break;
+    default:
+      break;
+    }
+
+  if (binary && !modified)
+    {
+    const unsigned char* view = DataFile->ReadView(length);
+    if (view)
+      {
+      return const_cast<unsigned char*> (view);
+      }
+    }
+
+  dicom_stl::vector<unsigned char>& scratch = this->Implementation->ScratchValue;
+  if (scratch.size() < static_cast<size_t> (length) + 1)
+    {
+    scratch.resize(length + 1);
+    }
+  DataFile->Read(&scratch[0], length);
+  scratch[length] = 0; // NULL terminate.
+  return &scratch[0];
+}
+
+unsigned char* DICOMParser::ReadCopiedValue(valuelength length)
+{
+  if (length <= 0)
+    {
+    return NULL;
+    }
+
+  unsigned char* value = static_cast<unsigned char*> (this->Arena->Allocate(static_cast<size_t> (length) + 1));
+  DataFile->Read(value, length);
+  value[length] = 0; // NULL terminate.
+  return value;
+}
+
 void DICOMParser::InitTypeMap()
 {
   DICOMRecord dicom_tags[] = {{0x0002, 0x0002, DICOMParser::VR_UI}, // Media storage SOP class uid
@@ -495,6 +1025,7 @@ void DICOMParser::InitTypeMap()
                               {0x0020, 0x0013, DICOMParser::VR_IS}, // Image number
                               {0x0020, 0x0032, DICOMParser::VR_SH}, // Patient position
                               {0x0020, 0x0037, DICOMParser::VR_SH}, // Patient position cosines
+                              {0x0028, 0x0008, DICOMParser::VR_IS}, // Number of frames
                               {0x0028, 0x0010, DICOMParser::VR_US}, // Num rows
                               {0x0028, 0x0011, DICOMParser::VR_US}, // Num cols
                               {0x0028, 0x0030, DICOMParser::VR_FL}, // pixel spacing
@@ -523,7 +1054,17 @@ void DICOMParser::InitTypeMap()
 
 void DICOMParser::SetDICOMTagCallbacks(doublebyte group, doublebyte element, VRTypes datatype, dicom_stl::vector<DICOMCallback*>* cbVector)
 {
-  Implementation->Map.insert(dicom_stl::pair<const DICOMMapKey, DICOMMapValue>(DICOMMapKey(group, element), DICOMMapValue((int)datatype, cbVector)));
+  DICOMMapTag tag = DICOMMakeMapTag(group, element);
+  if (!Implementation->Map.Find(tag))
+    {
+    for (dicom_stl::vector<DICOMCallback*>::iterator iter = cbVector->begin();
+         iter != cbVector->end();
+         iter++)
+      {
+      Implementation->Map.AddCallback(tag, datatype, *iter);
+      }
+    }
+  Implementation->Map.Adopt(cbVector);
 }
 
 
@@ -537,7 +1078,7 @@ bool DICOMParser::CheckMagic(char* magic_number)
           );
 }
 
-void DICOMParser::DumpTag(dicom_stream::ostream& out, doublebyte group, doublebyte element, VRTypes vrtype, unsigned char* tempdata, quadbyte length)
+void DICOMParser::DumpTag(dicom_stream::ostream& out, doublebyte group, doublebyte element, VRTypes vrtype, unsigned char* tempdata, valuelength length)
 {
 
   int t2 = int((0x0000FF00 & vrtype) >> 8);
@@ -588,7 +1129,7 @@ void DICOMParser::DumpTag(dicom_stream::ostream& out, doublebyte group, doubleby
 
 }
 
-void DICOMParser::ModalityTag(doublebyte, doublebyte, VRTypes, unsigned char* tempdata, quadbyte)
+void DICOMParser::ModalityTag(doublebyte, doublebyte, VRTypes, unsigned char* tempdata, valuelength)
 {
   if (!strcmp( (char*)tempdata, "MR"))
     {
@@ -604,15 +1145,14 @@ void DICOMParser::ModalityTag(doublebyte, doublebyte, VRTypes, unsigned char* te
 
 void DICOMParser::AddDICOMTagCallbacks(doublebyte group, doublebyte element, VRTypes datatype, dicom_stl::vector<DICOMCallback*>* cbVector)
 {
-  DICOMParserMap::iterator miter = Implementation->Map.find(DICOMMapKey(group,element));
-  if (miter != Implementation->Map.end())
+  DICOMMapTag tag = DICOMMakeMapTag(group, element);
+  if (Implementation->Map.Find(tag))
     {
     for (dicom_stl::vector<DICOMCallback*>::iterator iter = cbVector->begin();
          iter != cbVector->end();
          iter++)
       {
-      dicom_stl::vector<DICOMCallback*>* callbacks = (*miter).second.second;
-      callbacks->push_back(*iter);
+      Implementation->Map.AddCallback(tag, datatype, *iter);
       }
     }
   else
@@ -623,34 +1163,20 @@ void DICOMParser::AddDICOMTagCallbacks(doublebyte group, doublebyte element, VRT
 
 void DICOMParser::AddDICOMTagCallback(doublebyte group, doublebyte element, VRTypes datatype, DICOMCallback* cb)
 {
-  DICOMParserMap::iterator miter = Implementation->Map.find(DICOMMapKey(group,element));
-  if (miter != Implementation->Map.end())
-    {
-    dicom_stl::vector<DICOMCallback*>* callbacks = (*miter).second.second;
-    callbacks->push_back(cb);
-    }
-  else
-    {
-    dicom_stl::vector<DICOMCallback*>* callback = new dicom_stl::vector<DICOMCallback*>;
-    callback->push_back(cb);
-    this->SetDICOMTagCallbacks(group, element, datatype, callback);
-    }
+  Implementation->Map.AddCallback(DICOMMakeMapTag(group, element), datatype, cb);
 }
 
 void DICOMParser::AddDICOMTagCallbackToAllTags(DICOMCallback* cb)
 {
-  DICOMParserMap::iterator miter;
-  for (miter = Implementation->Map.begin();
-       miter != Implementation->Map.end();
-       miter++);
-  {
-  dicom_stl::vector<DICOMCallback*>* callbacks = (*miter).second.second;
-  callbacks->push_back(cb);
-  }
+  for (size_t i = 0; i < Implementation->Map.GetNumberOfEntries(); i++)
+    {
+    DICOMParserMap::Entry& entry = Implementation->Map.GetEntry(i);
+    Implementation->Map.AddCallback(entry.Tag, entry.Datatype, cb);
+    }
 }
 
 bool DICOMParser::ParseExplicitRecord(doublebyte, doublebyte, 
-                                      quadbyte& length, 
+                                      valuelength& length, 
                                       VRTypes& represent)
 {
   doublebyte representation = DataFile->ReadDoubleByte();
@@ -670,7 +1196,7 @@ bool DICOMParser::ParseExplicitRecord(doublebyte, doublebyte,
 }
 
 bool DICOMParser::ParseImplicitRecord(doublebyte group, doublebyte element,
-                                      quadbyte& length,
+                                      valuelength& length,
                                       VRTypes& represent)
 {
   DICOMImplicitTypeMap::iterator iter = 
@@ -679,7 +1205,7 @@ bool DICOMParser::ParseImplicitRecord(doublebyte group, doublebyte element,
   //
   // length?
   //
-  length = DataFile->ReadQuadByte();
+  length = DICOMValueLength(DataFile->ReadQuadByte());
   return false;
 }
 
@@ -690,7 +1216,7 @@ void DICOMParser::TransferSyntaxCallback(DICOMParser *,
                                          doublebyte,
                                          DICOMParser::VRTypes,
                                          unsigned char* val,
-                                         quadbyte) 
+                                         valuelength) 
 
 {
 #ifdef DEBUG_DICOM
@@ -699,23 +1225,37 @@ void DICOMParser::TransferSyntaxCallback(DICOMParser *,
 
   const char* TRANSFER_UID_EXPLICIT_BIG_ENDIAN = "1.2.840.10008.1.2.2";
   const char* TRANSFER_UID_GE_PRIVATE_IMPLICIT_BIG_ENDIAN = "1.2.840.113619.5.2";
+  const char* TRANSFER_UID_DEFLATED_EXPLICIT_LITTLE_ENDIAN = "1.2.840.10008.1.2.1.99";
 
   // char* fileEndian = "LittleEndian";
   // char* dataEndian = "LittleEndian";
 
   this->ToggleByteSwapImageData = false;
+  this->DataSetByteSwapPending = false;
+  this->DataSetInflatePending = false;
+
+  //
+  // An empty value, which is passed as NULL, leaves the
+  // default little endian.
+  //
+  if (!val)
+    {
+    return;
+    }
 
   if (strcmp(TRANSFER_UID_EXPLICIT_BIG_ENDIAN, (char*) val) == 0)
     {
 #ifdef DEBUG_DICOM
     dicom_stream::cout << "EXPLICIT BIG ENDIAN" << dicom_stream::endl;
 #endif
-    this->ToggleByteSwapImageData = true;
     //
     // Data byte order is big endian
     // 
     // We're always reading little endian in the beginning,
-    // so now we need to swap.
+    // so swap everything, pixel data included, once the meta
+    // information ends; see ReadNextRecordHeader.
+    //
+    this->DataSetByteSwapPending = true;
     }
   else if (strcmp(TRANSFER_UID_GE_PRIVATE_IMPLICIT_BIG_ENDIAN, (char*) val) == 0)
     {
@@ -725,6 +1265,17 @@ void DICOMParser::TransferSyntaxCallback(DICOMParser *,
     dicom_stream::cout << "ToggleByteSwapImageData : " << this->ToggleByteSwapImageData << dicom_stream::endl;
 #endif
     }
+  else if (strcmp(TRANSFER_UID_DEFLATED_EXPLICIT_LITTLE_ENDIAN, (char*) val) == 0)
+    {
+#ifdef DEBUG_DICOM
+    dicom_stream::cout << "DEFLATED EXPLICIT LITTLE ENDIAN" << dicom_stream::endl;
+#endif
+    //
+    // Everything after the file meta information is deflated;
+    // see ReadNextRecordHeader.
+    //
+    this->DataSetInflatePending = true;
+    }
   else
     {
     }
@@ -754,20 +1305,7 @@ void DICOMParser::GetGroupsElementsDatatypes(dicom_stl::vector<doublebyte>& grou
 
 void DICOMParser::ClearAllDICOMTagCallbacks()
 {
-  DICOMParserMap::iterator mapIter;
-  
-  for (mapIter = this->Implementation->Map.begin();
-       mapIter != this->Implementation->Map.end();
-       mapIter++)
-       {
-       dicom_stl::pair<const DICOMMapKey, DICOMMapValue> mapPair = *mapIter;
-       DICOMMapValue mapVal = mapPair.second;
-       dicom_stl::vector<DICOMCallback*>* cbVector = mapVal.second;
-       
-       delete cbVector;
-       }
-
-  this->Implementation->Map.clear();
+  this->Implementation->Map.Clear();
 }
 
 DICOMParser::DICOMParser(const DICOMParser&)
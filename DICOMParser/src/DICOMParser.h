@@ -39,7 +39,9 @@
 #include "DICOMTypes.h"
 #include "DICOMParserMap.h"
 
+class DICOMArena;
 class DICOMCallback;
+class DICOMFragmentIndex;
 template <class T> class DICOMMemberCallback;
 
 //DICOM_EXPIMP_TEMPLATE template class DICOM_EXPORT dicom_stl::vector<doublebyte>;
@@ -51,6 +53,12 @@ class DICOMParserImplementation;
 // separate from the callbacks.  We can use this for the implicit types.
 //
 //
+// Threading: a DICOMParser has no global or static state, so separate
+// instances can be used from separate threads at the same time.  A single
+// instance, its open DICOMFile and the callbacks registered with it must
+// only be used by one thread at a time.  The parser writes nothing to
+// standard output or error unless DEBUG_DICOM is defined.
+//
 
 class DICOM_EXPORT DICOMParser
 {
@@ -67,7 +75,117 @@ class DICOM_EXPORT DICOMParser
   virtual ~DICOMParser();
 
   //
-  // Opens a file and initializes the parser.
+  // Ways OpenFile can access a file.  ACCESS_STREAM reads
+  // through an ifstream.  ACCESS_MAPPED maps the file into
+  // memory and serves reads from the mapping.
+  // ACCESS_BUFFERED reads the file in 64 KB blocks and serves
+  // reads from that window, for file systems where mapping
+  // is unavailable or slow.
+  //
+  enum FileAccessModes
+    {
+      ACCESS_STREAM = 0,
+      ACCESS_MAPPED,
+      ACCESS_BUFFERED
+    };
+
+  //
+  // Set/Get how files are accessed by the next OpenFile.  If
+  // a file can't be mapped, OpenFile falls back to a stream.
+  //
+  void SetFileAccessMode(FileAccessModes mode)
+    {
+    this->FileAccessMode = mode;
+    }
+
+  FileAccessModes GetFileAccessMode()
+    {
+    return this->FileAccessMode;
+    }
+
+  //
+  // Set/Get whether values are passed to callbacks without a
+  // per element copy.  When on, the val pointer a callback
+  // receives is borrowed: it points into the file's mapping or
+  // into a buffer owned by the parser.  Callbacks must treat it
+  // as read-only, must not delete it, and must not keep it past
+  // the call.  Text values are still NULL terminated.  Off by
+  // default, in which case every value is a copy made in the
+  // parser's arena (see SetArena) that stays valid until the
+  // next OpenFile.  Callbacks must not delete it either way.
+  //
+  void SetZeroCopyValues(bool v)
+    {
+    this->ZeroCopyValues = v;
+    }
+
+  bool GetZeroCopyValues()
+    {
+    return this->ZeroCopyValues;
+    }
+
+  //
+  // Set/Get whether pixel data that needs its bytes swapped is
+  // passed to the pixel data callbacks unswapped, so that they
+  // can swap it in the same pass that decodes it instead of the
+  // parser going over it first.  A callback that sees pixel
+  // data must then check GetPixelDataNeedsSwap.  This also lets
+  // such pixel data be borrowed when ZeroCopyValues is on.  Off
+  // by default.
+  //
+  void SetDeferPixelDataSwap(bool v)
+    {
+    this->DeferPixelDataSwap = v;
+    }
+
+  bool GetDeferPixelDataSwap()
+    {
+    return this->DeferPixelDataSwap;
+    }
+
+  //
+  // True while the pixel data callbacks run if the value they
+  // were given is in file byte order and its 16 bit words still
+  // need swapping.  Only ever true with DeferPixelDataSwap on.
+  //
+  bool GetPixelDataNeedsSwap()
+    {
+    return this->PixelDataNeedsSwap;
+    }
+
+  //
+  // True while the pixel data callbacks run if the value they
+  // were given is encapsulated, as compressed transfer syntaxes
+  // store it: pixel data of undefined length made of items,
+  // the Basic Offset Table first and then the fragments of the
+  // compressed frames, ended by a sequence delimiter.  The
+  // value given is all of that, delimiter included, and its
+  // length is the real one.  Its items are little endian.
+  //
+  bool GetPixelDataEncapsulated()
+    {
+    return this->PixelDataEncapsulated;
+    }
+
+  //
+  // Set/Get the arena values are copied into when
+  // ZeroCopyValues is off.  The arena is reset by every
+  // OpenFile and AttachFile, so the storage for one file is
+  // reused for the next.  The caller keeps ownership of arena
+  // and must not share it with a parser used from another
+  // thread.  Passing NULL goes back to the parser's own arena.
+  //
+  void SetArena(DICOMArena* arena);
+
+  DICOMArena* GetArena()
+    {
+    return this->Arena;
+    }
+
+  //
+  // Opens a file and initializes the parser.  The DICOMFile
+  // used for the previous file is reused when it is of the
+  // kind the access mode asks for.
   //
   bool OpenFile(const dicom_stl::string& filename);
 
@@ -137,21 +255,122 @@ class DICOM_EXPORT DICOMParser
       VR_FD=0x4446  // Floating point double precision
     };
 
+  //
+  // Where an element's value sits in the file, and the byte
+  // order state needed to read it.  Offset is -1 if the
+  // element wasn't found.  In a deflated data set
+  // DeflateOffset is where the compressed stream starts, and
+  // Offset counts inflated bytes from there on; otherwise
+  // DeflateOffset is -1.
+  //
+  struct ElementLocation
+    {
+    ElementLocation() : Group(0), Element(0), Type(VR_UNKNOWN), Offset(-1), Length(0),
+                        ToggleByteSwapImageData(false), FileByteSwap(false),
+                        Encapsulated(false), DeflateOffset(-1) {}
+
+    doublebyte Group;
+    doublebyte Element;
+    VRTypes Type;
+    fileoffset Offset;
+    valuelength Length;
+    bool ToggleByteSwapImageData;
+    bool FileByteSwap;
+    bool Encapsulated;
+    fileoffset DeflateOffset;
+    };
+
+  //
+  // Like ReadHeader, but stops when it reaches the element
+  // (stopGroup, stopElement), by default the pixel data,
+  // without reading its value.  Callbacks run for everything
+  // before it.  The element's location is then available from
+  // GetStopElementLocation so its value can be read later with
+  // ReadElement without parsing the header again.
+  //
+  bool ReadHeaderOnly(doublebyte stopGroup = 0x7FE0, doublebyte stopElement = 0x0010);
+
+  //
+  // Location of the element the last ReadHeaderOnly stopped
+  // at.  Offset is -1 if the file ended first.
+  //
+  const ElementLocation& GetStopElementLocation()
+    {
+    return this->StopElementLocation;
+    }
+
+  //
+  // Read the value at loc from the open file and run the
+  // callbacks registered for its (group, element).  Returns
+  // false if no file is open or loc is not valid.
+  //
+  bool ReadElement(const ElementLocation& loc);
+
+  //
+  // Read part of the value at loc: length bytes starting offset
+  // bytes into it, for instance some of the frames of multi-frame
+  // pixel data.  The callbacks are given just that part.  Returns
+  // false if it doesn't lie within the value, or if the value is
+  // encapsulated pixel data, which is only read whole.
+  //
+  bool ReadElement(const ElementLocation& loc, fileoffset offset, valuelength length);
+
+  //
+  // Index the encapsulated pixel data at loc, as found by
+  // ReadHeaderOnly, for numberOfFrames frames (see
+  // DICOMFragmentIndex::Build) without running callbacks or
+  // decoding anything, so that the compressed frames can be
+  // handed to a decoder or copied elsewhere as they are.  The
+  // fragments are borrowed from the file's mapping when it is
+  // mapped and copied into the arena otherwise; either way they
+  // stay valid until the next OpenFile or AttachFile.  Returns
+  // false if loc isn't encapsulated or the index can't be built.
+  //
+  bool ReadFragmentIndex(const ElementLocation& loc, int numberOfFrames, DICOMFragmentIndex& index);
+
   //
   // Callback for the modality tag.
   //
-  void ModalityTag(doublebyte group, doublebyte element, VRTypes datatype, unsigned char* tempdata, quadbyte length);
+  void ModalityTag(doublebyte group, doublebyte element, VRTypes datatype, unsigned char* tempdata, valuelength length);
 
+  //
+  // Register callbacks for (group, element).  The callbacks in
+  // cbVector are copied into the parser's table when it is
+  // registered, so later changes to cbVector are not seen.  As
+  // before, the parser deletes a vector passed to
+  // SetDICOMTagCallbacks (or to AddDICOMTagCallbacks for a new
+  // tag) in ClearAllDICOMTagCallbacks.
+  //
   void SetDICOMTagCallbacks(doublebyte group, doublebyte element, VRTypes datatype, dicom_stl::vector<DICOMCallback*>* cbVector);
   void AddDICOMTagCallbacks(doublebyte group, doublebyte element, VRTypes datatype, dicom_stl::vector<DICOMCallback*>* cbVector);
   void AddDICOMTagCallback (doublebyte group, doublebyte element, VRTypes datatype, DICOMCallback* cb);
   void AddDICOMTagCallbackToAllTags(DICOMCallback* cb);
 
+  //
+  // The file values are read from.  In a deflated data set
+  // that is the inflating file layered over the one opened.
+  //
   DICOMFile* GetDICOMFile()
     {
     return this->DataFile;
     }
 
+  //
+  // Hand the open file over to the caller, who must delete it.
+  // The parser is left with no file open.  Together with
+  // AttachFile this lets a caller keep a mapped file open
+  // between ReadHeaderOnly and ReadElement while the parser
+  // reads other files in between.
+  //
+  DICOMFile* DetachFile();
+
+  //
+  // Make file, already opened on filename, the file the parser
+  // reads from.  The parser takes ownership of it and closes
+  // any file it had open.
+  //
+  void AttachFile(DICOMFile* file, const dicom_stl::string& filename);
+
   void ClearAllDICOMTagCallbacks();
 
 
@@ -160,7 +379,7 @@ class DICOM_EXPORT DICOMParser
                               doublebyte,
                               DICOMParser::VRTypes,
                               unsigned char* val,
-                              quadbyte) ;
+                              valuelength) ;
 
   void GetGroupsElementsDatatypes(dicom_stl::vector<doublebyte>& groups,
                                   dicom_stl::vector<doublebyte>& elements,
@@ -169,17 +388,17 @@ class DICOM_EXPORT DICOMParser
  protected:
 
   bool ParseExplicitRecord(doublebyte group, doublebyte element, 
-                           quadbyte& length, 
+                           valuelength& length, 
                            VRTypes& represent);
 
   bool ParseImplicitRecord(doublebyte group, doublebyte element,
-                           quadbyte& length,
+                           valuelength& length,
                            VRTypes& represent);
   //
   // Print a tag.
   //
-  // void DumpTag(doublebyte group, doublebyte element, VRTypes datatype, unsigned char* data, quadbyte length);
-  void DumpTag(dicom_stream::ostream& out, doublebyte group, doublebyte element, VRTypes vrtype, unsigned char* tempdata, quadbyte length);
+  // void DumpTag(doublebyte group, doublebyte element, VRTypes datatype, unsigned char* data, valuelength length);
+  void DumpTag(dicom_stream::ostream& out, doublebyte group, doublebyte element, VRTypes vrtype, unsigned char* tempdata, valuelength length);
 
   struct DICOMRecord 
     {
@@ -192,13 +411,68 @@ class DICOM_EXPORT DICOMParser
   // Check to see if the type is a valid DICOM type.  If not, figure
   // out the right thing to do next (i.e. compute the element length).
   //
-  bool IsValidRepresentation(doublebyte rep, quadbyte& len, VRTypes &mytype);
+  bool IsValidRepresentation(doublebyte rep, valuelength& len, VRTypes &mytype);
+
+  //
+  // Reads records until the end of the file, or until
+  // (stopGroup, stopElement) if stopAtElement is true.
+  //
+  bool ReadRecords(bool stopAtElement, doublebyte stopGroup, doublebyte stopElement);
 
   //
   // Reads a record.
   //
   void ReadNextRecord(doublebyte& group, doublebyte& element, DICOMParser::VRTypes& mytype);
 
+  //
+  // Reads the group, element, type and length of the next
+  // record, leaving the file at the start of its value.
+  //
+  void ReadNextRecordHeader(doublebyte& group, doublebyte& element, DICOMParser::VRTypes& mytype, valuelength& length);
+
+  //
+  // Reads the value of a record and runs its callbacks, or
+  // skips it if there are none.
+  //
+  void ReadRecordValue(doublebyte group, doublebyte element, DICOMParser::VRTypes mytype, valuelength length);
+
+  //
+  // Length of the encapsulated pixel data value starting at the
+  // current position, found by stepping over its items up to
+  // and including the sequence delimiter.  The file is left
+  // where it was.  Returns -1 if the items are malformed.
+  //
+  valuelength ReadEncapsulatedLength();
+
+  //
+  // Read the data set from here on by inflating the deflated
+  // stream at offset start of the open file.  Returns false if
+  // it can't be inflated.  Does nothing if that stream is
+  // already being read.
+  //
+  bool BeginInflate(fileoffset start);
+
+  //
+  // Go back to reading the open file itself.
+  //
+  void EndInflate();
+
+  //
+  // Reads a value of the given length for a callback when
+  // ZeroCopyValues is on.  Returns a view into the file when
+  // possible, otherwise the value is read into the scratch
+  // buffer.  modified is true if the value will be byte
+  // swapped in place.
+  //
+  unsigned char* ReadBorrowedValue(valuelength length, VRTypes type, bool modified);
+
+  //
+  // Reads a value of the given length for a callback when
+  // ZeroCopyValues is off.  The value is copied into the
+  // arena and NULL terminated.
+  //
+  unsigned char* ReadCopiedValue(valuelength length);
+
   //
   // Sets up the type map.
   //
@@ -235,9 +509,47 @@ class DICOM_EXPORT DICOMParser
   //
   DICOMFile* DataFile;
   dicom_stl::string FileName;
+
+  //
+  // Kind of DICOMFile DataFile is.
+  //
+  FileAccessModes DataFileMode;
+
+  FileAccessModes FileAccessMode;
+  bool ZeroCopyValues;
+  bool DeferPixelDataSwap;
+  bool PixelDataNeedsSwap;
+
+  //
+  // Set when the header of encapsulated pixel data is read,
+  // until its callbacks have run.
+  //
+  bool PixelDataEncapsulated;
+
+  //
+  // Where copied values are allocated.  Either the caller's or
+  // the default one in the Implementation.
+  //
+  DICOMArena* Arena;
+
+  ElementLocation StopElementLocation;
   
   bool ToggleByteSwapImageData;
 
+  //
+  // Set by an explicit big endian transfer syntax until the
+  // first group after the file meta information is read.
+  //
+  bool DataSetByteSwapPending;
+
+  //
+  // Set by the deflated transfer syntax until the file meta
+  // information ends, which is at MetaInformationEnd if the
+  // meta information had a group length, -1 otherwise.
+  //
+  bool DataSetInflatePending;
+  fileoffset MetaInformationEnd;
+
   //dicom_stl::vector<doublebyte> Groups;
   //dicom_stl::vector<doublebyte> Elements;
   //dicom_stl::vector<VRTypes> Datatypes;
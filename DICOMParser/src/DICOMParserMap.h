@@ -30,6 +30,7 @@
 
 #include <map>
 #include <utility>
+#include <vector>
 
 #include "DICOMConfig.h"
 
@@ -88,40 +89,226 @@ class  DICOMMapKey : public DICOMMapKeyOverride
 };
 
 //
-// Typedef of a pair of doublebyte, vector.
+// Group and element packed into one value, (group << 16) | element,
+// so tags compare in the order they appear in a file.
 //
-typedef dicom_stl::pair<doublebyte, dicom_stl::vector<DICOMCallback*>*> DICOMMapValueOverride;
+typedef unsigned int DICOMMapTag;
 
-
-// DICOM_EXPIMP_TEMPLATE template struct DICOM_MAP_EXPORT dicom_stream::pair<doublebyte, dicom_stream::vector<DICOMCallback*>*>;
+inline DICOMMapTag DICOMMakeMapTag(doublebyte group, doublebyte element)
+{
+  return (DICOMMapTag(group) << 16) | DICOMMapTag(element);
+}
 
 //
-// Subclass of pair doublebyte, vector<DICOMCallback*>.
-// Makes types shorter in the code.
+// The callbacks registered with a parser, as a flat array of
+// entries sorted by tag.  An entry holds its first few callbacks
+// in place, so finding a tag and running its callbacks reads one
+// small contiguous record and allocates nothing.
 //
-class  DICOMMapValue : public DICOMMapValueOverride
+// Elements arrive in ascending tag order, so Find takes a cursor
+// that remembers where the last lookup ended and usually just
+// steps forward from there instead of searching.
+//
+class  DICOMParserMap
 {
  public:
-   DICOMMapValue() : dicom_stl::pair<doublebyte, dicom_stl::vector<DICOMCallback*>*>() {};
+  enum { INLINE_CALLBACKS = 3 };
 
-  DICOMMapValue(doublebyte v1, dicom_stl::vector<DICOMCallback*> * v2) :
-    dicom_stl::pair<doublebyte, dicom_stl::vector<DICOMCallback*>*>(v1, v2)
-  {
+  struct Entry
+    {
+    DICOMMapTag Tag;
+    doublebyte Datatype;
+    doublebyte NumberOfCallbacks;
+    DICOMCallback* InlineCallbacks[INLINE_CALLBACKS];
+    //
+    // All of the callbacks once there are more than fit in
+    // place, otherwise NULL.
+    //
+    dicom_stl::vector<DICOMCallback*>* OverflowCallbacks;
 
-  }
-};
+    DICOMCallback* const* GetCallbacks() const
+      {
+      return this->OverflowCallbacks ? &(*this->OverflowCallbacks)[0] : this->InlineCallbacks;
+      }
 
+    doublebyte GetGroup() const
+      {
+      return doublebyte(this->Tag >> 16);
+      }
+
+    doublebyte GetElement() const
+      {
+      return doublebyte(this->Tag & 0xFFFF);
+      }
+    };
 
-// DICOM_EXPIMP_TEMPLATE template class DICOM_MAP_EXPORT dicom_stream::map<DICOMMapKey, DICOMMapValue, group_element_compare>;
+  DICOMParserMap() : Entries(), AdoptedVectors()
+    {
+    }
 
-//
-// Subclass of the particular map we're using.  Again,
-// makes type specifiers shorter in the code.
-//
-class  DICOMParserMap : 
-  public  dicom_stl::map<DICOMMapKey, DICOMMapValue, group_element_compare> 
-{
+  ~DICOMParserMap()
+    {
+    this->Clear();
+    }
+
+  //
+  // Entry for tag, or NULL.  A binary search.
+  //
+  const Entry* Find(DICOMMapTag tag) const
+    {
+    size_t i = this->LowerBound(tag);
+    if (i < this->Entries.size() && this->Entries[i].Tag == tag)
+      {
+      return &this->Entries[i];
+      }
+    return NULL;
+    }
+
+  //
+  // Entry for tag, or NULL, starting from cursor.  Start a file
+  // with cursor set to 0 and pass the same cursor for every
+  // element after that.  Tags that go backwards (e.g. inside a
+  // sequence) fall back to a binary search.
+  //
+  const Entry* Find(DICOMMapTag tag, size_t& cursor) const
+    {
+    size_t count = this->Entries.size();
+    if (cursor > count ||
+        (cursor > 0 && this->Entries[cursor - 1].Tag >= tag))
+      {
+      cursor = this->LowerBound(tag);
+      }
+    else
+      {
+      while (cursor < count && this->Entries[cursor].Tag < tag)
+        {
+        cursor++;
+        }
+      }
+    if (cursor < count && this->Entries[cursor].Tag == tag)
+      {
+      return &this->Entries[cursor];
+      }
+    return NULL;
+    }
+
+  //
+  // Append cb to the callbacks for tag, creating the entry with
+  // datatype if the tag has none yet.
+  //
+  void AddCallback(DICOMMapTag tag, doublebyte datatype, DICOMCallback* cb)
+    {
+    Entry& entry = this->FindOrInsert(tag, datatype);
+    if (entry.OverflowCallbacks)
+      {
+      entry.OverflowCallbacks->push_back(cb);
+      }
+    else if (entry.NumberOfCallbacks < INLINE_CALLBACKS)
+      {
+      entry.InlineCallbacks[entry.NumberOfCallbacks] = cb;
+      }
+    else
+      {
+      entry.OverflowCallbacks = new dicom_stl::vector<DICOMCallback*>(entry.InlineCallbacks, entry.InlineCallbacks + INLINE_CALLBACKS);
+      entry.OverflowCallbacks->push_back(cb);
+      }
+    entry.NumberOfCallbacks++;
+    }
+
+  //
+  // True if cb is registered for tag.
+  //
+  bool HasCallback(DICOMMapTag tag, DICOMCallback* cb) const
+    {
+    const Entry* entry = this->Find(tag);
+    if (!entry)
+      {
+      return false;
+      }
+    DICOMCallback* const* callbacks = entry->GetCallbacks();
+    for (int i = 0; i < entry->NumberOfCallbacks; i++)
+      {
+      if (callbacks[i] == cb)
+        {
+        return true;
+        }
+      }
+    return false;
+    }
+
+  //
+  // Keep a callback vector handed over by a caller until Clear,
+  // when it is deleted, as the old map did.
+  //
+  void Adopt(dicom_stl::vector<DICOMCallback*>* cbVector)
+    {
+    this->AdoptedVectors.push_back(cbVector);
+    }
+
+  size_t GetNumberOfEntries() const
+    {
+    return this->Entries.size();
+    }
+
+  Entry& GetEntry(size_t i)
+    {
+    return this->Entries[i];
+    }
+
+  void Clear()
+    {
+    for (size_t i = 0; i < this->Entries.size(); i++)
+      {
+      delete this->Entries[i].OverflowCallbacks;
+      }
+    this->Entries.clear();
+    for (size_t j = 0; j < this->AdoptedVectors.size(); j++)
+      {
+      delete this->AdoptedVectors[j];
+      }
+    this->AdoptedVectors.clear();
+    }
+
+ private:
+  size_t LowerBound(DICOMMapTag tag) const
+    {
+    size_t lo = 0;
+    size_t hi = this->Entries.size();
+    while (lo < hi)
+      {
+      size_t mid = lo + (hi - lo) / 2;
+      if (this->Entries[mid].Tag < tag)
+        {
+        lo = mid + 1;
+        }
+      else
+        {
+        hi = mid;
+        }
+      }
+    return lo;
+    }
+
+  Entry& FindOrInsert(DICOMMapTag tag, doublebyte datatype)
+    {
+    size_t i = this->LowerBound(tag);
+    if (i == this->Entries.size() || this->Entries[i].Tag != tag)
+      {
+      Entry entry;
+      entry.Tag = tag;
+      entry.Datatype = datatype;
+      entry.NumberOfCallbacks = 0;
+      entry.OverflowCallbacks = NULL;
+      this->Entries.insert(this->Entries.begin() + i, entry);
+      }
+    return this->Entries[i];
+    }
+
+  DICOMParserMap(const DICOMParserMap&);
+  void operator=(const DICOMParserMap&);
 
+  dicom_stl::vector<Entry> Entries;
+  dicom_stl::vector<dicom_stl::vector<DICOMCallback*>*> AdoptedVectors;
 };
 
 typedef doublebyte DICOMTypeValue;
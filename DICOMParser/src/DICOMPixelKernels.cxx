@@ -0,0 +1,1490 @@
+/*=========================================================================
+
+  Program:   DICOMParser
+  Module:    $RCSfile: DICOMPixelKernels.cxx,v $
+  Language:  C++
+  Date:      $Date: 2003/10/23 19:13:34 $
+  Version:   $Revision: 1.1.1.1 $
+
+  Copyright (c) 2003 Matt Turek
+  All rights reserved.
+  See Copyright.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifdef _MSC_VER
+#pragma warning ( disable : 4514 )
+#pragma warning ( disable : 4710 )
+#pragma warning ( push, 3 )
+#endif
+
+#include <string.h>
+
+#include "DICOMConfig.h"
+#include "DICOMPixelKernels.h"
+
+//
+// The vector kernels are built for x86 only.  They are compiled
+// for their instruction set function by function, so the rest
+// of the library needs no special flags and runs on any CPU.
+//
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define DICOM_PIXEL_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define DICOM_TARGET_SSE2
+#define DICOM_TARGET_AVX2
+#else
+#define DICOM_TARGET_SSE2 __attribute__((target("sse2")))
+#define DICOM_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+//
+// Running statistics of one kernel call.  The histogram is kept
+// BIN_COPIES times over, indexed by position, so that runs of
+// equal values (the air around a body, say) don't serialize on
+// one counter; the copies are summed at the end.
+//
+enum { BIN_COPIES = 8 };
+
+struct DICOMPixelAccumulator
+{
+  unsigned long Count;
+  double Min;
+  double Max;
+  double Sum;
+  unsigned int Bins[BIN_COPIES][DICOMPixelStatistics::HISTOGRAM_BINS];
+};
+
+static inline void FoldStatistics(DICOMPixelAccumulator* acc, double min, double max, double sum, int count)
+{
+  if (count <= 0)
+    {
+    return;
+    }
+  if (acc->Count == 0)
+    {
+    acc->Min = min;
+    acc->Max = max;
+    }
+  else
+    {
+    if (min < acc->Min)
+      {
+      acc->Min = min;
+      }
+    if (max > acc->Max)
+      {
+      acc->Max = max;
+      }
+    }
+  acc->Sum += sum;
+  acc->Count += count;
+}
+
+static inline unsigned short SwapBytes(unsigned short v)
+{
+  return static_cast<unsigned short> ((v << 8) | (v >> 8));
+}
+
+static inline uint32_t SwapBytes(uint32_t v)
+{
+  return (v << 24) | ((v << 8) & 0x00ff0000u) | ((v >> 8) & 0x0000ff00u) | (v >> 24);
+}
+
+static inline uint64_t SwapBytes(uint64_t v)
+{
+  return (static_cast<uint64_t> (SwapBytes(static_cast<uint32_t> (v))) << 32) |
+    SwapBytes(static_cast<uint32_t> (v >> 32));
+}
+
+//
+// Scalar byte swaps, for any width.
+//
+template <class T>
+static void SwapBytesScalar(const T* in, T* out, size_t count)
+{
+  for (size_t i = 0; i < count; i++)
+    {
+    out[i] = SwapBytes(in[i]);
+    }
+}
+
+//
+// Histogram bins; see DICOMPixelStatistics.
+//
+static inline unsigned int CharBin(char v)
+{
+  return static_cast<unsigned char> (v) ^ 0x80;
+}
+
+static inline unsigned int ShortBin(short v)
+{
+  return (static_cast<unsigned short> (v) ^ 0x8000) >> 8;
+}
+
+static inline unsigned int FloatBin(float v)
+{
+  double t = (double(v) + 32768.0) / 256.0;
+  if (!(t >= 0.0))
+    {
+    return 0;
+    }
+  if (t >= DICOMPixelStatistics::HISTOGRAM_BINS)
+    {
+    return DICOMPixelStatistics::HISTOGRAM_BINS - 1;
+    }
+  return static_cast<unsigned int> (t);
+}
+
+//
+// Scalar kernels.  These are the reference; the vector ones
+// must match them bit for bit, and finish their tails with
+// them.  Byte swapped 8 bit data is read from the other byte of
+// its word, or from itself for a last odd byte.
+//
+static void DecodeUCharToCharScalar(const unsigned char* in, char* out, int n, bool swap,
+                                    float slope, float offset, DICOMPixelAccumulator* acc)
+{
+  int vmin = 127;
+  int vmax = -128;
+  long long sum = 0;
+  for (int i = 0; i < n; i++)
+    {
+    int j = (swap && (i ^ 1) < n) ? (i ^ 1) : i;
+    char r = char(slope * in[j] + offset);
+    out[i] = r;
+    if (acc)
+      {
+      vmin = r < vmin ? r : vmin;
+      vmax = r > vmax ? r : vmax;
+      sum += r;
+      acc->Bins[i & (BIN_COPIES - 1)][CharBin(r)]++;
+      }
+    }
+  if (acc)
+    {
+    FoldStatistics(acc, vmin, vmax, double(sum), n);
+    }
+}
+
+static void DecodeUCharToFloatScalar(const unsigned char* in, float* out, int n, bool swap,
+                                     float slope, float offset, DICOMPixelAccumulator* acc)
+{
+  float vmin = 0.0f;
+  float vmax = 0.0f;
+  double sum = 0.0;
+  for (int i = 0; i < n; i++)
+    {
+    int j = (swap && (i ^ 1) < n) ? (i ^ 1) : i;
+    float r = float(slope * in[j] + offset);
+    out[i] = r;
+    if (acc)
+      {
+      vmin = (i == 0 || r < vmin) ? r : vmin;
+      vmax = (i == 0 || r > vmax) ? r : vmax;
+      sum += r;
+      acc->Bins[i & (BIN_COPIES - 1)][FloatBin(r)]++;
+      }
+    }
+  if (acc)
+    {
+    FoldStatistics(acc, vmin, vmax, sum, n);
+    }
+}
+
+static void DecodeUShortToFloatScalar(const unsigned short* in, float* out, int n, bool swap,
+                                      float slope, float offset, DICOMPixelAccumulator* acc)
+{
+  float vmin = 0.0f;
+  float vmax = 0.0f;
+  double sum = 0.0;
+  for (int i = 0; i < n; i++)
+    {
+    unsigned short v = swap ? SwapBytes(in[i]) : in[i];
+    float r = float(slope * v + offset);
+    out[i] = r;
+    if (acc)
+      {
+      vmin = (i == 0 || r < vmin) ? r : vmin;
+      vmax = (i == 0 || r > vmax) ? r : vmax;
+      sum += r;
+      acc->Bins[i & (BIN_COPIES - 1)][FloatBin(r)]++;
+      }
+    }
+  if (acc)
+    {
+    FoldStatistics(acc, vmin, vmax, sum, n);
+    }
+}
+
+//
+// The short kernels are also built without the rescale, for
+// CopyShortToShort; slope and offset are then ignored.
+//
+template <bool TRescale>
+static void DecodeShortToShortScalar(const short* in, short* out, int n, bool swap,
+                                     float slope, float offset, short padding,
+                                     DICOMPixelAccumulator* acc)
+{
+  int vmin = 32767;
+  int vmax = -32768;
+  long long sum = 0;
+  for (int i = 0; i < n; i++)
+    {
+    short val = swap ? short(SwapBytes(static_cast<unsigned short> (in[i]))) : in[i];
+    if (val == padding)
+      {
+      val = 0;
+      }
+    short r = TRescale ? short(slope * val + offset) : val;
+    out[i] = r;
+    if (acc)
+      {
+      vmin = r < vmin ? r : vmin;
+      vmax = r > vmax ? r : vmax;
+      sum += r;
+      acc->Bins[i & (BIN_COPIES - 1)][ShortBin(r)]++;
+      }
+    }
+  if (acc)
+    {
+    FoldStatistics(acc, vmin, vmax, double(sum), n);
+    }
+}
+
+//
+// Resampling rows.  Values are clamped to the 16 bit range and
+// rounded half away from 0.  The clamps are written as the
+// vector min and max compute them, a NaN becoming -32768.
+//
+static inline short RoundToShort(float v)
+{
+  float c = v > -32768.0f ? v : -32768.0f;
+  c = c < 32767.0f ? c : 32767.0f;
+  return static_cast<short> (c < 0.0f ? c - 0.5f : c + 0.5f);
+}
+
+static void RoundFloatToShortScalar(const float* in, short* out, size_t count)
+{
+  for (size_t i = 0; i < count; i++)
+    {
+    out[i] = RoundToShort(in[i]);
+    }
+}
+
+static void BlendShortToShortScalar(const short* in0, const short* in1, short* out, size_t count,
+                                    float weight0, float weight1)
+{
+  for (size_t i = 0; i < count; i++)
+    {
+    out[i] = RoundToShort(weight0 * float(in0[i]) + weight1 * float(in1[i]));
+    }
+}
+
+//
+// Each output value is summed in tap order, the first product
+// taken as it is rather than added to 0, so every set adds the
+// same values in the same order.  The values from begin on are
+// done; tap t of value i is still at t * count + i.
+//
+static void InterpolateFloatScalar(const float* in, const uint32_t* index, const float* weight,
+                                   unsigned int taps, float* out, size_t begin, size_t count)
+{
+  for (size_t i = begin; i < count; i++)
+    {
+    float sum = taps ? weight[i] * in[index[i]] : 0.0f;
+    for (unsigned int t = 1; t < taps; t++)
+      {
+      sum += weight[t * count + i] * in[index[t * count + i]];
+      }
+    out[i] = sum;
+    }
+}
+
+#ifdef DICOM_PIXEL_KERNELS_X86
+
+//
+// SSE2 kernels.  Values are widened to 32 bit integers,
+// converted to float, multiplied and added separately (no
+// fused multiply-add, which would round differently) and
+// truncated back with cvttps, the same instruction the scalar
+// conversions compile to.  Narrowing keeps the low bits rather
+// than saturating, again like the scalar code.
+//
+// Range and sum are kept in vector registers, and the histogram
+// is counted from the results before they leave them, so the
+// input is read only once.
+//
+DICOM_TARGET_SSE2 static inline __m128i RescaleEpi32SSE2(__m128i v, __m128 s, __m128 o)
+{
+  return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(v), s), o));
+}
+
+DICOM_TARGET_SSE2 static inline __m128i SwapBytesSSE2(__m128i v)
+{
+  return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+DICOM_TARGET_SSE2 static inline double SumEpi32SSE2(__m128i v)
+{
+  int lanes[4];
+  _mm_storeu_si128(reinterpret_cast<__m128i*> (lanes), v);
+  return double(lanes[0]) + double(lanes[1]) + double(lanes[2]) + double(lanes[3]);
+}
+
+DICOM_TARGET_SSE2 static inline double SumEpi64SSE2(__m128i v)
+{
+  long long lanes[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i*> (lanes), v);
+  return double(lanes[0]) + double(lanes[1]);
+}
+
+DICOM_TARGET_SSE2 static inline double SumPdSSE2(__m128d v)
+{
+  double lanes[2];
+  _mm_storeu_pd(lanes, v);
+  return lanes[0] + lanes[1];
+}
+
+DICOM_TARGET_SSE2 static inline void RangePsSSE2(__m128 vmin, __m128 vmax, float& min, float& max)
+{
+  float lo[4];
+  float hi[4];
+  _mm_storeu_ps(lo, vmin);
+  _mm_storeu_ps(hi, vmax);
+  min = lo[0];
+  max = hi[0];
+  for (int k = 1; k < 4; k++)
+    {
+    min = lo[k] < min ? lo[k] : min;
+    max = hi[k] > max ? hi[k] : max;
+    }
+}
+
+//
+// Statistics of 16 chars, held as their bytes ^ 0x80 so that
+// unsigned byte compares and sums order them as signed values.
+//
+DICOM_TARGET_SSE2 static inline void AccumulateChars(__m128i flipped, __m128i& vmin, __m128i& vmax, __m128i& vsum,
+                                                     const char* out, DICOMPixelAccumulator* acc)
+{
+  vmin = _mm_min_epu8(vmin, flipped);
+  vmax = _mm_max_epu8(vmax, flipped);
+  vsum = _mm_add_epi64(vsum, _mm_sad_epu8(flipped, _mm_setzero_si128()));
+  for (int k = 0; k < 16; k++)
+    {
+    acc->Bins[k & (BIN_COPIES - 1)][CharBin(out[k])]++;
+    }
+}
+
+DICOM_TARGET_SSE2 static inline void FinishChars(__m128i vmin, __m128i vmax, __m128i vsum, int count,
+                                                 DICOMPixelAccumulator* acc)
+{
+  unsigned char lo[16];
+  unsigned char hi[16];
+  _mm_storeu_si128(reinterpret_cast<__m128i*> (lo), vmin);
+  _mm_storeu_si128(reinterpret_cast<__m128i*> (hi), vmax);
+  int min = 255;
+  int max = 0;
+  for (int k = 0; k < 16; k++)
+    {
+    min = lo[k] < min ? lo[k] : min;
+    max = hi[k] > max ? hi[k] : max;
+    }
+  FoldStatistics(acc, min - 128, max - 128, SumEpi64SSE2(vsum) - 128.0 * count, count);
+}
+
+DICOM_TARGET_SSE2 static void DecodeUCharToCharSSE2(const unsigned char* in, char* out, int n, bool swap,
+                                                    float slope, float offset, DICOMPixelAccumulator* acc)
+{
+  const __m128 s = _mm_set1_ps(slope);
+  const __m128 o = _mm_set1_ps(offset);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i low8 = _mm_set1_epi32(0xFF);
+  const __m128i flip = _mm_set1_epi8(char(0x80));
+
+  __m128i vmin = _mm_set1_epi8(char(0xFF));
+  __m128i vmax = zero;
+  __m128i vsum = zero;
+
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+    {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*> (in + i));
+    if (swap)
+      {
+      v = SwapBytesSSE2(v);
+      }
+    __m128i lo = _mm_unpacklo_epi8(v, zero);
+    __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+    __m128i r0 = _mm_and_si128(RescaleEpi32SSE2(_mm_unpacklo_epi16(lo, zero), s, o), low8);
+    __m128i r1 = _mm_and_si128(RescaleEpi32SSE2(_mm_unpackhi_epi16(lo, zero), s, o), low8);
+    __m128i r2 = _mm_and_si128(RescaleEpi32SSE2(_mm_unpacklo_epi16(hi, zero), s, o), low8);
+    __m128i r3 = _mm_and_si128(RescaleEpi32SSE2(_mm_unpackhi_epi16(hi, zero), s, o), low8);
+
+    __m128i r = _mm_packus_epi16(_mm_packs_epi32(r0, r1), _mm_packs_epi32(r2, r3));
+    _mm_storeu_si128(reinterpret_cast<__m128i*> (out + i), r);
+
+    if (acc)
+      {
+      AccumulateChars(_mm_xor_si128(r, flip), vmin, vmax, vsum, out + i, acc);
+      }
+    }
+
+  if (acc)
+    {
+    FinishChars(vmin, vmax, vsum, i, acc);
+    }
+  DecodeUCharToCharScalar(in + i, out + i, n - i, swap, slope, offset, acc);
+}
+
+//
+// Statistics of 4 floats.
+//
+DICOM_TARGET_SSE2 static inline void AccumulateFloatsSSE2(__m128 r, __m128& vmin, __m128& vmax, __m128d& vsum,
+                                                          const float* out, DICOMPixelAccumulator* acc)
+{
+  vmin = _mm_min_ps(vmin, r);
+  vmax = _mm_max_ps(vmax, r);
+  vsum = _mm_add_pd(vsum, _mm_add_pd(_mm_cvtps_pd(r), _mm_cvtps_pd(_mm_movehl_ps(r, r))));
+  for (int k = 0; k < 4; k++)
+    {
+    acc->Bins[k][FloatBin(out[k])]++;
+    }
+}
+
+DICOM_TARGET_SSE2 static void DecodeUCharToFloatSSE2(const unsigned char* in, float* out, int n, bool swap,
+                                                     float slope, float offset, DICOMPixelAccumulator* acc)
+{
+  const __m128 s = _mm_set1_ps(slope);
+  const __m128 o = _mm_set1_ps(offset);
+  const __m128i zero = _mm_setzero_si128();
+
+  __m128 vmin = _mm_set1_ps(3.0e38f);
+  __m128 vmax = _mm_set1_ps(-3.0e38f);
+  __m128d vsum = _mm_setzero_pd();
+
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+    {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*> (in + i));
+    if (swap)
+      {
+      v = SwapBytesSSE2(v);
+      }
+    __m128i lo = _mm_unpacklo_epi8(v, zero);
+    __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+    __m128 r[4];
+    r[0] = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), s), o);
+    r[1] = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), s), o);
+    r[2] = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), s), o);
+    r[3] = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), s), o);
+    for (int k = 0; k < 4; k++)
+      {
+      _mm_storeu_ps(out + i + 4 * k, r[k]);
+      if (acc)
+        {
+        AccumulateFloatsSSE2(r[k], vmin, vmax, vsum, out + i + 4 * k, acc);
+        }
+      }
+    }
+
+  if (acc && i > 0)
+    {
+    float min;
+    float max;
+    RangePsSSE2(vmin, vmax, min, max);
+    FoldStatistics(acc, min, max, SumPdSSE2(vsum), i);
+    }
+  DecodeUCharToFloatScalar(in + i, out + i, n - i, swap, slope, offset, acc);
+}
+
+DICOM_TARGET_SSE2 static void DecodeUShortToFloatSSE2(const unsigned short* in, float* out, int n, bool swap,
+                                                      float slope, float offset, DICOMPixelAccumulator* acc)
+{
+  const __m128 s = _mm_set1_ps(slope);
+  const __m128 o = _mm_set1_ps(offset);
+  const __m128i zero = _mm_setzero_si128();
+
+  __m128 vmin = _mm_set1_ps(3.0e38f);
+  __m128 vmax = _mm_set1_ps(-3.0e38f);
+  __m128d vsum = _mm_setzero_pd();
+
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*> (in + i));
+    if (swap)
+      {
+      v = SwapBytesSSE2(v);
+      }
+
+    __m128 r0 = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), s), o);
+    __m128 r1 = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)), s), o);
+    _mm_storeu_ps(out + i, r0);
+    _mm_storeu_ps(out + i + 4, r1);
+
+    if (acc)
+      {
+      AccumulateFloatsSSE2(r0, vmin, vmax, vsum, out + i, acc);
+      AccumulateFloatsSSE2(r1, vmin, vmax, vsum, out + i + 4, acc);
+      }
+    }
+
+  if (acc && i > 0)
+    {
+    float min;
+    float max;
+    RangePsSSE2(vmin, vmax, min, max);
+    FoldStatistics(acc, min, max, SumPdSSE2(vsum), i);
+    }
+  DecodeUShortToFloatScalar(in + i, out + i, n - i, swap, slope, offset, acc);
+}
+
+//
+// Statistics of shorts: madd against ones sums pairs into 32
+// bit lanes, which are moved into a double every SUM_BLOCK
+// iterations, well before they could overflow.
+//
+enum { SUM_BLOCK = 8192 };
+
+//
+// The bins of 8 shorts are taken straight from the register;
+// reading them back from the store just made stalls when the
+// store was wider than the loads.
+//
+DICOM_TARGET_SSE2 static inline void CountShortBinsSSE2(__m128i r, DICOMPixelAccumulator* acc)
+{
+  __m128i b = _mm_srli_epi16(_mm_xor_si128(r, _mm_set1_epi16(short(0x8000))), 8);
+  acc->Bins[0][_mm_extract_epi16(b, 0)]++;
+  acc->Bins[1][_mm_extract_epi16(b, 1)]++;
+  acc->Bins[2][_mm_extract_epi16(b, 2)]++;
+  acc->Bins[3][_mm_extract_epi16(b, 3)]++;
+  acc->Bins[4][_mm_extract_epi16(b, 4)]++;
+  acc->Bins[5][_mm_extract_epi16(b, 5)]++;
+  acc->Bins[6][_mm_extract_epi16(b, 6)]++;
+  acc->Bins[7][_mm_extract_epi16(b, 7)]++;
+}
+
+DICOM_TARGET_SSE2 static inline void FinishShortsSSE2(__m128i vmin, __m128i vmax, double sum, int count,
+                                                      DICOMPixelAccumulator* acc)
+{
+  short lo[8];
+  short hi[8];
+  _mm_storeu_si128(reinterpret_cast<__m128i*> (lo), vmin);
+  _mm_storeu_si128(reinterpret_cast<__m128i*> (hi), vmax);
+  int min = lo[0];
+  int max = hi[0];
+  for (int k = 1; k < 8; k++)
+    {
+    min = lo[k] < min ? lo[k] : min;
+    max = hi[k] > max ? hi[k] : max;
+    }
+  FoldStatistics(acc, min, max, sum, count);
+}
+
+template <bool TRescale>
+DICOM_TARGET_SSE2 static void DecodeShortToShortSSE2(const short* in, short* out, int n, bool swap,
+                                                     float slope, float offset, short padding,
+                                                     DICOMPixelAccumulator* acc)
+{
+  const __m128 s = _mm_set1_ps(slope);
+  const __m128 o = _mm_set1_ps(offset);
+  const __m128i pad = _mm_set1_epi16(padding);
+  const __m128i ones = _mm_set1_epi16(1);
+
+  __m128i vmin = _mm_set1_epi16(32767);
+  __m128i vmax = _mm_set1_epi16(-32768);
+  __m128i vsum = _mm_setzero_si128();
+  double sum = 0.0;
+  int block = 0;
+
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*> (in + i));
+    if (swap)
+      {
+      v = SwapBytesSSE2(v);
+      }
+
+    // padding values become 0
+    v = _mm_andnot_si128(_mm_cmpeq_epi16(v, pad), v);
+
+    __m128i r = v;
+    if (TRescale)
+      {
+      // sign extend to 32 bits
+      __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+      __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+
+      // keep the low 16 bits, so the pack below can't saturate
+      lo = _mm_srai_epi32(_mm_slli_epi32(RescaleEpi32SSE2(lo, s, o), 16), 16);
+      hi = _mm_srai_epi32(_mm_slli_epi32(RescaleEpi32SSE2(hi, s, o), 16), 16);
+
+      r = _mm_packs_epi32(lo, hi);
+      }
+    _mm_storeu_si128(reinterpret_cast<__m128i*> (out + i), r);
+
+    if (acc)
+      {
+      vmin = _mm_min_epi16(vmin, r);
+      vmax = _mm_max_epi16(vmax, r);
+      vsum = _mm_add_epi32(vsum, _mm_madd_epi16(r, ones));
+      if (++block == SUM_BLOCK)
+        {
+        sum += SumEpi32SSE2(vsum);
+        vsum = _mm_setzero_si128();
+        block = 0;
+        }
+      CountShortBinsSSE2(r, acc);
+      }
+    }
+
+  if (acc && i > 0)
+    {
+    FinishShortsSSE2(vmin, vmax, sum + SumEpi32SSE2(vsum), i, acc);
+    }
+  DecodeShortToShortScalar<TRescale>(in + i, out + i, n - i, swap, slope, offset, padding, acc);
+}
+
+//
+// AVX2 kernels.  Same arithmetic as the SSE2 ones, eight
+// values per conversion.  The packs work within 128 bit lanes,
+// so their results are put back in order with a permute.
+//
+DICOM_TARGET_AVX2 static inline __m256i RescaleEpi32AVX2(__m256i v, __m256 s, __m256 o)
+{
+  return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(v), s), o));
+}
+
+DICOM_TARGET_AVX2 static inline void AccumulateFloatsAVX2(__m256 r, __m256& vmin, __m256& vmax, __m256d& vsum,
+                                                          const float* out, DICOMPixelAccumulator* acc)
+{
+  vmin = _mm256_min_ps(vmin, r);
+  vmax = _mm256_max_ps(vmax, r);
+  vsum = _mm256_add_pd(vsum, _mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(r)),
+                                           _mm256_cvtps_pd(_mm256_extractf128_ps(r, 1))));
+  for (int k = 0; k < 8; k++)
+    {
+    acc->Bins[k & (BIN_COPIES - 1)][FloatBin(out[k])]++;
+    }
+}
+
+DICOM_TARGET_AVX2 static inline void FinishFloatsAVX2(__m256 vmin, __m256 vmax, __m256d vsum, int count,
+                                                      DICOMPixelAccumulator* acc)
+{
+  float min;
+  float max;
+  RangePsSSE2(_mm_min_ps(_mm256_castps256_ps128(vmin), _mm256_extractf128_ps(vmin, 1)),
+              _mm_max_ps(_mm256_castps256_ps128(vmax), _mm256_extractf128_ps(vmax, 1)), min, max);
+  double sum = SumPdSSE2(_mm_add_pd(_mm256_castpd256_pd128(vsum), _mm256_extractf128_pd(vsum, 1)));
+  FoldStatistics(acc, min, max, sum, count);
+}
+
+DICOM_TARGET_AVX2 static void DecodeUCharToCharAVX2(const unsigned char* in, char* out, int n, bool swap,
+                                                    float slope, float offset, DICOMPixelAccumulator* acc)
+{
+  const __m256 s = _mm256_set1_ps(slope);
+  const __m256 o = _mm256_set1_ps(offset);
+  const __m256i low8 = _mm256_set1_epi32(0xFF);
+  const __m128i flip = _mm_set1_epi8(char(0x80));
+
+  __m128i vmin = _mm_set1_epi8(char(0xFF));
+  __m128i vmax = _mm_setzero_si128();
+  __m128i vsum = _mm_setzero_si128();
+
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+    {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*> (in + i));
+    if (swap)
+      {
+      v = SwapBytesSSE2(v);
+      }
+
+    __m256i r0 = _mm256_and_si256(RescaleEpi32AVX2(_mm256_cvtepu8_epi32(v), s, o), low8);
+    __m256i r1 = _mm256_and_si256(RescaleEpi32AVX2(_mm256_cvtepu8_epi32(_mm_srli_si128(v, 8)), s, o), low8);
+
+    __m256i p = _mm256_permute4x64_epi64(_mm256_packs_epi32(r0, r1), 0xD8);
+    __m128i r = _mm_packus_epi16(_mm256_castsi256_si128(p), _mm256_extracti128_si256(p, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*> (out + i), r);
+
+    if (acc)
+      {
+      AccumulateChars(_mm_xor_si128(r, flip), vmin, vmax, vsum, out + i, acc);
+      }
+    }
+
+  if (acc)
+    {
+    FinishChars(vmin, vmax, vsum, i, acc);
+    }
+  DecodeUCharToCharScalar(in + i, out + i, n - i, swap, slope, offset, acc);
+}
+
+DICOM_TARGET_AVX2 static void DecodeUCharToFloatAVX2(const unsigned char* in, float* out, int n, bool swap,
+                                                     float slope, float offset, DICOMPixelAccumulator* acc)
+{
+  const __m256 s = _mm256_set1_ps(slope);
+  const __m256 o = _mm256_set1_ps(offset);
+
+  __m256 vmin = _mm256_set1_ps(3.0e38f);
+  __m256 vmax = _mm256_set1_ps(-3.0e38f);
+  __m256d vsum = _mm256_setzero_pd();
+
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    {
+    __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*> (in + i));
+    if (swap)
+      {
+      v = SwapBytesSSE2(v);
+      }
+    __m256 r = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v)), s), o);
+    _mm256_storeu_ps(out + i, r);
+
+    if (acc)
+      {
+      AccumulateFloatsAVX2(r, vmin, vmax, vsum, out + i, acc);
+      }
+    }
+
+  if (acc && i > 0)
+    {
+    FinishFloatsAVX2(vmin, vmax, vsum, i, acc);
+    }
+  DecodeUCharToFloatScalar(in + i, out + i, n - i, swap, slope, offset, acc);
+}
+
+DICOM_TARGET_AVX2 static void DecodeUShortToFloatAVX2(const unsigned short* in, float* out, int n, bool swap,
+                                                      float slope, float offset, DICOMPixelAccumulator* acc)
+{
+  const __m256 s = _mm256_set1_ps(slope);
+  const __m256 o = _mm256_set1_ps(offset);
+
+  __m256 vmin = _mm256_set1_ps(3.0e38f);
+  __m256 vmax = _mm256_set1_ps(-3.0e38f);
+  __m256d vsum = _mm256_setzero_pd();
+
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*> (in + i));
+    if (swap)
+      {
+      v = SwapBytesSSE2(v);
+      }
+    __m256 r = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(v)), s), o);
+    _mm256_storeu_ps(out + i, r);
+
+    if (acc)
+      {
+      AccumulateFloatsAVX2(r, vmin, vmax, vsum, out + i, acc);
+      }
+    }
+
+  if (acc && i > 0)
+    {
+    FinishFloatsAVX2(vmin, vmax, vsum, i, acc);
+    }
+  DecodeUShortToFloatScalar(in + i, out + i, n - i, swap, slope, offset, acc);
+}
+
+template <bool TRescale>
+DICOM_TARGET_AVX2 static void DecodeShortToShortAVX2(const short* in, short* out, int n, bool swap,
+                                                     float slope, float offset, short padding,
+                                                     DICOMPixelAccumulator* acc)
+{
+  const __m256 s = _mm256_set1_ps(slope);
+  const __m256 o = _mm256_set1_ps(offset);
+  const __m256i pad = _mm256_set1_epi16(padding);
+  const __m256i ones = _mm256_set1_epi16(1);
+
+  __m256i vmin = _mm256_set1_epi16(32767);
+  __m256i vmax = _mm256_set1_epi16(-32768);
+  __m256i vsum = _mm256_setzero_si256();
+  double sum = 0.0;
+  int block = 0;
+
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+    {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*> (in + i));
+    if (swap)
+      {
+      v = _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8));
+      }
+
+    // padding values become 0
+    v = _mm256_andnot_si256(_mm256_cmpeq_epi16(v, pad), v);
+
+    __m256i r = v;
+    if (TRescale)
+      {
+      __m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(v));
+      __m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1));
+
+      // keep the low 16 bits, so the pack below can't saturate
+      lo = _mm256_srai_epi32(_mm256_slli_epi32(RescaleEpi32AVX2(lo, s, o), 16), 16);
+      hi = _mm256_srai_epi32(_mm256_slli_epi32(RescaleEpi32AVX2(hi, s, o), 16), 16);
+
+      r = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+      }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*> (out + i), r);
+
+    if (acc)
+      {
+      vmin = _mm256_min_epi16(vmin, r);
+      vmax = _mm256_max_epi16(vmax, r);
+      vsum = _mm256_add_epi32(vsum, _mm256_madd_epi16(r, ones));
+      if (++block == SUM_BLOCK)
+        {
+        sum += SumEpi32SSE2(_mm_add_epi32(_mm256_castsi256_si128(vsum), _mm256_extracti128_si256(vsum, 1)));
+        vsum = _mm256_setzero_si256();
+        block = 0;
+        }
+      CountShortBinsSSE2(_mm256_castsi256_si128(r), acc);
+      CountShortBinsSSE2(_mm256_extracti128_si256(r, 1), acc);
+      }
+    }
+
+  if (acc && i > 0)
+    {
+    sum += SumEpi32SSE2(_mm_add_epi32(_mm256_castsi256_si128(vsum), _mm256_extracti128_si256(vsum, 1)));
+    FinishShortsSSE2(_mm_min_epi16(_mm256_castsi256_si128(vmin), _mm256_extracti128_si256(vmin, 1)),
+                     _mm_max_epi16(_mm256_castsi256_si128(vmax), _mm256_extracti128_si256(vmax, 1)),
+                     sum, i, acc);
+    }
+  DecodeShortToShortScalar<TRescale>(in + i, out + i, n - i, swap, slope, offset, padding, acc);
+}
+
+//
+// Vector byte swaps.  SSE2 has no byte shuffle, so it swaps the
+// bytes of each 16 bit word with shifts and then reverses the
+// words of each 32 or 64 bit value; AVX2 does it all with one
+// byte shuffle.  The shuffle patterns give the source byte of
+// each output byte and repeat in each 128 bit lane.
+//
+DICOM_TARGET_SSE2 static inline __m128i SwapWordsSSE2(__m128i v, int width)
+{
+  v = SwapBytesSSE2(v);
+  if (width == 4)
+    {
+    v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xB1), 0xB1);
+    }
+  else if (width == 8)
+    {
+    v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0x1B), 0x1B);
+    }
+  return v;
+}
+
+template <class T>
+DICOM_TARGET_SSE2 static void SwapBytesSSE2(const T* in, T* out, size_t count)
+{
+  const size_t step = 16 / sizeof(T);
+  size_t i = 0;
+  for (; i + 4 * step <= count; i += 4 * step)
+    {
+    __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*> (in + i));
+    __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*> (in + i + step));
+    __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i*> (in + i + 2 * step));
+    __m128i v3 = _mm_loadu_si128(reinterpret_cast<const __m128i*> (in + i + 3 * step));
+    _mm_storeu_si128(reinterpret_cast<__m128i*> (out + i), SwapWordsSSE2(v0, sizeof(T)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*> (out + i + step), SwapWordsSSE2(v1, sizeof(T)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*> (out + i + 2 * step), SwapWordsSSE2(v2, sizeof(T)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*> (out + i + 3 * step), SwapWordsSSE2(v3, sizeof(T)));
+    }
+  for (; i + step <= count; i += step)
+    {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*> (in + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*> (out + i), SwapWordsSSE2(v, sizeof(T)));
+    }
+  SwapBytesScalar(in + i, out + i, count - i);
+}
+
+template <class T>
+DICOM_TARGET_AVX2 static void SwapBytesAVX2(const T* in, T* out, size_t count)
+{
+  __m256i pattern;
+  if (sizeof(T) == 2)
+    {
+    pattern = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                               1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    }
+  else if (sizeof(T) == 4)
+    {
+    pattern = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                               3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    }
+  else
+    {
+    pattern = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                               7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    }
+
+  //
+  // Swap a few values first to align the stores; a 32 byte
+  // access that crosses a cache line costs twice as much.  In
+  // place, that aligns the loads too.
+  //
+  const size_t step = 32 / sizeof(T);
+  size_t i = 0;
+  uintptr_t address = reinterpret_cast<uintptr_t> (out);
+  if (address % sizeof(T) == 0)
+    {
+    size_t head = ((32 - (address & 31)) & 31) / sizeof(T);
+    head = head < count ? head : count;
+    SwapBytesScalar(in, out, head);
+    i = head;
+    }
+  for (; i + 4 * step <= count; i += 4 * step)
+    {
+    __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*> (in + i));
+    __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*> (in + i + step));
+    __m256i v2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*> (in + i + 2 * step));
+    __m256i v3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*> (in + i + 3 * step));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*> (out + i), _mm256_shuffle_epi8(v0, pattern));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*> (out + i + step), _mm256_shuffle_epi8(v1, pattern));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*> (out + i + 2 * step), _mm256_shuffle_epi8(v2, pattern));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*> (out + i + 3 * step), _mm256_shuffle_epi8(v3, pattern));
+    }
+  for (; i + step <= count; i += step)
+    {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*> (in + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*> (out + i), _mm256_shuffle_epi8(v, pattern));
+    }
+  SwapBytesScalar(in + i, out + i, count - i);
+}
+
+//
+// Vector resampling rows.  The rounding adds 0.5 carrying the
+// sign of the clamped value and truncates, which is what the
+// scalar code does; cvtps would round ties to even instead.
+// The 32 bit results are within the 16 bit range, so the packs
+// don't saturate.
+//
+DICOM_TARGET_SSE2 static inline __m128i RoundEpi32SSE2(__m128 v)
+{
+  const __m128 sign = _mm_castsi128_ps(_mm_set1_epi32(int(0x80000000)));
+  __m128 c = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-32768.0f)), _mm_set1_ps(32767.0f));
+  __m128 half = _mm_or_ps(_mm_and_ps(c, sign), _mm_set1_ps(0.5f));
+  return _mm_cvttps_epi32(_mm_add_ps(c, half));
+}
+
+DICOM_TARGET_SSE2 static void RoundFloatToShortSSE2(const float* in, short* out, size_t count)
+{
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8)
+    {
+    __m128i lo = RoundEpi32SSE2(_mm_loadu_ps(in + i));
+    __m128i hi = RoundEpi32SSE2(_mm_loadu_ps(in + i + 4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*> (out + i), _mm_packs_epi32(lo, hi));
+    }
+  RoundFloatToShortScalar(in + i, out + i, count - i);
+}
+
+DICOM_TARGET_SSE2 static void BlendShortToShortSSE2(const short* in0, const short* in1, short* out, size_t count,
+                                                    float weight0, float weight1)
+{
+  const __m128 w0 = _mm_set1_ps(weight0);
+  const __m128 w1 = _mm_set1_ps(weight1);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8)
+    {
+    __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*> (in0 + i));
+    __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*> (in1 + i));
+
+    // sign extend to 32 bits
+    __m128 lo0 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v0, v0), 16));
+    __m128 hi0 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v0, v0), 16));
+    __m128 lo1 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v1, v1), 16));
+    __m128 hi1 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v1, v1), 16));
+
+    __m128i lo = RoundEpi32SSE2(_mm_add_ps(_mm_mul_ps(lo0, w0), _mm_mul_ps(lo1, w1)));
+    __m128i hi = RoundEpi32SSE2(_mm_add_ps(_mm_mul_ps(hi0, w0), _mm_mul_ps(hi1, w1)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*> (out + i), _mm_packs_epi32(lo, hi));
+    }
+  BlendShortToShortScalar(in0 + i, in1 + i, out + i, count - i, weight0, weight1);
+}
+
+DICOM_TARGET_AVX2 static inline __m256i RoundEpi32AVX2(__m256 v)
+{
+  const __m256 sign = _mm256_castsi256_ps(_mm256_set1_epi32(int(0x80000000)));
+  __m256 c = _mm256_min_ps(_mm256_max_ps(v, _mm256_set1_ps(-32768.0f)), _mm256_set1_ps(32767.0f));
+  __m256 half = _mm256_or_ps(_mm256_and_ps(c, sign), _mm256_set1_ps(0.5f));
+  return _mm256_cvttps_epi32(_mm256_add_ps(c, half));
+}
+
+DICOM_TARGET_AVX2 static void RoundFloatToShortAVX2(const float* in, short* out, size_t count)
+{
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16)
+    {
+    __m256i lo = RoundEpi32AVX2(_mm256_loadu_ps(in + i));
+    __m256i hi = RoundEpi32AVX2(_mm256_loadu_ps(in + i + 8));
+    __m256i r = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*> (out + i), r);
+    }
+  RoundFloatToShortScalar(in + i, out + i, count - i);
+}
+
+DICOM_TARGET_AVX2 static void BlendShortToShortAVX2(const short* in0, const short* in1, short* out, size_t count,
+                                                    float weight0, float weight1)
+{
+  const __m256 w0 = _mm256_set1_ps(weight0);
+  const __m256 w1 = _mm256_set1_ps(weight1);
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16)
+    {
+    __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*> (in0 + i));
+    __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*> (in1 + i));
+
+    __m256 lo0 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v0)));
+    __m256 hi0 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(v0, 1)));
+    __m256 lo1 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v1)));
+    __m256 hi1 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(v1, 1)));
+
+    __m256i lo = RoundEpi32AVX2(_mm256_add_ps(_mm256_mul_ps(lo0, w0), _mm256_mul_ps(lo1, w1)));
+    __m256i hi = RoundEpi32AVX2(_mm256_add_ps(_mm256_mul_ps(hi0, w0), _mm256_mul_ps(hi1, w1)));
+    __m256i r = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*> (out + i), r);
+    }
+  BlendShortToShortScalar(in0 + i, in1 + i, out + i, count - i, weight0, weight1);
+}
+
+//
+// SSE2 has no gather, so it loads the four taps one by one and
+// vectorizes the arithmetic; AVX2 gathers eight.
+//
+DICOM_TARGET_SSE2 static void InterpolateFloatSSE2(const float* in, const uint32_t* index, const float* weight,
+                                                   unsigned int taps, float* out, size_t count)
+{
+  size_t i = 0;
+  if (taps)
+    {
+    for (; i + 4 <= count; i += 4)
+      {
+      const uint32_t* idx = index + i;
+      __m128 sum = _mm_mul_ps(_mm_loadu_ps(weight + i),
+                              _mm_setr_ps(in[idx[0]], in[idx[1]], in[idx[2]], in[idx[3]]));
+      for (unsigned int t = 1; t < taps; t++)
+        {
+        idx = index + t * count + i;
+        __m128 v = _mm_setr_ps(in[idx[0]], in[idx[1]], in[idx[2]], in[idx[3]]);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(weight + t * count + i), v));
+        }
+      _mm_storeu_ps(out + i, sum);
+      }
+    }
+  InterpolateFloatScalar(in, index, weight, taps, out, i, count);
+}
+
+DICOM_TARGET_AVX2 static void InterpolateFloatAVX2(const float* in, const uint32_t* index, const float* weight,
+                                                   unsigned int taps, float* out, size_t count)
+{
+  size_t i = 0;
+  if (taps)
+    {
+    for (; i + 8 <= count; i += 8)
+      {
+      __m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i*> (index + i));
+      __m256 sum = _mm256_mul_ps(_mm256_loadu_ps(weight + i), _mm256_i32gather_ps(in, idx, 4));
+      for (unsigned int t = 1; t < taps; t++)
+        {
+        idx = _mm256_loadu_si256(reinterpret_cast<const __m256i*> (index + t * count + i));
+        __m256 v = _mm256_i32gather_ps(in, idx, 4);
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(weight + t * count + i), v));
+        }
+      _mm256_storeu_ps(out + i, sum);
+      }
+    }
+  InterpolateFloatScalar(in, index, weight, taps, out, i, count);
+}
+
+#endif // DICOM_PIXEL_KERNELS_X86
+
+static DICOMPixelKernels::InstructionSets DetectInstructionSet()
+{
+#ifdef DICOM_PIXEL_KERNELS_X86
+  bool sse2 = false;
+  bool avx2 = false;
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  int maxLeaf = info[0];
+  __cpuid(info, 1);
+  sse2 = (info[3] & (1 << 26)) != 0;
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  bool avx = (info[2] & (1 << 28)) != 0;
+  //
+  // AVX2 also needs the OS to save the ymm registers.
+  //
+  if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6)
+    {
+    __cpuidex(info, 7, 0);
+    avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+  __builtin_cpu_init();
+  sse2 = __builtin_cpu_supports("sse2") != 0;
+  avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+  if (avx2)
+    {
+    return DICOMPixelKernels::AVX2;
+    }
+  if (sse2)
+    {
+    return DICOMPixelKernels::SSE2;
+    }
+#endif
+  return DICOMPixelKernels::SCALAR;
+}
+
+DICOMPixelKernels::InstructionSets DICOMPixelKernels::GetInstructionSet()
+{
+  static const InstructionSets set = DetectInstructionSet();
+  return set;
+}
+
+const char* DICOMPixelKernels::GetInstructionSetName(InstructionSets set)
+{
+  switch (set)
+    {
+    case SSE2:
+      return "SSE2";
+    case AVX2:
+      return "AVX2";
+    default:
+      return "scalar";
+    }
+}
+
+void DICOMPixelStatistics::Clear()
+{
+  this->Count = 0;
+  this->Min = 0.0;
+  this->Max = 0.0;
+  this->Sum = 0.0;
+  this->HistogramOrigin = 0.0;
+  this->HistogramBinWidth = 1.0;
+  for (int b = 0; b < HISTOGRAM_BINS; b++)
+    {
+    this->Histogram[b] = 0;
+    }
+}
+
+void DICOMPixelStatistics::Merge(const DICOMPixelStatistics& other)
+{
+  if (other.Count == 0)
+    {
+    return;
+    }
+  if (this->Count == 0)
+    {
+    this->Min = other.Min;
+    this->Max = other.Max;
+    this->HistogramOrigin = other.HistogramOrigin;
+    this->HistogramBinWidth = other.HistogramBinWidth;
+    }
+  else
+    {
+    if (other.Min < this->Min)
+      {
+      this->Min = other.Min;
+      }
+    if (other.Max > this->Max)
+      {
+      this->Max = other.Max;
+      }
+    }
+  this->Count += other.Count;
+  this->Sum += other.Sum;
+  for (int b = 0; b < HISTOGRAM_BINS; b++)
+    {
+    this->Histogram[b] += other.Histogram[b];
+    }
+}
+
+//
+// Never use a set the CPU doesn't have, whatever was asked for.
+//
+static DICOMPixelKernels::InstructionSets ClampInstructionSet(DICOMPixelKernels::InstructionSets set)
+{
+  DICOMPixelKernels::InstructionSets best = DICOMPixelKernels::GetInstructionSet();
+  return set > best ? best : set;
+}
+
+//
+// Accumulator for a call, or NULL if no statistics were asked
+// for.
+//
+static DICOMPixelAccumulator* StartStatistics(DICOMPixelStatistics* stats, DICOMPixelAccumulator& acc)
+{
+  if (!stats)
+    {
+    return NULL;
+    }
+  acc.Count = 0;
+  acc.Min = 0.0;
+  acc.Max = 0.0;
+  acc.Sum = 0.0;
+  memset(acc.Bins, 0, sizeof(acc.Bins));
+  return &acc;
+}
+
+static void FinishStatistics(DICOMPixelStatistics* stats, const DICOMPixelAccumulator* acc,
+                             double origin, double width)
+{
+  if (!acc)
+    {
+    return;
+    }
+  DICOMPixelStatistics add;
+  add.Count = acc->Count;
+  add.Min = acc->Min;
+  add.Max = acc->Max;
+  add.Sum = acc->Sum;
+  add.HistogramOrigin = origin;
+  add.HistogramBinWidth = width;
+  for (int b = 0; b < DICOMPixelStatistics::HISTOGRAM_BINS; b++)
+    {
+    add.Histogram[b] = 0;
+    for (int c = 0; c < BIN_COPIES; c++)
+      {
+      add.Histogram[b] += acc->Bins[c][b];
+      }
+    }
+  stats->Merge(add);
+}
+
+void DICOMPixelKernels::DecodeUCharToChar(const unsigned char* in, char* out, int n,
+                                          float slope, float offset, bool swap,
+                                          DICOMPixelStatistics* stats, InstructionSets set)
+{
+  DICOMPixelAccumulator storage;
+  DICOMPixelAccumulator* acc = StartStatistics(stats, storage);
+
+  switch (ClampInstructionSet(set))
+    {
+#ifdef DICOM_PIXEL_KERNELS_X86
+    case AVX2:
+      DecodeUCharToCharAVX2(in, out, n, swap, slope, offset, acc);
+      break;
+    case SSE2:
+      DecodeUCharToCharSSE2(in, out, n, swap, slope, offset, acc);
+      break;
+#endif
+    default:
+      DecodeUCharToCharScalar(in, out, n, swap, slope, offset, acc);
+      break;
+    }
+
+  FinishStatistics(stats, acc, -128.0, 1.0);
+}
+
+void DICOMPixelKernels::DecodeUCharToFloat(const unsigned char* in, float* out, int n,
+                                           float slope, float offset, bool swap,
+                                           DICOMPixelStatistics* stats, InstructionSets set)
+{
+  DICOMPixelAccumulator storage;
+  DICOMPixelAccumulator* acc = StartStatistics(stats, storage);
+
+  switch (ClampInstructionSet(set))
+    {
+#ifdef DICOM_PIXEL_KERNELS_X86
+    case AVX2:
+      DecodeUCharToFloatAVX2(in, out, n, swap, slope, offset, acc);
+      break;
+    case SSE2:
+      DecodeUCharToFloatSSE2(in, out, n, swap, slope, offset, acc);
+      break;
+#endif
+    default:
+      DecodeUCharToFloatScalar(in, out, n, swap, slope, offset, acc);
+      break;
+    }
+
+  FinishStatistics(stats, acc, -32768.0, 256.0);
+}
+
+void DICOMPixelKernels::DecodeUShortToFloat(const unsigned short* in, float* out, int n,
+                                            float slope, float offset, bool swap,
+                                            DICOMPixelStatistics* stats, InstructionSets set)
+{
+  DICOMPixelAccumulator storage;
+  DICOMPixelAccumulator* acc = StartStatistics(stats, storage);
+
+  switch (ClampInstructionSet(set))
+    {
+#ifdef DICOM_PIXEL_KERNELS_X86
+    case AVX2:
+      DecodeUShortToFloatAVX2(in, out, n, swap, slope, offset, acc);
+      break;
+    case SSE2:
+      DecodeUShortToFloatSSE2(in, out, n, swap, slope, offset, acc);
+      break;
+#endif
+    default:
+      DecodeUShortToFloatScalar(in, out, n, swap, slope, offset, acc);
+      break;
+    }
+
+  FinishStatistics(stats, acc, -32768.0, 256.0);
+}
+
+void DICOMPixelKernels::DecodeShortToShort(const short* in, short* out, int n,
+                                           float slope, float offset, short padding,
+                                           bool swap, DICOMPixelStatistics* stats,
+                                           InstructionSets set)
+{
+  DICOMPixelAccumulator storage;
+  DICOMPixelAccumulator* acc = StartStatistics(stats, storage);
+
+  switch (ClampInstructionSet(set))
+    {
+#ifdef DICOM_PIXEL_KERNELS_X86
+    case AVX2:
+      DecodeShortToShortAVX2<true>(in, out, n, swap, slope, offset, padding, acc);
+      break;
+    case SSE2:
+      DecodeShortToShortSSE2<true>(in, out, n, swap, slope, offset, padding, acc);
+      break;
+#endif
+    default:
+      DecodeShortToShortScalar<true>(in, out, n, swap, slope, offset, padding, acc);
+      break;
+    }
+
+  FinishStatistics(stats, acc, -32768.0, 256.0);
+}
+
+template <class T>
+static void SwapBytesDispatch(const T* in, T* out, size_t count, DICOMPixelKernels::InstructionSets set)
+{
+  switch (ClampInstructionSet(set))
+    {
+#ifdef DICOM_PIXEL_KERNELS_X86
+    case DICOMPixelKernels::AVX2:
+      SwapBytesAVX2(in, out, count);
+      break;
+    case DICOMPixelKernels::SSE2:
+      SwapBytesSSE2(in, out, count);
+      break;
+#endif
+    default:
+      SwapBytesScalar(in, out, count);
+      break;
+    }
+}
+
+void DICOMPixelKernels::SwapBytes16(const uint16_t* in, uint16_t* out, size_t count, InstructionSets set)
+{
+  SwapBytesDispatch(in, out, count, set);
+}
+
+void DICOMPixelKernels::SwapBytes32(const uint32_t* in, uint32_t* out, size_t count, InstructionSets set)
+{
+  SwapBytesDispatch(in, out, count, set);
+}
+
+void DICOMPixelKernels::SwapBytes64(const uint64_t* in, uint64_t* out, size_t count, InstructionSets set)
+{
+  SwapBytesDispatch(in, out, count, set);
+}
+
+void DICOMPixelKernels::CopyShortToShort(const short* in, short* out, int n, short padding,
+                                         bool swap, DICOMPixelStatistics* stats,
+                                         InstructionSets set)
+{
+  DICOMPixelAccumulator storage;
+  DICOMPixelAccumulator* acc = StartStatistics(stats, storage);
+
+  switch (ClampInstructionSet(set))
+    {
+#ifdef DICOM_PIXEL_KERNELS_X86
+    case AVX2:
+      DecodeShortToShortAVX2<false>(in, out, n, swap, 1.0f, 0.0f, padding, acc);
+      break;
+    case SSE2:
+      DecodeShortToShortSSE2<false>(in, out, n, swap, 1.0f, 0.0f, padding, acc);
+      break;
+#endif
+    default:
+      DecodeShortToShortScalar<false>(in, out, n, swap, 1.0f, 0.0f, padding, acc);
+      break;
+    }
+
+  FinishStatistics(stats, acc, -32768.0, 256.0);
+}
+
+void DICOMPixelKernels::RoundFloatToShort(const float* in, short* out, size_t count, InstructionSets set)
+{
+  switch (ClampInstructionSet(set))
+    {
+#ifdef DICOM_PIXEL_KERNELS_X86
+    case AVX2:
+      RoundFloatToShortAVX2(in, out, count);
+      break;
+    case SSE2:
+      RoundFloatToShortSSE2(in, out, count);
+      break;
+#endif
+    default:
+      RoundFloatToShortScalar(in, out, count);
+      break;
+    }
+}
+
+void DICOMPixelKernels::BlendShortToShort(const short* in0, const short* in1, short* out, size_t count,
+                                          float weight0, float weight1, InstructionSets set)
+{
+  switch (ClampInstructionSet(set))
+    {
+#ifdef DICOM_PIXEL_KERNELS_X86
+    case AVX2:
+      BlendShortToShortAVX2(in0, in1, out, count, weight0, weight1);
+      break;
+    case SSE2:
+      BlendShortToShortSSE2(in0, in1, out, count, weight0, weight1);
+      break;
+#endif
+    default:
+      BlendShortToShortScalar(in0, in1, out, count, weight0, weight1);
+      break;
+    }
+}
+
+void DICOMPixelKernels::InterpolateFloat(const float* in, const uint32_t* index, const float* weight,
+                                         unsigned int taps, float* out, size_t count, InstructionSets set)
+{
+  switch (ClampInstructionSet(set))
+    {
+#ifdef DICOM_PIXEL_KERNELS_X86
+    case AVX2:
+      InterpolateFloatAVX2(in, index, weight, taps, out, count);
+      break;
+    case SSE2:
+      InterpolateFloatSSE2(in, index, weight, taps, out, count);
+      break;
+#endif
+    default:
+      InterpolateFloatScalar(in, index, weight, taps, out, 0, count);
+      break;
+    }
+}
+
+#ifdef _MSC_VER
+#pragma warning ( pop )
+#endif
@@ -0,0 +1,215 @@
+/*=========================================================================
+
+  Program:   DICOMParser
+  Module:    $RCSfile: DICOMPixelKernels.h,v $
+  Language:  C++
+  Date:      $Date: 2003/10/23 19:13:34 $
+  Version:   $Revision: 1.1.1.1 $
+
+  Copyright (c) 2003 Matt Turek
+  All rights reserved.
+  See Copyright.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __DICOMPIXELKERNELS_H_
+#define __DICOMPIXELKERNELS_H_
+
+#ifdef _MSC_VER
+#pragma warning ( disable : 4514 )
+#pragma warning ( push, 3 )
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "DICOMConfig.h"
+
+//
+// Summary of the values a decode kernel wrote: their range,
+// sum and a coarse histogram.  The histogram has
+// HISTOGRAM_BINS bins, bin i counting the values in
+// [HistogramOrigin + i * HistogramBinWidth,
+//  HistogramOrigin + (i + 1) * HistogramBinWidth).  For char
+// output the bins are single values; for short and float
+// output they cover the 16 bit range in steps of 256, with
+// float values outside it counted in the end bins.
+//
+class DICOM_EXPORT DICOMPixelStatistics
+{
+ public:
+  enum { HISTOGRAM_BINS = 256 };
+
+  DICOMPixelStatistics()
+    {
+    this->Clear();
+    }
+
+  //
+  // Forget all values.
+  //
+  void Clear();
+
+  //
+  // Add the values summarized by other, which must be of the
+  // same output type.
+  //
+  void Merge(const DICOMPixelStatistics& other);
+
+  double GetMean() const
+    {
+    return this->Count ? this->Sum / this->Count : 0.0;
+    }
+
+  //
+  // Min, Max and Sum are only meaningful when Count is not 0.
+  // Sum is exact for char and short output.
+  //
+  uint64_t Count;
+  double Min;
+  double Max;
+  double Sum;
+  double HistogramOrigin;
+  double HistogramBinWidth;
+  uint64_t Histogram[HISTOGRAM_BINS];
+};
+
+//
+// The loops DICOMAppHelper uses to turn stored pixel values
+// into output values.  Each one reads the stored values once
+// and, in that single pass:
+//   - swaps the bytes of each 16 bit word if swap is true, as
+//     needed for pixel data left in file byte order (see
+//     DICOMParser::SetDeferPixelDataSwap),
+//   - replaces padding values by 0 where there is a padding
+//     value,
+//   - computes out = slope * in + offset in single precision
+//     and converts it to the output type by truncation, as C++
+//     does,
+//   - adds the output values to stats, if it isn't NULL.
+//
+// The resampling row kernels at the end round to nearest
+// instead, and keep no statistics.
+//
+// Each kernel has a scalar version and, on x86, SSE2 and AVX2
+// versions whose output is bit for bit the same.  The set used
+// is picked per call; by default it is the best one the CPU
+// supports, found once on first use.
+//
+class DICOM_EXPORT DICOMPixelKernels
+{
+ public:
+  enum InstructionSets
+    {
+    SCALAR = 0,
+    SSE2,
+    AVX2
+    };
+
+  //
+  // Best instruction set this CPU supports.
+  //
+  static InstructionSets GetInstructionSet();
+
+  //
+  // Name of an instruction set, for reporting.
+  //
+  static const char* GetInstructionSetName(InstructionSets set);
+
+  //
+  // 8 bit stored values to 8 bit output.  The result keeps the
+  // low 8 bits of the truncated value.  With swap, the two
+  // bytes of each 16 bit word trade places.
+  //
+  static void DecodeUCharToChar(const unsigned char* in, char* out, int n,
+                                float slope, float offset,
+                                bool swap = false,
+                                DICOMPixelStatistics* stats = NULL,
+                                InstructionSets set = GetInstructionSet());
+
+  //
+  // 8 bit stored values to float output.
+  //
+  static void DecodeUCharToFloat(const unsigned char* in, float* out, int n,
+                                 float slope, float offset,
+                                 bool swap = false,
+                                 DICOMPixelStatistics* stats = NULL,
+                                 InstructionSets set = GetInstructionSet());
+
+  //
+  // 16 bit stored values, read as unsigned, to float output.
+  //
+  static void DecodeUShortToFloat(const unsigned short* in, float* out, int n,
+                                  float slope, float offset,
+                                  bool swap = false,
+                                  DICOMPixelStatistics* stats = NULL,
+                                  InstructionSets set = GetInstructionSet());
+
+  //
+  // 16 bit signed stored values to 16 bit output.  Values equal
+  // to padding are replaced by 0 before they are rescaled.  The
+  // result keeps the low 16 bits of the truncated value.
+  //
+  static void DecodeShortToShort(const short* in, short* out, int n,
+                                 float slope, float offset, short padding,
+                                 bool swap = false,
+                                 DICOMPixelStatistics* stats = NULL,
+                                 InstructionSets set = GetInstructionSet());
+
+  //
+  // Reverse the bytes of count 16, 32 or 64 bit values from in
+  // into out.  in and out may be the same array, but must not
+  // otherwise overlap.  DICOMFile's swap functions use these.
+  //
+  static void SwapBytes16(const uint16_t* in, uint16_t* out, size_t count,
+                          InstructionSets set = GetInstructionSet());
+  static void SwapBytes32(const uint32_t* in, uint32_t* out, size_t count,
+                          InstructionSets set = GetInstructionSet());
+  static void SwapBytes64(const uint64_t* in, uint64_t* out, size_t count,
+                          InstructionSets set = GetInstructionSet());
+
+  //
+  // DecodeShortToShort with a slope of 1 and an offset of 0,
+  // without the arithmetic: only the swap and the padding.
+  //
+  static void CopyShortToShort(const short* in, short* out, int n, short padding,
+                               bool swap = false,
+                               DICOMPixelStatistics* stats = NULL,
+                               InstructionSets set = GetInstructionSet());
+
+  //
+  // The last step of a resample: count float values to 16 bit
+  // output, clamped to [-32768, 32767] and rounded half away
+  // from 0.
+  //
+  static void RoundFloatToShort(const float* in, short* out, size_t count,
+                                InstructionSets set = GetInstructionSet());
+
+  //
+  // out = weight0 * in0 + weight1 * in1 in single precision,
+  // rounded as RoundFloatToShort does: a sample between two
+  // slices in one pass.
+  //
+  static void BlendShortToShort(const short* in0, const short* in1, short* out, size_t count,
+                                float weight0, float weight1,
+                                InstructionSets set = GetInstructionSet());
+
+  //
+  // One row interpolated along itself: out[i] is the sum over
+  // taps t of weight[t * count + i] * in[index[t * count + i]],
+  // added in tap order.  With no taps out is 0.
+  //
+  static void InterpolateFloat(const float* in, const uint32_t* index, const float* weight,
+                               unsigned int taps, float* out, size_t count,
+                               InstructionSets set = GetInstructionSet());
+};
+
+#ifdef _MSC_VER
+#pragma warning ( pop )
+#endif
+
+#endif // __DICOMPIXELKERNELS_H_
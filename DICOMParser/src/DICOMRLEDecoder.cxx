@@ -0,0 +1,159 @@
+/*=========================================================================
+
+  Program:   DICOMParser
+  Module:    $RCSfile: DICOMRLEDecoder.cxx,v $
+  Language:  C++
+  Date:      $Date: 2003/10/23 19:13:34 $
+  Version:   $Revision: 1.1.1.1 $
+
+  Copyright (c) 2003 Matt Turek
+  All rights reserved.
+  See Copyright.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifdef _MSC_VER
+#pragma warning ( disable : 4514 )
+#pragma warning ( disable : 4710 )
+#pragma warning ( push, 3 )
+#endif
+
+#include <string.h>
+
+#include "DICOMConfig.h"
+#include "DICOMRLEDecoder.h"
+
+//
+// The header's numbers are little endian whatever the platform.
+//
+static size_t DICOMRLEReadUInt32(const unsigned char* p)
+{
+  return static_cast<size_t> (p[0]) | (static_cast<size_t> (p[1]) << 8) |
+    (static_cast<size_t> (p[2]) << 16) | (static_cast<size_t> (p[3]) << 24);
+}
+
+size_t DICOMRLEDecoder::DecodeSegment(const unsigned char* in, size_t length,
+                                      unsigned char* out, size_t stride, size_t count)
+{
+  const unsigned char* end = in + length;
+  size_t written = 0;
+
+  while (written < count && in < end)
+    {
+    int n = static_cast<signed char> (*in++);
+    if (n >= 0)
+      {
+      //
+      // n + 1 literal bytes.
+      //
+      size_t literal = static_cast<size_t> (n) + 1;
+      size_t available = static_cast<size_t> (end - in);
+      if (literal > available)
+        {
+        literal = available;
+        }
+      size_t run = literal;
+      if (run > count - written)
+        {
+        run = count - written;
+        }
+      if (stride == 1)
+        {
+        memcpy(out + written, in, run);
+        }
+      else
+        {
+        unsigned char* o = out + written * stride;
+        for (size_t i = 0; i < run; i++, o += stride)
+          {
+          *o = in[i];
+          }
+        }
+      in += literal;
+      written += run;
+      }
+    else if (n != -128)
+      {
+      //
+      // The next byte 1 - n times.  -128 is a no-op.
+      //
+      if (in == end)
+        {
+        break;
+        }
+      size_t run = static_cast<size_t> (1 - n);
+      if (run > count - written)
+        {
+        run = count - written;
+        }
+      unsigned char value = *in++;
+      if (stride == 1)
+        {
+        memset(out + written, value, run);
+        }
+      else
+        {
+        unsigned char* o = out + written * stride;
+        for (size_t i = 0; i < run; i++, o += stride)
+          {
+          *o = value;
+          }
+        }
+      written += run;
+      }
+    }
+
+  return written;
+}
+
+bool DICOMRLEDecoder::DecodeFrame(const unsigned char* in, size_t length,
+                                  unsigned char* out, size_t numberOfPixels,
+                                  int samplesPerPixel, int bytesPerSample)
+{
+  if (!in || length < HEADER_LENGTH || samplesPerPixel < 1 || bytesPerSample < 1)
+    {
+    return false;
+    }
+
+  size_t numberOfSegments = DICOMRLEReadUInt32(in);
+  if (numberOfSegments != static_cast<size_t> (samplesPerPixel) * bytesPerSample ||
+      numberOfSegments > MAX_SEGMENTS)
+    {
+    return false;
+    }
+
+  size_t stride = numberOfSegments;
+  for (size_t s = 0; s < numberOfSegments; s++)
+    {
+    size_t start = DICOMRLEReadUInt32(in + 4 + 4 * s);
+    size_t end = s + 1 < numberOfSegments ? DICOMRLEReadUInt32(in + 8 + 4 * s) : length;
+    if (start < HEADER_LENGTH || start > end || end > length)
+      {
+      return false;
+      }
+
+    //
+    // Segment s is byte s % bytesPerSample, counted from the
+    // most significant, of sample s / bytesPerSample.
+    //
+    size_t sample = s / bytesPerSample;
+    size_t byte = bytesPerSample - 1 - s % bytesPerSample;
+    unsigned char* o = out + sample * bytesPerSample + byte;
+
+    size_t written = DecodeSegment(in + start, end - start, o, stride, numberOfPixels);
+    for (size_t i = written; i < numberOfPixels; i++)
+      {
+      o[i * stride] = 0;
+      }
+    }
+
+  return true;
+}
+
+#ifdef _MSC_VER
+#pragma warning ( pop )
+#endif
@@ -0,0 +1,74 @@
+/*=========================================================================
+
+  Program:   DICOMParser
+  Module:    $RCSfile: DICOMRLEDecoder.h,v $
+  Language:  C++
+  Date:      $Date: 2003/10/23 19:13:34 $
+  Version:   $Revision: 1.1.1.1 $
+
+  Copyright (c) 2003 Matt Turek
+  All rights reserved.
+  See Copyright.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __DICOMRLEDECODER_H_
+#define __DICOMRLEDECODER_H_
+
+#ifdef _MSC_VER
+#pragma warning ( disable : 4514 )
+#pragma warning ( push, 3 )
+#endif
+
+#include <stddef.h>
+
+#include "DICOMConfig.h"
+
+//
+// Decoder for frames in the RLE Lossless transfer syntax
+// (1.2.840.10008.1.2.5, PS 3.5 Annex G).  A frame is a 64 byte
+// header giving the number of segments and where each starts,
+// followed by the segments.  Every segment holds one byte of
+// every sample, most significant byte first, compressed with
+// the PackBits scheme; a 16 bit RGB frame has six segments:
+// red high, red low, green high and so on.
+//
+class DICOM_EXPORT DICOMRLEDecoder
+{
+ public:
+  enum { HEADER_LENGTH = 64, MAX_SEGMENTS = 15 };
+
+  //
+  // Decode the frame in the length bytes at in to out, which
+  // takes numberOfPixels pixels of samplesPerPixel samples of
+  // bytesPerSample bytes each.  out is written the way native
+  // little endian pixel data is laid out: samples interleaved,
+  // low byte first.  A segment that decodes to fewer bytes
+  // than there are pixels leaves the rest of its bytes 0;
+  // extra bytes are ignored.  Returns false if the header
+  // doesn't describe samplesPerPixel * bytesPerSample segments
+  // that lie within the frame, in which case out is undefined.
+  //
+  static bool DecodeFrame(const unsigned char* in, size_t length,
+                          unsigned char* out, size_t numberOfPixels,
+                          int samplesPerPixel, int bytesPerSample);
+
+  //
+  // Decode one PackBits segment of length bytes to count bytes
+  // at out, stride bytes apart.  Returns the number of bytes
+  // the segment held, which may be less than count; the rest
+  // are left untouched.
+  //
+  static size_t DecodeSegment(const unsigned char* in, size_t length,
+                              unsigned char* out, size_t stride, size_t count);
+};
+
+#ifdef _MSC_VER
+#pragma warning ( pop )
+#endif
+
+#endif // __DICOMRLEDECODER_H_
@@ -21,10 +21,21 @@
 #ifndef __DICOM_TYPES_H_
 #define __DICOM_TYPES_H_
 
+#include <stdint.h>
+
 typedef unsigned short doublebyte;
 typedef int quadbyte;
 typedef unsigned short ushort;
 typedef unsigned long  ulong;
 
+//
+// Positions and sizes in a file, and the lengths of values.
+// These are 64 bits everywhere: long is 32 bits on Windows, and
+// a value length is an unsigned 32 bit number that a quadbyte
+// can't hold.  An undefined value length (0xFFFFFFFF) is -1.
+//
+typedef int64_t fileoffset;
+typedef int64_t valuelength;
+
 
 #endif
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <map>
+#include <string.h>
+
+#include "DicomBrickVolume.h"
+
+namespace
+{
+    // Copy the brick of volume starting at (uiX, uiY, uiZ) into piBrick,
+    // repeating the last voxel on each axis past the edges.  Returns true
+    // if every voxel has the same value.
+    bool ReadBrick( const DicomVolume & volume,
+                    const uint32_t      uiX,
+                    const uint32_t      uiY,
+                    const uint32_t      uiZ,
+                    int16_t *           piBrick )
+    {
+        const uint32_t  uiCount = std::min(uint32_t(DicomBrickVolume::BRICK_SIZE), volume.uiSizeX - uiX);
+        int16_t *       piRow = piBrick;
+
+        for (uint32_t z = 0; z < DicomBrickVolume::BRICK_SIZE; z++)
+        {
+            const uint32_t  uiSrcZ = std::min(uiZ + z, volume.uiSizeZ - 1);
+            for (uint32_t y = 0; y < DicomBrickVolume::BRICK_SIZE; y++)
+            {
+                const uint32_t  uiSrcY = std::min(uiY + y, volume.uiSizeY - 1);
+                const int16_t * piSrc = volume.GetRow(uiX, uiSrcY, uiSrcZ, uiCount, NULL);
+                memcpy(piRow, piSrc, uiCount * sizeof(int16_t));
+                std::fill(piRow + uiCount, piRow + DicomBrickVolume::BRICK_SIZE, piSrc[uiCount - 1]);
+                piRow += DicomBrickVolume::BRICK_SIZE;
+            }
+        }
+
+        for (uint32_t i = 1; i < DicomBrickVolume::BRICK_VOXELS; i++)
+        {
+            if (piBrick[i] != piBrick[0])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+void DicomBrickVolume::FromLinear( const DicomVolume & volume )
+{
+    uiSizeX = volume.uiSizeX;
+    uiSizeY = volume.uiSizeY;
+    uiSizeZ = volume.uiSizeZ;
+    uiBricksX = (uiSizeX + BRICK_MASK) >> BRICK_SHIFT;
+    uiBricksY = (uiSizeY + BRICK_MASK) >> BRICK_SHIFT;
+    uiBricksZ = (uiSizeZ + BRICK_MASK) >> BRICK_SHIFT;
+    fXSpacing = volume.fXSpacing;
+    fYSpacing = volume.fYSpacing;
+    fZSpacing = volume.fZSpacing;
+
+    const size_t    uiNumBricks = size_t(uiBricksX) * uiBricksY * uiBricksZ;
+    vuiBricks.assign(uiNumBricks, 0);
+    viVoxels.clear();
+    viVoxels.reserve(uiNumBricks * BRICK_VOXELS);
+
+    // where the one copy of each constant brick is, by its value
+    std::map<int16_t, uint64_t> mConstant;
+    std::vector<int16_t>        viBrick(BRICK_VOXELS);
+
+    size_t  uiBrick = 0;
+    for (uint32_t z = 0; z < uiBricksZ; z++)
+    {
+        for (uint32_t y = 0; y < uiBricksY; y++)
+        {
+            for (uint32_t x = 0; x < uiBricksX; x++, uiBrick++)
+            {
+                const bool  bConstant = ReadBrick(volume, x << BRICK_SHIFT, y << BRICK_SHIFT, z << BRICK_SHIFT, viBrick.data());
+                if (bConstant)
+                {
+                    std::map<int16_t, uint64_t>::const_iterator it = mConstant.find(viBrick[0]);
+                    if (it != mConstant.end())
+                    {
+                        vuiBricks[uiBrick] = it->second;
+                        continue;
+                    }
+                    mConstant[viBrick[0]] = viVoxels.size();
+                }
+
+                vuiBricks[uiBrick] = viVoxels.size();
+                viVoxels.insert(viVoxels.end(), viBrick.begin(), viBrick.end());
+            }
+        }
+    }
+
+    viVoxels.shrink_to_fit();
+}
+
+void DicomBrickVolume::ToLinear( DicomVolume & volume ) const
+{
+    volume.uiSizeX = uiSizeX;
+    volume.uiSizeY = uiSizeY;
+    volume.uiSizeZ = uiSizeZ;
+    volume.fXSpacing = fXSpacing;
+    volume.fYSpacing = fYSpacing;
+    volume.fZSpacing = fZSpacing;
+    volume.statistics.Clear();
+    volume.viVoxels.resize(size_t(uiSizeX) * uiSizeY * uiSizeZ);
+
+    int16_t *   piRow = volume.viVoxels.data();
+    for (uint32_t z = 0; z < uiSizeZ; z++)
+    {
+        for (uint32_t y = 0; y < uiSizeY; y++)
+        {
+            GetRow(0, y, z, uiSizeX, piRow);
+            piRow += uiSizeX;
+        }
+    }
+}
+
+const int16_t * DicomBrickVolume::GetRow(   const uint32_t  x,
+                                            const uint32_t  y,
+                                            const uint32_t  z,
+                                            const uint32_t  uiCount,
+                                            int16_t *       piBuffer    ) const
+{
+    uint32_t    uiX = x;
+    uint32_t    uiDone = 0;
+    while (uiDone < uiCount)
+    {
+        // the rest of this brick's row, or of the request
+        const uint32_t  uiRun = std::min(uiCount - uiDone, BRICK_SIZE - (uiX & BRICK_MASK));
+        memcpy(piBuffer + uiDone, &viVoxels[vuiBricks[Brick(uiX, y, z)] + Offset(uiX, y, z)], uiRun * sizeof(int16_t));
+        uiX += uiRun;
+        uiDone += uiRun;
+    }
+    return piBuffer;
+}
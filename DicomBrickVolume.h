@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "DicomVolume.h"
+
+// A volume stored as cubic bricks of BRICK_SIZE voxels a side instead of
+// one slice after another.
+//
+// Each brick is 8 KB, x fastest, then y, then z, so the voxels around any
+// position are a few cache lines and one page away, whichever way the
+// volume is walked; in a linear volume a step in z is a whole slice away.
+// Bricks on the far edges of the volume are padded by repeating its last
+// voxel on each axis.
+//
+// vuiBricks is the brick index: where in viVoxels each brick starts,
+// bricks x fastest, then y, then z.  Bricks whose voxels are all the same
+// value, such as the air around a patient, share a single copy.
+//
+// At, GetRow and GetCell match those of DicomVolume, so the volume
+// templates take either layout.
+struct DicomBrickVolume
+{
+    enum
+    {
+        BRICK_SHIFT = 4,
+        BRICK_SIZE = 1 << BRICK_SHIFT,
+        BRICK_MASK = BRICK_SIZE - 1,
+        BRICK_VOXELS = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE
+    };
+
+    std::vector<int16_t>    viVoxels;
+    std::vector<uint64_t>   vuiBricks;
+    uint32_t                uiSizeX = 0;
+    uint32_t                uiSizeY = 0;
+    uint32_t                uiSizeZ = 0;
+    uint32_t                uiBricksX = 0;
+    uint32_t                uiBricksY = 0;
+    uint32_t                uiBricksZ = 0;
+    float                   fXSpacing = 0.0f;
+    float                   fYSpacing = 0.0f;
+    float                   fZSpacing = 0.0f;
+
+    // Brick the voxels of volume, replacing everything held.
+    void    FromLinear( const DicomVolume & volume );
+
+    // Unbrick into volume, replacing its voxels; its statistics are
+    // cleared.
+    void    ToLinear( DicomVolume & volume ) const;
+
+    size_t  Brick( const uint32_t x, const uint32_t y, const uint32_t z ) const
+    {
+        return (size_t(z >> BRICK_SHIFT) * uiBricksY + (y >> BRICK_SHIFT)) * uiBricksX + (x >> BRICK_SHIFT);
+    }
+
+    // Position of (x, y, z) within its brick.
+    static uint32_t Offset( const uint32_t x, const uint32_t y, const uint32_t z )
+    {
+        return ((z & BRICK_MASK) << (2 * BRICK_SHIFT)) | ((y & BRICK_MASK) << BRICK_SHIFT) | (x & BRICK_MASK);
+    }
+
+    int16_t At( const uint32_t x, const uint32_t y, const uint32_t z ) const
+    {
+        return viVoxels[vuiBricks[Brick(x, y, z)] + Offset(x, y, z)];
+    }
+
+    // uiCount voxels of row (y, z) from x on, gathered from the bricks
+    // into piBuffer, which is returned.
+    const int16_t * GetRow( const uint32_t x, const uint32_t y, const uint32_t z, const uint32_t uiCount, int16_t * piBuffer ) const;
+
+    // The 2x2x2 voxels from (x, y, z) on, x fastest.  A neighbour past
+    // the last voxel on an axis repeats it.
+    void GetCell( const uint32_t x, const uint32_t y, const uint32_t z, int16_t aiCell[8] ) const
+    {
+        if ((x & BRICK_MASK) != BRICK_MASK && (y & BRICK_MASK) != BRICK_MASK && (z & BRICK_MASK) != BRICK_MASK)
+        {
+            // all in one brick, whose padding repeats the last voxels
+            const int16_t * p = &viVoxels[vuiBricks[Brick(x, y, z)] + Offset(x, y, z)];
+            aiCell[0] = p[0];
+            aiCell[1] = p[1];
+            aiCell[2] = p[BRICK_SIZE];
+            aiCell[3] = p[BRICK_SIZE + 1];
+            aiCell[4] = p[BRICK_SIZE * BRICK_SIZE];
+            aiCell[5] = p[BRICK_SIZE * BRICK_SIZE + 1];
+            aiCell[6] = p[BRICK_SIZE * BRICK_SIZE + BRICK_SIZE];
+            aiCell[7] = p[BRICK_SIZE * BRICK_SIZE + BRICK_SIZE + 1];
+            return;
+        }
+
+        const uint32_t  x1 = x + 1 < uiSizeX ? x + 1 : x;
+        const uint32_t  y1 = y + 1 < uiSizeY ? y + 1 : y;
+        const uint32_t  z1 = z + 1 < uiSizeZ ? z + 1 : z;
+        aiCell[0] = At(x, y, z);
+        aiCell[1] = At(x1, y, z);
+        aiCell[2] = At(x, y1, z);
+        aiCell[3] = At(x1, y1, z);
+        aiCell[4] = At(x, y, z1);
+        aiCell[5] = At(x1, y, z1);
+        aiCell[6] = At(x, y1, z1);
+        aiCell[7] = At(x1, y1, z1);
+    }
+};
@@ -0,0 +1,337 @@
+#include <algorithm>
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+
+#include "DicomIndex.h"
+
+namespace
+{
+    const char      acIndexMagic[8] = { 'D', 'C', 'M', 'I', 'N', 'D', 'E', 'X' };
+    const uint32_t  uiIndexVersion = 5;
+    const uint32_t  uiIndexByteOrder = 0x01020304;
+
+    struct DicomIndexHeader
+    {
+        char        acMagic[8];
+        uint32_t    uiVersion;
+        uint32_t    uiByteOrder;
+        uint32_t    uiRecordSize;
+        uint32_t    uiNumRecords;
+        uint64_t    uiStringsOffset;    // from the start of the file
+        uint64_t    uiStringsSize;
+    };
+
+    // One file.  Strings are (offset, length) into the string table.
+    struct DicomIndexRecord
+    {
+        uint64_t    uiFileSize;
+        int64_t     iModified;
+        int64_t     iPixelDataOffset;
+        int64_t     iPixelDataLength;
+        int64_t     iPixelDataDeflateOffset;
+        uint32_t    uiNameOffset;
+        uint32_t    uiNameLength;
+        uint32_t    uiSeriesOffset;
+        uint32_t    uiSeriesLength;
+        uint32_t    uiPhotometricOffset;
+        uint32_t    uiPhotometricLength;
+        uint32_t    uiTransferSyntaxOffset;
+        uint32_t    uiTransferSyntaxLength;
+        uint32_t    uiPixelDataType;
+        uint16_t    uiPixelDataGroup;
+        uint16_t    uiPixelDataElement;
+        int32_t     iSliceNumber;
+        float       fSliceLocation;
+        float       afImagePositionPatient[3];
+        float       afImageOrientationPatient[6];
+        int32_t     aiDimensions[2];
+        float       afPixelSpacing[3];
+        int32_t     iBitsAllocated;
+        int32_t     iPixelRepresentation;
+        float       fRescaleSlope;
+        float       fRescaleOffset;
+        int32_t     iNumberOfFrames;
+        uint8_t     uiImage;
+        uint8_t     uiToggleByteSwapImageData;
+        uint8_t     uiFileByteSwap;
+        uint8_t     uiEncapsulated;
+    };
+
+    static_assert(sizeof(DicomIndexHeader) % 8 == 0, "index header must keep records aligned");
+    static_assert(sizeof(DicomIndexRecord) % 8 == 0, "index records must stay aligned");
+
+    // Byte-wise name order, used both to sort the records and to search them.
+    int CompareNames( const char * pcA, const size_t uiA, const char * pcB, const size_t uiB )
+    {
+        int iCmp = memcmp(pcA, pcB, std::min(uiA, uiB));
+        if (iCmp != 0)
+        {
+            return iCmp;
+        }
+        return uiA < uiB ? -1 : (uiA > uiB ? 1 : 0);
+    }
+
+    bool EntryLess( const DicomIndexEntry * pA, const DicomIndexEntry * pB )
+    {
+        return CompareNames(pA->stamp.strName.data(), pA->stamp.strName.size(),
+                            pB->stamp.strName.data(), pB->stamp.strName.size()) < 0;
+    }
+
+    void AddString( std::string & strStrings, const std::string & str, uint32_t & uiOffset, uint32_t & uiLength )
+    {
+        uiOffset = uint32_t(strStrings.size());
+        uiLength = uint32_t(str.size());
+        strStrings += str;
+    }
+}
+
+DicomIndex::DicomIndex()
+{
+    pData = NULL;
+    uiSize = 0;
+    uiNumRecords = 0;
+}
+
+bool DicomIndex::Open( const std::string & strIndexFile )
+{
+    Close();
+
+    if (!file.Open(strIndexFile))
+    {
+        return false;
+    }
+
+    const fileoffset    lSize = file.GetSize();
+    if (lSize < fileoffset(sizeof(DicomIndexHeader)))
+    {
+        Close();
+        return false;
+    }
+
+    const unsigned char *       pView = file.ReadView(lSize);
+    const DicomIndexHeader *    pHeader = reinterpret_cast<const DicomIndexHeader *>(pView);
+
+    if (pView == NULL ||
+        memcmp(pHeader->acMagic, acIndexMagic, sizeof(acIndexMagic)) != 0 ||
+        pHeader->uiVersion != uiIndexVersion ||
+        pHeader->uiByteOrder != uiIndexByteOrder ||
+        pHeader->uiRecordSize != sizeof(DicomIndexRecord))
+    {
+        Close();
+        return false;
+    }
+
+    // written so that a hostile offset or size can't wrap around
+    const uint64_t  uiRecordsEnd = sizeof(DicomIndexHeader) + uint64_t(pHeader->uiNumRecords) * sizeof(DicomIndexRecord);
+    if (uiRecordsEnd > pHeader->uiStringsOffset ||
+        pHeader->uiStringsOffset > uint64_t(lSize) ||
+        pHeader->uiStringsSize > uint64_t(lSize) - pHeader->uiStringsOffset)
+    {
+        Close();
+        return false;
+    }
+
+    pData = pView;
+    uiSize = uint64_t(lSize);
+    uiNumRecords = pHeader->uiNumRecords;
+    return true;
+}
+
+void DicomIndex::Close()
+{
+    file.Close();
+    pData = NULL;
+    uiSize = 0;
+    uiNumRecords = 0;
+}
+
+uint32_t DicomIndex::GetNumEntries() const
+{
+    return uiNumRecords;
+}
+
+bool DicomIndex::Find( const DicomFileStamp & stamp, DicomIndexEntry & entry ) const
+{
+    if (pData == NULL)
+    {
+        return false;
+    }
+
+    const DicomIndexHeader *    pHeader = reinterpret_cast<const DicomIndexHeader *>(pData);
+    const DicomIndexRecord *    pRecords = reinterpret_cast<const DicomIndexRecord *>(pData + sizeof(DicomIndexHeader));
+    const char *                pcStrings = reinterpret_cast<const char *>(pData + pHeader->uiStringsOffset);
+    const uint64_t              uiStringsSize = pHeader->uiStringsSize;
+
+    // a string is only trusted if it lies inside the table
+    auto    validString = [uiStringsSize]( uint32_t uiOffset, uint32_t uiLength )
+    {
+        return uint64_t(uiOffset) + uiLength <= uiStringsSize;
+    };
+
+    uint32_t    uiLo = 0;
+    uint32_t    uiHi = uiNumRecords;
+    while (uiLo < uiHi)
+    {
+        const uint32_t              uiMid = uiLo + (uiHi - uiLo) / 2;
+        const DicomIndexRecord &    record = pRecords[uiMid];
+
+        if (!validString(record.uiNameOffset, record.uiNameLength))
+        {
+            return false;
+        }
+
+        int iCmp = CompareNames(pcStrings + record.uiNameOffset, record.uiNameLength,
+                                stamp.strName.data(), stamp.strName.size());
+        if (iCmp < 0)
+        {
+            uiLo = uiMid + 1;
+        }
+        else if (iCmp > 0)
+        {
+            uiHi = uiMid;
+        }
+        else
+        {
+            if (record.uiFileSize != stamp.uiSize || record.iModified != stamp.iModified ||
+                !validString(record.uiSeriesOffset, record.uiSeriesLength) ||
+                !validString(record.uiPhotometricOffset, record.uiPhotometricLength) ||
+                !validString(record.uiTransferSyntaxOffset, record.uiTransferSyntaxLength))
+            {
+                return false;
+            }
+
+            entry.stamp = stamp;
+            entry.bImage = record.uiImage != 0;
+
+            DICOMImageInfo &    info = entry.info;
+            info.FileName = stamp.strPath;
+            info.SeriesUID.assign(pcStrings + record.uiSeriesOffset, record.uiSeriesLength);
+            info.Ordering.SliceNumber = record.iSliceNumber;
+            info.Ordering.SliceLocation = record.fSliceLocation;
+            memcpy(info.Ordering.ImagePositionPatient, record.afImagePositionPatient, sizeof(record.afImagePositionPatient));
+            memcpy(info.Ordering.ImageOrientationPatient, record.afImageOrientationPatient, sizeof(record.afImageOrientationPatient));
+            info.Dimensions[0] = record.aiDimensions[0];
+            info.Dimensions[1] = record.aiDimensions[1];
+            memcpy(info.PixelSpacing, record.afPixelSpacing, sizeof(record.afPixelSpacing));
+            info.BitsAllocated = record.iBitsAllocated;
+            info.PixelRepresentation = record.iPixelRepresentation;
+            info.PhotometricInterpretation.assign(pcStrings + record.uiPhotometricOffset, record.uiPhotometricLength);
+            info.RescaleSlope = record.fRescaleSlope;
+            info.RescaleOffset = record.fRescaleOffset;
+            info.NumberOfFrames = record.iNumberOfFrames;
+            info.TransferSyntaxUID.assign(pcStrings + record.uiTransferSyntaxOffset, record.uiTransferSyntaxLength);
+            info.PixelData.Group = record.uiPixelDataGroup;
+            info.PixelData.Element = record.uiPixelDataElement;
+            info.PixelData.Type = DICOMParser::VRTypes(record.uiPixelDataType);
+            info.PixelData.Offset = record.iPixelDataOffset;
+            info.PixelData.Length = record.iPixelDataLength;
+            info.PixelData.DeflateOffset = record.iPixelDataDeflateOffset;
+            info.PixelData.ToggleByteSwapImageData = record.uiToggleByteSwapImageData != 0;
+            info.PixelData.FileByteSwap = record.uiFileByteSwap != 0;
+            info.PixelData.Encapsulated = record.uiEncapsulated != 0;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool DicomIndex::Write( const std::string & strIndexFile, const std::vector<DicomIndexEntry> & vEntries )
+{
+    std::vector<const DicomIndexEntry *>    vpSorted;
+    for (size_t i = 0; i < vEntries.size(); i++)
+    {
+        vpSorted.push_back(&vEntries[i]);
+    }
+    std::sort(vpSorted.begin(), vpSorted.end(), EntryLess);
+
+    std::vector<DicomIndexRecord>   vRecords(vpSorted.size());
+    std::string                     strStrings;
+
+    for (size_t i = 0; i < vpSorted.size(); i++)
+    {
+        const DicomIndexEntry &     entry = *vpSorted[i];
+        const DICOMImageInfo &      info = entry.info;
+        DicomIndexRecord &          record = vRecords[i];
+
+        memset(&record, 0, sizeof(record));
+        record.uiFileSize = entry.stamp.uiSize;
+        record.iModified = entry.stamp.iModified;
+        AddString(strStrings, entry.stamp.strName, record.uiNameOffset, record.uiNameLength);
+        record.uiImage = entry.bImage ? 1 : 0;
+        if (!entry.bImage)
+        {
+            continue;
+        }
+
+        AddString(strStrings, info.SeriesUID, record.uiSeriesOffset, record.uiSeriesLength);
+        AddString(strStrings, info.PhotometricInterpretation, record.uiPhotometricOffset, record.uiPhotometricLength);
+        AddString(strStrings, info.TransferSyntaxUID, record.uiTransferSyntaxOffset, record.uiTransferSyntaxLength);
+        record.iSliceNumber = info.Ordering.SliceNumber;
+        record.fSliceLocation = info.Ordering.SliceLocation;
+        memcpy(record.afImagePositionPatient, info.Ordering.ImagePositionPatient, sizeof(record.afImagePositionPatient));
+        memcpy(record.afImageOrientationPatient, info.Ordering.ImageOrientationPatient, sizeof(record.afImageOrientationPatient));
+        record.aiDimensions[0] = info.Dimensions[0];
+        record.aiDimensions[1] = info.Dimensions[1];
+        memcpy(record.afPixelSpacing, info.PixelSpacing, sizeof(record.afPixelSpacing));
+        record.iBitsAllocated = info.BitsAllocated;
+        record.iPixelRepresentation = info.PixelRepresentation;
+        record.fRescaleSlope = info.RescaleSlope;
+        record.fRescaleOffset = info.RescaleOffset;
+        record.iNumberOfFrames = info.NumberOfFrames;
+        record.uiPixelDataGroup = info.PixelData.Group;
+        record.uiPixelDataElement = info.PixelData.Element;
+        record.uiPixelDataType = uint32_t(info.PixelData.Type);
+        record.iPixelDataOffset = int64_t(info.PixelData.Offset);
+        record.iPixelDataLength = info.PixelData.Length;
+        record.iPixelDataDeflateOffset = int64_t(info.PixelData.DeflateOffset);
+        record.uiToggleByteSwapImageData = info.PixelData.ToggleByteSwapImageData ? 1 : 0;
+        record.uiFileByteSwap = info.PixelData.FileByteSwap ? 1 : 0;
+        record.uiEncapsulated = info.PixelData.Encapsulated ? 1 : 0;
+    }
+
+    DicomIndexHeader    header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.acMagic, acIndexMagic, sizeof(acIndexMagic));
+    header.uiVersion = uiIndexVersion;
+    header.uiByteOrder = uiIndexByteOrder;
+    header.uiRecordSize = sizeof(DicomIndexRecord);
+    header.uiNumRecords = uint32_t(vRecords.size());
+    header.uiStringsOffset = sizeof(DicomIndexHeader) + vRecords.size() * sizeof(DicomIndexRecord);
+    header.uiStringsSize = strStrings.size();
+
+    const std::string   strTempFile = strIndexFile + ".tmp";
+    {
+        std::ofstream   indexstream(strTempFile.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!indexstream)
+        {
+            return false;
+        }
+
+        indexstream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        if (!vRecords.empty())
+        {
+            indexstream.write(reinterpret_cast<const char *>(&vRecords[0]), vRecords.size() * sizeof(DicomIndexRecord));
+        }
+        indexstream.write(strStrings.data(), strStrings.size());
+
+        if (!indexstream)
+        {
+            indexstream.close();
+            remove(strTempFile.c_str());
+            return false;
+        }
+    }
+
+#ifdef _WIN32
+    // rename won't replace an existing file here
+    remove(strIndexFile.c_str());
+#endif
+    if (rename(strTempFile.c_str(), strIndexFile.c_str()) != 0)
+    {
+        remove(strTempFile.c_str());
+        return false;
+    }
+    return true;
+}
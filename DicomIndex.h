@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "DICOMMappedFile.h"
+#include "DICOMAppHelper.h"
+
+// Name of the index file kept in each DICOM directory.
+#define DICOM_INDEX_FILENAME    ".dicomindex"
+
+// A file found in a DICOM directory, with the size and modification time
+// the directory listing reported for it.  Together they decide whether an
+// index entry is still valid.
+struct DicomFileStamp
+{
+    std::string     strName;        // name within the directory; the index key
+    std::string     strPath;        // full path
+    uint64_t        uiSize = 0;
+    int64_t         iModified = 0;
+};
+
+// What is known about one file of a directory: its stamp, whether it is a
+// DICOM image, and if so its parsed header.
+struct DicomIndexEntry
+{
+    DicomFileStamp  stamp;
+    bool            bImage = false;
+    DICOMImageInfo  info;
+};
+
+// Sidecar index of the parsed headers of a DICOM directory.
+//
+// The file is a fixed header, an array of fixed size records sorted by
+// file name, and a table of the strings they refer to.  It is mapped
+// read-only and searched in place, so opening a directory whose files are
+// unchanged costs one lookup per file and no header parsing.  Entries whose
+// size or modification time no longer match are treated as missing.
+//
+// The layout is native byte order; an index written on a machine of the
+// other byte order, or by another version, is ignored.
+class DicomIndex
+{
+public:
+    DicomIndex();
+
+    // Map the index at strIndexFile.  Returns false if there is none or it
+    // can't be used, in which case every Find misses.
+    bool    Open( const std::string & strIndexFile );
+
+    void    Close();
+
+    // Number of entries in the open index.
+    uint32_t    GetNumEntries() const;
+
+    // Look stamp up.  Returns true and fills entry from the index if the
+    // file is in it with the same size and modification time.
+    bool    Find( const DicomFileStamp & stamp, DicomIndexEntry & entry ) const;
+
+    // Write vEntries as a new index at strIndexFile.  The index is written
+    // to a temporary file and renamed into place, so readers never see a
+    // partial index.
+    static bool Write( const std::string & strIndexFile, const std::vector<DicomIndexEntry> & vEntries );
+
+private:
+    DicomIndex( const DicomIndex & );
+    void operator=( const DicomIndex & );
+
+    DICOMMappedFile         file;
+    const unsigned char *   pData;
+    uint64_t                uiSize;
+    uint32_t                uiNumRecords;
+};
@@ -0,0 +1,694 @@
+#include <algorithm>
+#include <map>
+#include <math.h>
+#include <string.h>
+#include <thread>
+
+#include "DICOMPixelKernels.h"
+#include "DicomResample.h"
+
+namespace
+{
+    // Most taps a kernel has on one axis.
+    const uint32_t  MAX_TAPS = 6;
+
+    // The source samples each destination sample of one axis is made from.
+    // Tap t of sample i reads source sample viIndex[t * uiSize + i] with
+    // weight vfWeight[t * uiSize + i]; keeping each tap contiguous lets the
+    // X pass run over a row one tap at a time.
+    struct ResampleAxis
+    {
+        uint32_t                uiSize = 0;
+        uint32_t                uiTaps = 0;
+        bool                    bIdentity = false;  // sample i is source sample i
+        std::vector<uint32_t>   viIndex;
+        std::vector<float>      vfWeight;
+
+        uint32_t    Index( const uint32_t t, const uint32_t i ) const   { return viIndex[size_t(t) * uiSize + i]; }
+        float       Weight( const uint32_t t, const uint32_t i ) const  { return vfWeight[size_t(t) * uiSize + i]; }
+    };
+
+    uint32_t KernelTaps( const ResampleKernel kernel )
+    {
+        switch (kernel)
+        {
+        case RESAMPLE_NEAREST:      return 1;
+        case RESAMPLE_LINEAR:       return 2;
+        case RESAMPLE_CATMULL_ROM:  return 4;
+        case RESAMPLE_BSPLINE:      return 4;
+        case RESAMPLE_LANCZOS3:     return 6;
+        }
+        return 2;
+    }
+
+    // Mitchell-Netravali cubic with parameters B and C, at distance x.
+    // B = 0, C = 1/2 is Catmull-Rom; B = 1, C = 0 the cubic B-spline.
+    double Cubic( const double B, const double C, const double x )
+    {
+        if (x < 1.0)
+        {
+            return ((12.0 - 9.0 * B - 6.0 * C) * x * x * x +
+                    (-18.0 + 12.0 * B + 6.0 * C) * x * x +
+                    (6.0 - 2.0 * B)) / 6.0;
+        }
+        if (x < 2.0)
+        {
+            return ((-B - 6.0 * C) * x * x * x +
+                    (6.0 * B + 30.0 * C) * x * x +
+                    (-12.0 * B - 48.0 * C) * x +
+                    (8.0 * B + 24.0 * C)) / 6.0;
+        }
+        return 0.0;
+    }
+
+    // sin(pi x) / (pi x), exactly 0 at the other integers so that samples
+    // falling on source samples drop the other taps.
+    double Sinc( const double x )
+    {
+        if (x == floor(x))
+        {
+            return x == 0.0 ? 1.0 : 0.0;
+        }
+        const double    fPiX = 3.14159265358979323846 * x;
+        return sin(fPiX) / fPiX;
+    }
+
+    // Weight of a source sample fDistance away from the position sampled.
+    float KernelWeight( const ResampleKernel kernel, const double fDistance )
+    {
+        const double    x = fabs(fDistance);
+        switch (kernel)
+        {
+        case RESAMPLE_NEAREST:      return 1.0f;
+        case RESAMPLE_LINEAR:       return float(std::max(0.0, 1.0 - x));
+        case RESAMPLE_CATMULL_ROM:  return float(Cubic(0.0, 0.5, x));
+        case RESAMPLE_BSPLINE:      return float(Cubic(1.0, 0.0, x));
+        case RESAMPLE_LANCZOS3:     return x < 3.0 ? float(Sinc(x) * Sinc(x / 3.0)) : 0.0f;
+        }
+        return 0.0f;
+    }
+
+    // Number of samples fDestSpacing apart that fit within uiSrcSize
+    // samples fSrcSpacing apart, starting at the first.
+    uint32_t ResampleSize( const uint32_t uiSrcSize, const float fSrcSpacing, const float fDestSpacing )
+    {
+        const double    fExtent = double(uiSrcSize - 1) * fSrcSpacing;
+        return uint32_t(floor(fExtent / fDestSpacing + 1e-6)) + 1;
+    }
+
+    bool TapUnused( const ResampleAxis & axis, const uint32_t t )
+    {
+        for (uint32_t i = 0; i < axis.uiSize; i++)
+        {
+            if (axis.Weight(t, i) != 0.0f)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void BuildAxis( const uint32_t          uiSrcSize,
+                    const float             fSrcSpacing,
+                    const uint32_t          uiDestSize,
+                    const float             fDestSpacing,
+                    const ResampleKernel    kernel,
+                    ResampleAxis &          axis    )
+    {
+        axis.uiSize = uiDestSize;
+        axis.uiTaps = KernelTaps(kernel);
+        axis.viIndex.resize(size_t(axis.uiTaps) * uiDestSize);
+        axis.vfWeight.resize(size_t(axis.uiTaps) * uiDestSize);
+
+        const int64_t   iLast = int64_t(uiSrcSize) - 1;
+        const double    fScale = double(fDestSpacing) / fSrcSpacing;
+
+        for (uint32_t i = 0; i < uiDestSize; i++)
+        {
+            const double    fPos = double(i) * fScale;
+            const int64_t   iFirst = axis.uiTaps == 1 ?
+                                     int64_t(floor(fPos + 0.5)) :
+                                     int64_t(floor(fPos)) - int64_t(axis.uiTaps / 2 - 1);
+
+            // taps past either end read the end sample
+            float   fSum = 0.0f;
+            for (uint32_t t = 0; t < axis.uiTaps; t++)
+            {
+                const int64_t   iSample = iFirst + t;
+                const float     fWeight = KernelWeight(kernel, fPos - double(iSample));
+                axis.viIndex[size_t(t) * uiDestSize + i] = uint32_t(std::min(iLast, std::max(int64_t(0), iSample)));
+                axis.vfWeight[size_t(t) * uiDestSize + i] = fWeight;
+                fSum += fWeight;
+            }
+            for (uint32_t t = 0; t < axis.uiTaps; t++)
+            {
+                axis.vfWeight[size_t(t) * uiDestSize + i] /= fSum;
+            }
+        }
+
+        // Drop first and last taps that carry no weight anywhere, as when
+        // every sample falls on a source sample.  The taps left are still
+        // consecutive source samples.
+        uint32_t    uiFirstTap = 0;
+        uint32_t    uiEndTap = axis.uiTaps;
+        while (uiEndTap - uiFirstTap > 1 && TapUnused(axis, uiEndTap - 1))
+        {
+            uiEndTap--;
+        }
+        while (uiEndTap - uiFirstTap > 1 && TapUnused(axis, uiFirstTap))
+        {
+            uiFirstTap++;
+        }
+        axis.viIndex.erase(axis.viIndex.begin() + size_t(uiEndTap) * uiDestSize, axis.viIndex.end());
+        axis.viIndex.erase(axis.viIndex.begin(), axis.viIndex.begin() + size_t(uiFirstTap) * uiDestSize);
+        axis.vfWeight.erase(axis.vfWeight.begin() + size_t(uiEndTap) * uiDestSize, axis.vfWeight.end());
+        axis.vfWeight.erase(axis.vfWeight.begin(), axis.vfWeight.begin() + size_t(uiFirstTap) * uiDestSize);
+        axis.uiTaps = uiEndTap - uiFirstTap;
+
+        axis.bIdentity = axis.uiTaps == 1 && uiDestSize == uiSrcSize;
+        for (uint32_t i = 0; axis.bIdentity && i < uiDestSize; i++)
+        {
+            axis.bIdentity = axis.viIndex[i] == i && axis.vfWeight[i] == 1.0f;
+        }
+    }
+
+    // pfDest[x] += fWeight * pSrc[x]
+    template <typename T>
+    inline void AddRow( float * pfDest, const T * pSrc, const float fWeight, const size_t uiSize )
+    {
+        for (size_t x = 0; x < uiSize; x++)
+        {
+            pfDest[x] += fWeight * float(pSrc[x]);
+        }
+    }
+
+    // pfDest[x] = fWeight * pSrc[x]
+    template <typename T>
+    inline void ScaleRow( float * pfDest, const T * pSrc, const float fWeight, const size_t uiSize )
+    {
+        for (size_t x = 0; x < uiSize; x++)
+        {
+            pfDest[x] = fWeight * float(pSrc[x]);
+        }
+    }
+
+    // piDest[x] = pfSrc[x], rounded and clamped.  The rounding has a
+    // compare in it, which the compiler won't vectorize, so this and
+    // BlendRow use the SSE2 or AVX2 kernels, whichever the CPU has.
+    inline void StoreRow( int16_t * piDest, const float * pfSrc, const size_t uiSize )
+    {
+        DICOMPixelKernels::RoundFloatToShort(pfSrc, piDest, uiSize);
+    }
+
+    // piDest[x] = fWeight0 * piSrc0[x] + fWeight1 * piSrc1[x], rounded and
+    // clamped, in one pass with nothing in between
+    inline void BlendRow(   int16_t *       piDest,
+                            const int16_t * piSrc0,
+                            const int16_t * piSrc1,
+                            const float     fWeight0,
+                            const float     fWeight1,
+                            const size_t    uiSize  )
+    {
+        DICOMPixelKernels::BlendShortToShort(piSrc0, piSrc1, piDest, uiSize, fWeight0, fWeight1);
+    }
+
+    // One worker's share of a resample: a slab of destination slices, and
+    // the X/Y interpolated planes of the source slices they are made from.
+    // Planes are kept in uiTaps slots by source slice, so consecutive
+    // destination slices reuse the planes they share.
+    //
+    // When X and Y are unchanged, the usual case of making thin axial
+    // series isotropic, there are no planes: each destination slice is
+    // blended straight from the source slices, or copied from one.
+    //
+    // The source is read a row at a time, through GetRow, so it can be a
+    // DicomVolume or a DicomBrickVolume.
+    template <typename Volume>
+    struct ResampleSlab
+    {
+        const Volume *          pSource = NULL;
+        const ResampleAxis *    pAxisX = NULL;
+        const ResampleAxis *    pAxisY = NULL;
+        const ResampleAxis *    pAxisZ = NULL;
+        bool                    bZOnly = false; // X and Y are unchanged
+
+        std::vector<uint32_t>   vuiRows;        // source rows the Y pass reads
+        std::vector<float>      vfRows;         // those rows interpolated along X
+        std::vector<float>      vfSourceRow;    // one of them before, as float
+        std::vector<float>      vfPlanes;       // one plane per slot
+        std::vector<int64_t>    viSlotSlice;    // source slice in each slot, or -1
+        std::vector<float>      vfAccumulator;  // one destination row
+        std::vector<int16_t>    viRows;         // source rows GetRow may need
+                                                // to gather, one per tap
+
+        void Init(  const Volume &          source,
+                    const ResampleAxis &    axisX,
+                    const ResampleAxis &    axisY,
+                    const ResampleAxis &    axisZ   )
+        {
+            pSource = &source;
+            pAxisX = &axisX;
+            pAxisY = &axisY;
+            pAxisZ = &axisZ;
+
+            bZOnly = axisX.bIdentity && axisY.bIdentity;
+            vfAccumulator.resize(axisX.uiSize);
+            viRows.resize(size_t(MAX_TAPS) * source.uiSizeX);
+            if (bZOnly)
+            {
+                return;
+            }
+
+            vuiRows = axisY.viIndex;
+            std::sort(vuiRows.begin(), vuiRows.end());
+            vuiRows.erase(std::unique(vuiRows.begin(), vuiRows.end()), vuiRows.end());
+
+            vfSourceRow.resize(source.uiSizeX);
+            vfRows.resize(size_t(source.uiSizeY) * axisX.uiSize);
+            vfPlanes.resize(size_t(axisZ.uiTaps) * axisX.uiSize * axisY.uiSize);
+            viSlotSlice.assign(axisZ.uiTaps, -1);
+        }
+
+        // Source row pRow interpolated along X into pfDest.  The row is
+        // made float first, so the taps are a gather the SSE2 and AVX2
+        // kernels can do, rather than a scalar load and convert each.
+        void InterpolateRow( const int16_t * pRow, float * pfDest )
+        {
+            const ResampleAxis &    axis = *pAxisX;
+            float *                 pfRow = axis.bIdentity ? pfDest : vfSourceRow.data();
+            for (uint32_t x = 0; x < pSource->uiSizeX; x++)
+            {
+                pfRow[x] = float(pRow[x]);
+            }
+            if (!axis.bIdentity)
+            {
+                DICOMPixelKernels::InterpolateFloat(pfRow, axis.viIndex.data(), axis.vfWeight.data(), axis.uiTaps, pfDest, axis.uiSize);
+            }
+        }
+
+        // Plane of source slice uiSlice, interpolated along X and Y.
+        const float * Plane( const uint32_t uiSlice )
+        {
+            const uint32_t  uiSlot = uiSlice % pAxisZ->uiTaps;
+            const uint32_t  uiDestSizeX = pAxisX->uiSize;
+            const uint32_t  uiDestSizeY = pAxisY->uiSize;
+            float *         pfPlane = &vfPlanes[size_t(uiSlot) * uiDestSizeX * uiDestSizeY];
+            if (viSlotSlice[uiSlot] == int64_t(uiSlice))
+            {
+                return pfPlane;
+            }
+
+            for (size_t r = 0; r < vuiRows.size(); r++)
+            {
+                const int16_t * pRow = pSource->GetRow(0, vuiRows[r], uiSlice, pSource->uiSizeX, viRows.data());
+                InterpolateRow(pRow, &vfRows[size_t(vuiRows[r]) * uiDestSizeX]);
+            }
+
+            const ResampleAxis &    axis = *pAxisY;
+            for (uint32_t y = 0; y < uiDestSizeY; y++)
+            {
+                float * pfDest = pfPlane + size_t(y) * uiDestSizeX;
+                for (uint32_t t = 0; t < axis.uiTaps; t++)
+                {
+                    const float *   pfRow = &vfRows[size_t(axis.Index(t, y)) * uiDestSizeX];
+                    if (t == 0)
+                    {
+                        ScaleRow(pfDest, pfRow, axis.Weight(t, y), uiDestSizeX);
+                    }
+                    else
+                    {
+                        AddRow(pfDest, pfRow, axis.Weight(t, y), uiDestSizeX);
+                    }
+                }
+            }
+
+            viSlotSlice[uiSlot] = uiSlice;
+            return pfPlane;
+        }
+
+        // Destination slice z, when X and Y are unchanged, into piSlice.
+        void BlendSlice( const uint32_t z, int16_t * piSlice )
+        {
+            const ResampleAxis &    axis = *pAxisZ;
+            const uint32_t          uiSizeX = pSource->uiSizeX;
+
+            uint32_t    auiSlices[MAX_TAPS];
+            float       afWeights[MAX_TAPS];
+            uint32_t    uiTaps = 0;
+            for (uint32_t t = 0; t < axis.uiTaps; t++)
+            {
+                if (axis.Weight(t, z) != 0.0f)
+                {
+                    auiSlices[uiTaps] = axis.Index(t, z);
+                    afWeights[uiTaps] = axis.Weight(t, z);
+                    uiTaps++;
+                }
+            }
+
+            const int16_t * apiRows[MAX_TAPS];
+            for (uint32_t y = 0; y < pSource->uiSizeY; y++)
+            {
+                int16_t *   piRow = piSlice + size_t(y) * uiSizeX;
+                for (uint32_t t = 0; t < uiTaps; t++)
+                {
+                    apiRows[t] = pSource->GetRow(0, y, auiSlices[t], uiSizeX, &viRows[size_t(t) * uiSizeX]);
+                }
+
+                if (uiTaps == 1)
+                {
+                    // on a source slice; its weight is 1
+                    memcpy(piRow, apiRows[0], uiSizeX * sizeof(int16_t));
+                }
+                else if (uiTaps == 2)
+                {
+                    BlendRow(piRow, apiRows[0], apiRows[1], afWeights[0], afWeights[1], uiSizeX);
+                }
+                else
+                {
+                    float * pfSum = vfAccumulator.data();
+                    ScaleRow(pfSum, apiRows[0], afWeights[0], uiSizeX);
+                    for (uint32_t t = 1; t < uiTaps; t++)
+                    {
+                        AddRow(pfSum, apiRows[t], afWeights[t], uiSizeX);
+                    }
+                    StoreRow(piRow, pfSum, uiSizeX);
+                }
+            }
+        }
+
+        // Destination slices [uiBeginZ, uiEndZ) into piDest, which holds
+        // them from uiBeginZ on.
+        void Run( const uint32_t uiBeginZ, const uint32_t uiEndZ, int16_t * piDest )
+        {
+            const ResampleAxis &    axis = *pAxisZ;
+            const uint32_t          uiDestSizeX = pAxisX->uiSize;
+            const uint32_t          uiDestSizeY = pAxisY->uiSize;
+            const size_t            uiPlaneSize = size_t(uiDestSizeX) * uiDestSizeY;
+
+            std::vector<const float *>  vpfPlanes(axis.uiTaps);
+            std::vector<float>          vfWeights(axis.uiTaps);
+
+            for (uint32_t z = uiBeginZ; z < uiEndZ; z++)
+            {
+                if (bZOnly)
+                {
+                    BlendSlice(z, piDest + uiPlaneSize * (z - uiBeginZ));
+                    continue;
+                }
+
+                // taps of no weight, as on a source slice, aren't
+                // interpolated at all
+                uint32_t    uiTaps = 0;
+                for (uint32_t t = 0; t < axis.uiTaps; t++)
+                {
+                    if (axis.Weight(t, z) != 0.0f)
+                    {
+                        vpfPlanes[uiTaps] = Plane(axis.Index(t, z));
+                        vfWeights[uiTaps] = axis.Weight(t, z);
+                        uiTaps++;
+                    }
+                }
+
+                int16_t *   piSlice = piDest + uiPlaneSize * (z - uiBeginZ);
+                float *     pfRow = vfAccumulator.data();
+                for (uint32_t y = 0; y < uiDestSizeY; y++)
+                {
+                    const size_t    uiRow = size_t(y) * uiDestSizeX;
+                    ScaleRow(pfRow, vpfPlanes[0] + uiRow, vfWeights[0], uiDestSizeX);
+                    for (uint32_t t = 1; t < uiTaps; t++)
+                    {
+                        AddRow(pfRow, vpfPlanes[t] + uiRow, vfWeights[t], uiDestSizeX);
+                    }
+
+                    StoreRow(piSlice + uiRow, pfRow, uiDestSizeX);
+                }
+            }
+        }
+    };
+
+    // Size dest for a resample of source and build its axes.  dest's
+    // voxels are left alone.
+    template <typename Volume>
+    bool LayoutResample(    const Volume &          source,
+                            const float             fXSpacing,
+                            const float             fYSpacing,
+                            const float             fZSpacing,
+                            const ResampleKernel    kernel,
+                            DicomVolume &           dest,
+                            ResampleAxis &          axisX,
+                            ResampleAxis &          axisY,
+                            ResampleAxis &          axisZ   )
+    {
+        if (source.uiSizeX == 0 || source.uiSizeY == 0 || source.uiSizeZ == 0 ||
+            !(source.fXSpacing > 0.0f) || !(source.fYSpacing > 0.0f) || !(source.fZSpacing > 0.0f) ||
+            !(fXSpacing > 0.0f) || !(fYSpacing > 0.0f) || !(fZSpacing > 0.0f))
+        {
+            return false;
+        }
+
+        dest.uiSizeX = ResampleSize(source.uiSizeX, source.fXSpacing, fXSpacing);
+        dest.uiSizeY = ResampleSize(source.uiSizeY, source.fYSpacing, fYSpacing);
+        dest.uiSizeZ = ResampleSize(source.uiSizeZ, source.fZSpacing, fZSpacing);
+        dest.fXSpacing = fXSpacing;
+        dest.fYSpacing = fYSpacing;
+        dest.fZSpacing = fZSpacing;
+        dest.statistics.Clear();
+
+        BuildAxis(source.uiSizeX, source.fXSpacing, dest.uiSizeX, fXSpacing, kernel, axisX);
+        BuildAxis(source.uiSizeY, source.fYSpacing, dest.uiSizeY, fYSpacing, kernel, axisY);
+        BuildAxis(source.uiSizeZ, source.fZSpacing, dest.uiSizeZ, fZSpacing, kernel, axisZ);
+        return true;
+    }
+
+    uint32_t ResampleWorkers( const uint32_t uiNumThreads )
+    {
+        return std::max(1u, uiNumThreads ? uiNumThreads : std::thread::hardware_concurrency());
+    }
+
+    // Destination slices [uiBeginZ, uiEndZ) into piDest, which holds them
+    // from uiBeginZ on, in contiguous runs, one per worker of vSlabs.
+    template <typename Volume>
+    void RunSlabs(  std::vector<ResampleSlab<Volume> > &    vSlabs,
+                    const uint32_t                          uiBeginZ,
+                    const uint32_t                          uiEndZ,
+                    const size_t                            uiPlaneSize,
+                    int16_t *                               piDest  )
+    {
+        const uint32_t  uiCount = uiEndZ - uiBeginZ;
+        const uint32_t  uiWorkers = std::max(1u, std::min(uint32_t(vSlabs.size()), uiCount));
+
+        std::vector<std::thread>    vThreads;
+        for (uint32_t t = 0; t < uiWorkers; t++)
+        {
+            const uint32_t  uiBegin = uiBeginZ + uint32_t(uint64_t(uiCount) * t / uiWorkers);
+            const uint32_t  uiEnd = uiBeginZ + uint32_t(uint64_t(uiCount) * (t + 1) / uiWorkers);
+            vThreads.push_back(std::thread([&vSlabs, t, uiBegin, uiEnd, uiBeginZ, uiPlaneSize, piDest]()
+            {
+                vSlabs[t].Run(uiBegin, uiEnd, piDest + uiPlaneSize * (uiBegin - uiBeginZ));
+            }));
+        }
+        for (size_t t = 0; t < vThreads.size(); t++)
+        {
+            vThreads[t].join();
+        }
+    }
+
+    template <typename Volume>
+    bool Resample(  const Volume &          source,
+                    const float             fXSpacing,
+                    const float             fYSpacing,
+                    const float             fZSpacing,
+                    DicomVolume &           dest,
+                    const ResampleKernel    kernel,
+                    const uint32_t          uiNumThreads    )
+    {
+        ResampleAxis    axisX;
+        ResampleAxis    axisY;
+        ResampleAxis    axisZ;
+        if (!LayoutResample(source, fXSpacing, fYSpacing, fZSpacing, kernel, dest, axisX, axisY, axisZ))
+        {
+            return false;
+        }
+
+        const size_t    uiPlaneSize = size_t(dest.uiSizeX) * dest.uiSizeY;
+        dest.viVoxels.resize(uiPlaneSize * dest.uiSizeZ);
+
+        std::vector<ResampleSlab<Volume> >  vSlabs(std::min(ResampleWorkers(uiNumThreads), dest.uiSizeZ));
+        for (size_t t = 0; t < vSlabs.size(); t++)
+        {
+            vSlabs[t].Init(source, axisX, axisY, axisZ);
+        }
+        RunSlabs(vSlabs, 0, dest.uiSizeZ, uiPlaneSize, dest.viVoxels.data());
+        return true;
+    }
+
+    // The source slices one slab of a streamed resample is made from,
+    // read through the same GetRow as a whole volume.  Slices the next
+    // slab still needs are kept; the buffers of the others are reused.
+    struct ResampleWindow
+    {
+        uint32_t                                    uiSizeX = 0;
+        uint32_t                                    uiSizeY = 0;
+        uint32_t                                    uiFirst = 0;
+        std::vector<const int16_t *>                vpiSlices;  // slice uiFirst + i, or NULL
+        std::map<uint32_t, std::vector<int16_t> >   mSlices;    // the slices held
+
+        const int16_t * GetRow( const uint32_t x, const uint32_t y, const uint32_t z, const uint32_t, int16_t * ) const
+        {
+            return vpiSlices[z - uiFirst] + size_t(y) * uiSizeX + x;
+        }
+
+        // Hold the slices in vuiNeeded, which is sorted, and no others.
+        bool Load( const std::vector<uint32_t> & vuiNeeded, const ResampleSliceReader & readSlice )
+        {
+            std::map<uint32_t, std::vector<int16_t> >   mKept;
+            std::vector<std::vector<int16_t> >          vFree;
+            for (std::map<uint32_t, std::vector<int16_t> >::iterator it = mSlices.begin(); it != mSlices.end(); ++it)
+            {
+                if (std::binary_search(vuiNeeded.begin(), vuiNeeded.end(), it->first))
+                {
+                    mKept[it->first].swap(it->second);
+                }
+                else
+                {
+                    vFree.push_back(std::vector<int16_t>());
+                    vFree.back().swap(it->second);
+                }
+            }
+            mSlices.swap(mKept);
+            vpiSlices.clear();
+
+            for (size_t i = 0; i < vuiNeeded.size(); i++)
+            {
+                std::vector<int16_t> &  viSlice = mSlices[vuiNeeded[i]];
+                if (!viSlice.empty())
+                {
+                    continue;
+                }
+                if (!vFree.empty())
+                {
+                    viSlice.swap(vFree.back());
+                    vFree.pop_back();
+                }
+                viSlice.resize(size_t(uiSizeX) * uiSizeY);
+                if (!readSlice(vuiNeeded[i], viSlice.data()))
+                {
+                    mSlices.erase(vuiNeeded[i]);
+                    return false;
+                }
+            }
+
+            uiFirst = vuiNeeded.empty() ? 0 : vuiNeeded.front();
+            vpiSlices.assign(vuiNeeded.empty() ? 0 : vuiNeeded.back() - uiFirst + 1, NULL);
+            for (size_t i = 0; i < vuiNeeded.size(); i++)
+            {
+                vpiSlices[vuiNeeded[i] - uiFirst] = mSlices[vuiNeeded[i]].data();
+            }
+            return true;
+        }
+    };
+}
+
+bool ResampleVolume(    const DicomVolume &     source,
+                        const float             fXSpacing,
+                        const float             fYSpacing,
+                        const float             fZSpacing,
+                        DicomVolume &           dest,
+                        const ResampleKernel    kernel,
+                        const uint32_t          uiNumThreads    )
+{
+    if (source.viVoxels.size() < size_t(source.uiSizeX) * source.uiSizeY * source.uiSizeZ)
+    {
+        return false;
+    }
+    return Resample(source, fXSpacing, fYSpacing, fZSpacing, dest, kernel, uiNumThreads);
+}
+
+bool ResampleVolume(    const DicomBrickVolume &    source,
+                        const float                 fXSpacing,
+                        const float                 fYSpacing,
+                        const float                 fZSpacing,
+                        DicomVolume &               dest,
+                        const ResampleKernel        kernel,
+                        const uint32_t              uiNumThreads    )
+{
+    if (source.vuiBricks.size() < size_t(source.uiBricksX) * source.uiBricksY * source.uiBricksZ)
+    {
+        return false;
+    }
+    return Resample(source, fXSpacing, fYSpacing, fZSpacing, dest, kernel, uiNumThreads);
+}
+
+bool ResampleVolumeStreamed(    const DicomVolume &             source,
+                                const ResampleSliceReader &     readSlice,
+                                const float                     fXSpacing,
+                                const float                     fYSpacing,
+                                const float                     fZSpacing,
+                                DicomVolume &                   dest,
+                                const ResampleSlabWriter &      writeSlab,
+                                const ResampleKernel            kernel,
+                                const uint32_t                  uiSlabSize,
+                                const uint32_t                  uiNumThreads    )
+{
+    ResampleAxis    axisX;
+    ResampleAxis    axisY;
+    ResampleAxis    axisZ;
+    if (!LayoutResample(source, fXSpacing, fYSpacing, fZSpacing, kernel, dest, axisX, axisY, axisZ))
+    {
+        return false;
+    }
+    dest.viVoxels.clear();
+
+    const uint32_t  uiWorkers = ResampleWorkers(uiNumThreads);
+    const uint32_t  uiSlab = uiSlabSize ? uiSlabSize : 8 * uiWorkers;
+    const size_t    uiPlaneSize = size_t(dest.uiSizeX) * dest.uiSizeY;
+
+    ResampleWindow  window;
+    window.uiSizeX = source.uiSizeX;
+    window.uiSizeY = source.uiSizeY;
+
+    // the workers outlive each slab, so planes carry over to the next
+    std::vector<ResampleSlab<ResampleWindow> >  vSlabs(uiWorkers);
+    for (size_t t = 0; t < vSlabs.size(); t++)
+    {
+        vSlabs[t].Init(window, axisX, axisY, axisZ);
+    }
+
+    std::vector<int16_t>    viSlab;
+    std::vector<uint32_t>   vuiNeeded;
+
+    for (uint32_t uiBeginZ = 0; uiBeginZ < dest.uiSizeZ; uiBeginZ += uiSlab)
+    {
+        const uint32_t  uiEndZ = std::min(dest.uiSizeZ, uiBeginZ + uiSlab);
+
+        // only the source slices the slab's taps weigh in
+        vuiNeeded.clear();
+        for (uint32_t z = uiBeginZ; z < uiEndZ; z++)
+        {
+            for (uint32_t t = 0; t < axisZ.uiTaps; t++)
+            {
+                if (axisZ.Weight(t, z) != 0.0f)
+                {
+                    vuiNeeded.push_back(axisZ.Index(t, z));
+                }
+            }
+        }
+        std::sort(vuiNeeded.begin(), vuiNeeded.end());
+        vuiNeeded.erase(std::unique(vuiNeeded.begin(), vuiNeeded.end()), vuiNeeded.end());
+
+        if (!window.Load(vuiNeeded, readSlice))
+        {
+            return false;
+        }
+
+        viSlab.resize(uiPlaneSize * (uiEndZ - uiBeginZ));
+        RunSlabs(vSlabs, uiBeginZ, uiEndZ, uiPlaneSize, viSlab.data());
+
+        if (!writeSlab(viSlab.data(), uiBeginZ, uiEndZ))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <functional>
+
+#include "DicomVolume.h"
+#include "DicomBrickVolume.h"
+
+// How a destination voxel is made from the source voxels around it.  The
+// cubic and Lanczos kernels are sharper but cost 2-3 times as many taps
+// per axis; all of them are applied separably, so the cost grows with the
+// taps of each axis, not their product.
+enum ResampleKernel
+{
+    RESAMPLE_NEAREST,       // the closest source voxel
+    RESAMPLE_LINEAR,        // trilinear, from the 2x2x2 voxels around it
+    RESAMPLE_CATMULL_ROM,   // tricubic Catmull-Rom spline, 4x4x4; passes
+                            // through the source voxels, may overshoot edges
+    RESAMPLE_BSPLINE,       // tricubic B-spline, 4x4x4; smooth and never
+                            // overshoots, but blurs: it approximates the
+                            // source voxels rather than passing through them
+    RESAMPLE_LANCZOS3       // Lanczos windowed sinc, 6x6x6; the sharpest,
+                            // rings slightly at edges
+};
+
+// Resample source to fXSpacing, fYSpacing and fZSpacing into dest.
+//
+// Destination voxel (x, y, z) sits at (x * fXSpacing, y * fYSpacing,
+// z * fZSpacing) in the source, so the two share their first voxel and the
+// destination has as many voxels on each axis as fit within the source.
+// Positions past the last source voxel on an axis take its value.
+//
+// The kernel is applied one axis at a time.  Which source voxels each
+// destination voxel is made from, and their weights, are worked out once
+// per axis.  Each source slice needed is interpolated along X and then Y
+// into a float plane, and each destination slice is a weighted sum of
+// those planes, rounded to the nearest integer and clamped to int16.
+//
+// The destination slices are split into uiNumThreads contiguous slabs, one
+// per worker; every voxel is computed the same way whichever slab it is
+// in, so the result doesn't depend on the thread count.  0 threads means
+// one per hardware thread.  Returns false if source is empty or a spacing
+// isn't positive.
+bool ResampleVolume(    const DicomVolume &     source,
+                        const float             fXSpacing,
+                        const float             fYSpacing,
+                        const float             fZSpacing,
+                        DicomVolume &           dest,
+                        const ResampleKernel    kernel = RESAMPLE_LINEAR,
+                        const uint32_t          uiNumThreads = 0    );
+
+// Same, from a bricked volume.
+bool ResampleVolume(    const DicomBrickVolume &    source,
+                        const float                 fXSpacing,
+                        const float                 fYSpacing,
+                        const float                 fZSpacing,
+                        DicomVolume &               dest,
+                        const ResampleKernel        kernel = RESAMPLE_LINEAR,
+                        const uint32_t              uiNumThreads = 0    );
+
+// Reads source slice uiSlice into piDest, which holds one slice.
+typedef std::function<bool( uint32_t uiSlice, int16_t * piDest )>    ResampleSliceReader;
+
+// Takes destination slices [uiBeginZ, uiEndZ), one after the other from
+// piSlices.  Slabs come in order, and the slices are only valid during the
+// call.
+typedef std::function<bool( const int16_t * piSlices, uint32_t uiBeginZ, uint32_t uiEndZ )>  ResampleSlabWriter;
+
+// Same as ResampleVolume, without holding either volume whole, for
+// volumes larger than memory.
+//
+// source only gives the sizes and spacing of the source; its voxels aren't
+// used and may be empty.  dest gets the sizes and spacing of the result
+// before the first slab is written; its voxels are left empty.
+//
+// The destination is made uiSlabSize slices at a time, by default 8 per
+// thread.  The source slices a slab is made from, and only those, are
+// read with readSlice, which is only ever called from the calling thread;
+// slices the next slab shares are kept rather than read again.  The
+// finished slab is passed to writeSlab.  Peak memory is the source slices
+// of one slab, the slab and each worker's planes, whatever the size of
+// the volumes.  The voxels are the same as ResampleVolume gives.  Returns
+// false as ResampleVolume does, or if readSlice or writeSlab fail.
+bool ResampleVolumeStreamed(    const DicomVolume &             source,
+                                const ResampleSliceReader &     readSlice,
+                                const float                     fXSpacing,
+                                const float                     fYSpacing,
+                                const float                     fZSpacing,
+                                DicomVolume &                   dest,
+                                const ResampleSlabWriter &      writeSlab,
+                                const ResampleKernel            kernel = RESAMPLE_LINEAR,
+                                const uint32_t                  uiSlabSize = 0,
+                                const uint32_t                  uiNumThreads = 0    );
+
+// Trilinear sample of volume, a DicomVolume or DicomBrickVolume, at
+// (fX, fY, fZ) in voxels, for sampling at arbitrary positions such as
+// oblique slices.  Positions outside the volume are clamped to it.
+template <typename Volume>
+float SampleTrilinear(  const Volume &  volume,
+                        float           fX,
+                        float           fY,
+                        float           fZ  )
+{
+    fX = std::min(float(volume.uiSizeX - 1), std::max(0.0f, fX));
+    fY = std::min(float(volume.uiSizeY - 1), std::max(0.0f, fY));
+    fZ = std::min(float(volume.uiSizeZ - 1), std::max(0.0f, fZ));
+
+    const uint32_t  x = uint32_t(fX);
+    const uint32_t  y = uint32_t(fY);
+    const uint32_t  z = uint32_t(fZ);
+    const float     u = fX - float(x);
+    const float     v = fY - float(y);
+    const float     w = fZ - float(z);
+
+    int16_t aiCell[8];
+    volume.GetCell(x, y, z, aiCell);
+
+    const float f00 = aiCell[0] + u * (aiCell[1] - aiCell[0]);
+    const float f10 = aiCell[2] + u * (aiCell[3] - aiCell[2]);
+    const float f01 = aiCell[4] + u * (aiCell[5] - aiCell[4]);
+    const float f11 = aiCell[6] + u * (aiCell[7] - aiCell[6]);
+    const float f0 = f00 + v * (f10 - f00);
+    const float f1 = f01 + v * (f11 - f01);
+    return f0 + w * (f1 - f0);
+}
@@ -0,0 +1,555 @@
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <string.h>
+
+#include "DICOMMappedFile.h"
+
+#include "tinydir.h"
+#include "DicomIndex.h"
+#include "DicomVolume.h"
+
+namespace
+{
+    struct DicomSlice
+    {
+        DicomFileStamp  stamp;
+        DICOMImageInfo  info;
+        DICOMFile *     pFile = NULL;   // still mapped from the header pass, or NULL
+        bool            bImage = false; // a DICOM file with pixel data
+        bool            bIndexed = false; // header came from the directory index
+    };
+
+    bool SliceLess( const DicomSlice & a, const DicomSlice & b )
+    {
+        return a.info.Ordering.SliceNumber < b.info.Ordering.SliceNumber;
+    }
+
+    void FreeSlices( std::vector<DicomSlice> & vSlices )
+    {
+        for ( size_t i = 0; i < vSlices.size(); i++ )
+        {
+            delete vSlices[i].pFile;
+            vSlices[i].pFile = NULL;
+        }
+    }
+
+    bool ListDicomDir(  const std::string &             strDicomDir,
+                        std::vector<DicomFileStamp> &   vStamps     )
+    {
+        tinydir_dir dir;
+        if (tinydir_open(&dir, strDicomDir.c_str()) == -1)
+        {
+            perror("Error opening dicom dir\n");
+            return false;
+        }
+
+        while (dir.has_next)
+        {
+            tinydir_file file;
+            if (tinydir_readfile(&dir, &file) == -1)
+            {
+                perror("Error getting file\n");
+                tinydir_close(&dir);
+                return false;
+            }
+
+            const std::string   strName(file.name);
+            if (!file.is_dir &&
+                strName != DICOM_INDEX_FILENAME &&
+                strName != DICOM_INDEX_FILENAME ".tmp")
+            {
+                // the listing already stat'ed the file, so the stamp is free
+                DicomFileStamp  stamp;
+                stamp.strName = strName;
+                stamp.strPath = std::string(file.path);
+#ifdef _MSC_VER
+                stamp.uiSize = (uint64_t(dir._f.nFileSizeHigh) << 32) | dir._f.nFileSizeLow;
+                stamp.iModified = (int64_t(dir._f.ftLastWriteTime.dwHighDateTime) << 32) | dir._f.ftLastWriteTime.dwLowDateTime;
+#elif defined(__linux__)
+                stamp.uiSize = uint64_t(file._s.st_size);
+                stamp.iModified = int64_t(file._s.st_mtim.tv_sec) * 1000000000 + file._s.st_mtim.tv_nsec;
+#else
+                stamp.uiSize = uint64_t(file._s.st_size);
+                stamp.iModified = int64_t(file._s.st_mtime);
+#endif
+                vStamps.push_back(stamp);
+            }
+
+            if (tinydir_next(&dir) == -1)
+            {
+                perror("Error getting next file");
+                tinydir_close(&dir);
+                return false;
+            }
+        }
+
+        tinydir_close(&dir);
+        return true;
+    }
+
+    // Parse one header up to its pixel data, unless the index already has
+    // it.  Files that aren't DICOM images are left with bImage false.
+    bool ReadSliceHeader(   const DicomFileStamp &  stamp,
+                            const DicomIndex &      index,
+                            DICOMParser &           parser,
+                            DICOMAppHelper &        helper,
+                            DicomSlice &            slice,
+                            std::string &           strError    )
+    {
+        const std::string & strFilename = stamp.strPath;
+        slice.stamp = stamp;
+
+        DicomIndexEntry entry;
+        if (index.Find(stamp, entry))
+        {
+            slice.info = entry.info;
+            slice.bImage = entry.bImage;
+            slice.bIndexed = true;
+            return true;
+        }
+
+        if (!parser.OpenFile(dicom_stl::string(strFilename.c_str())))
+        {
+            strError = "Couldn't open " + strFilename;
+            return false;
+        }
+
+        if (!parser.IsDICOMFile())
+        {
+            return true;
+        }
+
+        if (!parser.ReadHeaderOnly())
+        {
+            strError = "Couldn't read dicom header " + strFilename;
+            return false;
+        }
+
+        helper.GetImageInfo(&parser, slice.info);
+        slice.bImage = slice.info.PixelData.Offset >= 0;
+
+        // a mapping holds no descriptor, so it can stay open until the
+        // pixels are read; anything else is reopened later
+        if (slice.bImage && parser.GetFileAccessMode() == DICOMParser::ACCESS_MAPPED)
+        {
+            DICOMFile * pFile = parser.DetachFile();
+            if (dynamic_cast<DICOMMappedFile *>(pFile))
+            {
+                slice.pFile = pFile;
+            }
+            else
+            {
+                delete pFile;
+            }
+        }
+
+        return true;
+    }
+
+    // Decode the pixels of slice into its slot, which starts at piDest.
+    bool ReadSliceVoxels(   DICOMParser &           parser,
+                            DICOMAppHelper &        helper,
+                            DicomSlice &            slice,
+                            int16_t *               piDest,
+                            const size_t            uiPixelSize,
+                            DICOMPixelStatistics &  statistics,
+                            std::string &           strError    )
+    {
+        const std::string & strFilename = slice.info.FileName;
+
+        if (slice.pFile)
+        {
+            parser.AttachFile(slice.pFile, strFilename);
+            slice.pFile = NULL;
+        }
+        else if (!parser.OpenFile(strFilename))
+        {
+            strError = "Couldn't open " + strFilename;
+            return false;
+        }
+
+        // decode straight into the slot; a multi-frame file gives its
+        // first frame, without reading the others
+        helper.SetImageDestination(DICOMImageView<short>(piDest, uiPixelSize));
+        bool    bRead = slice.info.NumberOfFrames > 1 ?
+                        helper.ReadFrames(&parser, slice.info, 0, 1) :
+                        helper.ReadPixelData(&parser, slice.info);
+        helper.ClearImageDestination();
+
+        if (!bRead)
+        {
+            strError = "Couldn't read pixel data " + strFilename;
+            return false;
+        }
+
+        DICOMImageView<short>   view;
+        if (!helper.GetImageView(view))
+        {
+            strError = "Only 16 bit integer images are supported " + strFilename;
+            return false;
+        }
+
+        // only a slice larger than the slot ends up in the helper's buffer
+        if (view.GetData() != piDest)
+        {
+            memcpy(piDest, view.GetData(), std::min(view.GetSize(), uiPixelSize) * sizeof(int16_t));
+        }
+        statistics.Merge(helper.GetImageStatistics());
+        return true;
+    }
+
+    // Order the slices, check they agree and size the volume from them.
+    // The voxels are left to the caller.
+    bool LayoutVolume(  std::vector<DicomSlice> &   vSlices,
+                        DicomVolume &               volume,
+                        std::string &               strError    )
+    {
+        std::vector<DicomSlice> vImages;
+        for (size_t i = 0; i < vSlices.size(); i++)
+        {
+            if (vSlices[i].bImage)
+            {
+                vImages.push_back(vSlices[i]);
+            }
+        }
+        vSlices.swap(vImages);
+
+        if (vSlices.empty())
+        {
+            strError = "No dicom images";
+            return false;
+        }
+
+        std::stable_sort(vSlices.begin(), vSlices.end(), SliceLess);
+
+        const DICOMImageInfo &  first = vSlices[0].info;
+
+        for (size_t i = 1; i < vSlices.size(); i++)
+        {
+            if (vSlices[i].info.Dimensions[0] != first.Dimensions[0] ||
+                vSlices[i].info.Dimensions[1] != first.Dimensions[1])
+            {
+                strError = "Slice size differs from the first slice in " + vSlices[i].info.FileName;
+                return false;
+            }
+        }
+
+        volume.uiSizeX = uint32_t(first.Dimensions[0]);
+        volume.uiSizeY = uint32_t(first.Dimensions[1]);
+        volume.uiSizeZ = uint32_t(vSlices.size());
+        volume.fXSpacing = first.PixelSpacing[0];
+        volume.fYSpacing = first.PixelSpacing[1];
+
+        std::vector<float>  vfZ;
+        for (size_t i = 0; i < vSlices.size(); i++)
+        {
+            vfZ.push_back(vSlices[i].info.Ordering.ImagePositionPatient[2]);
+        }
+        std::sort(vfZ.begin(), vfZ.end());
+        volume.fZSpacing = vfZ.size() > 1 ? vfZ[1] - vfZ[0] : first.PixelSpacing[2];
+        volume.statistics.Clear();
+        return true;
+    }
+
+    void AllocateVolume( DicomVolume & volume )
+    {
+        volume.viVoxels.assign(size_t(volume.uiSizeX) * volume.uiSizeY * volume.uiSizeZ, 0);
+    }
+
+    // Rewrite the directory index if any header had to be parsed or files
+    // have gone.  An index that can't be written is not an error; the
+    // next load just parses again.
+    void UpdateIndex(   const std::string &             strIndexFile,
+                        DicomIndex &                    index,
+                        const std::vector<DicomSlice> & vSlices )
+    {
+        bool    bStale = index.GetNumEntries() != vSlices.size();
+        for (size_t i = 0; !bStale && i < vSlices.size(); i++)
+        {
+            bStale = !vSlices[i].bIndexed;
+        }
+        if (!bStale)
+        {
+            return;
+        }
+
+        std::vector<DicomIndexEntry>    vEntries(vSlices.size());
+        for (size_t i = 0; i < vSlices.size(); i++)
+        {
+            vEntries[i].stamp = vSlices[i].stamp;
+            vEntries[i].bImage = vSlices[i].bImage;
+            vEntries[i].info = vSlices[i].info;
+        }
+
+        index.Close();
+        DicomIndex::Write(strIndexFile, vEntries);
+    }
+
+    // Worker t takes items t, t + N, t + 2N, ...  Results only ever go
+    // to the item's own slot, so the output doesn't depend on timing.
+    void RunWorkers(    const uint32_t                                      uiWorkers,
+                        const size_t                                        uiCount,
+                        const std::function<void(uint32_t, size_t)> &      work    )
+    {
+        std::vector<std::thread>    vThreads;
+        for (uint32_t t = 0; t < uiWorkers; t++)
+        {
+            vThreads.push_back(std::thread([&work, t, uiWorkers, uiCount]()
+            {
+                for (size_t i = t; i < uiCount; i += uiWorkers)
+                {
+                    work(t, i);
+                }
+            }));
+        }
+        for (size_t t = 0; t < vThreads.size(); t++)
+        {
+            vThreads[t].join();
+        }
+    }
+
+    // First error by file order, so the message doesn't depend on
+    // which worker got there first.
+    bool FirstError( const std::vector<std::string> & vstrErrors, std::string & strError )
+    {
+        for (size_t i = 0; i < vstrErrors.size(); i++)
+        {
+            if (!vstrErrors[i].empty())
+            {
+                strError = vstrErrors[i];
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+bool LoadDicomVolume(   const std::string &     strDicomDir,
+                        DICOMParser &           parser,
+                        DICOMAppHelper &        helper,
+                        DicomVolume &           volume,
+                        const bool              bUseIndex   )
+{
+    std::vector<DicomFileStamp> vStamps;
+    if (!ListDicomDir(strDicomDir, vStamps))
+    {
+        return false;
+    }
+
+    const std::string   strIndexFile = strDicomDir + "/" DICOM_INDEX_FILENAME;
+    DicomIndex          index;
+    if (bUseIndex)
+    {
+        index.Open(strIndexFile);
+    }
+
+    parser.SetDeferPixelDataSwap(true);
+    helper.SetComputeImageStatistics(true);
+
+    std::vector<DicomSlice> vSlices(vStamps.size());
+    std::string             strError;
+    bool                    bOK = true;
+
+    for (size_t i = 0; bOK && i < vStamps.size(); i++)
+    {
+        bOK = ReadSliceHeader(vStamps[i], index, parser, helper, vSlices[i], strError);
+    }
+
+    if (bOK && bUseIndex)
+    {
+        UpdateIndex(strIndexFile, index, vSlices);
+    }
+
+    bOK = bOK && LayoutVolume(vSlices, volume, strError);
+    if (bOK)
+    {
+        AllocateVolume(volume);
+    }
+
+    const size_t    uiPixelSize = size_t(volume.uiSizeX) * volume.uiSizeY;
+    for (size_t i = 0; bOK && i < vSlices.size(); i++)
+    {
+        bOK = ReadSliceVoxels(parser, helper, vSlices[i], &volume.viVoxels[uiPixelSize * i], uiPixelSize, volume.statistics, strError);
+    }
+
+    FreeSlices(vSlices);
+
+    if (!bOK)
+    {
+        std::cout << strError << "\n";
+    }
+    return bOK;
+}
+
+bool LoadDicomVolumeParallel(   const std::string &             strDicomDir,
+                                const uint32_t                  uiNumThreads,
+                                DicomVolume &                   volume,
+                                DICOMParser::FileAccessModes    accessMode,
+                                const bool                      bUseIndex   )
+{
+    std::vector<DicomFileStamp> vStamps;
+    if (!ListDicomDir(strDicomDir, vStamps))
+    {
+        return false;
+    }
+
+    const std::string   strIndexFile = strDicomDir + "/" DICOM_INDEX_FILENAME;
+    DicomIndex          index;
+    if (bUseIndex)
+    {
+        index.Open(strIndexFile);
+    }
+
+    const uint32_t  uiWorkers = std::max(1u, uiNumThreads);
+
+    // one parser and helper per worker; they are not safe to share
+    std::vector<DICOMParser>    vParsers(uiWorkers);
+    std::vector<DICOMAppHelper> vHelpers(uiWorkers);
+    for (uint32_t t = 0; t < uiWorkers; t++)
+    {
+        vParsers[t].SetFileAccessMode(accessMode);
+        vParsers[t].SetZeroCopyValues(true);
+        vParsers[t].SetDeferPixelDataSwap(true);        // swapped by the decode pass
+        vHelpers[t].SetRecordSeriesDatabase(false);     // slices are ordered from GetImageInfo
+        vHelpers[t].SetComputeImageStatistics(true);
+        vHelpers[t].RegisterCallbacks(&vParsers[t]);
+        vHelpers[t].RegisterPixelDataCallback(&vParsers[t]);
+    }
+
+    std::vector<DicomSlice>     vSlices(vStamps.size());
+    std::vector<std::string>    vstrErrors(vStamps.size());
+    std::string                 strError;
+
+    RunWorkers(uiWorkers, vStamps.size(), [&]( uint32_t t, size_t i )
+    {
+        ReadSliceHeader(vStamps[i], index, vParsers[t], vHelpers[t], vSlices[i], vstrErrors[i]);
+    });
+
+    bool    bOK = !FirstError(vstrErrors, strError);
+
+    if (bOK && bUseIndex)
+    {
+        UpdateIndex(strIndexFile, index, vSlices);
+    }
+
+    bOK = bOK && LayoutVolume(vSlices, volume, strError);
+    if (bOK)
+    {
+        AllocateVolume(volume);
+    }
+
+    if (bOK)
+    {
+        const size_t    uiPixelSize = size_t(volume.uiSizeX) * volume.uiSizeY;
+
+        // each worker summarizes its own slices; the sums are combined
+        // afterwards
+        std::vector<DICOMPixelStatistics>   vStatistics(uiWorkers);
+
+        vstrErrors.assign(vSlices.size(), std::string());
+        RunWorkers(uiWorkers, vSlices.size(), [&]( uint32_t t, size_t i )
+        {
+            ReadSliceVoxels(vParsers[t], vHelpers[t], vSlices[i], &volume.viVoxels[uiPixelSize * i], uiPixelSize, vStatistics[t], vstrErrors[i]);
+        });
+
+        for (uint32_t t = 0; t < uiWorkers; t++)
+        {
+            volume.statistics.Merge(vStatistics[t]);
+        }
+
+        bOK = !FirstError(vstrErrors, strError);
+    }
+
+    FreeSlices(vSlices);
+
+    if (!bOK)
+    {
+        std::cout << strError << "\n";
+    }
+    return bOK;
+}
+
+DicomSeries::DicomSeries()
+{
+    parser.SetFileAccessMode(DICOMParser::ACCESS_BUFFERED);
+    parser.SetDeferPixelDataSwap(true);
+    helper.SetRecordSeriesDatabase(false);
+    helper.SetComputeImageStatistics(true);
+    helper.RegisterCallbacks(&parser);
+    helper.RegisterPixelDataCallback(&parser);
+}
+
+bool DicomSeries::Open( const std::string &     strDicomDir,
+                        DicomVolume &           volume,
+                        const bool              bUseIndex   )
+{
+    vInfos.clear();
+    statistics.Clear();
+
+    std::vector<DicomFileStamp> vStamps;
+    if (!ListDicomDir(strDicomDir, vStamps))
+    {
+        return false;
+    }
+
+    const std::string   strIndexFile = strDicomDir + "/" DICOM_INDEX_FILENAME;
+    DicomIndex          index;
+    if (bUseIndex)
+    {
+        index.Open(strIndexFile);
+    }
+
+    std::vector<DicomSlice> vSlices(vStamps.size());
+    std::string             strError;
+    bool                    bOK = true;
+
+    for (size_t i = 0; bOK && i < vStamps.size(); i++)
+    {
+        bOK = ReadSliceHeader(vStamps[i], index, parser, helper, vSlices[i], strError);
+    }
+
+    if (bOK && bUseIndex)
+    {
+        UpdateIndex(strIndexFile, index, vSlices);
+    }
+
+    bOK = bOK && LayoutVolume(vSlices, volume, strError);
+    volume.viVoxels.clear();
+
+    // buffered files aren't kept open; each slice is opened when read
+    FreeSlices(vSlices);
+
+    if (!bOK)
+    {
+        std::cout << strError << "\n";
+        return false;
+    }
+
+    uiPixelSize = size_t(volume.uiSizeX) * volume.uiSizeY;
+    for (size_t i = 0; i < vSlices.size(); i++)
+    {
+        vInfos.push_back(vSlices[i].info);
+    }
+    return true;
+}
+
+bool DicomSeries::ReadSlice( const uint32_t uiSlice, int16_t * piDest )
+{
+    if (uiSlice >= vInfos.size())
+    {
+        return false;
+    }
+
+    DicomSlice  slice;
+    slice.info = vInfos[uiSlice];
+
+    std::string strError;
+    if (!ReadSliceVoxels(parser, helper, slice, piDest, uiPixelSize, statistics, strError))
+    {
+        std::cout << strError << "\n";
+        return false;
+    }
+    return true;
+}
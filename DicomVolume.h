@@ -0,0 +1,134 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "DICOMParser.h"
+#include "DICOMAppHelper.h"
+
+// A 16 bit volume assembled from a directory of DICOM slices.
+// Voxels are stored x fastest, then y, then z, one slice per file.
+struct DicomVolume
+{
+    std::vector<int16_t>    viVoxels;
+    uint32_t                uiSizeX = 0;
+    uint32_t                uiSizeY = 0;
+    uint32_t                uiSizeZ = 0;
+    float                   fXSpacing = 0.0f;
+    float                   fYSpacing = 0.0f;
+    float                   fZSpacing = 0.0f;
+
+    // Range, sum and histogram of viVoxels, gathered while the slices
+    // were decoded.
+    DICOMPixelStatistics    statistics;
+
+    // Read access shared with DicomBrickVolume, so templates can take
+    // either layout.
+
+    int16_t At( const uint32_t x, const uint32_t y, const uint32_t z ) const
+    {
+        return viVoxels[(size_t(z) * uiSizeY + y) * uiSizeX + x];
+    }
+
+    // The voxels of row (y, z) from x on.  They are returned in place, so
+    // the count and buffer a DicomBrickVolume gathers into aren't used.
+    const int16_t * GetRow( const uint32_t x, const uint32_t y, const uint32_t z, const uint32_t, int16_t * ) const
+    {
+        return &viVoxels[(size_t(z) * uiSizeY + y) * uiSizeX + x];
+    }
+
+    // The 2x2x2 voxels from (x, y, z) on, x fastest.  A neighbour past
+    // the last voxel on an axis repeats it.
+    void GetCell( const uint32_t x, const uint32_t y, const uint32_t z, int16_t aiCell[8] ) const
+    {
+        const size_t    uiStepX = x + 1 < uiSizeX ? 1 : 0;
+        const size_t    uiStepY = y + 1 < uiSizeY ? uiSizeX : 0;
+        const size_t    uiStepZ = z + 1 < uiSizeZ ? size_t(uiSizeX) * uiSizeY : 0;
+        const int16_t * p = &viVoxels[(size_t(z) * uiSizeY + y) * uiSizeX + x];
+        aiCell[0] = p[0];
+        aiCell[1] = p[uiStepX];
+        aiCell[2] = p[uiStepY];
+        aiCell[3] = p[uiStepY + uiStepX];
+        aiCell[4] = p[uiStepZ];
+        aiCell[5] = p[uiStepZ + uiStepX];
+        aiCell[6] = p[uiStepZ + uiStepY];
+        aiCell[7] = p[uiStepZ + uiStepY + uiStepX];
+    }
+};
+
+// Load every DICOM file in strDicomDir into volume.
+//
+// The directory is walked once.  Each header is parsed up to the pixel
+// data and the pixel data offset is remembered; once all slices are known
+// the volume is allocated and each slice is decoded straight from its
+// offset into place, so no header is parsed twice.  The helper writes the
+// decoded pixels directly into the volume (see
+// DICOMAppHelper::SetImageDestination), without a per-slice buffer or
+// copy.  With a mapped parser
+// (DICOMParser::ACCESS_MAPPED) each file is opened once, otherwise it is
+// opened again to read its pixels.
+//
+// Slices are placed by their instance number.  A multi-frame file
+// contributes its first frame, and only that frame is read.  The helper must have its
+// callbacks and pixel data callback registered with parser.  The parser
+// is switched to deferred pixel data swapping and the helper to computing
+// image statistics, so each slice is swapped, rescaled and summarized into
+// volume.statistics in one pass.
+//
+// With bUseIndex the parsed headers are kept in a DicomIndex in the
+// directory.  Files whose size and modification time still match their
+// entry skip header parsing entirely and go straight to the pixel read;
+// the index is rewritten whenever anything had to be parsed.
+bool LoadDicomVolume(   const std::string &     strDicomDir,
+                        DICOMParser &           parser,
+                        DICOMAppHelper &        helper,
+                        DicomVolume &           volume,
+                        const bool              bUseIndex = false   );
+
+// Same as LoadDicomVolume, but headers and pixels are read by
+// uiNumThreads workers, each with its own parser and helper.  Every slice
+// is decoded straight into its slot, which comes from the slice ordering,
+// so the result is identical to LoadDicomVolume for any thread count.
+bool LoadDicomVolumeParallel(   const std::string &             strDicomDir,
+                                const uint32_t                  uiNumThreads,
+                                DicomVolume &                   volume,
+                                DICOMParser::FileAccessModes    accessMode = DICOMParser::ACCESS_MAPPED,
+                                const bool                      bUseIndex = false );
+
+// The slices of a DICOM directory, whose pixels are read one slice at a
+// time, for volumes too large to hold whole.
+//
+// Open walks the directory and orders and checks its slices just as
+// LoadDicomVolume does, without reading any pixels.  Each ReadSlice then
+// opens one file and decodes it, so only the slices being worked on need
+// to be in memory.  Not safe to share between threads.
+class DicomSeries
+{
+public:
+    DicomSeries();
+
+    // Parse the headers of strDicomDir, using and updating its index with
+    // bUseIndex.  volume gets the sizes and spacing of the series; its
+    // voxels are left empty.
+    bool    Open(   const std::string &     strDicomDir,
+                    DicomVolume &           volume,
+                    const bool              bUseIndex = false   );
+
+    // Decode slice uiSlice, counted in the order LoadDicomVolume would
+    // place it, into piDest, which holds one slice.
+    bool    ReadSlice( const uint32_t uiSlice, int16_t * piDest );
+
+    // Range, sum and histogram of the slices read so far.
+    const DICOMPixelStatistics &    GetStatistics() const  { return statistics; }
+
+private:
+    DicomSeries( const DicomSeries & );
+    void operator=( const DicomSeries & );
+
+    DICOMParser                     parser;
+    DICOMAppHelper                  helper;
+    std::vector<DICOMImageInfo>     vInfos;
+    size_t                          uiPixelSize = 0;
+    DICOMPixelStatistics            statistics;
+};
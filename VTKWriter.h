@@ -2,6 +2,7 @@
 
 #include <fstream>
 #include <string>
+#include <vector>
 
 #undef min
 #undef max
@@ -12,7 +13,6 @@
 
 bool WriteVTKHeader(    std::ofstream &     vtkstream,
                         const std::string & strFileName,
-                        const int16_t *     pVoxels,
                         const uint32_t      iX,
                         const uint32_t      iY,
                         const uint32_t      iZ,
@@ -33,13 +33,40 @@ bool WriteVTKHeader(    std::ofstream &     vtkstream,
     vtkstream << "DIMENSIONS " << iX << " " << iY << " " << iZ << std::endl;
     vtkstream << "ASPECT_RATIO " << fXSpacing << " " << fYSpacing << " " << fZSpacing << std::endl;
     vtkstream << "ORIGIN " << 0.0f << " " << 0.0f << " " << 0.0f << std::endl;
-    vtkstream << "POINT_DATA " << iX*iY*iZ << std::endl;
+    vtkstream << "POINT_DATA " << uint64_t(iX)*iY*iZ << std::endl;
     vtkstream << "SCALARS volume_scalars short 1" << std::endl;
     vtkstream << "LOOKUP_TABLE default" << std::endl;
 
     return true;
 }
 
+// Append uiNumVoxels voxels to a file started with WriteVTKHeader, big
+// endian as the format wants.  A volume can be written in any number of
+// pieces this way, in order, without ever holding it whole.
+bool WriteVTKVoxels(    std::ofstream &     vtkstream,
+                        const int16_t *     pVoxels,
+                        const uint64_t      uiNumVoxels )
+{
+    const uint64_t          uiChunk = 65536;
+    std::vector<uint8_t>    vuiSwapped(size_t(std::min(uiNumVoxels, uiChunk)) * 2);
+    const uint8_t *         pu1 = reinterpret_cast<const uint8_t *>(pVoxels);
+
+    for (uint64_t uiStart = 0; uiStart < uiNumVoxels; uiStart += uiChunk)
+    {
+        const size_t    uiCount = size_t(std::min(uiChunk, uiNumVoxels - uiStart));
+        for (size_t i = 0; i < uiCount; i++)
+        {
+            // endian swap
+            vuiSwapped[2 * i] = pu1[2 * i + 1];
+            vuiSwapped[2 * i + 1] = pu1[2 * i];
+        }
+        vtkstream.write( reinterpret_cast<const char *>(vuiSwapped.data()), uiCount * 2 );
+        pu1 += uiCount * 2;
+    }
+
+    return bool(vtkstream);
+}
+
 bool WriteVTK(  const std::string & strFileName,
                 const int16_t *     pVoxels,
                 const uint32_t      iX,
@@ -53,7 +80,6 @@ bool WriteVTK(  const std::string & strFileName,
 
     if ( !WriteVTKHeader(   vtkstream,
                             strFileName,
-                            pVoxels,
                             iX,
                             iY,
                             iZ,
@@ -64,45 +90,41 @@ bool WriteVTK(  const std::string & strFileName,
         return false;
     }
 
-    //vtkstream.write( reinterpret_cast<char *>(const_cast<int16_t *>(pVoxels)), iX*iY*iZ*sizeof(int16_t) );
-
-    uint8_t * pu1 = reinterpret_cast<uint8_t *>(const_cast<int16_t *>(pVoxels));
-    for (uint32_t i = 0; i < iX*iY*iZ; i++)
-    {
-        // endian swap
-        vtkstream.write( reinterpret_cast<char *>(pu1+1), 1 );
-        vtkstream.write( reinterpret_cast<char *>(pu1), 1 );
-        pu1 += 2;
-    }
+    WriteVTKVoxels( vtkstream, pVoxels, uint64_t(iX)*iY*iZ );
 
     vtkstream.close();
 
     return true;
 }
 
+// Write the iX x iY x iZ voxels of volume, a DicomVolume or
+// DicomBrickVolume, from (iOriginX, iOriginY, iOriginZ) on.  The block is
+// cut down to what the volume has.
+template <typename Volume>
 bool WriteVTK(  const std::string & strFileName,
-                const int16_t *     pVoxels,
+                const Volume &      volume,
                 const uint32_t      iX,
                 const uint32_t      iY,
                 const uint32_t      iZ,
                 const uint32_t      iOriginX,
                 const uint32_t      iOriginY,
                 const uint32_t      iOriginZ,
-                const uint32_t      iPitchX,
-                const uint32_t      iPitchY,
-                const uint32_t      iPitchZ,
                 const float         fXSpacing,
                 const float         fYSpacing,
                 const float         fZSpacing   )
 {
+    const uint32_t  iEndX = std::min(volume.uiSizeX, iOriginX + iX);
+    const uint32_t  iEndY = std::min(volume.uiSizeY, iOriginY + iY);
+    const uint32_t  iEndZ = std::min(volume.uiSizeZ, iOriginZ + iZ);
+    const uint32_t  iCount = iEndX > iOriginX ? iEndX - iOriginX : 0;
+
     std::ofstream vtkstream;
 
     if ( !WriteVTKHeader(   vtkstream,
                             strFileName,
-                            pVoxels,
-                            iX,
-                            iY,
-                            iZ,
+                            iCount,
+                            iEndY > iOriginY ? iEndY - iOriginY : 0,
+                            iEndZ > iOriginZ ? iEndZ - iOriginZ : 0,
                             fXSpacing,
                             fYSpacing,
                             fZSpacing))
@@ -110,30 +132,23 @@ bool WriteVTK(  const std::string & strFileName,
         return false;
     }
 
-    //vtkstream.write( reinterpret_cast<char *>(const_cast<int16_t *>(pVoxels)), iX*iY*iZ*sizeof(int16_t) );
-
-    uint32_t    iEndX = std::min(iPitchX, iOriginX + iX);
-    uint32_t    iEndY = std::min(iPitchY, iOriginY + iY);
-    uint32_t    iEndZ = std::min(iPitchZ, iOriginZ + iZ);
+    std::vector<int16_t>    viRow(iCount);
+    std::vector<uint8_t>    vuiSwapped(size_t(iCount) * 2);
 
     for ( uint32_t i = iOriginZ; i < iEndZ; i++ )
     {
-        uint32_t    iZStart = i * iPitchX * iPitchY;
-
-        for (uint32_t j = iOriginY; j < iEndY; j++)
+        for (uint32_t j = iOriginY; j < iEndY && iCount; j++)
         {
-            uint32_t    iYStart = j * iPitchX;
-
-            const int16_t * pStart = &pVoxels[iZStart+iYStart+ iOriginX];
-            uint8_t *       pu1 = reinterpret_cast<uint8_t *>(const_cast<int16_t *>(pStart));
+            const int16_t * pRow = volume.GetRow(iOriginX, j, i, iCount, viRow.data());
+            const uint8_t * pu1 = reinterpret_cast<const uint8_t *>(pRow);
 
-            for (uint32_t k = iOriginX; k < iEndX; k++)
+            for (uint32_t k = 0; k < iCount; k++)
             {
                 // endian swap
-                vtkstream.write(reinterpret_cast<char *>(pu1 + 1), 1);
-                vtkstream.write(reinterpret_cast<char *>(pu1), 1);
-                pu1 += 2;
+                vuiSwapped[2 * k] = pu1[2 * k + 1];
+                vuiSwapped[2 * k + 1] = pu1[2 * k];
             }
+            vtkstream.write(reinterpret_cast<const char *>(vuiSwapped.data()), vuiSwapped.size());
         }
     }
 
@@ -199,9 +214,9 @@ bool ReadVTK(   const std::string & strFileName,
     vtkstream >> str1 >> str2 >> str3 >> str4;
 
     //"POINT_DATA " << iX*iY*iZ;
-    uint32_t    uiPointDataSize;
+    uint64_t    uiPointDataSize;
     vtkstream >> str1 >> uiPointDataSize;
-    assert( uiPointDataSize == iX*iY*iZ );
+    assert( uiPointDataSize == uint64_t(iX)*iY*iZ );
 
     //"SCALARS volume_scalars short 1";
     vtkstream >> str1 >> str2 >> str3 >> str4;
@@ -217,7 +232,7 @@ bool ReadVTK(   const std::string & strFileName,
 
     if (ascii)
     {
-        for (unsigned int i = 0; i<uiPointDataSize; ++i)
+        for (uint64_t i = 0; i<uiPointDataSize; ++i)
         {
             vtkstream >> *ppVoxels[i];
         }
@@ -226,7 +241,7 @@ bool ReadVTK(   const std::string & strFileName,
     {
         //vtkstream.read(reinterpret_cast<char *>(const_cast<int16_t *>(*ppVoxels)), iX*iY*iZ * sizeof(int16_t));
         uint8_t * pu1 = reinterpret_cast<uint8_t *>(const_cast<int16_t *>(*ppVoxels));
-        for (uint32_t i = 0; i < iX*iY*iZ; i++)
+        for (uint64_t i = 0; i < uiPointDataSize; i++)
         {
             // endian swap
             vtkstream.read(reinterpret_cast<char *>(pu1 + 1), 1);
@@ -262,7 +277,7 @@ bool WriteVTU(   const std::string & strFileName,
         return false;
     }
 
-    std::string encoded = base64_encode(reinterpret_cast<const unsigned char*>(pVoxels), iX*iY*iZ * sizeof(int16_t));
+    std::string encoded = base64_encode(reinterpret_cast<const unsigned char*>(pVoxels), size_t(iX)*iY*iZ * sizeof(int16_t));
 
     vtkstream << "<VTKFile type = \"ImageData\" version = \"1.0\" byte_order = \"LittleEndian\" header_type = \"UInt64\">\n";
     vtkstream << "<ImageData WholeExtent = \"0 " << iX-1 << " 0 " << iY-1 << " 0 " << iZ-1 << "\"";
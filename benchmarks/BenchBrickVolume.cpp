@@ -0,0 +1,262 @@
+// DicomVolume against DicomBrickVolume for the accesses bricking is for:
+// random trilinear samples, walks over every voxel with each axis
+// innermost, rays along arbitrary directions, and ResampleVolume.
+//
+// BenchBrickVolume [directory]
+//
+// Without a directory the volume is a synthetic 512x512x320 CT, a
+// cylinder of noisy tissue in air, so almost a third of the bricks are
+// uniform and shared.  Every access is done on both layouts and the
+// results compared, so this also checks that they agree.
+
+#include <math.h>
+#include <stdio.h>
+#include <iostream>
+
+#include "DicomResample.h"
+#include "DicomBrickVolume.h"
+#include "BenchmarkUtilities.h"
+
+namespace
+{
+    const uint32_t  uiRuns = 3;
+
+    uint32_t NextRandom( uint32_t & uiState )
+    {
+        uiState = uiState * 1664525u + 1013904223u;
+        return uiState;
+    }
+
+    void MakeVolume( DicomVolume & volume )
+    {
+        volume.uiSizeX = 512;
+        volume.uiSizeY = 512;
+        volume.uiSizeZ = 320;
+        volume.fXSpacing = 0.7f;
+        volume.fYSpacing = 0.7f;
+        volume.fZSpacing = 1.25f;
+        volume.viVoxels.resize(size_t(volume.uiSizeX) * volume.uiSizeY * volume.uiSizeZ);
+
+        uint32_t    uiState = 1;
+        size_t      i = 0;
+        for (uint32_t z = 0; z < volume.uiSizeZ; z++)
+        {
+            for (uint32_t y = 0; y < volume.uiSizeY; y++)
+            {
+                for (uint32_t x = 0; x < volume.uiSizeX; x++, i++)
+                {
+                    const float fX = float(x) - 256.0f;
+                    const float fY = float(y) - 256.0f;
+                    const int   iNoise = int(NextRandom(uiState) >> 24);
+                    volume.viVoxels[i] = fX * fX + fY * fY > 230.0f * 230.0f ? int16_t(-1024) :
+                                         int16_t(40 + int(300.0f * sinf(float(z) * 0.05f)) + iNoise);
+                }
+            }
+        }
+    }
+
+    // The accesses, each run on both layouts and summing what it read.
+
+    struct RandomTrilinear
+    {
+        const std::vector<float> *  pvfPositions;
+
+        template <class Volume>
+        double operator()( const Volume & volume ) const
+        {
+            const std::vector<float> &  vfPositions = *pvfPositions;
+            double  fSum = 0.0;
+            for (size_t i = 0; i < vfPositions.size(); i += 3)
+            {
+                fSum += SampleTrilinear(volume, vfPositions[i], vfPositions[i + 1], vfPositions[i + 2]);
+            }
+            return fSum;
+        }
+    };
+
+    // Every voxel, iAxis innermost: 0 is x, 1 is y, 2 is z.
+    struct AxisWalk
+    {
+        int     iAxis;
+
+        template <class Volume>
+        double operator()( const Volume & volume ) const
+        {
+            const uint32_t  uiSizeX = volume.uiSizeX;
+            const uint32_t  uiSizeY = volume.uiSizeY;
+            const uint32_t  uiSizeZ = volume.uiSizeZ;
+            double          fSum = 0.0;
+            if (iAxis == 0)
+            {
+                for (uint32_t z = 0; z < uiSizeZ; z++)
+                {
+                    for (uint32_t y = 0; y < uiSizeY; y++)
+                    {
+                        for (uint32_t x = 0; x < uiSizeX; x++)
+                        {
+                            fSum += volume.At(x, y, z);
+                        }
+                    }
+                }
+            }
+            else if (iAxis == 1)
+            {
+                for (uint32_t z = 0; z < uiSizeZ; z++)
+                {
+                    for (uint32_t x = 0; x < uiSizeX; x++)
+                    {
+                        for (uint32_t y = 0; y < uiSizeY; y++)
+                        {
+                            fSum += volume.At(x, y, z);
+                        }
+                    }
+                }
+            }
+            else
+            {
+                for (uint32_t y = 0; y < uiSizeY; y++)
+                {
+                    for (uint32_t x = 0; x < uiSizeX; x++)
+                    {
+                        for (uint32_t z = 0; z < uiSizeZ; z++)
+                        {
+                            fSum += volume.At(x, y, z);
+                        }
+                    }
+                }
+            }
+            return fSum;
+        }
+    };
+
+    // Parallel rays from every other voxel of the first slice, one voxel
+    // steps along (fDX, fDY, fDZ), wrapping around the volume, for as
+    // many steps as there are slices.
+    struct Rays
+    {
+        float   fDX;
+        float   fDY;
+        float   fDZ;
+
+        template <class Volume>
+        double operator()( const Volume & volume ) const
+        {
+            const float fMaxX = float(volume.uiSizeX - 1);
+            const float fMaxY = float(volume.uiSizeY - 1);
+            const float fMaxZ = float(volume.uiSizeZ - 1);
+            double      fSum = 0.0;
+            for (uint32_t j = 0; j < volume.uiSizeY; j += 2)
+            {
+                for (uint32_t i = 0; i < volume.uiSizeX; i += 2)
+                {
+                    float   fX = float(i);
+                    float   fY = float(j);
+                    float   fZ = 0.0f;
+                    for (uint32_t k = 0; k < volume.uiSizeZ; k++)
+                    {
+                        fSum += SampleTrilinear(volume, fX, fY, fZ);
+                        fX += fDX;
+                        fY += fDY;
+                        fZ += fDZ;
+                        fX = fX >= fMaxX ? fX - fMaxX : fX;
+                        fY = fY >= fMaxY ? fY - fMaxY : fY;
+                        fZ = fZ >= fMaxZ ? fZ - fMaxZ : fZ;
+                    }
+                }
+            }
+            return fSum;
+        }
+    };
+
+    // Time function on both layouts and print one line.
+    template <class Function>
+    void Compare( const std::string & strAccess, const DicomVolume & linear, const DicomBrickVolume & bricked, Function function )
+    {
+        double  fLinearResult = 0.0;
+        double  fBrickedResult = 0.0;
+        const double    fLinear = BestMilliseconds(uiRuns, [&]() { fLinearResult = function(linear); });
+        const double    fBricked = BestMilliseconds(uiRuns, [&]() { fBrickedResult = function(bricked); });
+        std::cout << "  " << strAccess << ": linear " << fLinear << " ms, bricked " << fBricked << " ms, x"
+                  << fLinear / fBricked << (fLinearResult == fBrickedResult ? "" : ", DIFFERENT RESULTS") << "\n";
+    }
+}
+
+int main( int argc, char ** argv )
+{
+    DicomVolume linear;
+    if (argc > 1)
+    {
+        DICOMParser     parser;
+        DICOMAppHelper  helper;
+        parser.SetFileAccessMode(DICOMParser::ACCESS_MAPPED);
+        helper.RegisterCallbacks(&parser);
+        helper.RegisterPixelDataCallback(&parser);
+        if (!LoadDicomVolume(argv[1], parser, helper, linear))
+        {
+            std::cout << "couldn't load " << argv[1] << "\n";
+            return 1;
+        }
+    }
+    else
+    {
+        MakeVolume(linear);
+    }
+
+    DicomBrickVolume    bricked;
+    const double        fFromLinear = BestMilliseconds(1, [&]() { bricked.FromLinear(linear); });
+    std::cout << linear.uiSizeX << "x" << linear.uiSizeY << "x" << linear.uiSizeZ << ", FromLinear " << fFromLinear << " ms, "
+              << bricked.viVoxels.size() / DicomBrickVolume::BRICK_VOXELS << " of " << bricked.vuiBricks.size() << " bricks stored, "
+              << bricked.viVoxels.size() * sizeof(int16_t) / (1024 * 1024) << " MB against "
+              << linear.viVoxels.size() * sizeof(int16_t) / (1024 * 1024) << " MB\n";
+
+    // 10 million positions spread over the whole volume
+    std::vector<float>  vfPositions;
+    uint32_t            uiState = 9;
+    for (uint32_t i = 0; i < 3 * 10000000; i++)
+    {
+        const float     fU = float(NextRandom(uiState) >> 8) / 16777216.0f;
+        const uint32_t  uiSize = i % 3 == 0 ? linear.uiSizeX : i % 3 == 1 ? linear.uiSizeY : linear.uiSizeZ;
+        vfPositions.push_back(fU * float(uiSize - 1));
+    }
+
+    std::cout << "random access\n";
+    const RandomTrilinear   randomTrilinear = { &vfPositions };
+    Compare("10M trilinear samples", linear, bricked, randomTrilinear);
+
+    std::cout << "traversal\n";
+    const char *    apcAxes[] = { "x", "y", "z" };
+    for (int iAxis = 0; iAxis < 3; iAxis++)
+    {
+        const AxisWalk  walk = { iAxis };
+        Compare(std::string("every voxel, ") + apcAxes[iAxis] + " innermost", linear, bricked, walk);
+    }
+
+    const float afDirections[][3] = { { 0.0f, 0.0f, 1.0f }, { 0.3f, 0.2f, 0.93f }, { 0.57f, 0.57f, 0.57f }, { 0.0f, 0.93f, 0.37f } };
+    for (size_t d = 0; d < sizeof(afDirections) / sizeof(afDirections[0]); d++)
+    {
+        const Rays  rays = { afDirections[d][0], afDirections[d][1], afDirections[d][2] };
+        char        acName[64];
+        snprintf(acName, sizeof(acName), "rays along (%.2f, %.2f, %.2f)", rays.fDX, rays.fDY, rays.fDZ);
+        Compare(acName, linear, bricked, rays);
+    }
+
+    std::cout << "resampling, one thread\n";
+    const float afSpacings[] = { 0.7f, 0.9f };
+    for (size_t s = 0; s < sizeof(afSpacings) / sizeof(afSpacings[0]); s++)
+    {
+        DicomVolume linearDest, brickedDest;
+        const float fSpacing = afSpacings[s];
+        const double    fLinear = BestMilliseconds(uiRuns, [&]()
+        {
+            ResampleVolume(linear, fSpacing, fSpacing, fSpacing, linearDest, RESAMPLE_LINEAR, 1);
+        });
+        const double    fBricked = BestMilliseconds(uiRuns, [&]()
+        {
+            ResampleVolume(bricked, fSpacing, fSpacing, fSpacing, brickedDest, RESAMPLE_LINEAR, 1);
+        });
+        std::cout << "  to " << fSpacing << " mm: linear " << fLinear << " ms, bricked " << fBricked << " ms, x"
+                  << fLinear / fBricked << (linearDest.viVoxels == brickedDest.viVoxels ? "" : ", DIFFERENT VOXELS") << "\n";
+    }
+
+    return 0;
+}
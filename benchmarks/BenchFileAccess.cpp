@@ -0,0 +1,123 @@
+// The DICOMFile backends against each other: the plain stream, the
+// mapping and the 64 KB buffered window.
+//
+// BenchFileAccess [file]
+//
+// Without a file, a synthetic 512x512 16 bit slice is written to
+// BenchFileAccess.data and read.  For each backend this times reading
+// the whole file with ReadDoubleByte, with ReadQuadByte and with Skip
+// steps the size of a small element, then a full DICOMParser::ReadHeader
+// through that backend, pixel data included.
+
+#include <memory>
+
+#include "DICOMParser.h"
+#include "DICOMAppHelper.h"
+#include "DICOMFile.h"
+#include "DICOMMappedFile.h"
+#include "DICOMBufferedFile.h"
+#include "DicomTestUtilities.h"
+#include "BenchmarkUtilities.h"
+
+namespace
+{
+    const uint32_t  uiRuns = 5;
+
+    DICOMFile * MakeFile( const DICOMParser::FileAccessModes mode )
+    {
+        switch (mode)
+        {
+            case DICOMParser::ACCESS_MAPPED:    return new DICOMMappedFile;
+            case DICOMParser::ACCESS_BUFFERED:  return new DICOMBufferedFile;
+            default:                            return new DICOMFile;
+        }
+    }
+}
+
+int main( int argc, char ** argv )
+{
+    std::string strFile = "BenchFileAccess.data/IM0000.dcm";
+    if (argc > 1)
+    {
+        strFile = argv[1];
+    }
+    else
+    {
+        TestDicomImage  image;
+        image.uiRows = 512;
+        image.uiColumns = 512;
+        if (!MakeTestDirectory("BenchFileAccess.data") || !WriteTestDicom(strFile, image))
+        {
+            std::cout << "couldn't write " << strFile << "\n";
+            return 1;
+        }
+    }
+
+    const DICOMParser::FileAccessModes  aModes[] = { DICOMParser::ACCESS_STREAM, DICOMParser::ACCESS_MAPPED, DICOMParser::ACCESS_BUFFERED };
+    const char *                        apcModes[] = { "stream", "mapped", "buffered" };
+
+    for (size_t m = 0; m < 3; m++)
+    {
+        std::unique_ptr<DICOMFile>  pFile(MakeFile(aModes[m]));
+        if (!pFile->Open(strFile))
+        {
+            std::cout << "couldn't open " << strFile << "\n";
+            return 1;
+        }
+        const fileoffset    uiSize = pFile->GetSize();
+        std::cout << apcModes[m] << ", " << uiSize << " bytes\n";
+
+        uint32_t    uiSum = 0;
+        const double    fDoubleBytes = BestMilliseconds(uiRuns, [&]()
+        {
+            pFile->SkipToStart();
+            for (fileoffset i = 0; i + 2 <= uiSize; i += 2)
+            {
+                uiSum += pFile->ReadDoubleByte();
+            }
+        });
+        const double    fQuadBytes = BestMilliseconds(uiRuns, [&]()
+        {
+            pFile->SkipToStart();
+            for (fileoffset i = 0; i + 4 <= uiSize; i += 4)
+            {
+                uiSum += pFile->ReadQuadByte();
+            }
+        });
+        // a tag and a short value, skipped, as the parser does with
+        // elements nobody registered for
+        const double    fSkips = BestMilliseconds(uiRuns, [&]()
+        {
+            pFile->SkipToStart();
+            for (fileoffset i = 0; i + 16 <= uiSize; i += 16)
+            {
+                uiSum += pFile->ReadQuadByte();
+                pFile->Skip(12);
+            }
+        });
+        KeepResult(uiSum);
+        std::cout << "  ReadDoubleByte: " << fDoubleBytes * 1e6 / double(uiSize / 2) << " ns per call\n"
+                  << "  ReadQuadByte: " << fQuadBytes * 1e6 / double(uiSize / 4) << " ns per call\n"
+                  << "  ReadQuadByte and Skip: " << fSkips * 1e6 / double(uiSize / 16) << " ns per element\n";
+
+        DICOMParser     parser;
+        DICOMAppHelper  helper;
+        parser.SetFileAccessMode(aModes[m]);
+        helper.SetRecordSeriesDatabase(false);
+        helper.RegisterCallbacks(&parser);
+        helper.RegisterPixelDataCallback(&parser);
+        const uint32_t  uiFiles = 200;
+        const double    fParse = BestMilliseconds(uiRuns, [&]()
+        {
+            for (uint32_t i = 0; i < uiFiles; i++)
+            {
+                parser.OpenFile(strFile);
+                parser.ReadHeader();
+            }
+        });
+        std::cout << "  ReadHeader: " << fParse * 1e3 / uiFiles << " us per file, "
+                  << MegabytesPerSecond(uint64_t(uiSize) * uiFiles, fParse) << " MB/s\n";
+    }
+
+    return 0;
+}
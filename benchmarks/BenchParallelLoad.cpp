@@ -0,0 +1,87 @@
+// How LoadDicomVolumeParallel scales with its thread count, against
+// LoadDicomVolume, for each file access mode.
+//
+// BenchParallelLoad [directory]
+//
+// Without a directory, a synthetic series of 256 512x512 slices is
+// written to BenchParallelLoad.data and loaded.  Each load is timed as
+// the best of five; the first, untimed load warms the file cache, so
+// this measures decoding and placing the slices, not the disk.
+
+#include <algorithm>
+#include <thread>
+
+#include "DicomVolume.h"
+#include "DicomTestUtilities.h"
+#include "BenchmarkUtilities.h"
+
+int main( int argc, char ** argv )
+{
+    std::string strDir = "BenchParallelLoad.data";
+    if (argc > 1)
+    {
+        strDir = argv[1];
+    }
+    else
+    {
+        TestDicomImage  image;
+        image.uiRows = 512;
+        image.uiColumns = 512;
+        if (!WriteTestSeries(strDir, 256, image))
+        {
+            std::cout << "couldn't write " << strDir << "\n";
+            return 1;
+        }
+    }
+
+    const uint32_t  uiRuns = 5;
+    const uint32_t  uiCores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<uint32_t>   vuiThreads;
+    for (uint32_t t = 1; t < uiCores; t *= 2)
+    {
+        vuiThreads.push_back(t);
+    }
+    vuiThreads.push_back(uiCores);
+
+    const DICOMParser::FileAccessModes  aModes[] = { DICOMParser::ACCESS_STREAM, DICOMParser::ACCESS_MAPPED, DICOMParser::ACCESS_BUFFERED };
+    const char *                        apcModes[] = { "stream", "mapped", "buffered" };
+
+    for (size_t m = 0; m < 3; m++)
+    {
+        DicomVolume     serial;
+        DICOMParser     parser;
+        DICOMAppHelper  helper;
+        parser.SetFileAccessMode(aModes[m]);
+        helper.RegisterCallbacks(&parser);
+        helper.RegisterPixelDataCallback(&parser);
+        if (!LoadDicomVolume(strDir, parser, helper, serial))
+        {
+            std::cout << "couldn't load " << strDir << "\n";
+            return 1;
+        }
+        const uint64_t  uiBytes = uint64_t(serial.viVoxels.size()) * sizeof(int16_t);
+
+        const double    fSerial = BestMilliseconds(uiRuns, [&]()
+        {
+            DicomVolume volume;
+            LoadDicomVolume(strDir, parser, helper, volume);
+        });
+        std::cout << apcModes[m] << ", " << serial.uiSizeX << "x" << serial.uiSizeY << "x" << serial.uiSizeZ << "\n"
+                  << "  LoadDicomVolume: " << fSerial << " ms, " << MegabytesPerSecond(uiBytes, fSerial) << " MB/s\n";
+
+        for (size_t t = 0; t < vuiThreads.size(); t++)
+        {
+            DicomVolume volume;
+            bool        bSame = true;
+            const double    fParallel = BestMilliseconds(uiRuns, [&]()
+            {
+                bSame = LoadDicomVolumeParallel(strDir, vuiThreads[t], volume, aModes[m]) && bSame;
+            });
+            bSame = bSame && volume.viVoxels == serial.viVoxels;
+            std::cout << "  LoadDicomVolumeParallel, " << vuiThreads[t] << " threads: " << fParallel << " ms, "
+                      << MegabytesPerSecond(uiBytes, fParallel) << " MB/s, x" << fSerial / fParallel << (bSame ? "" : ", DIFFERENT VOXELS") << "\n";
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,188 @@
+// Header records parsed per second, and the tag lookup behind them.
+//
+// BenchParserRecords
+//
+// Two sets of synthetic files are written to BenchParserRecords.data: 50
+// rich headers of over 400 elements, and 2000 small ones of about 20.
+// Each set is read with ReadHeaderOnly through every access mode, values
+// borrowed, and the rate is records, that is elements, per second.
+//
+// Then the lookup ReadRecordValue does for each record is timed on its
+// own, over the tags of a rich header, a quarter of them registered:
+// a std::map keyed by (group, element) holding a heap vector of callbacks
+// per tag, as the parser used to keep them, against DICOMParserMap
+// searched for each tag and DICOMParserMap stepped with a cursor.
+
+#include <map>
+
+#include "DICOMParser.h"
+#include "DICOMAppHelper.h"
+#include "DICOMParserMap.h"
+#include "DicomTestUtilities.h"
+#include "BenchmarkUtilities.h"
+
+namespace
+{
+    const uint32_t  uiRuns = 5;
+
+    // Write uiFiles files like image into strDir.
+    bool WriteFiles( const std::string & strDir, const uint32_t uiFiles, TestDicomImage image, std::vector<std::string> & vstrFiles )
+    {
+        if (!MakeTestDirectory(strDir))
+        {
+            return false;
+        }
+        for (uint32_t i = 0; i < uiFiles; i++)
+        {
+            char    acName[32];
+            snprintf(acName, sizeof(acName), "/IM%04u.dcm", i);
+            image.iInstance = int32_t(i + 1);
+            vstrFiles.push_back(strDir + acName);
+            if (!WriteTestDicom(vstrFiles.back(), image))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void ReportParse( const char * pcSet, const std::vector<std::string> & vstrFiles )
+    {
+        const DICOMParser::FileAccessModes  aModes[] = { DICOMParser::ACCESS_STREAM, DICOMParser::ACCESS_MAPPED, DICOMParser::ACCESS_BUFFERED };
+        const char *                        apcModes[] = { "stream", "mapped", "buffered" };
+
+        for (size_t m = 0; m < 3; m++)
+        {
+            DICOMParser     parser;
+            DICOMAppHelper  helper;
+            parser.SetFileAccessMode(aModes[m]);
+            parser.SetZeroCopyValues(true);
+            helper.SetRecordSeriesDatabase(false);
+            helper.RegisterCallbacks(&parser);
+
+            uint64_t    uiRecords = 0;
+            const double    fMilliseconds = BestMilliseconds(uiRuns, [&]()
+            {
+                uiRecords = 0;
+                std::vector<doublebyte>             vGroups, vElements;
+                std::vector<DICOMParser::VRTypes>   vTypes;
+                for (size_t i = 0; i < vstrFiles.size(); i++)
+                {
+                    parser.OpenFile(vstrFiles[i]);
+                    parser.ReadHeaderOnly();
+                    parser.GetGroupsElementsDatatypes(vGroups, vElements, vTypes);
+                    uiRecords += vGroups.size();
+                }
+            });
+            std::cout << pcSet << ", " << apcModes[m] << ": " << uiRecords << " records, "
+                      << double(uiRecords) / (fMilliseconds * 1e3) << " M records/s\n";
+        }
+    }
+
+    // The callback table as the parser used to keep it.
+    typedef std::map< DICOMMapKey, std::pair<doublebyte, std::vector<DICOMCallback *> *>, group_element_compare >  OldParserMap;
+
+    void ReportLookup( const std::string & strFile )
+    {
+        DICOMParser parser;
+        parser.OpenFile(strFile);
+        parser.ReadHeaderOnly();
+        std::vector<doublebyte>             vGroups, vElements;
+        std::vector<DICOMParser::VRTypes>   vTypes;
+        parser.GetGroupsElementsDatatypes(vGroups, vElements, vTypes);
+
+        // the callbacks are never run, only counted
+        DICOMCallback * pCallback = reinterpret_cast<DICOMCallback *>(&parser);
+        OldParserMap    oldMap;
+        DICOMParserMap  map;
+        for (size_t i = 0; i < vGroups.size(); i += 4)
+        {
+            oldMap[DICOMMapKey(vGroups[i], vElements[i])] =
+                std::make_pair(doublebyte(vTypes[i]), new std::vector<DICOMCallback *>(1, pCallback));
+            map.AddCallback(DICOMMakeMapTag(vGroups[i], vElements[i]), doublebyte(vTypes[i]), pCallback);
+        }
+
+        const uint32_t  uiPasses = 20000;
+        const double    fLookups = double(vGroups.size()) * uiPasses;
+        size_t          uiFound = 0;
+
+        const double    fOld = BestMilliseconds(uiRuns, [&]()
+        {
+            for (uint32_t p = 0; p < uiPasses; p++)
+            {
+                for (size_t i = 0; i < vGroups.size(); i++)
+                {
+                    OldParserMap::const_iterator    it = oldMap.find(DICOMMapKey(vGroups[i], vElements[i]));
+                    if (it != oldMap.end())
+                    {
+                        uiFound += it->second.second->size();
+                    }
+                }
+            }
+        });
+        const double    fSearch = BestMilliseconds(uiRuns, [&]()
+        {
+            for (uint32_t p = 0; p < uiPasses; p++)
+            {
+                for (size_t i = 0; i < vGroups.size(); i++)
+                {
+                    const DICOMParserMap::Entry *   pEntry = map.Find(DICOMMakeMapTag(vGroups[i], vElements[i]));
+                    if (pEntry)
+                    {
+                        uiFound += pEntry->NumberOfCallbacks;
+                    }
+                }
+            }
+        });
+        const double    fCursor = BestMilliseconds(uiRuns, [&]()
+        {
+            for (uint32_t p = 0; p < uiPasses; p++)
+            {
+                size_t  uiCursor = 0;
+                for (size_t i = 0; i < vGroups.size(); i++)
+                {
+                    const DICOMParserMap::Entry *   pEntry = map.Find(DICOMMakeMapTag(vGroups[i], vElements[i]), uiCursor);
+                    if (pEntry)
+                    {
+                        uiFound += pEntry->NumberOfCallbacks;
+                    }
+                }
+            }
+        });
+        KeepResult(uiFound);
+
+        std::cout << "lookup of " << vGroups.size() << " tags, " << oldMap.size() << " registered\n"
+                  << "  std::map: " << fLookups / (fOld * 1e3) << " M lookups/s\n"
+                  << "  DICOMParserMap, search: " << fLookups / (fSearch * 1e3) << " M lookups/s\n"
+                  << "  DICOMParserMap, cursor: " << fLookups / (fCursor * 1e3) << " M lookups/s\n";
+
+        for (OldParserMap::iterator it = oldMap.begin(); it != oldMap.end(); ++it)
+        {
+            delete it->second.second;
+        }
+    }
+}
+
+int main()
+{
+    std::vector<std::string>    vstrRich, vstrSmall;
+    TestDicomImage              image;
+    image.uiRows = 64;
+    image.uiColumns = 64;
+    image.uiExtraElements = 400;
+    bool    bOK = MakeTestDirectory("BenchParserRecords.data");
+    bOK = bOK && WriteFiles("BenchParserRecords.data/rich", 50, image, vstrRich);
+    image.uiExtraElements = 0;
+    bOK = bOK && WriteFiles("BenchParserRecords.data/small", 2000, image, vstrSmall);
+    if (!bOK)
+    {
+        std::cout << "couldn't write BenchParserRecords.data\n";
+        return 1;
+    }
+
+    ReportParse("rich headers", vstrRich);
+    ReportParse("small headers", vstrSmall);
+    ReportLookup(vstrRich[0]);
+
+    return 0;
+}
@@ -0,0 +1,103 @@
+// Throughput of each DICOMPixelKernels loop with each instruction set,
+// in GB/s of stored pixel data read, without and with statistics.  The
+// 16 bit kernels swap bytes, as for big endian files.
+//
+// The input is 16 million values of CT like slices, a disc of tissue
+// values in air with padding outside it, so the padding and histogram
+// branches see what they would in practice.  Sets the CPU lacks are
+// reported as not supported.
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "DICOMPixelKernels.h"
+#include "BenchmarkUtilities.h"
+
+namespace
+{
+    typedef DICOMPixelKernels   Kernels;
+
+    const int       iSize = 512;
+    const int       iSlices = 64;
+    const int       n = iSize * iSize * iSlices;
+    const uint32_t  uiRuns = 5;
+
+    // Time kernel, which takes the statistics to fill or NULL and the
+    // instruction set, with each set.
+    template <class Kernel>
+    void Report( const char * pcKernel, const size_t uiInputBytes, const bool bStatistics, Kernel kernel )
+    {
+        const Kernels::InstructionSets  aSets[] = { Kernels::SCALAR, Kernels::SSE2, Kernels::AVX2 };
+        std::cout << pcKernel << "\n";
+        for (size_t s = 0; s < sizeof(aSets) / sizeof(aSets[0]); s++)
+        {
+            if (aSets[s] > Kernels::GetInstructionSet())
+            {
+                std::cout << "  " << Kernels::GetInstructionSetName(aSets[s]) << ": not supported\n";
+                continue;
+            }
+            for (int iStatistics = 0; iStatistics < (bStatistics ? 2 : 1); iStatistics++)
+            {
+                DICOMPixelStatistics    statistics;
+                const double    fMilliseconds = BestMilliseconds(uiRuns, [&]()
+                {
+                    kernel(iStatistics ? &statistics : NULL, aSets[s]);
+                });
+                std::cout << "  " << Kernels::GetInstructionSetName(aSets[s]) << (iStatistics ? ", statistics: " : ": ")
+                          << MegabytesPerSecond(uiInputBytes, fMilliseconds) / 1024.0 << " GB/s\n";
+            }
+        }
+    }
+}
+
+int main()
+{
+    std::mt19937        random(1);
+    std::vector<short>  viStored(n);
+    for (int i = 0; i < n; i++)
+    {
+        const int   x = i % iSize - iSize / 2;
+        const int   y = (i / iSize) % iSize - iSize / 2;
+        const int   r2 = x * x + y * y;
+        viStored[i] = r2 > 250 * 250 ? short(-2000) : r2 > 200 * 200 ? short(-1000 + random() % 40) : short(random() % 1400 - 200);
+    }
+    Kernels::SwapBytes16(reinterpret_cast<const uint16_t *>(viStored.data()), reinterpret_cast<uint16_t *>(viStored.data()), n);
+
+    const short *           piStored = viStored.data();
+    const unsigned short *  puiStored = reinterpret_cast<const unsigned short *>(piStored);
+    const unsigned char *   pucStored = reinterpret_cast<const unsigned char *>(piStored);
+    std::vector<short>      viOut(n);
+    std::vector<char>       vcOut(n);
+    std::vector<float>      vfOut(n);
+    std::vector<uint16_t>   vuiSwapped(n);
+
+    std::cout << n << " values, best instruction set " << Kernels::GetInstructionSetName(Kernels::GetInstructionSet()) << "\n";
+
+    Report("DecodeShortToShort", n * sizeof(short), true, [&]( DICOMPixelStatistics * pStatistics, Kernels::InstructionSets set )
+    {
+        Kernels::DecodeShortToShort(piStored, viOut.data(), n, 1.0f, -1024.0f, -2000, true, pStatistics, set);
+    });
+    Report("CopyShortToShort", n * sizeof(short), true, [&]( DICOMPixelStatistics * pStatistics, Kernels::InstructionSets set )
+    {
+        Kernels::CopyShortToShort(piStored, viOut.data(), n, -2000, true, pStatistics, set);
+    });
+    Report("DecodeUShortToFloat", n * sizeof(short), true, [&]( DICOMPixelStatistics * pStatistics, Kernels::InstructionSets set )
+    {
+        Kernels::DecodeUShortToFloat(puiStored, vfOut.data(), n, 0.5f, -1024.0f, true, pStatistics, set);
+    });
+    Report("DecodeUCharToChar", n, true, [&]( DICOMPixelStatistics * pStatistics, Kernels::InstructionSets set )
+    {
+        Kernels::DecodeUCharToChar(pucStored, vcOut.data(), n, 1.0f, 0.0f, false, pStatistics, set);
+    });
+    Report("DecodeUCharToFloat", n, true, [&]( DICOMPixelStatistics * pStatistics, Kernels::InstructionSets set )
+    {
+        Kernels::DecodeUCharToFloat(pucStored, vfOut.data(), n, 0.5f, -1024.0f, false, pStatistics, set);
+    });
+    Report("SwapBytes16", n * sizeof(short), false, [&]( DICOMPixelStatistics *, Kernels::InstructionSets set )
+    {
+        Kernels::SwapBytes16(puiStored, vuiSwapped.data(), n, set);
+    });
+
+    return 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+
+// Timing shared by the benchmarks.  Each measurement is the best of a
+// few runs, which is the least disturbed by whatever else the machine is
+// doing.
+
+// Milliseconds the fastest of uiRuns calls of function took.
+template <class Function>
+double BestMilliseconds( const uint32_t uiRuns, Function function )
+{
+    double  fBest = 0.0;
+    for (uint32_t r = 0; r < uiRuns; r++)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        function();
+        const double    fElapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        fBest = r == 0 ? fElapsed : std::min(fBest, fElapsed);
+    }
+    return fBest;
+}
+
+// Throughput of uiBytes done in fMilliseconds, in MB/s.
+inline double MegabytesPerSecond( const uint64_t uiBytes, const double fMilliseconds )
+{
+    return fMilliseconds > 0.0 ? double(uiBytes) / (1024.0 * 1024.0) / (fMilliseconds / 1000.0) : 0.0;
+}
+
+// Keeps the compiler from dropping work whose result is otherwise unused.
+// The value goes through a volatile store and load, which no compiler may
+// drop; an asm escape would do the same for GCC and Clang only.
+template <class T>
+T KeepResult( const T & value )
+{
+    static volatile T   sink;
+    sink = value;
+    return sink;
+}
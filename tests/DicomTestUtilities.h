@@ -0,0 +1,532 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _MSC_VER
+#include <direct.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "tinydir.h"
+#include "DICOMPixelKernels.h"
+
+// Small helpers shared by the tests and benchmarks: a check that counts
+// failures instead of stopping, and a writer of synthetic DICOM files, so
+// nothing depends on data that isn't in the tree.
+
+// Failed checks so far; a test returns TestResult() from main.
+inline int & TestFailures()
+{
+    static int  iFailures = 0;
+    return iFailures;
+}
+
+inline int TestResult()
+{
+    if (TestFailures() != 0)
+    {
+        std::cout << TestFailures() << " checks failed\n";
+        return 1;
+    }
+    std::cout << "all checks passed\n";
+    return 0;
+}
+
+#define TEST_CHECK( condition )                                                         \
+    do                                                                                  \
+    {                                                                                   \
+        if (!(condition))                                                               \
+        {                                                                               \
+            std::cout << __FILE__ << ":" << __LINE__ << ": check failed: " #condition "\n";   \
+            TestFailures()++;                                                           \
+        }                                                                               \
+    } while (0)
+
+// Whether a and b summarize the same values, exactly.
+inline bool SameStatistics( const DICOMPixelStatistics & a, const DICOMPixelStatistics & b )
+{
+    if (a.Count != b.Count || a.HistogramOrigin != b.HistogramOrigin || a.HistogramBinWidth != b.HistogramBinWidth)
+    {
+        return false;
+    }
+    if (a.Count != 0 && (a.Min != b.Min || a.Max != b.Max || a.Sum != b.Sum))
+    {
+        return false;
+    }
+    for (int i = 0; i < DICOMPixelStatistics::HISTOGRAM_BINS; i++)
+    {
+        if (a.Histogram[i] != b.Histogram[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Return code that ctest reports as a skipped test (SKIP_RETURN_CODE).
+const int TEST_SKIPPED = 77;
+
+// One synthetic image, 16 bit monochrome unless said otherwise.  The
+// samples come from TestSample unless viPixels is given, frame after
+// frame.  With bRLE the pixel data is RLE Lossless, encapsulated with or
+// without a Basic Offset Table and each frame in one or more fragments.
+struct TestDicomImage
+{
+    uint32_t                uiRows = 16;
+    uint32_t                uiColumns = 16;
+    uint32_t                uiFrames = 1;
+    uint16_t                uiBitsAllocated = 16;       // 8 or 16
+    uint16_t                uiSamplesPerPixel = 1;      // 3 is RGB, interleaved
+    int32_t                 iInstance = 1;
+    float                   fZ = 0.0f;                  // image position z
+    float                   fPixelSpacing = 0.7f;
+    float                   fSlope = 1.0f;
+    float                   fIntercept = 0.0f;
+    bool                    bBigEndian = false;         // explicit VR big endian, else little
+    uint64_t                uiPaddingBytes = 0;         // private OB element before the pixel data
+    uint32_t                uiExtraElements = 0;        // private LO elements, as in a rich header
+    std::vector<uint32_t>   vuiEmptyElements;           // (group << 16) | element, written with no value
+    bool                    bRLE = false;
+    bool                    bOffsetTable = true;
+    uint32_t                uiFragmentsPerFrame = 1;
+    std::string             strTransferSyntax;          // written instead of the one the above imply
+    std::string             strSeriesUID = "1.2.826.0.1.3680043.2.1125.1";
+    std::vector<int16_t>    viPixels;
+};
+
+// Stored value of pixel (x, y) of frame uiFrame of image iInstance.
+inline int16_t TestPixel( const int32_t iInstance, const uint32_t uiFrame, const uint32_t x, const uint32_t y )
+{
+    return int16_t((iInstance * 131 + uiFrame * 17 + x * 7 + y * 3) % 4000 - 1000);
+}
+
+// Stored value of sample uiSample of pixel (x, y) of frame uiFrame of
+// image; 8 bit images store its low byte.
+inline int16_t TestSample( const TestDicomImage & image, const uint32_t uiFrame, const uint32_t x, const uint32_t y, const uint32_t uiSample )
+{
+    if (!image.viPixels.empty())
+    {
+        return image.viPixels[((size_t(uiFrame) * image.uiRows + y) * image.uiColumns + x) * image.uiSamplesPerPixel + uiSample];
+    }
+    return int16_t(TestPixel(image.iInstance, uiFrame, x, y) + uiSample * 1000);
+}
+
+namespace TestDicomDetail
+{
+    inline void PutUInt16( std::string & str, const uint16_t u, const bool bBigEndian )
+    {
+        str += char(bBigEndian ? u >> 8 : u & 0xFF);
+        str += char(bBigEndian ? u & 0xFF : u >> 8);
+    }
+
+    inline void PutUInt32( std::string & str, const uint32_t u, const bool bBigEndian )
+    {
+        PutUInt16(str, uint16_t(bBigEndian ? u >> 16 : u & 0xFFFF), bBigEndian);
+        PutUInt16(str, uint16_t(bBigEndian ? u & 0xFFFF : u >> 16), bBigEndian);
+    }
+
+    // Header of an explicit VR element of uiLength bytes.
+    inline void PutHeader(  std::string &       str,
+                            const uint16_t      uiGroup,
+                            const uint16_t      uiElement,
+                            const char *        pcVR,
+                            const uint32_t      uiLength,
+                            const bool          bBigEndian  )
+    {
+        PutUInt16(str, uiGroup, bBigEndian);
+        PutUInt16(str, uiElement, bBigEndian);
+        str.append(pcVR, 2);
+        const std::string   strVR(pcVR);
+        if (strVR == "OB" || strVR == "OW" || strVR == "UN" || strVR == "SQ" || strVR == "UT")
+        {
+            PutUInt16(str, 0, bBigEndian);
+            PutUInt32(str, uiLength, bBigEndian);
+        }
+        else
+        {
+            PutUInt16(str, uint16_t(uiLength), bBigEndian);
+        }
+    }
+
+    // Text element, padded to even length with cPad.
+    inline void PutText(    std::string &       str,
+                            const uint16_t      uiGroup,
+                            const uint16_t      uiElement,
+                            const char *        pcVR,
+                            std::string         strValue,
+                            const bool          bBigEndian,
+                            const char          cPad = ' '  )
+    {
+        if (strValue.size() % 2)
+        {
+            strValue += cPad;
+        }
+        PutHeader(str, uiGroup, uiElement, pcVR, uint32_t(strValue.size()), bBigEndian);
+        str += strValue;
+    }
+
+    inline void PutUS(  std::string &       str,
+                        const uint16_t      uiGroup,
+                        const uint16_t      uiElement,
+                        const uint16_t      uiValue,
+                        const bool          bBigEndian  )
+    {
+        PutHeader(str, uiGroup, uiElement, "US", 2, bBigEndian);
+        PutUInt16(str, uiValue, bBigEndian);
+    }
+
+    // Item (FFFE,uiElement) of encapsulated pixel data, little endian.
+    inline void PutItem( std::string & str, const uint16_t uiElement, const std::string & strValue )
+    {
+        PutUInt16(str, 0xFFFE, false);
+        PutUInt16(str, uiElement, false);
+        PutUInt32(str, uint32_t(strValue.size()), false);
+        str += strValue;
+    }
+
+    inline std::string Number( const double f )
+    {
+        char    acBuffer[32];
+        snprintf(acBuffer, sizeof(acBuffer), "%g", f);
+        return acBuffer;
+    }
+}
+
+// Bytes of one frame of image, uncompressed.
+inline uint64_t TestFrameBytes( const TestDicomImage & image )
+{
+    return uint64_t(image.uiRows) * image.uiColumns * image.uiSamplesPerPixel * (image.uiBitsAllocated / 8);
+}
+
+// Frame uiFrame of image as native pixel data: samples interleaved, in
+// the image's byte order.
+inline std::string TestFrameData( const TestDicomImage & image, const uint32_t uiFrame )
+{
+    std::string strFrame;
+    strFrame.reserve(size_t(TestFrameBytes(image)));
+    for (uint32_t y = 0; y < image.uiRows; y++)
+    {
+        for (uint32_t x = 0; x < image.uiColumns; x++)
+        {
+            for (uint32_t s = 0; s < image.uiSamplesPerPixel; s++)
+            {
+                const int16_t   iValue = TestSample(image, uiFrame, x, y, s);
+                if (image.uiBitsAllocated == 8)
+                {
+                    strFrame += char(iValue & 0xFF);
+                }
+                else
+                {
+                    TestDicomDetail::PutUInt16(strFrame, uint16_t(iValue), image.bBigEndian);
+                }
+            }
+        }
+    }
+    return strFrame;
+}
+
+// PackBits, as RLE Lossless segments use it: runs of 3 or more equal
+// bytes replicated, the rest as literals of up to 128 bytes.  Padded to
+// even length with a no-op.
+inline std::string TestPackBits( const std::string & strIn )
+{
+    std::string strOut;
+    size_t      i = 0;
+    while (i < strIn.size())
+    {
+        size_t  uiRun = 1;
+        while (i + uiRun < strIn.size() && uiRun < 128 && strIn[i + uiRun] == strIn[i])
+        {
+            uiRun++;
+        }
+        if (uiRun >= 3)
+        {
+            strOut += char(1 - int(uiRun));
+            strOut += strIn[i];
+            i += uiRun;
+            continue;
+        }
+
+        size_t  uiLiteral = 0;
+        while (i + uiLiteral < strIn.size() && uiLiteral < 128 &&
+               !(i + uiLiteral + 2 < strIn.size() && strIn[i + uiLiteral] == strIn[i + uiLiteral + 1] &&
+                 strIn[i + uiLiteral] == strIn[i + uiLiteral + 2]))
+        {
+            uiLiteral++;
+        }
+        strOut += char(uiLiteral - 1);
+        strOut.append(strIn, i, uiLiteral);
+        i += uiLiteral;
+    }
+    if (strOut.size() % 2)
+    {
+        strOut += char(-128);
+    }
+    return strOut;
+}
+
+// Frame uiFrame of image, which must be little endian, compressed as an
+// RLE Lossless frame: the 64 byte header, then a segment per byte of each
+// sample, most significant byte first.
+inline std::string TestRLEFrame( const TestDicomImage & image, const uint32_t uiFrame )
+{
+    const std::string   strNative = TestFrameData(image, uiFrame);
+    const uint32_t      uiBytes = image.uiBitsAllocated / 8;
+    const uint32_t      uiSegments = image.uiSamplesPerPixel * uiBytes;
+
+    std::string strHeader;
+    std::string strSegments;
+    TestDicomDetail::PutUInt32(strHeader, uiSegments, false);
+    for (uint32_t s = 0; s < uiSegments; s++)
+    {
+        // segment s is byte s % uiBytes, from the top, of sample s / uiBytes
+        const uint32_t  uiByte = (s / uiBytes) * uiBytes + uiBytes - 1 - s % uiBytes;
+        std::string     strPlane;
+        for (size_t i = uiByte; i < strNative.size(); i += uiSegments)
+        {
+            strPlane += strNative[i];
+        }
+        TestDicomDetail::PutUInt32(strHeader, uint32_t(64 + strSegments.size()), false);
+        strSegments += TestPackBits(strPlane);
+    }
+    strHeader.resize(64, '\0');
+    return strHeader + strSegments;
+}
+
+// Write everything of image up to its pixel data value to file, which
+// must be open for writing at its start.  The padding element's value is
+// skipped over rather than written, so a large one leaves a hole in a
+// sparse file.  Returns the offset of the pixel data value.
+inline uint64_t WriteTestDicomHeader( std::fstream & file, const TestDicomImage & image )
+{
+    using namespace TestDicomDetail;
+
+    const bool          bBE = image.bBigEndian;
+    const std::string   strSyntax = !image.strTransferSyntax.empty() ? image.strTransferSyntax :
+                                    image.bRLE ? "1.2.840.10008.1.2.5" : bBE ? "1.2.840.10008.1.2.2" : "1.2.840.10008.1.2.1";
+
+    // the elements every image has, or just their headers when listed in
+    // vuiEmptyElements
+    const std::vector<uint32_t> & vuiEmpty = image.vuiEmptyElements;
+    const auto  Empty = [&]( const uint16_t uiGroup, const uint16_t uiElement )
+    {
+        return std::find(vuiEmpty.begin(), vuiEmpty.end(), (uint32_t(uiGroup) << 16) | uiElement) != vuiEmpty.end();
+    };
+    const auto  Text = [&]( std::string & str, const uint16_t uiGroup, const uint16_t uiElement, const char * pcVR, const std::string & strValue, const char cPad )
+    {
+        if (Empty(uiGroup, uiElement))
+        {
+            PutHeader(str, uiGroup, uiElement, pcVR, 0, bBE && uiGroup != 0x0002);
+        }
+        else
+        {
+            PutText(str, uiGroup, uiElement, pcVR, strValue, bBE && uiGroup != 0x0002, cPad);
+        }
+    };
+    const auto  US = [&]( std::string & str, const uint16_t uiGroup, const uint16_t uiElement, const uint16_t uiValue )
+    {
+        if (Empty(uiGroup, uiElement))
+        {
+            PutHeader(str, uiGroup, uiElement, "US", 0, bBE);
+        }
+        else
+        {
+            PutUS(str, uiGroup, uiElement, uiValue, bBE);
+        }
+    };
+
+    std::string strMetaBody;
+    Text(strMetaBody, 0x0002, 0x0010, "UI", strSyntax, '\0');
+
+    std::string strHeader(128, '\0');
+    strHeader += "DICM";
+    PutHeader(strHeader, 0x0002, 0x0000, "UL", 4, false);
+    PutUInt32(strHeader, uint32_t(strMetaBody.size()), false);
+    strHeader += strMetaBody;
+
+    Text(strHeader, 0x0008, 0x0060, "CS", "CT", ' ');
+    Text(strHeader, 0x0018, 0x0050, "DS", Number(image.fPixelSpacing), ' ');
+    Text(strHeader, 0x0020, 0x000E, "UI", image.strSeriesUID, '\0');
+    Text(strHeader, 0x0020, 0x0013, "IS", Number(image.iInstance), ' ');
+    Text(strHeader, 0x0020, 0x0032, "DS", "-100\\-120\\" + Number(image.fZ), ' ');
+    Text(strHeader, 0x0020, 0x0037, "DS", "1\\0\\0\\0\\1\\0", ' ');
+    for (uint32_t i = 0; i < image.uiExtraElements; i++)
+    {
+        PutText(strHeader, 0x0027, uint16_t(0x1000 + i), "LO", "EXTRA " + Number(i), bBE);
+    }
+    US(strHeader, 0x0028, 0x0002, image.uiSamplesPerPixel);
+    Text(strHeader, 0x0028, 0x0004, "CS", image.uiSamplesPerPixel == 3 ? "RGB" : "MONOCHROME2", ' ');
+    if (image.uiSamplesPerPixel > 1)
+    {
+        US(strHeader, 0x0028, 0x0006, 0);
+    }
+    if (image.uiFrames > 1 || Empty(0x0028, 0x0008))
+    {
+        Text(strHeader, 0x0028, 0x0008, "IS", Number(image.uiFrames), ' ');
+    }
+    US(strHeader, 0x0028, 0x0010, uint16_t(image.uiRows));
+    US(strHeader, 0x0028, 0x0011, uint16_t(image.uiColumns));
+    Text(strHeader, 0x0028, 0x0030, "DS", Number(image.fPixelSpacing) + "\\" + Number(image.fPixelSpacing), ' ');
+    US(strHeader, 0x0028, 0x0100, image.uiBitsAllocated);
+    US(strHeader, 0x0028, 0x0103, 1);
+    Text(strHeader, 0x0028, 0x1052, "DS", Number(image.fIntercept), ' ');
+    Text(strHeader, 0x0028, 0x1053, "DS", Number(image.fSlope), ' ');
+
+    if (image.uiPaddingBytes)
+    {
+        PutHeader(strHeader, 0x0029, 0x1010, "OB", uint32_t(image.uiPaddingBytes), bBE);
+    }
+    file.write(strHeader.data(), strHeader.size());
+    file.seekp(std::streamoff(image.uiPaddingBytes), std::ios::cur);
+
+    // encapsulated pixel data is of undefined length
+    std::string strPixelHeader;
+    PutHeader(strPixelHeader, 0x7FE0, 0x0010, image.uiBitsAllocated == 8 || image.bRLE ? "OB" : "OW",
+              image.bRLE ? 0xFFFFFFFF : uint32_t(TestFrameBytes(image) * image.uiFrames), bBE);
+    file.write(strPixelHeader.data(), strPixelHeader.size());
+    return strHeader.size() + image.uiPaddingBytes + strPixelHeader.size();
+}
+
+// Write image to strPath as a complete file.
+inline bool WriteTestDicom( const std::string & strPath, const TestDicomImage & image )
+{
+    std::fstream    file(strPath.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    WriteTestDicomHeader(file, image);
+
+    std::string strPixels;
+    if (!image.bRLE)
+    {
+        strPixels.reserve(size_t(TestFrameBytes(image) * image.uiFrames));
+        for (uint32_t f = 0; f < image.uiFrames; f++)
+        {
+            strPixels += TestFrameData(image, f);
+        }
+        file.write(strPixels.data(), strPixels.size());
+        return bool(file);
+    }
+
+    // the Basic Offset Table gives where each frame's first item is,
+    // counted from the first fragment's
+    std::string strTable;
+    std::string strFragments;
+    for (uint32_t f = 0; f < image.uiFrames; f++)
+    {
+        if (image.bOffsetTable)
+        {
+            TestDicomDetail::PutUInt32(strTable, uint32_t(strFragments.size()), false);
+        }
+        const std::string   strFrame = TestRLEFrame(image, f);
+        const uint32_t      uiFragments = std::max(1u, image.uiFragmentsPerFrame);
+        size_t              uiStart = 0;
+        for (uint32_t i = 0; i < uiFragments; i++)
+        {
+            // even fragments, the last one taking what's left
+            size_t  uiEnd = i + 1 == uiFragments ? strFrame.size() : (strFrame.size() * (i + 1) / uiFragments) & ~size_t(1);
+            TestDicomDetail::PutItem(strFragments, 0xE000, strFrame.substr(uiStart, uiEnd - uiStart));
+            uiStart = uiEnd;
+        }
+    }
+    TestDicomDetail::PutItem(strPixels, 0xE000, strTable);
+    strPixels += strFragments;
+    TestDicomDetail::PutItem(strPixels, 0xE0DD, "");
+    file.write(strPixels.data(), strPixels.size());
+    return bool(file);
+}
+
+// Make strDir, or empty it of files if it exists.
+inline bool MakeTestDirectory( const std::string & strDir )
+{
+#ifdef _MSC_VER
+    _mkdir(strDir.c_str());
+#else
+    mkdir(strDir.c_str(), 0755);
+#endif
+
+    tinydir_dir dir;
+    if (tinydir_open(&dir, strDir.c_str()) == -1)
+    {
+        return false;
+    }
+    std::vector<std::string>    vstrFiles;
+    while (dir.has_next)
+    {
+        tinydir_file    file;
+        if (tinydir_readfile(&dir, &file) == 0 && !file.is_dir)
+        {
+            vstrFiles.push_back(file.path);
+        }
+        tinydir_next(&dir);
+    }
+    tinydir_close(&dir);
+
+    for (size_t i = 0; i < vstrFiles.size(); i++)
+    {
+        remove(vstrFiles[i].c_str());
+    }
+    return true;
+}
+
+// Write a series of uiSlices images like image into strDir, which is
+// emptied first, instance numbers from 1 and fZSpacing apart.  The files
+// are named in reverse, so a loader has to sort them.
+inline bool WriteTestSeries(    const std::string &     strDir,
+                                const uint32_t          uiSlices,
+                                TestDicomImage          image,
+                                const float             fZSpacing = 1.25f   )
+{
+    if (!MakeTestDirectory(strDir))
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < uiSlices; i++)
+    {
+        image.iInstance = int32_t(i + 1);
+        image.fZ = float(i) * fZSpacing;
+        char    acName[32];
+        snprintf(acName, sizeof(acName), "/IM%04u.dcm", uiSlices - 1 - i);
+        if (!WriteTestDicom(strDir + acName, image))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Make strPath a file of uiSize bytes without writing them, so that on
+// file systems with sparse files it takes no space.
+inline bool MakeSparseFile( const std::string & strPath, const uint64_t uiSize )
+{
+#ifdef _MSC_VER
+    int     iFile = _open(strPath.c_str(), _O_RDWR | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+    if (iFile < 0)
+    {
+        return false;
+    }
+    const bool  bOK = _chsize_s(iFile, int64_t(uiSize)) == 0;
+    _close(iFile);
+#else
+    int     iFile = open(strPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (iFile < 0)
+    {
+        return false;
+    }
+    const bool  bOK = ftruncate(iFile, off_t(uiSize)) == 0;
+    close(iFile);
+#endif
+    return bOK;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdlib.h>
+#include <new>
+
+// Global operator new and delete replaced to count heap allocations, for
+// tests that check what a code path allocates.  The replacements are
+// definitions, so include this in only one file of a test program.
+
+// Whether an allocation of uiSize bytes is counted.
+typedef bool (*TestAllocationFilter)( size_t uiSize );
+
+// Allocations counted so far.
+inline size_t & TestAllocations()
+{
+    static size_t   uiAllocations = 0;
+    return uiAllocations;
+}
+
+// The filter allocations are counted by; every one counts while it is NULL.
+inline TestAllocationFilter & TestAllocationCounterFilter()
+{
+    static TestAllocationFilter pFilter = NULL;
+    return pFilter;
+}
+
+inline void * TestCountedAlloc( size_t uiSize )
+{
+    const TestAllocationFilter  pFilter = TestAllocationCounterFilter();
+    if (pFilter == NULL || pFilter(uiSize))
+    {
+        TestAllocations()++;
+    }
+    void *  p = malloc(uiSize ? uiSize : 1);
+    if (p == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void * operator new( size_t uiSize )                    { return TestCountedAlloc(uiSize); }
+void * operator new[]( size_t uiSize )                  { return TestCountedAlloc(uiSize); }
+void operator delete( void * p ) noexcept               { free(p); }
+void operator delete[]( void * p ) noexcept             { free(p); }
+void operator delete( void * p, size_t ) noexcept       { free(p); }
+void operator delete[]( void * p, size_t ) noexcept     { free(p); }
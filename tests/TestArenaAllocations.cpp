@@ -0,0 +1,104 @@
+// Once a parser has read a file, reading it again allocates nothing: the
+// values copied for the callbacks go to the parser's DICOMArena, which
+// Reset() and MergeBlocks() turn into one block large enough for a whole
+// file, and every other buffer is kept between files.  The allocations
+// are counted by TestAllocationCounter.h.
+//
+// The helper's series database is off, as it is for batch loading; with
+// it on, every file parsed is recorded, which has to allocate.
+
+#include "DICOMParser.h"
+#include "DICOMAppHelper.h"
+#include "DICOMArena.h"
+#include "DicomTestUtilities.h"
+#include "TestAllocationCounter.h"
+
+namespace
+{
+    const uint32_t  uiPasses = 5;
+
+    // Allocations made by each pass over vstrFiles, parsing each with
+    // the same parser and helper.
+    std::vector<size_t> CountPasses(    const std::vector<std::string> &    vstrFiles,
+                                        const DICOMParser::FileAccessModes  mode,
+                                        const bool                          bZeroCopy   )
+    {
+        DICOMParser     parser;
+        DICOMAppHelper  helper;
+        parser.SetFileAccessMode(mode);
+        parser.SetZeroCopyValues(bZeroCopy);
+        helper.SetRecordSeriesDatabase(false);
+        helper.RegisterCallbacks(&parser);
+        helper.RegisterPixelDataCallback(&parser);
+
+        DICOMImageInfo      info;
+        std::vector<size_t> vuiCounts;
+        for (uint32_t p = 0; p < uiPasses; p++)
+        {
+            const size_t    uiBefore = TestAllocations();
+            for (size_t i = 0; i < vstrFiles.size(); i++)
+            {
+                TEST_CHECK(parser.OpenFile(vstrFiles[i]) && parser.ReadHeader());
+                helper.GetImageInfo(&parser, info);
+            }
+            vuiCounts.push_back(TestAllocations() - uiBefore);
+        }
+        return vuiCounts;
+    }
+}
+
+int main()
+{
+    const std::string   strDir = "TestArenaAllocations.data";
+    if (!MakeTestDirectory(strDir))
+    {
+        std::cout << "couldn't make " << strDir << "\n";
+        return 1;
+    }
+
+    // A file whose values fit in one arena block, and one with 128 KB of
+    // pixels, more than a default block, so that copying its values spills
+    // into a second block.  The blocks are merged by the first Allocate
+    // after the Reset for the next file, which is the one allocation the
+    // second pass over that file may make.
+    const uint32_t  auiSizes[] = { 64, 256 };
+    for (size_t s = 0; s < 2; s++)
+    {
+        TestDicomImage  image;
+        image.uiRows = auiSizes[s];
+        image.uiColumns = auiSizes[s];
+        char    acName[32];
+        snprintf(acName, sizeof(acName), "/IM%ux%u.dcm", auiSizes[s], auiSizes[s]);
+        const std::vector<std::string>  vstrFiles(1, strDir + acName);
+        TEST_CHECK(WriteTestDicom(vstrFiles[0], image));
+
+        const bool  bSpills = TestFrameBytes(image) > uint64_t(DICOMArena::DEFAULT_BLOCK_SIZE);
+
+        const DICOMParser::FileAccessModes  aModes[] = { DICOMParser::ACCESS_STREAM, DICOMParser::ACCESS_MAPPED, DICOMParser::ACCESS_BUFFERED };
+        const char *                        apcModes[] = { "stream", "mapped", "buffered" };
+        for (size_t m = 0; m < 3; m++)
+        {
+            for (int iZeroCopy = 0; iZeroCopy < 2; iZeroCopy++)
+            {
+                const std::vector<size_t>   vuiCounts = CountPasses(vstrFiles, aModes[m], iZeroCopy != 0);
+
+                std::cout << auiSizes[s] << "x" << auiSizes[s] << ", " << apcModes[m]
+                          << (iZeroCopy ? ", zero copy" : ", copied values") << ": allocations per pass";
+                for (size_t p = 0; p < vuiCounts.size(); p++)
+                {
+                    std::cout << " " << vuiCounts[p];
+                }
+                std::cout << "\n";
+
+                TEST_CHECK(vuiCounts[0] > 0);
+                TEST_CHECK(vuiCounts[1] <= ((bSpills && !iZeroCopy) ? 1u : 0u));
+                for (size_t p = 2; p < vuiCounts.size(); p++)
+                {
+                    TEST_CHECK(vuiCounts[p] == 0);
+                }
+            }
+        }
+    }
+
+    return TestResult();
+}
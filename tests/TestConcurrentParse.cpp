@@ -0,0 +1,159 @@
+// 64 DICOMParser/DICOMAppHelper pairs parse the same files at once, each
+// on its own thread, and must give what a serial parse gives.  Separate
+// instances share no state (see the threading notes in DICOMParser.h and
+// DICOMAppHelper.h); this is the check that they don't.
+//
+// To look for data races as well, build with -fsanitize=thread, e.g.
+// cmake -DCMAKE_CXX_FLAGS=-fsanitize=thread -DCMAKE_EXE_LINKER_FLAGS=-fsanitize=thread
+
+#include <string.h>
+#include <atomic>
+#include <thread>
+
+#include "DICOMParser.h"
+#include "DICOMAppHelper.h"
+#include "DicomTestUtilities.h"
+
+namespace
+{
+    const uint32_t  uiThreads = 64;
+    const uint32_t  uiPasses = 2;
+
+    // What parsing one file gives.
+    struct ParseResult
+    {
+        bool                bOK = false;
+        DICOMImageInfo      info;
+        int                 iType = 0;
+        std::vector<char>   vcData;
+
+        bool operator==( const ParseResult & other ) const
+        {
+            return bOK == other.bOK &&
+                   info.SeriesUID == other.info.SeriesUID &&
+                   info.Ordering.SliceNumber == other.info.Ordering.SliceNumber &&
+                   info.Ordering.ImagePositionPatient[2] == other.info.Ordering.ImagePositionPatient[2] &&
+                   info.Dimensions[0] == other.info.Dimensions[0] &&
+                   info.Dimensions[1] == other.info.Dimensions[1] &&
+                   info.NumberOfFrames == other.info.NumberOfFrames &&
+                   info.RescaleSlope == other.info.RescaleSlope &&
+                   info.RescaleOffset == other.info.RescaleOffset &&
+                   info.TransferSyntaxUID == other.info.TransferSyntaxUID &&
+                   iType == other.iType &&
+                   vcData == other.vcData;
+        }
+    };
+
+    void ParseFiles(    const std::vector<std::string> &    vstrFiles,
+                        const DICOMParser::FileAccessModes  mode,
+                        const bool                          bZeroCopy,
+                        std::vector<ParseResult> &          vResults    )
+    {
+        DICOMParser     parser;
+        DICOMAppHelper  helper;
+        parser.SetFileAccessMode(mode);
+        parser.SetZeroCopyValues(bZeroCopy);
+        helper.RegisterCallbacks(&parser);
+        helper.RegisterPixelDataCallback(&parser);
+
+        vResults.assign(vstrFiles.size(), ParseResult());
+        for (size_t i = 0; i < vstrFiles.size(); i++)
+        {
+            ParseResult &   result = vResults[i];
+            result.bOK = parser.OpenFile(vstrFiles[i]) && parser.ReadHeader();
+            helper.GetImageInfo(&parser, result.info);
+
+            void *                  pData = NULL;
+            DICOMParser::VRTypes    type = DICOMParser::VR_UNKNOWN;
+            size_t                  uiLength = 0;
+            helper.GetImageData(pData, type, uiLength);
+            result.iType = int(type);
+            if (pData)
+            {
+                result.vcData.assign(static_cast<char *>(pData), static_cast<char *>(pData) + uiLength);
+            }
+        }
+    }
+}
+
+int main()
+{
+    const std::string           strDir = "TestConcurrentParse.data";
+    std::vector<std::string>    vstrFiles;
+
+    // a little endian series, then big endian, rescaled to float and
+    // multi-frame files, so every decode path runs
+    TestDicomImage  image;
+    image.uiRows = 32;
+    image.uiColumns = 40;
+    if (!WriteTestSeries(strDir, 8, image))
+    {
+        std::cout << "couldn't write " << strDir << "\n";
+        return 1;
+    }
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        char    acName[32];
+        snprintf(acName, sizeof(acName), "/IM%04u.dcm", i);
+        vstrFiles.push_back(strDir + acName);
+    }
+
+    for (int32_t i = 0; i < 6; i++)
+    {
+        TestDicomImage  other;
+        other.uiRows = 24 + i;
+        other.uiColumns = 20 + 2 * i;
+        other.iInstance = 100 + i;
+        other.bBigEndian = (i % 2) == 0;
+        other.fSlope = i >= 2 ? 0.5f : 1.0f;
+        other.fIntercept = -1024.0f;
+        other.uiFrames = i >= 4 ? 3 : 1;
+        other.strSeriesUID = "1.2.826.0.1.3680043.2.1125.2";
+        char    acName[32];
+        snprintf(acName, sizeof(acName), "/OTHER%d.dcm", int(i));
+        TEST_CHECK(WriteTestDicom(strDir + acName, other));
+        vstrFiles.push_back(strDir + acName);
+    }
+
+    std::vector<ParseResult>    vSerial;
+    ParseFiles(vstrFiles, DICOMParser::ACCESS_STREAM, false, vSerial);
+    for (size_t i = 0; i < vSerial.size(); i++)
+    {
+        TEST_CHECK(vSerial[i].bOK);
+        TEST_CHECK(!vSerial[i].vcData.empty());
+    }
+
+    // every thread goes over all the files, with a mix of access modes
+    // and value copying
+    const DICOMParser::FileAccessModes  aModes[] = { DICOMParser::ACCESS_STREAM, DICOMParser::ACCESS_MAPPED, DICOMParser::ACCESS_BUFFERED };
+    std::atomic<uint32_t>       uiMismatches(0);
+    std::vector<std::thread>    vThreads;
+    for (uint32_t t = 0; t < uiThreads; t++)
+    {
+        vThreads.push_back(std::thread([&, t]()
+        {
+            std::vector<ParseResult>    vResults;
+            for (uint32_t p = 0; p < uiPasses; p++)
+            {
+                ParseFiles(vstrFiles, aModes[(t + p) % 3], ((t >> 1) & 1) != 0, vResults);
+                for (size_t i = 0; i < vResults.size(); i++)
+                {
+                    if (!(vResults[i] == vSerial[i]))
+                    {
+                        uiMismatches++;
+                    }
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < vThreads.size(); t++)
+    {
+        vThreads[t].join();
+    }
+
+    std::cout << vstrFiles.size() << " files, " << uiThreads << " threads x " << uiPasses << " passes, "
+              << uiMismatches << " mismatches\n";
+    TEST_CHECK(uiMismatches == 0);
+
+    return TestResult();
+}
@@ -0,0 +1,336 @@
+// Deflated Explicit VR Little Endian data sets read the same as the
+// uncompressed ones they were made from: a whole series through every
+// access mode, single elements found by ReadHeaderOnly and read back with
+// ReadElement in any order, which moves back through the stream, and the
+// inflated stream itself.  Truncated or corrupt streams fail without
+// crashing.  Only built with DICOMParser_USE_ZLIB, since it needs zlib to
+// write the deflated files.
+
+#include <string.h>
+#include <zlib.h>
+
+#include "DICOMParser.h"
+#include "DICOMAppHelper.h"
+#include "DICOMCallback.h"
+#include "DICOMInflateFile.h"
+#include "DicomVolume.h"
+#include "DicomTestUtilities.h"
+
+namespace
+{
+    const char *                        pcDeflated = "1.2.840.10008.1.2.1.99";
+    const DICOMParser::FileAccessModes  aModes[] = { DICOMParser::ACCESS_STREAM, DICOMParser::ACCESS_MAPPED, DICOMParser::ACCESS_BUFFERED };
+
+    // The value of the last element it was registered for.
+    struct ValueCallback : public DICOMCallback
+    {
+        std::string strValue;
+        int         iCalls = 0;
+
+        virtual void Execute( DICOMParser *, doublebyte, doublebyte, DICOMParser::VRTypes, unsigned char * pVal, valuelength len )
+        {
+            strValue.assign(pVal ? reinterpret_cast<const char *>(pVal) : "", pVal ? size_t(len) : 0);
+            iCalls++;
+        }
+    };
+
+    bool ReadFile( const std::string & strPath, std::string & strData )
+    {
+        std::ifstream   file(strPath.c_str(), std::ios::binary);
+        strData.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return bool(file) || file.eof();
+    }
+
+    bool WriteFile( const std::string & strPath, const std::string & strData )
+    {
+        std::ofstream   file(strPath.c_str(), std::ios::binary | std::ios::trunc);
+        file.write(strData.data(), strData.size());
+        return bool(file);
+    }
+
+    // Where the data set after the file meta information starts in a file
+    // written by WriteTestDicom: the group length's value says.
+    size_t DataSetStart( const std::string & strFile )
+    {
+        const unsigned char *   p = reinterpret_cast<const unsigned char *>(strFile.data()) + 140;
+        return 144 + (size_t(p[0]) | size_t(p[1]) << 8 | size_t(p[2]) << 16 | size_t(p[3]) << 24);
+    }
+
+    // strIn with everything after the file meta information deflated, with
+    // no zlib header or checksum, as the transfer syntax has it.
+    std::string Deflate( const std::string & strIn )
+    {
+        const size_t    uiStart = DataSetStart(strIn);
+        z_stream        stream;
+        memset(&stream, 0, sizeof(stream));
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            return std::string();
+        }
+        std::string strOut(deflateBound(&stream, uLong(strIn.size() - uiStart)), '\0');
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(strIn.data() + uiStart));
+        stream.avail_in = uInt(strIn.size() - uiStart);
+        stream.next_out = reinterpret_cast<Bytef *>(&strOut[0]);
+        stream.avail_out = uInt(strOut.size());
+        const bool  bOK = deflate(&stream, Z_FINISH) == Z_STREAM_END;
+        strOut.resize(stream.total_out);
+        deflateEnd(&stream);
+        return bOK ? strIn.substr(0, uiStart) + strOut : std::string();
+    }
+
+    // Write image uncompressed to strNative and deflated to strDeflated.
+    bool WriteDeflated( const std::string & strNative, const std::string & strDeflated, TestDicomImage image )
+    {
+        std::string strData;
+        image.strTransferSyntax = pcDeflated;
+        if (!WriteTestDicom(strDeflated, image) || !ReadFile(strDeflated, strData))
+        {
+            return false;
+        }
+        const std::string   strCompressed = Deflate(strData);
+        image.strTransferSyntax.clear();
+        return !strCompressed.empty() && WriteFile(strDeflated, strCompressed) && WriteTestDicom(strNative, image);
+    }
+
+    // The image helper decoded last, or empty if it decoded none.
+    std::string Decoded( DICOMAppHelper & helper )
+    {
+        void *                  pData = NULL;
+        DICOMParser::VRTypes    type = DICOMParser::VR_UNKNOWN;
+        size_t                  uiLength = 0;
+        helper.GetImageData(pData, type, uiLength);
+        return type == DICOMParser::VR_UNKNOWN || !pData ? std::string() : std::string(static_cast<const char *>(pData), uiLength);
+    }
+
+    std::string Decode( const std::string & strPath, const DICOMParser::FileAccessModes mode )
+    {
+        DICOMParser     parser;
+        DICOMAppHelper  helper;
+        parser.SetFileAccessMode(mode);
+        helper.RegisterCallbacks(&parser);
+        helper.RegisterPixelDataCallback(&parser);
+        return parser.OpenFile(strPath) && parser.ReadHeader() ? Decoded(helper) : std::string();
+    }
+
+    // A deflated series loads like the one it was made from.
+    void TestSeries( const std::string & strDir )
+    {
+        TestDicomImage  image;
+        image.uiRows = 64;
+        image.uiColumns = 48;
+        image.fSlope = 2.0f;
+        image.fIntercept = -1024.0f;
+        const uint32_t  uiSlices = 5;
+        TEST_CHECK(WriteTestSeries(strDir + "/native", uiSlices, image));
+        image.strTransferSyntax = pcDeflated;
+        TEST_CHECK(WriteTestSeries(strDir + "/deflated", uiSlices, image));
+        for (uint32_t i = 0; i < uiSlices; i++)
+        {
+            char    acName[32];
+            snprintf(acName, sizeof(acName), "/deflated/IM%04u.dcm", i);
+            std::string strData;
+            TEST_CHECK(ReadFile(strDir + acName, strData) && WriteFile(strDir + acName, Deflate(strData)));
+        }
+
+        for (size_t m = 0; m < sizeof(aModes) / sizeof(aModes[0]); m++)
+        {
+            DicomVolume     native, deflated;
+            DICOMParser     parser;
+            DICOMAppHelper  helper;
+            parser.SetFileAccessMode(aModes[m]);
+            helper.RegisterCallbacks(&parser);
+            helper.RegisterPixelDataCallback(&parser);
+            TEST_CHECK(LoadDicomVolume(strDir + "/native", parser, helper, native));
+            TEST_CHECK(LoadDicomVolume(strDir + "/deflated", parser, helper, deflated));
+            TEST_CHECK(native.uiSizeZ == uiSlices && !native.viVoxels.empty());
+            TEST_CHECK(deflated.uiSizeX == native.uiSizeX && deflated.uiSizeY == native.uiSizeY && deflated.uiSizeZ == native.uiSizeZ);
+            TEST_CHECK(deflated.fZSpacing == native.fZSpacing && deflated.viVoxels == native.viVoxels);
+        }
+    }
+
+    // Elements found by ReadHeaderOnly read back in any order, the stream
+    // restarting when one is further back than the inflate window.
+    void TestReadElement( const std::string & strDir )
+    {
+        TestDicomImage  image;
+        image.uiRows = 256;
+        image.uiColumns = 256;
+        image.iInstance = 5;
+        image.uiFrames = 2;
+        const std::string   strNative = strDir + "/native.dcm";
+        const std::string   strDeflated = strDir + "/deflated.dcm";
+        TEST_CHECK(WriteDeflated(strNative, strDeflated, image));
+        TEST_CHECK(TestFrameBytes(image) > DICOMInflateFile::WINDOW_SIZE);
+
+        for (size_t m = 0; m < sizeof(aModes) / sizeof(aModes[0]); m++)
+        {
+            const std::string   strExpected = Decode(strNative, aModes[m]);
+            TEST_CHECK(strExpected.size() == TestFrameBytes(image) * image.uiFrames);
+            TEST_CHECK(Decode(strDeflated, aModes[m]) == strExpected);
+
+            DICOMParser     parser;
+            DICOMAppHelper  helper;
+            ValueCallback   instance;
+            parser.SetFileAccessMode(aModes[m]);
+            helper.RegisterCallbacks(&parser);
+            helper.RegisterPixelDataCallback(&parser);
+            parser.AddDICOMTagCallback(0x0020, 0x0013, DICOMParser::VR_IS, &instance);
+
+            TEST_CHECK(parser.OpenFile(strDeflated) && parser.ReadHeaderOnly(0x0020, 0x0013));
+            const DICOMParser::ElementLocation  instanceLocation = parser.GetStopElementLocation();
+            TEST_CHECK(instance.iCalls == 0);
+            TEST_CHECK(parser.ReadHeaderOnly());
+            const DICOMParser::ElementLocation  pixelLocation = parser.GetStopElementLocation();
+            TEST_CHECK(instance.strValue == "5 ");
+            TEST_CHECK(instanceLocation.DeflateOffset > 0 && instanceLocation.DeflateOffset == pixelLocation.DeflateOffset);
+            TEST_CHECK(pixelLocation.Offset > instanceLocation.Offset + DICOMInflateFile::WINDOW_SIZE ||
+                       pixelLocation.Length > DICOMInflateFile::WINDOW_SIZE);
+
+            // the pixel data, back to the instance number, then forward
+            instance.strValue.clear();
+            TEST_CHECK(parser.ReadElement(pixelLocation) && Decoded(helper) == strExpected);
+            TEST_CHECK(parser.ReadElement(instanceLocation) && instance.strValue == "5 ");
+            TEST_CHECK(parser.ReadElement(pixelLocation) && Decoded(helper) == strExpected);
+
+            // the second frame alone
+            const valuelength   uiFrame = valuelength(TestFrameBytes(image));
+            TEST_CHECK(parser.ReadElement(pixelLocation, uiFrame, uiFrame) &&
+                       Decoded(helper) == strExpected.substr(size_t(uiFrame)));
+            TEST_CHECK(parser.ReadElement(instanceLocation) && instance.strValue == "5 ");
+        }
+    }
+
+    // The data set of strPath, and where it starts in strPath's deflated
+    // copy, whose meta information is longer by the transfer syntax.
+    bool ReadDataSet( const std::string & strNative, const std::string & strDeflated, std::string & strDataSet, size_t & uiStart )
+    {
+        std::string strNativeFile, strDeflatedFile;
+        if (!ReadFile(strNative, strNativeFile) || !ReadFile(strDeflated, strDeflatedFile))
+        {
+            return false;
+        }
+        strDataSet = strNativeFile.substr(DataSetStart(strNativeFile));
+        uiStart = DataSetStart(strDeflatedFile);
+        return true;
+    }
+
+    // The inflated stream is the data set, wherever it is read from.
+    void TestInflateFile( const std::string & strDir )
+    {
+        std::string strDataSet;
+        size_t      uiStart = 0;
+        TEST_CHECK(ReadDataSet(strDir + "/native.dcm", strDir + "/deflated.dcm", strDataSet, uiStart));
+        const size_t    uiEnd = uiStart + strDataSet.size();
+
+        DICOMFile           file;
+        DICOMInflateFile    inflate;
+        TEST_CHECK(file.Open(strDir + "/deflated.dcm") && inflate.Start(&file, fileoffset(uiStart)));
+        TEST_CHECK(inflate.Tell() == fileoffset(uiStart));
+
+        // all of it, in one read larger than the window
+        std::string strInflated(strDataSet.size(), '\0');
+        inflate.Read(&strInflated[0], fileoffset(strInflated.size()));
+        TEST_CHECK(strInflated == strDataSet);
+        TEST_CHECK(inflate.GetSize() == fileoffset(uiEnd));
+
+        // steps back within the window and further, and forward again
+        const size_t    auiOffsets[] = { uiEnd - 100, uiEnd - 1000, uiStart + 10, uiStart + strDataSet.size() / 2, uiStart, uiEnd - 16 };
+        for (size_t i = 0; i < sizeof(auiOffsets) / sizeof(auiOffsets[0]); i++)
+        {
+            char    acBytes[16];
+            inflate.SkipToPos(fileoffset(auiOffsets[i]));
+            inflate.Read(acBytes, sizeof(acBytes));
+            TEST_CHECK(inflate.Tell() == fileoffset(auiOffsets[i] + sizeof(acBytes)));
+            TEST_CHECK(memcmp(acBytes, strDataSet.data() + (auiOffsets[i] - uiStart), sizeof(acBytes)) == 0);
+        }
+        inflate.Close();
+        file.Close();
+    }
+
+    // A stream cut short or corrupted doesn't give the original pixels,
+    // and never crashes: bytes past the damage read as 0.
+    void TestDamaged( const std::string & strDir )
+    {
+        std::string strDataSet;
+        std::string strDeflated;
+        size_t      uiStart = 0;
+        TEST_CHECK(ReadDataSet(strDir + "/native.dcm", strDir + "/deflated.dcm", strDataSet, uiStart));
+        TEST_CHECK(ReadFile(strDir + "/deflated.dcm", strDeflated));
+        const std::string   strExpected = Decode(strDir + "/native.dcm", DICOMParser::ACCESS_MAPPED);
+
+        std::vector<std::string>    vstrDamaged;
+        vstrDamaged.push_back(strDeflated.substr(0, uiStart + (strDeflated.size() - uiStart) / 2));
+        vstrDamaged.push_back(strDeflated.substr(0, uiStart + 3));
+        vstrDamaged.push_back(strDeflated.substr(0, uiStart));
+        std::string strCorrupt = strDeflated;
+        for (size_t i = 0; i < 64; i++)
+        {
+            strCorrupt[(strCorrupt.size() + uiStart) / 2 + i] = char(i * 37 + 11);
+        }
+        vstrDamaged.push_back(strCorrupt);
+        strCorrupt = strDeflated;
+        strCorrupt.replace(uiStart, 16, 16, char(0xFF));
+        vstrDamaged.push_back(strCorrupt);
+
+        const std::string   strPath = strDir + "/damaged.dcm";
+        for (size_t d = 0; d < vstrDamaged.size(); d++)
+        {
+            TEST_CHECK(WriteFile(strPath, vstrDamaged[d]));
+            for (size_t m = 0; m < sizeof(aModes) / sizeof(aModes[0]); m++)
+            {
+                if (Decode(strPath, aModes[m]) == strExpected)
+                {
+                    std::cout << "damaged stream " << d << ", mode " << aModes[m] << ": decoded the original pixels\n";
+                    TestFailures()++;
+                }
+
+                DICOMParser     parser;
+                DICOMAppHelper  helper;
+                parser.SetFileAccessMode(aModes[m]);
+                helper.RegisterCallbacks(&parser);
+                helper.RegisterPixelDataCallback(&parser);
+                if (parser.OpenFile(strPath) && parser.ReadHeaderOnly() && parser.GetStopElementLocation().Offset >= 0)
+                {
+                    parser.ReadElement(parser.GetStopElementLocation());
+                    TEST_CHECK(Decoded(helper) != strExpected);
+                }
+            }
+
+            DICOMFile           file;
+            DICOMInflateFile    inflate;
+            TEST_CHECK(file.Open(strPath));
+            if (inflate.Start(&file, fileoffset(uiStart)))
+            {
+                std::string strInflated(strDataSet.size(), char(1));
+                inflate.Read(&strInflated[0], fileoffset(strInflated.size()));
+                TEST_CHECK(strInflated != strDataSet);
+                TEST_CHECK(inflate.GetSize() <= fileoffset(uiStart + strDataSet.size()));
+                inflate.SkipToPos(fileoffset(uiStart));
+                inflate.Read(&strInflated[0], 16);
+            }
+        }
+    }
+}
+
+int main()
+{
+    if (!DICOMInflateFile::IsAvailable())
+    {
+        std::cout << "the parser was built without zlib\n";
+        return 1;
+    }
+
+    const std::string   strDir = "TestDeflate.data";
+    if (!MakeTestDirectory(strDir))
+    {
+        std::cout << "couldn't make " << strDir << "\n";
+        return 1;
+    }
+
+    TestSeries(strDir);
+    TestReadElement(strDir);
+    TestInflateFile(strDir);
+    TestDamaged(strDir);
+
+    return TestResult();
+}
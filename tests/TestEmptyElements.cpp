@@ -0,0 +1,128 @@
+// Elements of zero length, which the parser hands its callbacks as NULL,
+// read as empty through every access mode, with values copied or
+// borrowed: an empty Number of Frames is one frame, an empty Rescale
+// Slope is no rescale, and empty text or image size elements don't crash.
+
+#include "DICOMParser.h"
+#include "DICOMAppHelper.h"
+#include "DicomTestUtilities.h"
+
+namespace
+{
+    uint32_t Tag( const uint16_t uiGroup, const uint16_t uiElement )
+    {
+        return (uint32_t(uiGroup) << 16) | uiElement;
+    }
+
+    // Whether the image the helper decoded last is frame 0 of image.
+    bool SameFrame( DICOMAppHelper & helper, const TestDicomImage & image )
+    {
+        DICOMImageView<short>   view;
+        if (!helper.GetImageView(view) || view.GetSize() != size_t(image.uiRows) * image.uiColumns)
+        {
+            return false;
+        }
+        for (uint32_t y = 0; y < image.uiRows; y++)
+        {
+            for (uint32_t x = 0; x < image.uiColumns; x++)
+            {
+                if (view[size_t(y) * image.uiColumns + x] != TestPixel(image.iInstance, 0, x, y))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+}
+
+int main()
+{
+    const std::string   strDir = "TestEmptyElements.data";
+    if (!MakeTestDirectory(strDir))
+    {
+        std::cout << "couldn't make " << strDir << "\n";
+        return 1;
+    }
+
+    // every text element DICOMAppHelper reads, the transfer syntax and
+    // Number of Frames included, empty; the image still decodes
+    TestDicomImage  text;
+    text.uiRows = 12;
+    text.uiColumns = 10;
+    text.iInstance = 3;
+    text.vuiEmptyElements.push_back(Tag(0x0002, 0x0010));
+    text.vuiEmptyElements.push_back(Tag(0x0018, 0x0050));
+    text.vuiEmptyElements.push_back(Tag(0x0020, 0x000E));
+    text.vuiEmptyElements.push_back(Tag(0x0020, 0x0013));
+    text.vuiEmptyElements.push_back(Tag(0x0020, 0x0032));
+    text.vuiEmptyElements.push_back(Tag(0x0020, 0x0037));
+    text.vuiEmptyElements.push_back(Tag(0x0028, 0x0004));
+    text.vuiEmptyElements.push_back(Tag(0x0028, 0x0008));
+    text.vuiEmptyElements.push_back(Tag(0x0028, 0x0030));
+    text.vuiEmptyElements.push_back(Tag(0x0028, 0x1052));
+    text.vuiEmptyElements.push_back(Tag(0x0028, 0x1053));
+
+    // three frames, but an empty Number of Frames says one
+    TestDicomImage  frames = text;
+    frames.uiFrames = 3;
+    frames.vuiEmptyElements.clear();
+    frames.vuiEmptyElements.push_back(Tag(0x0028, 0x0008));
+
+    // the image size and pixel layout empty too: nothing to decode
+    TestDicomImage  binary = text;
+    binary.vuiEmptyElements.push_back(Tag(0x0028, 0x0002));
+    binary.vuiEmptyElements.push_back(Tag(0x0028, 0x0010));
+    binary.vuiEmptyElements.push_back(Tag(0x0028, 0x0011));
+    binary.vuiEmptyElements.push_back(Tag(0x0028, 0x0100));
+    binary.vuiEmptyElements.push_back(Tag(0x0028, 0x0103));
+
+    const std::string   strText = strDir + "/text.dcm";
+    const std::string   strFrames = strDir + "/frames.dcm";
+    const std::string   strBinary = strDir + "/binary.dcm";
+    if (!WriteTestDicom(strText, text) || !WriteTestDicom(strFrames, frames) || !WriteTestDicom(strBinary, binary))
+    {
+        std::cout << "couldn't write " << strDir << "\n";
+        return 1;
+    }
+
+    const DICOMParser::FileAccessModes  aModes[] = { DICOMParser::ACCESS_STREAM, DICOMParser::ACCESS_MAPPED, DICOMParser::ACCESS_BUFFERED };
+    for (size_t m = 0; m < sizeof(aModes) / sizeof(aModes[0]); m++)
+    {
+        for (int iZeroCopy = 0; iZeroCopy < 2; iZeroCopy++)
+        {
+            DICOMParser     parser;
+            DICOMAppHelper  helper;
+            parser.SetFileAccessMode(aModes[m]);
+            parser.SetZeroCopyValues(iZeroCopy != 0);
+            helper.RegisterCallbacks(&parser);
+            helper.RegisterPixelDataCallback(&parser);
+
+            TEST_CHECK(parser.OpenFile(strText) && parser.ReadHeader());
+            TEST_CHECK(helper.GetNumberOfFrames() == 1);
+            TEST_CHECK(helper.GetRescaleSlope() == 1.0f);
+            TEST_CHECK(helper.GetRescaleOffset() == 0.0f);
+            TEST_CHECK(helper.GetTransferSyntaxUID().empty());
+            TEST_CHECK(SameFrame(helper, text));
+
+            TEST_CHECK(parser.OpenFile(strFrames) && parser.ReadHeader());
+            TEST_CHECK(helper.GetNumberOfFrames() == 1);
+            TEST_CHECK(SameFrame(helper, frames));
+
+            // read frame by frame, only the one frame there is
+            TEST_CHECK(parser.OpenFile(strFrames) && parser.ReadHeaderOnly());
+            DICOMImageInfo  info;
+            helper.GetImageInfo(&parser, info);
+            TEST_CHECK(info.NumberOfFrames == 1);
+            TEST_CHECK(helper.ReadFrames(&parser, info, 0, 1));
+            TEST_CHECK(SameFrame(helper, frames));
+
+            TEST_CHECK(parser.OpenFile(strBinary) && parser.ReadHeader());
+            TEST_CHECK(helper.GetWidth() == 0 && helper.GetHeight() == 0);
+            DICOMImageView<short>   view;
+            TEST_CHECK(!helper.GetImageView(view) || view.GetSize() == 0);
+        }
+    }
+
+    return TestResult();
+}
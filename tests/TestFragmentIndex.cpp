@@ -0,0 +1,353 @@
+// DICOMFragmentIndex groups the fragments of encapsulated pixel data into
+// frames by the Basic Offset Table, one per frame when there are as many,
+// or all of them for a single frame, and joins a frame split over several
+// fragments into the caller's buffer.  Malformed item tags and lengths
+// leave it empty.  DICOMParser::ReadFragmentIndex builds it with spans
+// into the file's mapping when it is mapped, and into copies in the
+// parser's arena otherwise.
+
+#include <string.h>
+
+#include "DICOMParser.h"
+#include "DICOMArena.h"
+#include "DICOMFragmentIndex.h"
+#include "DicomTestUtilities.h"
+
+namespace
+{
+    const DICOMParser::FileAccessModes  aModes[] = { DICOMParser::ACCESS_STREAM, DICOMParser::ACCESS_MAPPED, DICOMParser::ACCESS_BUFFERED };
+
+    // An arena that remembers what it handed out.
+    class RecordingArena : public DICOMArena
+    {
+    public:
+        virtual void * Allocate( size_t uiSize )
+        {
+            void *  p = DICOMArena::Allocate(uiSize);
+            vpAllocations.push_back(std::make_pair(static_cast<const unsigned char *>(p), uiSize));
+            return p;
+        }
+
+        virtual void Reset()
+        {
+            vpAllocations.clear();
+            DICOMArena::Reset();
+        }
+
+        std::vector<std::pair<const unsigned char *, size_t> >  vpAllocations;
+    };
+
+    // Encapsulated pixel data: a table of the offsets in vuiTable, then
+    // the fragments and the delimiter.
+    std::string Encapsulate( const std::vector<std::string> & vstrFragments, const std::vector<uint32_t> & vuiTable )
+    {
+        std::string strTable;
+        std::string strData;
+        for (size_t i = 0; i < vuiTable.size(); i++)
+        {
+            TestDicomDetail::PutUInt32(strTable, vuiTable[i], false);
+        }
+        TestDicomDetail::PutItem(strData, 0xE000, strTable);
+        for (size_t i = 0; i < vstrFragments.size(); i++)
+        {
+            TestDicomDetail::PutItem(strData, 0xE000, vstrFragments[i]);
+        }
+        TestDicomDetail::PutItem(strData, 0xE0DD, "");
+        return strData;
+    }
+
+    bool Build( DICOMFragmentIndex & index, const std::string & strData, const int iFrames )
+    {
+        return index.Build(reinterpret_cast<const unsigned char *>(strData.data()), strData.size(), iFrames);
+    }
+
+    // Frame i of index, as one run.
+    std::string FrameData( const DICOMFragmentIndex & index, const int i, std::vector<unsigned char> & vucJoined )
+    {
+        size_t                  uiLength = 0;
+        const unsigned char *   pucData = index.GetFrameData(i, uiLength, vucJoined);
+        return pucData ? std::string(reinterpret_cast<const char *>(pucData), uiLength) : std::string();
+    }
+
+    bool IsEmpty( const DICOMFragmentIndex & index )
+    {
+        return index.GetNumberOfFragments() == 0 && index.GetNumberOfFrames() == 0 &&
+               index.GetOffsetTable().Data == NULL && index.GetOffsetTable().Length == 0;
+    }
+
+    // Fragments of every length from 2 to 12 bytes, each byte telling
+    // which fragment it is in.
+    std::vector<std::string> MakeFragments( const size_t uiCount )
+    {
+        std::vector<std::string>    vstrFragments;
+        for (size_t i = 0; i < uiCount; i++)
+        {
+            vstrFragments.push_back(std::string(2 + 2 * (i % 6), char('a' + i)));
+        }
+        return vstrFragments;
+    }
+
+    // Where each fragment's item tag is, counted from the first one's.
+    std::vector<uint32_t> FragmentOffsets( const std::vector<std::string> & vstrFragments )
+    {
+        std::vector<uint32_t>   vuiOffsets;
+        uint32_t                uiOffset = 0;
+        for (size_t i = 0; i < vstrFragments.size(); i++)
+        {
+            vuiOffsets.push_back(uiOffset);
+            uiOffset += uint32_t(8 + vstrFragments[i].size());
+        }
+        return vuiOffsets;
+    }
+
+    void TestGrouping()
+    {
+        const std::vector<std::string>  vstrFragments = MakeFragments(6);
+        const std::vector<uint32_t>     vuiOffsets = FragmentOffsets(vstrFragments);
+        std::vector<unsigned char>      vucJoined;
+        DICOMFragmentIndex              index;
+
+        // the table puts fragments 0-1, 2 and 3-5 in three frames
+        std::vector<uint32_t>   vuiTable;
+        vuiTable.push_back(vuiOffsets[0]);
+        vuiTable.push_back(vuiOffsets[2]);
+        vuiTable.push_back(vuiOffsets[3]);
+        const std::string       strTable = Encapsulate(vstrFragments, vuiTable);
+        TEST_CHECK(Build(index, strTable, 3));
+        TEST_CHECK(index.GetOffsetTable().Length == 12);
+        TEST_CHECK(index.GetNumberOfFragments() == 6 && index.GetNumberOfFrames() == 3);
+        for (size_t i = 0; i < index.GetNumberOfFragments(); i++)
+        {
+            TEST_CHECK(index.GetFragment(i).Offset == vuiOffsets[i]);
+            TEST_CHECK(index.GetFragment(i).Length == vstrFragments[i].size());
+            TEST_CHECK(memcmp(index.GetFragment(i).Data, vstrFragments[i].data(), vstrFragments[i].size()) == 0);
+        }
+        TEST_CHECK(index.GetFrameFragmentCount(0) == 2 && index.GetFrameFragmentCount(1) == 1 && index.GetFrameFragmentCount(2) == 3);
+        TEST_CHECK(index.GetFrameFragments(1) == &index.GetFragment(2));
+        TEST_CHECK(index.GetFrameLength(2) == vstrFragments[3].size() + vstrFragments[4].size() + vstrFragments[5].size());
+
+        // split frames are joined into the buffer given, whole ones are
+        // returned in place and leave it alone
+        TEST_CHECK(FrameData(index, 0, vucJoined) == vstrFragments[0] + vstrFragments[1]);
+        TEST_CHECK(vucJoined.size() == index.GetFrameLength(0));
+        TEST_CHECK(FrameData(index, 2, vucJoined) == vstrFragments[3] + vstrFragments[4] + vstrFragments[5]);
+        TEST_CHECK(vucJoined.size() == index.GetFrameLength(2));
+        size_t  uiLength = 0;
+        vucJoined.assign(3, 0x5A);
+        TEST_CHECK(index.GetFrameData(1, uiLength, vucJoined) == index.GetFragment(2).Data);
+        TEST_CHECK(uiLength == vstrFragments[2].size() && vucJoined == std::vector<unsigned char>(3, 0x5A));
+
+        // a table entry that isn't where a fragment is can't be followed,
+        // and neither can one that goes back
+        std::vector<uint32_t>   vuiBadTable = vuiTable;
+        vuiBadTable[1] += 2;
+        TEST_CHECK(!Build(index, Encapsulate(vstrFragments, vuiBadTable), 3));
+        TEST_CHECK(index.GetNumberOfFragments() == 6 && index.GetNumberOfFrames() == 0);
+        vuiBadTable = vuiTable;
+        std::swap(vuiBadTable[1], vuiBadTable[2]);
+        TEST_CHECK(!Build(index, Encapsulate(vstrFragments, vuiBadTable), 3));
+        TEST_CHECK(index.GetNumberOfFrames() == 0);
+
+        // a table with an entry per fragment, for as many frames
+        TEST_CHECK(Build(index, Encapsulate(vstrFragments, vuiOffsets), 6));
+        TEST_CHECK(index.GetNumberOfFrames() == 6);
+
+        // a table for another number of frames is ignored: one fragment
+        // per frame when there are as many, else all of them for one
+        for (int iTable = 0; iTable < 2; iTable++)
+        {
+            const std::string   strData = Encapsulate(vstrFragments, iTable ? vuiTable : std::vector<uint32_t>());
+            TEST_CHECK(Build(index, strData, 6));
+            TEST_CHECK(index.GetNumberOfFrames() == 6);
+            for (int i = 0; i < 6; i++)
+            {
+                TEST_CHECK(index.GetFrameFragmentCount(i) == 1);
+                TEST_CHECK(FrameData(index, i, vucJoined) == vstrFragments[i]);
+            }
+
+            TEST_CHECK(Build(index, strData, 1));
+            TEST_CHECK(index.GetNumberOfFrames() == 1 && index.GetFrameFragmentCount(0) == 6);
+            std::string strAll;
+            for (size_t i = 0; i < vstrFragments.size(); i++)
+            {
+                strAll += vstrFragments[i];
+            }
+            TEST_CHECK(FrameData(index, 0, vucJoined) == strAll);
+
+            // fragments listed, but not grouped
+            TEST_CHECK(!Build(index, strData, 4));
+            TEST_CHECK(index.GetNumberOfFragments() == 6 && index.GetNumberOfFrames() == 0);
+            TEST_CHECK(!Build(index, strData, 0));
+            TEST_CHECK(index.GetNumberOfFrames() == 0);
+        }
+
+        // no fragments at all is no frame
+        TEST_CHECK(!Build(index, Encapsulate(std::vector<std::string>(), std::vector<uint32_t>()), 1));
+        TEST_CHECK(index.GetNumberOfFragments() == 0 && index.GetNumberOfFrames() == 0);
+
+        // a frame of empty fragments is empty
+        std::vector<std::string>    vstrEmpty(2);
+        TEST_CHECK(Build(index, Encapsulate(vstrEmpty, std::vector<uint32_t>()), 1));
+        TEST_CHECK(index.GetFrameLength(0) == 0 && FrameData(index, 0, vucJoined).empty());
+    }
+
+    void PutUInt16At( std::string & str, const size_t uiAt, const uint16_t uiValue )
+    {
+        str[uiAt] = char(uiValue & 0xFF);
+        str[uiAt + 1] = char(uiValue >> 8);
+    }
+
+    void PutUInt32At( std::string & str, const size_t uiAt, const uint32_t uiValue )
+    {
+        std::string strValue;
+        TestDicomDetail::PutUInt32(strValue, uiValue, false);
+        str.replace(uiAt, 4, strValue);
+    }
+
+    // Malformed items leave the index empty, whatever was in it before,
+    // without reading past the value.
+    void TestMalformed()
+    {
+        const std::vector<std::string>  vstrFragments = MakeFragments(3);
+        const std::string               strGood = Encapsulate(vstrFragments, std::vector<uint32_t>());
+        const size_t                    uiSecond = 8 + 8 + vstrFragments[0].size();     // the second fragment's tag
+        const size_t                    uiDelimiter = strGood.size() - 8;
+
+        std::vector<std::string>    vstrBad;
+        std::string                 strBad = strGood;
+        PutUInt16At(strBad, uiSecond, 0xFFFC);                          // not an item's group
+        vstrBad.push_back(strBad);
+        strBad = strGood;
+        PutUInt16At(strBad, uiSecond + 2, 0xE00D);                      // an item delimiter
+        vstrBad.push_back(strBad);
+        strBad = strGood;
+        PutUInt16At(strBad, 2, 0xE0DD);                                 // no table
+        vstrBad.push_back(strBad);
+        strBad = strGood;
+        PutUInt32At(strBad, uiSecond + 4, uint32_t(strGood.size()));    // longer than what's left
+        vstrBad.push_back(strBad);
+        strBad = strGood;
+        PutUInt32At(strBad, uiSecond + 4, 0xFFFFFFFF);                  // undefined length
+        vstrBad.push_back(strBad);
+        strBad = strGood;
+        PutUInt32At(strBad, 4, 0xFFFFFFF8);                             // a table past the end
+        vstrBad.push_back(strBad);
+        vstrBad.push_back(strGood.substr(0, uiDelimiter));              // no delimiter
+        vstrBad.push_back(strGood.substr(0, uiDelimiter + 7));          // half of one
+        vstrBad.push_back(strGood.substr(0, uiSecond + 12));            // cut in a fragment
+        vstrBad.push_back(strGood.substr(0, 7));
+        vstrBad.push_back(std::string());
+
+        DICOMFragmentIndex  index;
+        for (size_t i = 0; i < vstrBad.size(); i++)
+        {
+            TEST_CHECK(Build(index, strGood, 3));
+            // a copy of just the bytes given, for the address sanitizer
+            std::vector<unsigned char>  vucBad(vstrBad[i].begin(), vstrBad[i].end());
+            if (index.Build(vucBad.empty() ? NULL : &vucBad[0], vucBad.size(), 3) || !IsEmpty(index))
+            {
+                std::cout << "malformed value " << i << " was indexed\n";
+                TestFailures()++;
+            }
+        }
+        TEST_CHECK(!index.Build(NULL, 64, 1) && IsEmpty(index));
+
+        // bytes past the delimiter are none of the index's business
+        TEST_CHECK(Build(index, strGood + std::string(5, char(0xFF)), 3));
+        TEST_CHECK(index.GetNumberOfFrames() == 3);
+    }
+
+    // ReadFragmentIndex lends spans from the mapping and copies them into
+    // the arena otherwise, where they stay valid until the next file.
+    void TestParser( const std::string & strDir )
+    {
+        TestDicomImage  image;
+        image.uiRows = 40;
+        image.uiColumns = 36;
+        image.uiFrames = 3;
+        image.bRLE = true;
+        image.uiFragmentsPerFrame = 2;
+        const std::string   strPath = strDir + "/rle.dcm";
+        TestDicomImage      native = image;
+        native.bRLE = false;
+        const std::string   strNative = strDir + "/native.dcm";
+        TEST_CHECK(WriteTestDicom(strPath, image) && WriteTestDicom(strNative, native));
+
+        for (size_t m = 0; m < sizeof(aModes) / sizeof(aModes[0]); m++)
+        {
+            DICOMParser                     parser;
+            RecordingArena                  arena;
+            DICOMFragmentIndex              index;
+            std::vector<unsigned char>      vucJoined;
+            parser.SetFileAccessMode(aModes[m]);
+            parser.SetArena(&arena);
+
+            TEST_CHECK(parser.OpenFile(strPath) && parser.ReadHeaderOnly());
+            const DICOMParser::ElementLocation  loc = parser.GetStopElementLocation();
+            TEST_CHECK(loc.Encapsulated);
+            arena.vpAllocations.clear();
+            TEST_CHECK(parser.ReadFragmentIndex(loc, int(image.uiFrames), index));
+            TEST_CHECK(index.GetNumberOfFragments() == 6 && index.GetNumberOfFrames() == int(image.uiFrames));
+
+            // the spans lie in the mapping, or in the one copy of the value
+            const unsigned char *   pucStart = NULL;
+            size_t                  uiSize = 0;
+            if (aModes[m] == DICOMParser::ACCESS_MAPPED)
+            {
+                DICOMFile * pFile = parser.GetDICOMFile();
+                uiSize = size_t(pFile->GetSize());
+                pFile->SkipToPos(0);
+                pucStart = pFile->ReadView(fileoffset(uiSize));
+                TEST_CHECK(pucStart != NULL && arena.vpAllocations.empty());
+            }
+            else if (arena.vpAllocations.size() == 1)
+            {
+                pucStart = arena.vpAllocations[0].first;
+                uiSize = arena.vpAllocations[0].second;
+                TEST_CHECK(uiSize == size_t(loc.Length));
+            }
+            else
+            {
+                std::cout << "mode " << aModes[m] << ": " << arena.vpAllocations.size() << " arena allocations\n";
+                TestFailures()++;
+            }
+            for (size_t i = 0; pucStart && i < index.GetNumberOfFragments(); i++)
+            {
+                const DICOMFragmentSpan &   span = index.GetFragment(i);
+                TEST_CHECK(span.Data >= pucStart && span.Data + span.Length <= pucStart + uiSize);
+            }
+
+            // the spans outlive reading the header again
+            TEST_CHECK(parser.ReadHeaderOnly());
+            for (uint32_t f = 0; f < image.uiFrames; f++)
+            {
+                TEST_CHECK(index.GetFrameFragmentCount(int(f)) == 2);
+                TEST_CHECK(FrameData(index, int(f), vucJoined) == TestRLEFrame(image, f));
+            }
+
+            // too many frames for the table, and nothing encapsulated
+            TEST_CHECK(!parser.ReadFragmentIndex(loc, int(image.uiFrames) + 1, index));
+            TEST_CHECK(index.GetNumberOfFrames() == 0);
+            TEST_CHECK(parser.OpenFile(strNative) && parser.ReadHeaderOnly());
+            TEST_CHECK(!parser.GetStopElementLocation().Encapsulated);
+            TEST_CHECK(!parser.ReadFragmentIndex(parser.GetStopElementLocation(), int(image.uiFrames), index));
+            TEST_CHECK(IsEmpty(index));
+        }
+    }
+}
+
+int main()
+{
+    const std::string   strDir = "TestFragmentIndex.data";
+    if (!MakeTestDirectory(strDir))
+    {
+        std::cout << "couldn't make " << strDir << "\n";
+        return 1;
+    }
+
+    TestGrouping();
+    TestMalformed();
+    TestParser(strDir);
+
+    return TestResult();
+}
@@ -0,0 +1,173 @@
+// Offsets past 4 GB: a sparse file whose pixel data starts beyond 2^32,
+// behind a large private element, and is itself over 2 GB long.  The
+// header is read with ReadHeaderOnly and frames are read from all over
+// the pixel data, through each file backend.  Only the frames checked
+// are written, so the file takes next to no space; if it can't be made,
+// the test is skipped.
+
+#include "DICOMParser.h"
+#include "DICOMAppHelper.h"
+#include "DICOMFile.h"
+#include "DicomTestUtilities.h"
+
+namespace
+{
+    // 512 KB frames; frame 4096 starts 2 GB into the pixel data.
+    const uint32_t  uiSize = 512;
+    const int       iFrames = 4400;
+    const int       iRangeFirst = 4080;
+    const int       iRangeFrames = 32;
+
+    // The first and last pixels of each checked frame.
+    int16_t FirstPixel( const int iFrame )  { return int16_t(iFrame); }
+    int16_t LastPixel( const int iFrame )   { return int16_t(iFrame ^ 0x5A5A); }
+
+    std::vector<int> CheckedFrames()
+    {
+        std::vector<int>    viFrames;
+        for (int f = 0; f < iFrames; f += iFrames / 7)
+        {
+            viFrames.push_back(f);
+        }
+        viFrames.push_back(iRangeFirst);
+        viFrames.push_back(iRangeFirst + iRangeFrames - 1);
+        viFrames.push_back(iFrames - 1);
+        return viFrames;
+    }
+
+    bool WriteFrameMarkers( std::fstream & file, const uint64_t uiPixelOffset, const uint64_t uiFrameBytes )
+    {
+        const std::vector<int>  viFrames = CheckedFrames();
+        for (size_t i = 0; i < viFrames.size(); i++)
+        {
+            std::string strFirst, strLast;
+            TestDicomDetail::PutUInt16(strFirst, uint16_t(FirstPixel(viFrames[i])), false);
+            TestDicomDetail::PutUInt16(strLast, uint16_t(LastPixel(viFrames[i])), false);
+
+            const uint64_t  uiFrame = uiPixelOffset + uint64_t(viFrames[i]) * uiFrameBytes;
+            file.seekp(std::streamoff(uiFrame));
+            file.write(strFirst.data(), 2);
+            file.seekp(std::streamoff(uiFrame + uiFrameBytes - 2));
+            file.write(strLast.data(), 2);
+        }
+        return bool(file);
+    }
+}
+
+int main()
+{
+    const std::string   strDir = "TestLargeFileOffsets.data";
+    const std::string   strFile = strDir + "/LARGE.dcm";
+
+    TestDicomImage  image;
+    image.uiRows = uiSize;
+    image.uiColumns = uiSize;
+    image.uiFrames = iFrames;
+    image.uiPaddingBytes = 0xFFFFFFFE;      // the longest even, defined length
+
+    const uint64_t  uiFrameBytes = TestFrameBytes(image);
+    const uint64_t  uiPixelBytes = uiFrameBytes * iFrames;
+
+    // the header is written over a file already of the full size, so
+    // that a file system which can't hold it is found before anything
+    // else is written; its size is that of the header without padding,
+    // plus the padding element's 12 byte header and its value
+    uint64_t    uiPixelOffset = 0;
+    bool        bMade = MakeTestDirectory(strDir);
+    if (bMade)
+    {
+        TestDicomImage  header = image;
+        header.uiPaddingBytes = 0;
+        std::fstream    probe(strFile.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+        const uint64_t  uiHeaderBytes = WriteTestDicomHeader(probe, header) + 12 + image.uiPaddingBytes;
+        probe.close();
+        bMade = MakeSparseFile(strFile, uiHeaderBytes + uiPixelBytes);
+    }
+    if (bMade)
+    {
+        std::fstream    file(strFile.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+        uiPixelOffset = WriteTestDicomHeader(file, image);
+        bMade = bool(file) && WriteFrameMarkers(file, uiPixelOffset, uiFrameBytes);
+    }
+    if (!bMade)
+    {
+        std::cout << "couldn't make a sparse file of over 4 GB in " << strDir << ", skipped\n";
+        remove(strFile.c_str());
+        return TEST_SKIPPED;
+    }
+    TEST_CHECK(uiPixelOffset > (uint64_t(1) << 32));
+    TEST_CHECK(uiPixelBytes > (uint64_t(1) << 31));
+
+    const DICOMParser::FileAccessModes  aModes[] = { DICOMParser::ACCESS_MAPPED, DICOMParser::ACCESS_BUFFERED, DICOMParser::ACCESS_STREAM };
+    const char *                        apcModes[] = { "mapped", "buffered", "stream" };
+    const std::vector<int>              viFrames = CheckedFrames();
+
+    for (size_t m = 0; m < sizeof(aModes) / sizeof(aModes[0]); m++)
+    {
+        std::cout << apcModes[m] << "\n";
+
+        DICOMParser     parser;
+        DICOMAppHelper  helper;
+        parser.SetFileAccessMode(aModes[m]);
+        helper.RegisterCallbacks(&parser);
+        helper.RegisterPixelDataCallback(&parser);
+
+        TEST_CHECK(parser.OpenFile(strFile));
+        TEST_CHECK(uint64_t(parser.GetDICOMFile()->GetSize()) == uiPixelOffset + uiPixelBytes);
+        TEST_CHECK(parser.ReadHeaderOnly());
+
+        const DICOMParser::ElementLocation &    loc = parser.GetStopElementLocation();
+        TEST_CHECK(loc.Group == 0x7FE0 && loc.Element == 0x0010);
+        TEST_CHECK(loc.Type == DICOMParser::VR_OW);
+        TEST_CHECK(uint64_t(loc.Offset) == uiPixelOffset);
+        TEST_CHECK(uint64_t(loc.Length) == uiPixelBytes);
+
+        DICOMImageInfo  info;
+        helper.GetImageInfo(&parser, info);
+        TEST_CHECK(info.NumberOfFrames == iFrames);
+        TEST_CHECK(uint64_t(info.PixelData.Offset) == uiPixelOffset);
+        TEST_CHECK(uint64_t(info.PixelData.Length) == uiPixelBytes);
+        TEST_CHECK(uint64_t(info.GetFrameLengthInBytes()) == uiFrameBytes);
+        TEST_CHECK(uint64_t(info.GetFrameOffset(iFrames - 1)) == uiPixelOffset + uiPixelBytes - uiFrameBytes);
+
+        // single frames from the start of the pixel data to its end
+        const size_t    uiFramePixels = size_t(uiFrameBytes / 2);
+        for (size_t i = 0; i < viFrames.size(); i++)
+        {
+            const int   f = viFrames[i];
+            DICOMImageView<short>   view;
+            if (!helper.ReadFrames(&parser, info, f, 1) || !helper.GetImageView(view))
+            {
+                std::cout << "couldn't read frame " << f << "\n";
+                TestFailures()++;
+                continue;
+            }
+            TEST_CHECK(view.GetSize() == uiFramePixels);
+            TEST_CHECK(view[0] == FirstPixel(f));
+            TEST_CHECK(view[1] == 0);
+            TEST_CHECK(view[uiFramePixels - 1] == LastPixel(f));
+        }
+
+        // a run of frames across the 2 GB point of the pixel data
+        DICOMImageView<short>   view;
+        TEST_CHECK(helper.ReadFrames(&parser, info, iRangeFirst, iRangeFrames));
+        TEST_CHECK(helper.GetImageView(view));
+        TEST_CHECK(view.GetSize() == uiFramePixels * iRangeFrames);
+        if (view.GetSize() == uiFramePixels * iRangeFrames)
+        {
+            const size_t    uiLast = view.GetSize() - uiFramePixels;
+            TEST_CHECK(view[0] == FirstPixel(iRangeFirst));
+            TEST_CHECK(view[uiFramePixels - 1] == LastPixel(iRangeFirst));
+            TEST_CHECK(view[uiFramePixels * (iRangeFrames / 2)] == 0);
+            TEST_CHECK(view[uiLast] == FirstPixel(iRangeFirst + iRangeFrames - 1));
+            TEST_CHECK(view[uiLast + uiFramePixels - 1] == LastPixel(iRangeFirst + iRangeFrames - 1));
+        }
+
+        // frames past the end of the file
+        TEST_CHECK(!helper.ReadFrames(&parser, info, iFrames - 1, 2));
+        TEST_CHECK(!helper.ReadFrames(&parser, info, iFrames, 1));
+    }
+
+    remove(strFile.c_str());
+    return TestResult();
+}
@@ -0,0 +1,125 @@
+// LoadDicomVolume decodes each slice straight into its place in the
+// volume, through DICOMAppHelper::SetImageDestination, with no slice
+// sized buffer in between.
+
+#include "DicomVolume.h"
+#include "DicomTestUtilities.h"
+#include "TestAllocationCounter.h"
+
+namespace
+{
+    const uint32_t  uiRows = 48;
+    const uint32_t  uiColumns = 64;
+    const uint32_t  uiSlices = 12;
+    const size_t    uiSliceBytes = size_t(uiRows) * uiColumns * sizeof(int16_t);
+
+    // Only allocations of a slice or more are counted.
+    bool IsSliceSized( size_t uiSize )
+    {
+        return uiSize >= uiSliceBytes;
+    }
+
+    void CheckVoxels( const DicomVolume & volume )
+    {
+        TEST_CHECK(volume.uiSizeX == uiColumns);
+        TEST_CHECK(volume.uiSizeY == uiRows);
+        TEST_CHECK(volume.uiSizeZ == uiSlices);
+        TEST_CHECK(volume.fXSpacing == 0.7f);
+        TEST_CHECK(volume.fZSpacing == 1.25f);
+        TEST_CHECK(volume.viVoxels.size() == size_t(uiColumns) * uiRows * uiSlices);
+
+        size_t  uiWrong = 0;
+        for (uint32_t z = 0; z < volume.uiSizeZ; z++)
+        {
+            for (uint32_t y = 0; y < volume.uiSizeY; y++)
+            {
+                for (uint32_t x = 0; x < volume.uiSizeX; x++)
+                {
+                    uiWrong += volume.At(x, y, z) != TestPixel(int32_t(z + 1), 0, x, y);
+                }
+            }
+        }
+        TEST_CHECK(uiWrong == 0);
+        TEST_CHECK(volume.statistics.Count == uint64_t(volume.viVoxels.size()));
+    }
+}
+
+int main()
+{
+    const std::string   strDir = "TestLoadDicomVolume.data";
+    TestDicomImage      image;
+    image.uiRows = uiRows;
+    image.uiColumns = uiColumns;
+    if (!WriteTestSeries(strDir, uiSlices, image))
+    {
+        std::cout << "couldn't write " << strDir << "\n";
+        return 1;
+    }
+
+    const DICOMParser::FileAccessModes  aModes[] = { DICOMParser::ACCESS_STREAM, DICOMParser::ACCESS_MAPPED, DICOMParser::ACCESS_BUFFERED };
+
+    for (size_t m = 0; m < sizeof(aModes) / sizeof(aModes[0]); m++)
+    {
+        DICOMParser     parser;
+        DICOMAppHelper  helper;
+        parser.SetFileAccessMode(aModes[m]);
+        parser.SetZeroCopyValues(true);
+        helper.RegisterCallbacks(&parser);
+        helper.RegisterPixelDataCallback(&parser);
+
+        DicomVolume volume;
+        TestAllocationCounterFilter() = IsSliceSized;
+        const size_t    uiBefore = TestAllocations();
+        const bool      bOK = LoadDicomVolume(strDir, parser, helper, volume);
+        const size_t    uiLargeAllocations = TestAllocations() - uiBefore;
+        TestAllocationCounterFilter() = NULL;
+
+        TEST_CHECK(bOK);
+        CheckVoxels(volume);
+
+        // the last slice was decoded in place, not copied there
+        DICOMImageView<short>   view;
+        TEST_CHECK(helper.GetImageView(view));
+        TEST_CHECK(view.GetData() == &volume.viVoxels[uiSliceBytes / sizeof(int16_t) * (uiSlices - 1)]);
+
+        // Mapped, values are borrowed from the mapping, so the volume is
+        // the only slice sized allocation.  The other modes read the pixel
+        // data through the file's buffer and the parser's read buffer,
+        // each made once and reused, never one per slice.
+        if (aModes[m] == DICOMParser::ACCESS_MAPPED)
+        {
+            TEST_CHECK(uiLargeAllocations == 1);
+        }
+        else
+        {
+            TEST_CHECK(uiLargeAllocations <= 3);
+        }
+    }
+
+    // SetImageDestination on its own: an image that fits is decoded into
+    // the destination, one that doesn't goes to the helper's buffer
+    DICOMParser     parser;
+    DICOMAppHelper  helper;
+    helper.RegisterCallbacks(&parser);
+    helper.RegisterPixelDataCallback(&parser);
+
+    std::vector<short>  viSlice(size_t(uiRows) * uiColumns);
+    helper.SetImageDestination(DICOMImageView<short>(viSlice.data(), viSlice.size()));
+    TEST_CHECK(parser.OpenFile(strDir + "/IM0000.dcm") && parser.ReadHeader());
+
+    DICOMImageView<short>   view;
+    TEST_CHECK(helper.GetImageView(view));
+    TEST_CHECK(view.GetData() == viSlice.data());
+    TEST_CHECK(view.GetSize() == viSlice.size());
+    TEST_CHECK(viSlice[0] == TestPixel(int32_t(uiSlices), 0, 0, 0));
+    TEST_CHECK(viSlice.back() == TestPixel(int32_t(uiSlices), 0, uiColumns - 1, uiRows - 1));
+
+    helper.SetImageDestination(DICOMImageView<short>(viSlice.data(), viSlice.size() - 1));
+    TEST_CHECK(parser.OpenFile(strDir + "/IM0001.dcm") && parser.ReadHeader());
+    TEST_CHECK(helper.GetImageView(view));
+    TEST_CHECK(view.GetData() != viSlice.data());
+    TEST_CHECK(view[0] == TestPixel(int32_t(uiSlices - 1), 0, 0, 0));
+    helper.ClearImageDestination();
+
+    return TestResult();
+}
@@ -0,0 +1,228 @@
+// LoadDicomVolumeParallel gives exactly what LoadDicomVolume gives, for
+// any number of threads: the same voxels, sizes, spacing and statistics,
+// whatever order the workers finish in.
+//
+// With the directory index, a warm load takes headers from it instead of
+// parsing them; a file whose size or modification time changed, or that
+// was replaced or deleted, is parsed again, and an index that is garbage,
+// truncated or of another version is ignored.  To tell which happened, one
+// file is made unreadable as DICOM without changing its size, and its
+// modification time is set back: only a load that trusts the index still
+// places that slice.
+
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#ifdef _MSC_VER
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+#include "DicomVolume.h"
+#include "DicomIndex.h"
+#include "DicomTestUtilities.h"
+
+namespace
+{
+    bool SameVolume( const DicomVolume & a, const DicomVolume & b )
+    {
+        return a.uiSizeX == b.uiSizeX &&
+               a.uiSizeY == b.uiSizeY &&
+               a.uiSizeZ == b.uiSizeZ &&
+               a.fXSpacing == b.fXSpacing &&
+               a.fYSpacing == b.fYSpacing &&
+               a.fZSpacing == b.fZSpacing &&
+               a.viVoxels == b.viVoxels &&
+               SameStatistics(a.statistics, b.statistics);
+    }
+
+    bool ReadFile( const std::string & strPath, std::string & strData )
+    {
+        std::ifstream   file(strPath.c_str(), std::ios::binary);
+        strData.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return bool(file) || file.eof();
+    }
+
+    bool WriteFile( const std::string & strPath, const std::string & strData )
+    {
+        std::ofstream   file(strPath.c_str(), std::ios::binary | std::ios::trunc);
+        file.write(strData.data(), strData.size());
+        return bool(file);
+    }
+
+    // Set strPath's modification time to iSeconds since the epoch.
+    bool SetModifiedTime( const std::string & strPath, const int64_t iSeconds )
+    {
+#ifdef _MSC_VER
+        struct _utimbuf times;
+        times.actime = time_t(iSeconds);
+        times.modtime = time_t(iSeconds);
+        return _utime(strPath.c_str(), &times) == 0;
+#else
+        struct utimbuf  times;
+        times.actime = time_t(iSeconds);
+        times.modtime = time_t(iSeconds);
+        return utime(strPath.c_str(), &times) == 0;
+#endif
+    }
+
+    // Number of slices a load through the index gives, or 0 if it fails.
+    uint32_t IndexedSlices( const std::string & strDir, DicomVolume & volume, const DICOMParser::FileAccessModes mode = DICOMParser::ACCESS_MAPPED )
+    {
+        return LoadDicomVolumeParallel(strDir, 2, volume, mode, true) ? volume.uiSizeZ : 0;
+    }
+
+    void TestIndex( const std::string & strDir )
+    {
+        const uint32_t      uiSlices = 6;
+        const int64_t       iTime = 1000000000;
+        TestDicomImage      image;
+        image.uiRows = 24;
+        image.uiColumns = 20;
+        TEST_CHECK(WriteTestSeries(strDir, uiSlices, image));
+
+        // the last slice, so that the others still make a series without it
+        const std::string   strSlice = strDir + "/IM0000.dcm";
+        const std::string   strIndex = strDir + "/" DICOM_INDEX_FILENAME;
+        std::string         strGood;
+        TEST_CHECK(ReadFile(strSlice, strGood) && strGood.compare(128, 4, "DICM") == 0);
+        std::string         strBroken = strGood;
+        strBroken.replace(128, 4, "XXXX");
+        TEST_CHECK(SetModifiedTime(strSlice, iTime));
+
+        // a cold load writes the index
+        DicomVolume     expected;
+        DicomVolume     volume;
+        TEST_CHECK(LoadDicomVolumeParallel(strDir, 2, expected, DICOMParser::ACCESS_MAPPED, false));
+        TEST_CHECK(expected.uiSizeZ == uiSlices);
+        TEST_CHECK(IndexedSlices(strDir, volume) == uiSlices);
+        std::string     strIndexData;
+        TEST_CHECK(ReadFile(strIndex, strIndexData));
+        DicomIndex      index;
+        TEST_CHECK(index.Open(strIndex) && index.GetNumEntries() == uiSlices);
+        index.Close();
+
+        // a warm load doesn't parse the broken slice, and leaves the index be
+        TEST_CHECK(WriteFile(strSlice, strBroken) && SetModifiedTime(strSlice, iTime));
+        const DICOMParser::FileAccessModes  aModes[] = { DICOMParser::ACCESS_STREAM, DICOMParser::ACCESS_MAPPED, DICOMParser::ACCESS_BUFFERED };
+        for (size_t m = 0; m < sizeof(aModes) / sizeof(aModes[0]); m++)
+        {
+            TEST_CHECK(IndexedSlices(strDir, volume, aModes[m]) == uiSlices && SameVolume(volume, expected));
+        }
+        std::string     strWarmIndex;
+        TEST_CHECK(ReadFile(strIndex, strWarmIndex) && strWarmIndex == strIndexData);
+
+        // a changed modification time or size, or a new file in its place,
+        // makes it parsed again
+        TEST_CHECK(SetModifiedTime(strSlice, iTime + 10));
+        TEST_CHECK(IndexedSlices(strDir, volume) == uiSlices - 1);
+
+        TEST_CHECK(WriteFile(strIndex, strIndexData));
+        TEST_CHECK(WriteFile(strSlice, strBroken + std::string(2, '\0')) && SetModifiedTime(strSlice, iTime));
+        TEST_CHECK(IndexedSlices(strDir, volume) == uiSlices - 1);
+
+        TEST_CHECK(WriteFile(strIndex, strIndexData));
+        TEST_CHECK(remove(strSlice.c_str()) == 0 && WriteFile(strSlice, strBroken));
+        TEST_CHECK(IndexedSlices(strDir, volume) == uiSlices - 1);
+
+        // a deleted file is dropped from the index
+        TEST_CHECK(WriteFile(strIndex, strIndexData));
+        TEST_CHECK(remove(strSlice.c_str()) == 0);
+        TEST_CHECK(IndexedSlices(strDir, volume) == uiSlices - 1);
+        TEST_CHECK(index.Open(strIndex) && index.GetNumEntries() == uiSlices - 1);
+        index.Close();
+
+        // an index that can't be used is parsed around, and replaced
+        std::vector<std::string>    vstrBad;
+        std::string                 strGarbage(strIndexData.size(), '\0');
+        for (size_t i = 0; i < strGarbage.size(); i++)
+        {
+            strGarbage[i] = char(i * 131 + 7);
+        }
+        vstrBad.push_back(strGarbage);
+        vstrBad.push_back(strIndexData.substr(0, strIndexData.size() / 2));
+        vstrBad.push_back(strIndexData.substr(0, 20));
+        vstrBad.push_back(std::string());
+        std::string                 strOld = strIndexData;
+        uint32_t                    uiVersion = 0;
+        memcpy(&uiVersion, &strOld[8], sizeof(uiVersion));
+        uiVersion--;
+        memcpy(&strOld[8], &uiVersion, sizeof(uiVersion));
+        vstrBad.push_back(strOld);
+
+        TEST_CHECK(WriteFile(strSlice, strBroken) && SetModifiedTime(strSlice, iTime));
+        for (size_t i = 0; i < vstrBad.size(); i++)
+        {
+            TEST_CHECK(WriteFile(strIndex, vstrBad[i]));
+            TEST_CHECK(!index.Open(strIndex));
+            if (IndexedSlices(strDir, volume) != uiSlices - 1)
+            {
+                std::cout << "bad index " << i << " was used\n";
+                TestFailures()++;
+            }
+            TEST_CHECK(index.Open(strIndex) && index.GetNumEntries() == uiSlices);
+            index.Close();
+        }
+    }
+}
+
+int main()
+{
+    // a slice count no thread count divides, rescaled so the statistics
+    // see negative values
+    const std::string   strDir = "TestParallelLoad.data";
+    const uint32_t      uiSlices = 37;
+    TestDicomImage      image;
+    image.uiRows = 40;
+    image.uiColumns = 56;
+    image.fIntercept = -1024.0f;
+    if (!WriteTestSeries(strDir, uiSlices, image))
+    {
+        std::cout << "couldn't write " << strDir << "\n";
+        return 1;
+    }
+
+    std::vector<uint32_t>   vuiThreads;
+    vuiThreads.push_back(1);
+    vuiThreads.push_back(2);
+    vuiThreads.push_back(std::max(1u, std::thread::hardware_concurrency()));
+    vuiThreads.push_back(uiSlices + 7);     // more workers than slices
+
+    const DICOMParser::FileAccessModes  aModes[] = { DICOMParser::ACCESS_STREAM, DICOMParser::ACCESS_MAPPED, DICOMParser::ACCESS_BUFFERED };
+    const char *                        apcModes[] = { "stream", "mapped", "buffered" };
+
+    for (size_t m = 0; m < 3; m++)
+    {
+        DicomVolume     serial;
+        DICOMParser     parser;
+        DICOMAppHelper  helper;
+        parser.SetFileAccessMode(aModes[m]);
+        helper.RegisterCallbacks(&parser);
+        helper.RegisterPixelDataCallback(&parser);
+        TEST_CHECK(LoadDicomVolume(strDir, parser, helper, serial));
+        TEST_CHECK(serial.uiSizeZ == uiSlices);
+        TEST_CHECK(serial.statistics.Count == uint64_t(serial.viVoxels.size()));
+        TEST_CHECK(serial.statistics.Min < 0.0);
+
+        // without the index, then writing it, then reading from it
+        for (int iIndex = 0; iIndex < 3; iIndex++)
+        {
+            for (size_t t = 0; t < vuiThreads.size(); t++)
+            {
+                DicomVolume parallel;
+                const bool  bOK = LoadDicomVolumeParallel(strDir, vuiThreads[t], parallel, aModes[m], iIndex != 0);
+                const bool  bSame = bOK && SameVolume(parallel, serial);
+                std::cout << apcModes[m] << (iIndex == 0 ? "" : ", index") << ", " << vuiThreads[t] << " threads: "
+                          << (bSame ? "same" : "different") << "\n";
+                TEST_CHECK(bOK);
+                TEST_CHECK(bSame);
+            }
+        }
+        remove((strDir + "/" DICOM_INDEX_FILENAME).c_str());
+    }
+
+    TestIndex(strDir + "/index");
+
+    return TestResult();
+}
@@ -0,0 +1,359 @@
+// Every DICOMPixelKernels loop gives the same output, bit for bit, and
+// the same statistics with the scalar, SSE2 and AVX2 instruction sets.
+// The input is random, the lengths odd and not multiples of any vector
+// width, the arrays not aligned, with and without byte swapping, padding
+// values and statistics.  The scalar output is checked against plain
+// loops written here.  A set the CPU lacks falls back to the best one it
+// has, so on such a CPU those comparisons repeat an earlier one.  The
+// resampling row kernels are checked against the rounding DicomResample
+// had before it used them.
+
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+#include "DICOMPixelKernels.h"
+#include "DicomTestUtilities.h"
+
+namespace
+{
+    typedef DICOMPixelKernels   Kernels;
+
+    const Kernels::InstructionSets  aSets[] = { Kernels::SCALAR, Kernels::SSE2, Kernels::AVX2 };
+    const short                     iPadding = -2000;
+
+    // Float sums are added in a different order by each set, so they
+    // may differ in the last bits; everything else must be the same.
+    bool SameFloatStatistics( const DICOMPixelStatistics & a, DICOMPixelStatistics b )
+    {
+        if (std::fabs(a.Sum - b.Sum) > 1e-9 * std::max(1.0, std::fabs(a.Sum)))
+        {
+            return false;
+        }
+        b.Sum = a.Sum;
+        return SameStatistics(a, b);
+    }
+
+    // in with the bytes of each 16 bit word swapped, an odd last byte
+    // left as it is.
+    std::vector<unsigned char> SwapPairs( const unsigned char * pIn, const int n )
+    {
+        std::vector<unsigned char>  vOut(pIn, pIn + n);
+        for (int i = 0; i + 1 < n; i += 2)
+        {
+            std::swap(vOut[i], vOut[i + 1]);
+        }
+        return vOut;
+    }
+
+    std::vector<unsigned short> SwapWords( const unsigned short * pIn, const int n )
+    {
+        std::vector<unsigned short> vOut(pIn, pIn + n);
+        for (int i = 0; i < n; i++)
+        {
+            vOut[i] = (unsigned short)((vOut[i] << 8) | (vOut[i] >> 8));
+        }
+        return vOut;
+    }
+
+    struct Case
+    {
+        int     n;
+        float   fSlope;
+        float   fOffset;
+        bool    bSwap;
+        bool    bStatistics;
+    };
+
+    // Run kernel with each set on the same input, check the scalar output
+    // against vReference and the others against the scalar one.
+    template <class Out, class Kernel>
+    void CompareSets( const char * pcKernel, const Case & c, const std::vector<Out> & vReference, const bool bExactSum, Kernel kernel )
+    {
+        std::vector<Out>        vScalar;
+        DICOMPixelStatistics    scalarStatistics;
+        for (size_t s = 0; s < sizeof(aSets) / sizeof(aSets[0]); s++)
+        {
+            // one element in, so the output isn't aligned either
+            std::vector<Out>        vOut(c.n + 1);
+            DICOMPixelStatistics    statistics;
+            kernel(vOut.data() + 1, c.bStatistics ? &statistics : NULL, aSets[s]);
+            vOut.erase(vOut.begin());
+
+            const bool  bSameOutput = s == 0 ?
+                memcmp(vOut.data(), vReference.data(), c.n * sizeof(Out)) == 0 :
+                memcmp(vOut.data(), vScalar.data(), c.n * sizeof(Out)) == 0;
+            const bool  bSameStatistics = s == 0 || !c.bStatistics ||
+                (bExactSum ? SameStatistics(statistics, scalarStatistics) : SameFloatStatistics(statistics, scalarStatistics));
+            if (!bSameOutput || !bSameStatistics)
+            {
+                std::cout << pcKernel << ", " << Kernels::GetInstructionSetName(aSets[s]) << ", n " << c.n
+                          << ", slope " << c.fSlope << ", offset " << c.fOffset << (c.bSwap ? ", swap" : "")
+                          << (bSameOutput ? "" : ": output differs") << (bSameStatistics ? "" : ": statistics differ") << "\n";
+                TestFailures()++;
+            }
+            if (s == 0)
+            {
+                vScalar = vOut;
+                scalarStatistics = statistics;
+                if (c.bStatistics)
+                {
+                    TEST_CHECK(statistics.Count == uint64_t(c.n));
+                }
+            }
+        }
+    }
+
+    void TestCase( const Case & c, std::mt19937 & random )
+    {
+        // one element more than needed, so the kernels read from an
+        // address one element in
+        std::vector<unsigned char>  vBytes(c.n + 1);
+        std::vector<unsigned short> vWords(c.n + 1);
+        for (int i = 0; i <= c.n; i++)
+        {
+            vBytes[i] = (unsigned char)random();
+            vWords[i] = (unsigned short)random();
+            if (random() % 8 == 0)
+            {
+                vWords[i] = (unsigned short)iPadding;
+            }
+        }
+        const unsigned char *   pBytes = vBytes.data() + 1;
+        const unsigned short *  pWords = vWords.data() + 1;
+        const short *           pShorts = reinterpret_cast<const short *>(pWords);
+
+        // the values the kernels see once they've swapped
+        const std::vector<unsigned char>    vStoredBytes = c.bSwap ? SwapPairs(pBytes, c.n) : std::vector<unsigned char>(pBytes, pBytes + c.n);
+        const std::vector<unsigned short>   vStoredWords = c.bSwap ? SwapWords(pWords, c.n) : std::vector<unsigned short>(pWords, pWords + c.n);
+
+        std::vector<char>   vChars(c.n);
+        std::vector<float>  vBytesToFloats(c.n), vWordsToFloats(c.n);
+        std::vector<short>  vShorts(c.n), vCopies(c.n);
+        for (int i = 0; i < c.n; i++)
+        {
+            const short iValue = short(vStoredWords[i]) == iPadding ? short(0) : short(vStoredWords[i]);
+            vChars[i] = char(int(c.fSlope * vStoredBytes[i] + c.fOffset));
+            vBytesToFloats[i] = c.fSlope * vStoredBytes[i] + c.fOffset;
+            vWordsToFloats[i] = c.fSlope * vStoredWords[i] + c.fOffset;
+            vShorts[i] = short(int(c.fSlope * iValue + c.fOffset));
+            vCopies[i] = iValue;
+        }
+
+        CompareSets("DecodeUCharToChar", c, vChars, true,
+            [&]( char * pOut, DICOMPixelStatistics * pStatistics, Kernels::InstructionSets set )
+            { Kernels::DecodeUCharToChar(pBytes, pOut, c.n, c.fSlope, c.fOffset, c.bSwap, pStatistics, set); });
+        CompareSets("DecodeUCharToFloat", c, vBytesToFloats, false,
+            [&]( float * pOut, DICOMPixelStatistics * pStatistics, Kernels::InstructionSets set )
+            { Kernels::DecodeUCharToFloat(pBytes, pOut, c.n, c.fSlope, c.fOffset, c.bSwap, pStatistics, set); });
+        CompareSets("DecodeUShortToFloat", c, vWordsToFloats, false,
+            [&]( float * pOut, DICOMPixelStatistics * pStatistics, Kernels::InstructionSets set )
+            { Kernels::DecodeUShortToFloat(pWords, pOut, c.n, c.fSlope, c.fOffset, c.bSwap, pStatistics, set); });
+        CompareSets("DecodeShortToShort", c, vShorts, true,
+            [&]( short * pOut, DICOMPixelStatistics * pStatistics, Kernels::InstructionSets set )
+            { Kernels::DecodeShortToShort(pShorts, pOut, c.n, c.fSlope, c.fOffset, iPadding, c.bSwap, pStatistics, set); });
+        CompareSets("CopyShortToShort", c, vCopies, true,
+            [&]( short * pOut, DICOMPixelStatistics * pStatistics, Kernels::InstructionSets set )
+            { Kernels::CopyShortToShort(pShorts, pOut, c.n, iPadding, c.bSwap, pStatistics, set); });
+    }
+
+    // SwapBytes16, 32 and 64, out of place and in place.
+    template <class T, class Swap>
+    void TestSwap( const char * pcKernel, const size_t uiCount, std::mt19937 & random, Swap swap )
+    {
+        std::vector<T>  vIn(uiCount + 1), vReference(uiCount);
+        for (size_t i = 0; i <= uiCount; i++)
+        {
+            vIn[i] = T(random()) << (4 * sizeof(T)) ^ T(random());
+        }
+        for (size_t i = 0; i < uiCount; i++)
+        {
+            const unsigned char *   pIn = reinterpret_cast<const unsigned char *>(&vIn[i + 1]);
+            unsigned char *         pOut = reinterpret_cast<unsigned char *>(&vReference[i]);
+            std::reverse_copy(pIn, pIn + sizeof(T), pOut);
+        }
+
+        for (size_t s = 0; s < sizeof(aSets) / sizeof(aSets[0]); s++)
+        {
+            std::vector<T>  vOut(uiCount + 1);
+            swap(vIn.data() + 1, vOut.data() + 1, uiCount, aSets[s]);
+            std::vector<T>  vInPlace(vIn.begin() + 1, vIn.end());
+            swap(vInPlace.data(), vInPlace.data(), uiCount, aSets[s]);
+            if (!std::equal(vReference.begin(), vReference.end(), vOut.begin() + 1) || vInPlace != vReference)
+            {
+                std::cout << pcKernel << ", " << Kernels::GetInstructionSetName(aSets[s]) << ", count " << uiCount << ": output differs\n";
+                TestFailures()++;
+            }
+        }
+    }
+
+    // What DicomResample did before it used the kernels: clamp, then
+    // round half away from 0.
+    short RoundVoxel( const float fValue )
+    {
+        const float fClamped = std::min(32767.0f, std::max(-32768.0f, fValue));
+        return short(fClamped < 0.0f ? fClamped - 0.5f : fClamped + 0.5f);
+    }
+
+    // RoundFloatToShort and BlendShortToShort, on values that round
+    // exactly to .5, out of range, -0 and NaN among random ones.
+    void TestResampleRows( const size_t uiCount, std::mt19937 & random )
+    {
+        const float afSpecial[] = { 0.5f, -0.5f, 2.5f, -2.5f, -0.0f, 0.49999997f, 32767.4f, 32767.5f, 40000.0f,
+                                    -32768.4f, -32768.5f, -1.0e9f, std::numeric_limits<float>::quiet_NaN() };
+        std::vector<float>  vFloats(uiCount + 1);
+        std::vector<short>  vIn0(uiCount + 1), vIn1(uiCount + 1);
+        for (size_t i = 0; i <= uiCount; i++)
+        {
+            vFloats[i] = random() % 4 == 0 ? afSpecial[random() % (sizeof(afSpecial) / sizeof(afSpecial[0]))] :
+                                             float(int(random() % 140000) - 70000) / 2.0f + float(random() % 1000) / 1000.0f;
+            vIn0[i] = short(random());
+            vIn1[i] = short(random());
+        }
+
+        // weights of linear interpolation, and of a kernel that overshoots
+        const float afWeights[][2] = { { 0.25f, 0.75f }, { 0.5f, 0.5f }, { 0.3f, 0.7f }, { 1.2f, -0.2f }, { -0.0625f, 1.0625f } };
+        for (size_t s = 0; s < sizeof(aSets) / sizeof(aSets[0]); s++)
+        {
+            std::vector<short>  vOut(uiCount + 1);
+            Kernels::RoundFloatToShort(vFloats.data() + 1, vOut.data() + 1, uiCount, aSets[s]);
+            for (size_t i = 0; i < uiCount; i++)
+            {
+                if (vOut[i + 1] != RoundVoxel(vFloats[i + 1]))
+                {
+                    std::cout << "RoundFloatToShort, " << Kernels::GetInstructionSetName(aSets[s]) << ", count " << uiCount
+                              << ": " << vFloats[i + 1] << " gave " << vOut[i + 1] << "\n";
+                    TestFailures()++;
+                    break;
+                }
+            }
+
+            for (size_t w = 0; w < sizeof(afWeights) / sizeof(afWeights[0]); w++)
+            {
+                const float fWeight0 = afWeights[w][0];
+                const float fWeight1 = afWeights[w][1];
+                Kernels::BlendShortToShort(vIn0.data() + 1, vIn1.data() + 1, vOut.data() + 1, uiCount, fWeight0, fWeight1, aSets[s]);
+                for (size_t i = 0; i < uiCount; i++)
+                {
+                    if (vOut[i + 1] != RoundVoxel(fWeight0 * float(vIn0[i + 1]) + fWeight1 * float(vIn1[i + 1])))
+                    {
+                        std::cout << "BlendShortToShort, " << Kernels::GetInstructionSetName(aSets[s]) << ", count " << uiCount
+                                  << ", weights " << fWeight0 << " " << fWeight1 << ": output differs\n";
+                        TestFailures()++;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // InterpolateFloat with every tap count a kernel has, and none,
+    // against the sum of the taps in order.
+    void TestInterpolate( const size_t uiCount, std::mt19937 & random )
+    {
+        const size_t        uiSourceSize = uiCount / 2 + 7;
+        std::vector<float>  vIn(uiSourceSize);
+        for (size_t i = 0; i < uiSourceSize; i++)
+        {
+            vIn[i] = float(short(random())) * 0.75f;
+        }
+
+        for (unsigned int uiTaps = 0; uiTaps <= 6; uiTaps++)
+        {
+            std::vector<uint32_t>   vuiIndex(uiTaps * uiCount);
+            std::vector<float>      vfWeight(uiTaps * uiCount);
+            for (size_t i = 0; i < vuiIndex.size(); i++)
+            {
+                vuiIndex[i] = uint32_t(random() % uiSourceSize);
+                vfWeight[i] = float(int(random() % 2001) - 1000) / 997.0f;
+            }
+            std::vector<float>  vReference(uiCount);
+            for (size_t i = 0; i < uiCount; i++)
+            {
+                float   fSum = uiTaps ? vfWeight[i] * vIn[vuiIndex[i]] : 0.0f;
+                for (unsigned int t = 1; t < uiTaps; t++)
+                {
+                    fSum += vfWeight[t * uiCount + i] * vIn[vuiIndex[t * uiCount + i]];
+                }
+                vReference[i] = fSum;
+            }
+
+            for (size_t s = 0; s < sizeof(aSets) / sizeof(aSets[0]); s++)
+            {
+                std::vector<float>  vOut(uiCount + 1, 1.0f);
+                Kernels::InterpolateFloat(vIn.data(), vuiIndex.data(), vfWeight.data(), uiTaps, vOut.data() + 1, uiCount, aSets[s]);
+                if (memcmp(vOut.data() + 1, vReference.data(), uiCount * sizeof(float)) != 0)
+                {
+                    std::cout << "InterpolateFloat, " << Kernels::GetInstructionSetName(aSets[s]) << ", count " << uiCount
+                              << ", taps " << uiTaps << ": output differs\n";
+                    TestFailures()++;
+                }
+            }
+        }
+    }
+}
+
+int main()
+{
+    std::cout << "best instruction set: " << Kernels::GetInstructionSetName(Kernels::GetInstructionSet()) << "\n";
+
+    std::mt19937    random(1);
+
+    std::vector<int>    viLengths;
+    for (int n = 0; n < 70; n++)
+    {
+        viLengths.push_back(n);
+    }
+    viLengths.push_back(1023);
+    viLengths.push_back(4097);
+    viLengths.push_back(65537);
+
+    // integer rescales, which 8 and 16 bit output should take exactly,
+    // and fractional ones for float output and truncation
+    const float afSlopes[] = { 1.0f, 2.0f, -1.0f, 0.5f, 3.1415926f };
+    const float afOffsets[] = { 0.0f, -1024.0f, 1024.5f, -32768.0f };
+
+    for (size_t l = 0; l < viLengths.size(); l++)
+    {
+        for (size_t s = 0; s < sizeof(afSlopes) / sizeof(afSlopes[0]); s++)
+        {
+            for (size_t o = 0; o < sizeof(afOffsets) / sizeof(afOffsets[0]); o++)
+            {
+                for (int iFlags = 0; iFlags < 4; iFlags++)
+                {
+                    Case    c;
+                    c.n = viLengths[l];
+                    c.fSlope = afSlopes[s];
+                    c.fOffset = afOffsets[o];
+                    c.bSwap = (iFlags & 1) != 0;
+                    c.bStatistics = (iFlags & 2) != 0;
+                    TestCase(c, random);
+                }
+            }
+        }
+
+        const size_t    uiCount = size_t(viLengths[l]);
+        TestSwap<uint16_t>("SwapBytes16", uiCount, random, Kernels::SwapBytes16);
+        TestSwap<uint32_t>("SwapBytes32", uiCount, random, Kernels::SwapBytes32);
+        TestSwap<uint64_t>("SwapBytes64", uiCount, random, Kernels::SwapBytes64);
+        TestResampleRows(uiCount, random);
+        TestInterpolate(uiCount, random);
+    }
+
+    // statistics merged from parts are those of the whole
+    std::vector<short>  vIn(10001), vOut(10001);
+    for (size_t i = 0; i < vIn.size(); i++)
+    {
+        vIn[i] = short(random());
+    }
+    DICOMPixelStatistics    whole, first, second;
+    Kernels::DecodeShortToShort(vIn.data(), vOut.data(), 10001, 1.0f, 0.0f, iPadding, false, &whole);
+    Kernels::DecodeShortToShort(vIn.data(), vOut.data(), 3333, 1.0f, 0.0f, iPadding, false, &first);
+    Kernels::DecodeShortToShort(vIn.data() + 3333, vOut.data() + 3333, 6668, 1.0f, 0.0f, iPadding, false, &second);
+    first.Merge(second);
+    TEST_CHECK(SameStatistics(whole, first));
+
+    return TestResult();
+}
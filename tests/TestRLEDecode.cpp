@@ -0,0 +1,283 @@
+// RLE Lossless pixel data decodes to exactly what the same image stored
+// natively does: 8 and 16 bit, monochrome and RGB, with and without a
+// Basic Offset Table, each frame in one fragment or split over two, on
+// one thread or several and through every access mode.  Malformed frame
+// headers and segments are rejected, or cut short, without reading or
+// writing out of bounds.
+
+#include <string.h>
+#include <random>
+
+#include "DICOMParser.h"
+#include "DICOMAppHelper.h"
+#include "DICOMRLEDecoder.h"
+#include "DicomTestUtilities.h"
+
+namespace
+{
+    const DICOMParser::FileAccessModes  aModes[] = { DICOMParser::ACCESS_STREAM, DICOMParser::ACCESS_MAPPED, DICOMParser::ACCESS_BUFFERED };
+    const int                           aiThreads[] = { 1, 4 };
+
+    // The image helper decoded last, or empty if it decoded none.
+    std::string Decoded( DICOMAppHelper & helper )
+    {
+        void *                  pData = NULL;
+        DICOMParser::VRTypes    type = DICOMParser::VR_UNKNOWN;
+        size_t                  uiLength = 0;
+        helper.GetImageData(pData, type, uiLength);
+        return type == DICOMParser::VR_UNKNOWN || !pData ? std::string() : std::string(static_cast<const char *>(pData), uiLength);
+    }
+
+    // strPath decoded whole, or only uiCount frames from uiFirst on.
+    std::string Decode( const std::string &                 strPath,
+                        const DICOMParser::FileAccessModes  mode,
+                        const int                           iThreads,
+                        const int                           iFirst = 0,
+                        const int                           iCount = 0  )
+    {
+        DICOMParser     parser;
+        DICOMAppHelper  helper;
+        parser.SetFileAccessMode(mode);
+        helper.RegisterCallbacks(&parser);
+        helper.RegisterPixelDataCallback(&parser);
+        helper.SetNumberOfThreads(iThreads);
+        if (!parser.OpenFile(strPath))
+        {
+            return std::string();
+        }
+        if (iCount == 0)
+        {
+            return parser.ReadHeader() ? Decoded(helper) : std::string();
+        }
+        DICOMImageInfo  info;
+        if (!parser.ReadHeaderOnly())
+        {
+            return std::string();
+        }
+        helper.GetImageInfo(&parser, info);
+        return helper.ReadFrames(&parser, info, iFirst, iCount) ? Decoded(helper) : std::string();
+    }
+
+    bool ReadFile( const std::string & strPath, std::string & strData )
+    {
+        std::ifstream   file(strPath.c_str(), std::ios::binary);
+        strData.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return bool(file) || file.eof();
+    }
+
+    bool WriteFile( const std::string & strPath, const std::string & strData )
+    {
+        std::ofstream   file(strPath.c_str(), std::ios::binary | std::ios::trunc);
+        file.write(strData.data(), strData.size());
+        return bool(file);
+    }
+
+    // Every layout of image's frames decodes like its native copy.
+    void TestLayouts( const std::string & strDir, TestDicomImage image, const char * pcName )
+    {
+        const std::string   strNative = strDir + "/" + pcName + "-native.dcm";
+        TEST_CHECK(WriteTestDicom(strNative, image));
+        const std::string   strExpected = Decode(strNative, DICOMParser::ACCESS_MAPPED, 1);
+        const std::string   strFrame1 = Decode(strNative, DICOMParser::ACCESS_MAPPED, 1, 1, 1);
+        TEST_CHECK(strExpected.size() == TestFrameBytes(image) * image.uiFrames);
+        TEST_CHECK(image.uiFrames == 1 || strFrame1.size() == TestFrameBytes(image));
+
+        image.bRLE = true;
+        for (int iTable = 0; iTable < 2; iTable++)
+        {
+            for (uint32_t uiFragments = 1; uiFragments <= 2; uiFragments++)
+            {
+                image.bOffsetTable = iTable != 0;
+                image.uiFragmentsPerFrame = uiFragments;
+                const std::string   strRLE = strDir + "/" + pcName + (iTable ? "-table-" : "-notable-") + char('0' + uiFragments) + ".dcm";
+                TEST_CHECK(WriteTestDicom(strRLE, image));
+
+                // without the table, split frames can only be grouped
+                // when there is just one
+                const bool  bGroups = image.bOffsetTable || uiFragments == 1 || image.uiFrames == 1;
+                for (size_t m = 0; m < sizeof(aModes) / sizeof(aModes[0]); m++)
+                {
+                    for (size_t t = 0; t < sizeof(aiThreads) / sizeof(aiThreads[0]); t++)
+                    {
+                        const std::string   strDecoded = Decode(strRLE, aModes[m], aiThreads[t]);
+                        if (bGroups ? strDecoded != strExpected : !strDecoded.empty())
+                        {
+                            std::cout << strRLE << ", mode " << aModes[m] << ", " << aiThreads[t] << " threads: "
+                                      << (bGroups ? "differs from the native decode\n" : "decoded frames it can't group\n");
+                            TestFailures()++;
+                        }
+                    }
+                    if (bGroups && image.uiFrames > 1)
+                    {
+                        TEST_CHECK(Decode(strRLE, aModes[m], 1, 1, 1) == strFrame1);
+                    }
+                }
+            }
+        }
+    }
+
+    // DecodeFrame on frame, with out given guard bytes either side: they
+    // must be left alone, whatever the frame holds.
+    bool DecodeGuarded( const std::string & strFrame, const size_t uiPixels, const int iSamples, const int iBytes, std::string & strOut )
+    {
+        const size_t    uiGuard = 64;
+        const size_t    uiSize = uiPixels * iSamples * iBytes;
+        std::string     strBuffer(uiSize + 2 * uiGuard, char(0x5A));
+        const bool      bOK = DICOMRLEDecoder::DecodeFrame(reinterpret_cast<const unsigned char *>(strFrame.data()), strFrame.size(),
+                                                           reinterpret_cast<unsigned char *>(&strBuffer[uiGuard]), uiPixels, iSamples, iBytes);
+        TEST_CHECK(strBuffer.compare(0, uiGuard, std::string(uiGuard, char(0x5A))) == 0);
+        TEST_CHECK(strBuffer.compare(uiGuard + uiSize, uiGuard, std::string(uiGuard, char(0x5A))) == 0);
+        strOut = strBuffer.substr(uiGuard, uiSize);
+        return bOK;
+    }
+
+    void PutUInt32At( std::string & str, const size_t uiAt, const uint32_t uiValue )
+    {
+        std::string strValue;
+        TestDicomDetail::PutUInt32(strValue, uiValue, false);
+        str.replace(uiAt, 4, strValue);
+    }
+
+    // Frame headers that don't describe the frame are rejected; segments
+    // cut short leave the rest of their bytes 0.
+    void TestMalformedFrames()
+    {
+        TestDicomImage  image;
+        image.uiRows = 20;
+        image.uiColumns = 24;
+        image.uiSamplesPerPixel = 3;
+        const size_t        uiPixels = size_t(image.uiRows) * image.uiColumns;
+        const std::string   strNative = TestFrameData(image, 0);
+        const std::string   strFrame = TestRLEFrame(image, 0);
+        std::string         strOut;
+
+        TEST_CHECK(DecodeGuarded(strFrame, uiPixels, 3, 2, strOut) && strOut == strNative);
+
+        // the header's segment count must match the samples
+        TEST_CHECK(!DecodeGuarded(strFrame, uiPixels, 1, 2, strOut));
+        TEST_CHECK(!DecodeGuarded(strFrame, uiPixels, 3, 1, strOut));
+        const uint32_t  auiCounts[] = { 0, 5, 7, 15, 16, 0xFFFFFFFF };
+        for (size_t i = 0; i < sizeof(auiCounts) / sizeof(auiCounts[0]); i++)
+        {
+            std::string strBad = strFrame;
+            PutUInt32At(strBad, 0, auiCounts[i]);
+            TEST_CHECK(!DecodeGuarded(strBad, uiPixels, 3, 2, strOut));
+        }
+
+        // segments must start after the header, in order, within the frame
+        const uint32_t  auiStarts[] = { 0, 4, 63, uint32_t(strFrame.size() + 1), 0x7FFFFFFF, 0xFFFFFFFF };
+        for (size_t i = 0; i < sizeof(auiStarts) / sizeof(auiStarts[0]); i++)
+        {
+            for (size_t s = 0; s < 6; s++)
+            {
+                std::string strBad = strFrame;
+                PutUInt32At(strBad, 4 + 4 * s, auiStarts[i]);
+                TEST_CHECK(!DecodeGuarded(strBad, uiPixels, 3, 2, strOut));
+            }
+        }
+
+        // too short for a header, or for the segments it lists
+        TEST_CHECK(!DecodeGuarded(std::string(), uiPixels, 3, 2, strOut));
+        TEST_CHECK(!DecodeGuarded(strFrame.substr(0, 63), uiPixels, 3, 2, strOut));
+        TEST_CHECK(!DecodeGuarded(strFrame.substr(0, 64), uiPixels, 3, 2, strOut));
+
+        // the last segment cut short: what it holds is decoded, the rest
+        // of its bytes, the low ones of blue, are 0
+        const std::string   strCut = strFrame.substr(0, strFrame.size() - 40);
+        TEST_CHECK(DecodeGuarded(strCut, uiPixels, 3, 2, strOut));
+        bool    bCut = strOut.size() == strNative.size() && strOut[strOut.size() - 2] == 0;
+        for (size_t i = 0; bCut && i < strOut.size(); i++)
+        {
+            bCut = strOut[i] == strNative[i] || (i % 6 == 4 && strOut[i] == 0);
+        }
+        TEST_CHECK(bCut);
+
+        // runs: a replicate run missing its byte ends the segment, a
+        // literal longer than the segment takes what there is, -128 is
+        // a no-op and bytes past count are ignored
+        const unsigned char aucRuns[] = { 0xFE, 7, 0x80, 0x01, 1, 2, 0xFF };
+        unsigned char       aucOut[12];
+        memset(aucOut, 0xEE, sizeof(aucOut));
+        TEST_CHECK(DICOMRLEDecoder::DecodeSegment(aucRuns, sizeof(aucRuns), aucOut, 1, 10) == 5);
+        TEST_CHECK(aucOut[0] == 7 && aucOut[2] == 7 && aucOut[3] == 1 && aucOut[4] == 2 && aucOut[5] == 0xEE);
+        const unsigned char aucLiteral[] = { 0x09, 1, 2, 3 };
+        TEST_CHECK(DICOMRLEDecoder::DecodeSegment(aucLiteral, sizeof(aucLiteral), aucOut, 2, 6) == 3);
+        TEST_CHECK(aucOut[0] == 1 && aucOut[2] == 2 && aucOut[4] == 3 && aucOut[6] == 0xEE);
+        TEST_CHECK(DICOMRLEDecoder::DecodeSegment(aucRuns, sizeof(aucRuns), aucOut, 1, 2) == 2);
+        TEST_CHECK(DICOMRLEDecoder::DecodeSegment(aucRuns, 0, aucOut, 1, 10) == 0);
+
+        // garbage after a good header stays within out
+        std::mt19937    random(7);
+        for (int i = 0; i < 2000; i++)
+        {
+            std::string strGarbage = strFrame;
+            for (size_t b = 64; b < strGarbage.size(); b++)
+            {
+                strGarbage[b] = char(random());
+            }
+            strGarbage.resize(64 + random() % (strGarbage.size() - 63));
+            const size_t    uiStep = random() % ((strGarbage.size() - 64) / 6 + 1);
+            for (size_t s = 0; s < 6; s++)
+            {
+                PutUInt32At(strGarbage, 4 + 4 * s, uint32_t(64 + s * uiStep));
+            }
+            DecodeGuarded(strGarbage, uiPixels, 3, 2, strOut);
+        }
+    }
+}
+
+int main()
+{
+    const std::string   strDir = "TestRLEDecode.data";
+    if (!MakeTestDirectory(strDir))
+    {
+        std::cout << "couldn't make " << strDir << "\n";
+        return 1;
+    }
+
+    TestDicomImage  image;
+    image.uiRows = 33;
+    image.uiColumns = 50;
+    image.uiFrames = 3;
+    TestLayouts(strDir, image, "short");
+
+    image.uiBitsAllocated = 8;
+    TestLayouts(strDir, image, "char");
+
+    image.uiSamplesPerPixel = 3;
+    TestLayouts(strDir, image, "rgb8");
+
+    image.uiBitsAllocated = 16;
+    TestLayouts(strDir, image, "rgb16");
+
+    // one frame split over two fragments, without a table, is all of them
+    image.uiFrames = 1;
+    TestLayouts(strDir, image, "single");
+
+    TestMalformedFrames();
+
+    // a file whose frame header is bad decodes to nothing, on any thread
+    image.uiFrames = 3;
+    image.bRLE = true;
+    const std::string   strBad = strDir + "/bad.dcm";
+    std::string         strData;
+    TEST_CHECK(WriteTestDicom(strBad, image) && ReadFile(strBad, strData));
+    const size_t        uiFrame = strData.find(TestRLEFrame(image, 1));
+    TEST_CHECK(uiFrame != std::string::npos);
+    if (uiFrame != std::string::npos)
+    {
+        PutUInt32At(strData, uiFrame, 2);
+        TEST_CHECK(WriteFile(strBad, strData));
+        for (size_t m = 0; m < sizeof(aModes) / sizeof(aModes[0]); m++)
+        {
+            for (size_t t = 0; t < sizeof(aiThreads) / sizeof(aiThreads[0]); t++)
+            {
+                TEST_CHECK(Decode(strBad, aModes[m], aiThreads[t]).empty());
+            }
+            TEST_CHECK(Decode(strBad, aModes[m], 1, 1, 1).empty());
+            TEST_CHECK(Decode(strBad, aModes[m], 1, 2, 1).size() == TestFrameBytes(image));
+        }
+    }
+
+    return TestResult();
+}
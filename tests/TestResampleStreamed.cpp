@@ -0,0 +1,153 @@
+// ResampleVolumeStreamed gives the voxels ResampleVolume gives, reading
+// each source slice at most once and writing the slabs in order, for any
+// slab size and thread count, and fails when its reader or writer does.
+
+#include <string.h>
+#include <algorithm>
+
+#include "DicomResample.h"
+#include "DicomTestUtilities.h"
+
+namespace
+{
+    const ResampleKernel    aKernels[] = { RESAMPLE_NEAREST, RESAMPLE_LINEAR, RESAMPLE_CATMULL_ROM, RESAMPLE_BSPLINE, RESAMPLE_LANCZOS3 };
+
+    // Source slices from a volume held whole, counting the reads of each.
+    struct CountingReader
+    {
+        const DicomVolume *     pSource;
+        std::vector<uint32_t> * pvuiReads;
+
+        bool operator()( const uint32_t uiSlice, int16_t * piDest ) const
+        {
+            const size_t    uiSliceVoxels = size_t(pSource->uiSizeX) * pSource->uiSizeY;
+            (*pvuiReads)[uiSlice]++;
+            memcpy(piDest, &pSource->viVoxels[uiSlice * uiSliceVoxels], uiSliceVoxels * sizeof(int16_t));
+            return true;
+        }
+    };
+
+    // The slabs appended to a volume, checking they come in order and
+    // noting the largest.
+    struct CollectingWriter
+    {
+        const DicomVolume *     pDest;
+        std::vector<int16_t> *  pviVoxels;
+        uint32_t *              puiNextZ;
+        uint32_t *              puiLargestSlab;
+        bool *                  pbInOrder;
+
+        bool operator()( const int16_t * piSlices, const uint32_t uiBeginZ, const uint32_t uiEndZ ) const
+        {
+            *pbInOrder = *pbInOrder && uiBeginZ == *puiNextZ && uiEndZ > uiBeginZ;
+            *puiNextZ = uiEndZ;
+            *puiLargestSlab = std::max(*puiLargestSlab, uiEndZ - uiBeginZ);
+            pviVoxels->insert(pviVoxels->end(), piSlices, piSlices + size_t(pDest->uiSizeX) * pDest->uiSizeY * (uiEndZ - uiBeginZ));
+            return true;
+        }
+    };
+}
+
+int main()
+{
+    // odd sizes and random voxels, so every tap of every kernel counts
+    DicomVolume source;
+    source.uiSizeX = 37;
+    source.uiSizeY = 29;
+    source.uiSizeZ = 53;
+    source.fXSpacing = 0.7f;
+    source.fYSpacing = 0.8f;
+    source.fZSpacing = 1.3f;
+    source.viVoxels.resize(size_t(source.uiSizeX) * source.uiSizeY * source.uiSizeZ);
+    uint32_t    uiState = 5;
+    for (size_t i = 0; i < source.viVoxels.size(); i++)
+    {
+        uiState = uiState * 1664525u + 1013904223u;
+        source.viVoxels[i] = int16_t(uiState >> 16);
+    }
+
+    // the sizes and spacing only, as a streamed source has
+    DicomVolume layout = source;
+    layout.viVoxels.clear();
+
+    // finer, mixed, much coarser in z, and the same spacing
+    const float afSpacings[][3] = { { 0.7f, 0.7f, 0.7f }, { 0.5f, 0.9f, 0.33f }, { 0.7f, 0.8f, 5.2f }, { 0.7f, 0.8f, 1.3f } };
+    const uint32_t  auiSlabSizes[] = { 1, 3, 0 };
+    const uint32_t  auiThreads[] = { 1, 4 };
+
+    for (size_t s = 0; s < sizeof(afSpacings) / sizeof(afSpacings[0]); s++)
+    {
+        const float *   pfSpacing = afSpacings[s];
+        for (size_t k = 0; k < sizeof(aKernels) / sizeof(aKernels[0]); k++)
+        {
+            DicomVolume whole;
+            TEST_CHECK(ResampleVolume(source, pfSpacing[0], pfSpacing[1], pfSpacing[2], whole, aKernels[k]));
+
+            for (size_t b = 0; b < sizeof(auiSlabSizes) / sizeof(auiSlabSizes[0]); b++)
+            {
+                for (size_t t = 0; t < sizeof(auiThreads) / sizeof(auiThreads[0]); t++)
+                {
+                    DicomVolume             dest;
+                    std::vector<uint32_t>   vuiReads(source.uiSizeZ, 0);
+                    std::vector<int16_t>    viVoxels;
+                    uint32_t                uiNextZ = 0;
+                    uint32_t                uiLargestSlab = 0;
+                    bool                    bInOrder = true;
+                    const CountingReader    reader = { &source, &vuiReads };
+                    const CollectingWriter  writer = { &dest, &viVoxels, &uiNextZ, &uiLargestSlab, &bInOrder };
+
+                    const bool  bOK = ResampleVolumeStreamed(layout, reader, pfSpacing[0], pfSpacing[1], pfSpacing[2], dest, writer,
+                                                             aKernels[k], auiSlabSizes[b], auiThreads[t]);
+
+                    uint32_t    uiMostReads = 0;
+                    uint32_t    uiSlicesRead = 0;
+                    for (size_t z = 0; z < vuiReads.size(); z++)
+                    {
+                        uiMostReads = std::max(uiMostReads, vuiReads[z]);
+                        uiSlicesRead += vuiReads[z] != 0;
+                    }
+                    const bool  bSlabSize = auiSlabSizes[b] == 0 || uiLargestSlab <= auiSlabSizes[b];
+                    const bool  bSame = bOK && bInOrder && bSlabSize && uiNextZ == whole.uiSizeZ && uiMostReads <= 1 &&
+                                        dest.uiSizeX == whole.uiSizeX && dest.uiSizeY == whole.uiSizeY && dest.uiSizeZ == whole.uiSizeZ &&
+                                        dest.fZSpacing == whole.fZSpacing && dest.viVoxels.empty() && viVoxels == whole.viVoxels;
+                    if (!bSame)
+                    {
+                        std::cout << "spacing " << pfSpacing[0] << " " << pfSpacing[1] << " " << pfSpacing[2] << ", kernel " << int(aKernels[k])
+                                  << ", slabs of " << auiSlabSizes[b] << ", " << auiThreads[t] << " threads: "
+                                  << (bOK ? "" : "failed, ") << (bInOrder ? "" : "slabs out of order, ")
+                                  << (bSlabSize ? "" : "slabs too large, ")
+                                  << "a slice read " << uiMostReads << " times, "
+                                  << (viVoxels == whole.viVoxels ? "same voxels" : "different voxels") << "\n";
+                        TestFailures()++;
+                    }
+
+                    // much coarser in z, the slices between the ones
+                    // used are never read
+                    if (pfSpacing[2] > 4.0f * source.fZSpacing && aKernels[k] == RESAMPLE_NEAREST)
+                    {
+                        TEST_CHECK(uiSlicesRead < source.uiSizeZ / 2);
+                    }
+                }
+            }
+        }
+    }
+
+    // a reader that fails part way, and a writer that fails on its second
+    // slab, which is the last slab asked for
+    const size_t    uiSliceVoxels = size_t(source.uiSizeX) * source.uiSizeY;
+    DicomVolume     dest;
+    TEST_CHECK(!ResampleVolumeStreamed(layout,
+        []( uint32_t uiSlice, int16_t * ) { return uiSlice < 10; },
+        0.7f, 0.8f, 0.7f, dest,
+        []( const int16_t *, uint32_t, uint32_t ) { return true; }));
+
+    uint32_t        uiSlabs = 0;
+    TEST_CHECK(!ResampleVolumeStreamed(layout,
+        [&]( uint32_t, int16_t * piDest ) { memset(piDest, 0, uiSliceVoxels * sizeof(int16_t)); return true; },
+        0.7f, 0.8f, 0.7f, dest,
+        [&]( const int16_t *, uint32_t, uint32_t ) { return ++uiSlabs < 2; },
+        RESAMPLE_LINEAR, 4));
+    TEST_CHECK(uiSlabs == 2);
+
+    return TestResult();
+}